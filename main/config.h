@@ -9,18 +9,259 @@
 #include "freertos/event_groups.h"
 
 /* ===== System Configuration ===== */
-#define PARKING_THRESHOLD 10.0      /* Distance threshold in cm for parking slot status */
-#define MAX_PARKING_SLOTS 2         /* Maximum number of parking slots supported */
+#define PARKING_THRESHOLD 10        /* Distance threshold in cm for parking slot status */
+#define MAX_PARKING_SLOTS 256       /* Maximum number of parking slots supported */
 #define UPDATE_INTERVAL_SEC 3000    /* Send parking updates every 3 seconds */
 
+/* ===== Occupancy Filter Configuration ===== */
+#define PARKING_HYSTERESIS_CM 2                     /* Must back out this far past the threshold to free a slot */
+#define PARKING_MIN_DISTANCE_CM 2                   /* Closer readings are invalid */
+#define PARKING_MAX_DISTANCE_CM 400                 /* Farther readings are invalid */
+#define PARKING_MEDIAN_WINDOW 5                     /* Per-slot median filter length */
+#define PARKING_DWELL_MS 1000                       /* A transition must persist this long before it is committed */
+#define PARKING_INVALID_READINGS 3                  /* Consecutive bad echoes before a sensor is flagged */
+
+/* Speed of sound 343 m/s: round-trip echo time per distance, integer-only */
+#define ULTRASONIC_CM_TO_ECHO_US(cm) (((cm) * 20000u) / 343u)
+#define ULTRASONIC_ECHO_US_TO_MM(us) (((us) * 343u) / 2000u)
+
+/* Thresholds precomputed in echo microseconds */
+#define PARKING_ENTER_ECHO_US ULTRASONIC_CM_TO_ECHO_US(PARKING_THRESHOLD)
+#define PARKING_EXIT_ECHO_US ULTRASONIC_CM_TO_ECHO_US(PARKING_THRESHOLD + PARKING_HYSTERESIS_CM)
+#define PARKING_MIN_ECHO_US ULTRASONIC_CM_TO_ECHO_US(PARKING_MIN_DISTANCE_CM)
+#define PARKING_MAX_ECHO_US ULTRASONIC_CM_TO_ECHO_US(PARKING_MAX_DISTANCE_CM)
+
+/* ===== Slot Table Configuration ===== */
+#define PARKING_SLOT_NAME_LEN 16                    /* Slot name buffer, including the terminator */
+#define SLOT_NVS_NAMESPACE "parking"                /* NVS namespace holding the slot table */
+#define SLOT_NVS_KEY "slots"                        /* Blob of parking_slot_def_t entries */
+
+/* ===== Ultrasonic Sensor Configuration ===== */
+#define ULTRASONIC_MAX_SENSORS MAX_PARKING_SLOTS    /* One sensor per parking slot */
+#define ULTRASONIC_TRIGGER_PULSE_US 10              /* HC-SR04 trigger pulse width */
+#define ULTRASONIC_ECHO_TIMEOUT_MS 30               /* Longest echo (400 cm) is ~23 ms */
+
+/* ===== Sensor Backend Configuration ===== */
+/* What a slot's trig_pin and echo_pin mean depends on the backend:
+ *  - GPIO: the sensor's own trigger and echo GPIOs.
+ *  - Mux: the bank's shared trigger and echo GPIOs; slots on one bank take
+ *    mux channels 0, 1, 2... in slot order.
+ *  - Bus: trig_pin is the module's 7-bit I2C address, echo_pin is unused.
+ *  - Sim: both unused; distances come from sensor_sim_set_distance(). */
+#define SENSOR_BACKEND_GPIO 0                       /* Two GPIOs per sensor, echo timed by interrupt */
+#define SENSOR_BACKEND_MUX 1                        /* Analog mux banks sharing one trigger and echo line each */
+#define SENSOR_BACKEND_BUS 2                        /* SRF08-style I2C modules, one broadcast starts them all */
+#define SENSOR_BACKEND_SIM 3                        /* Deterministic software sensors, no hardware */
+#ifndef SENSOR_BACKEND
+#define SENSOR_BACKEND SENSOR_BACKEND_GPIO
+#endif
+#define SENSOR_COLLECT_CHUNK 16                     /* Readings taken per collect call by the scan task */
+#define SENSOR_MEASURE_TIMEOUT_MS (2 * ULTRASONIC_ECHO_TIMEOUT_MS) /* Single blocking reading, any backend */
+
+#define SENSOR_MUX_SELECT_BITS 4                    /* CD74HC4067: 16 channels per bank */
+#define SENSOR_MUX_CHANNELS (1 << SENSOR_MUX_SELECT_BITS)
+#define SENSOR_MUX_MAX_BANKS 16                     /* Banks (trigger/echo line pairs) */
+#define SENSOR_MUX_SELECT_PINS {10, 11, 22, 23}     /* S0..S3, shared by every bank */
+#ifndef SENSOR_MUX_SELECT_SHIFT
+#define SENSOR_MUX_SELECT_SHIFT 0                   /* 1 = select bits clocked into a 74HC595 instead */
+#endif
+#define SENSOR_MUX_SHIFT_PINS {10, 11, 22}          /* 74HC595 data, clock, latch */
+#define SENSOR_MUX_SETTLE_US 2                      /* Switch settling after a select change */
+
+#define SENSOR_BUS_SDA_PIN 2                        /* I2C data */
+#define SENSOR_BUS_SCL_PIN 3                        /* I2C clock */
+#define SENSOR_BUS_CLOCK_HZ 400000                  /* SRF08 is good for 400 kHz */
+#define SENSOR_BUS_XFER_TIMEOUT_MS 10               /* Per I2C transaction */
+#define SENSOR_BUS_RANGE_REG ((PARKING_MAX_DISTANCE_CM * 10 - 43) / 43) /* Range window 43 mm per step */
+#define SENSOR_BUS_RANGING_US (ULTRASONIC_CM_TO_ECHO_US(PARKING_MAX_DISTANCE_CM) + 1000) /* Before the first poll */
+
+/* ===== Scan Scheduler Configuration ===== */
+#define SCAN_GROUP_PERIOD_MS 35                     /* Echo timeout plus settle time per group */
+#define SCAN_MAX_GROUPS 8                           /* Interference groups fired in sequence */
+#define SCAN_TASK_STACK_SIZE 4096                   /* Scan task stack */
+#define SCAN_TASK_PRIORITY 5                        /* Above the upload task so sensing never waits */
+
+/* ===== Adaptive Sampling Configuration ===== */
+#ifndef SCAN_ADAPTIVE_ENABLED
+#define SCAN_ADAPTIVE_ENABLED 1                     /* 0 = sample every slot on every pass */
+#endif
+#define SCAN_BACKOFF_BASE_MS 250                    /* First sampling gap once a slot has settled */
+#define SCAN_BACKOFF_MAX_MS 1000                    /* Gap doubles per settled reading up to this */
+#define SCAN_ACTIVE_BAND_CM 2                       /* Medians this close to the threshold keep a slot active */
+#define SCAN_ACTIVE_CHANGE_CM 3                     /* Newest sample this far from the median counts as changing */
+#define SCAN_IDLE_MIN_MS 100                        /* Stop the scan timer for idle gaps at least this long */
+
+/* ===== Power Management Configuration ===== */
+#define PM_MAX_FREQ_MHZ 160                         /* CPU clock while any PM lock is held */
+#define PM_MIN_FREQ_MHZ 40                          /* XTAL clock when idle */
+#define PM_LIGHT_SLEEP_ENABLED 1                    /* Automatic light sleep when all tasks block */
+
+/* ===== LED Output Configuration ===== */
+#define LED_BACKEND_GPIO 0                          /* gpio_set_level() per changed LED pin */
+#define LED_BACKEND_BUNDLE 1                        /* Discrete LEDs in one dedicated-GPIO bundle write */
+#define LED_BACKEND_STRIP 2                         /* One WS2812 pixel per slot, clocked out by RMT */
+#ifndef LED_BACKEND
+#define LED_BACKEND LED_BACKEND_GPIO
+#endif
+#define LED_BUNDLE_MAX_PINS 8                       /* Dedicated GPIO output channels on the C6 */
+#define LED_STRIP_GPIO 8                            /* Strip data pin (DevKitC-1 on-board LED) */
+#define LED_STRIP_RESOLUTION_HZ 10000000            /* RMT tick of 0.1 us */
+#define LED_STRIP_BRIGHTNESS 32                     /* Level of a lit colour channel (0-255) */
+#define LED_STRIP_TIMEOUT_MS 10                     /* Wait for the previous frame before refilling */
+
+/* ===== Upload Task Configuration ===== */
+#define UPLOAD_QUEUE_LENGTH (MAX_PARKING_SLOTS + 2) /* One entry per slot plus flush and pre-warm markers */
+#define UPLOAD_TASK_STACK_SIZE 6144                 /* Network task stack (TLS needs headroom) */
+#define UPLOAD_TASK_PRIORITY 4                      /* Above the sensing loop in app_main */
+#define BATCH_MODE_ENABLED 1                        /* Send pending changes as one multi-slot POST */
+#define BATCH_MAX_SIZE 50                           /* Maximum slot changes per batched POST */
+#define BATCH_WINDOW_MS 200                         /* How long to collect changes before sending */
+
+/* ===== Offline Journal Configuration ===== */
+#define JOURNAL_PARTITION_LABEL "journal"           /* Data partition holding the ring (see partitions.csv) */
+#define JOURNAL_WRITE_BATCH 16                      /* Records staged in RAM per flash write */
+#define JOURNAL_RETRY_MS 5000                       /* Replay retry interval while a backlog exists */
+#define JOURNAL_REPLAY_HISTORY 0                    /* 1 = replay every transition, 0 = final state per slot */
+
+/* ===== Memory Telemetry Configuration ===== */
+#define MEM_TELEMETRY_RING_SIZE 256                 /* Heap samples kept in RAM (24 bytes each) */
+#define MEM_TELEMETRY_WALK_PERIOD_MS 5000           /* Minimum time between heap_caps_get_info() walks */
+#define MEM_TELEMETRY_DUMP_COMMAND "memdump"        /* Console line that dumps the ring as MEMLOG CSV */
+
+/* ===== Static Memory Configuration ===== */
+#ifndef STATIC_MEMORY_MODE
+#define STATIC_MEMORY_MODE 1                        /* 1 = bodies serialized into a static buffer, 0 = cJSON on the heap */
+#endif
+
+/* ===== Heap Soak Configuration ===== */
+/* Leak attribution needs CONFIG_HEAP_TRACING_STANDALONE=y in sdkconfig; without it
+ * the soak still streams MEMLOG samples and checks for drift */
+#ifndef HEAP_SOAK_ENABLED
+#define HEAP_SOAK_ENABLED 0                         /* Debug builds only: the soak posts to PARKING_ENDPOINT */
+#endif
+#define HEAP_SOAK_COMMAND "soak"                    /* Console line that starts a soak run */
+#define HEAP_SOAK_UPDATES 2000                      /* Updates sent per soak run */
+#define HEAP_SOAK_WARMUP 20                         /* Updates before tracing starts (lazy init, TLS session) */
+#define HEAP_SOAK_CHECKPOINT_EVERY 100              /* Updates between heap-walk checkpoints */
+#define HEAP_SOAK_DRIFT_BYTES 512                   /* Net fall after warm-up that counts as drift */
+#define HEAP_SOAK_TRACE_RECORDS 256                 /* Outstanding allocations the tracer can hold */
+#define HEAP_SOAK_MAX_SITES 32                      /* Distinct call sites aggregated per run */
+#define HEAP_SOAK_TOP_SITES 8                       /* Call sites printed per run */
+#define HEAP_SOAK_SPOT_ID "soak"                    /* Spot the soak updates, so real slots stay untouched */
+#define HEAP_SOAK_TASK_STACK_SIZE 6144              /* Runs the update path, so as large as the upload task */
+#define HEAP_SOAK_TASK_PRIORITY 2                   /* Below the upload task */
+
+/* ===== Span Tracing Configuration ===== */
+#ifndef SPAN_TRACE_ENABLED
+#ifdef NDEBUG
+#define SPAN_TRACE_ENABLED 0                        /* Release builds: span macros compile to nothing */
+#else
+#define SPAN_TRACE_ENABLED 1
+#endif
+#endif
+#define SPAN_TRACE_ENDPOINT "/pt/telemetry"         /* Where latency summaries are posted */
+#define SPAN_TRACE_UPLOAD_INTERVAL_MS 300000        /* Summary upload period (histograms reset after) */
+#define SPAN_TRACE_COMMAND "spans"                  /* Console line that prints the span histograms */
+#define SPAN_TRACE_RESET_COMMAND "spanreset"        /* Console line that clears them */
+
+/* ===== Occupancy History Configuration ===== */
+#define HISTORY_RING_BYTES 3072                     /* Transition ring in RTC memory, 2-7 bytes per transition */
+#define HISTORY_ENDPOINT "/pt/analytics"            /* Where occupancy summaries are posted */
+#define HISTORY_SUMMARY_INTERVAL_MS 900000          /* Summary upload period (the window restarts after) */
+#define HISTORY_COMMAND "history"                   /* Console line that prints the aggregates */
+
+/* ===== Freshness Configuration ===== */
+#define FRESHNESS_SLO_MS 5000                       /* Detection-to-ack target per transition */
+#define FRESHNESS_DETECT_RING 4                     /* Detection times kept per slot for unacked transitions */
+#define FRESHNESS_SNTP_SERVER "pool.ntp.org"        /* Wall time for update timestamps; uptime ages until synced */
+#define FRESHNESS_HEARTBEAT_ENDPOINT "/pt/heartbeat" /* Where freshness heartbeats are posted */
+#define FRESHNESS_HEARTBEAT_INTERVAL_MS 60000       /* Heartbeat period (the window histogram resets after) */
+#define FRESHNESS_HEARTBEAT_MAX_SLOTS 16            /* Stalest slots listed per heartbeat */
+#define FRESHNESS_COMMAND "fresh"                   /* Console line that prints the freshness stats */
+
+/* ===== Console Configuration ===== */
+#define CONSOLE_ENABLED 1                           /* Read line commands from the serial console */
+#define CONSOLE_MAX_COMMANDS 8                      /* Size of the command table */
+#define CONSOLE_POLL_MS 200                         /* stdin poll interval while idle */
+#define CONSOLE_TASK_STACK_SIZE 3072                /* Console task stack */
+#define CONSOLE_TASK_PRIORITY 1                     /* Below everything that does real work */
+#define STATS_COMMAND "stats"                       /* Console line that prints slot status and module stats */
+#define STATS_PRINT_INTERVAL_MS 0                   /* Also log them from the main loop this often; 0 = console only */
+
 /* ===== Server Configuration ===== */
 #define SERVER_URL "https://138.199.217.16"
 #define PARKING_ENDPOINT "/pt/parking"
+#define HTTP_TIMEOUT_MS 50000       /* Socket timeout for a single HTTP request */
+#define HTTP_MAX_RECONNECTS 1       /* Reconnect attempts when a kept-alive connection was dropped */
+
+/* ===== Connection Pre-warm Configuration ===== */
+#ifndef PREWARM_ENABLED
+#define PREWARM_ENABLED 1                           /* Open the session when a slot nears the threshold, close it when idle */
+#endif
+#define PREWARM_BAND_CM 30                          /* Closing in from within this far of the threshold counts as approaching */
+#define PREWARM_IDLE_MS 10000                       /* Close the session after this long without a request */
+
+/* ===== Wire Protocol Configuration ===== */
+#define WIRE_MODE_HTTP_JSON 0                       /* One JSON POST per update or batch */
+#define WIRE_MODE_STREAM 1                          /* Bit-packed frames over one persistent TLS stream */
+#define WIRE_MODE_GATEWAY 2                         /* Node: frames to a gateway controller, which uplinks for it */
+#ifndef WIRE_MODE
+#define WIRE_MODE WIRE_MODE_HTTP_JSON
+#endif
+#define STREAM_HOST "138.199.217.16"                /* Same server as SERVER_URL */
+#define STREAM_PORT 8443                            /* TLS port of the frame endpoint */
+#define STREAM_CONNECT_TIMEOUT_MS 10000             /* TCP + TLS handshake limit */
+#define STREAM_ACK_TIMEOUT_MS 5000                  /* Wait for the ack covering a batch */
+
+/* ===== Gateway Configuration ===== */
+#ifndef GATEWAY_ENABLED
+#define GATEWAY_ENABLED 0                           /* 1 = take node frames and forward them upstream */
+#endif
+#define GATEWAY_TRANSPORT_ESPNOW 0                  /* No association needed on the nodes */
+#define GATEWAY_TRANSPORT_UDP 1                     /* LAN datagrams, for testing against a host */
+#ifndef GATEWAY_TRANSPORT
+#define GATEWAY_TRANSPORT GATEWAY_TRANSPORT_ESPNOW
+#endif
+#define GATEWAY_CHANNEL 1                           /* ESP-NOW nodes: channel of the gateway's AP */
+#define GATEWAY_UDP_PORT 47800                      /* UDP transport: the gateway's port */
+#define GATEWAY_MAX_NODES 32                        /* Node table; the node heard from longest ago is evicted */
+#define GATEWAY_BUFFER_SIZE 128                     /* Spot states held for forwarding (latest per node and spot) */
+#define GATEWAY_RX_QUEUE_LEN 32                     /* Received frames waiting for the gateway task; more are dropped */
+#define GATEWAY_BATCH_WINDOW_MS 100                 /* Collect node records this long before forwarding */
+#define GATEWAY_RETRY_MS 2000                       /* Forwarding retry after a failed upstream batch */
+#define GATEWAY_ACK_TIMEOUT_MS 50                   /* Node: retransmit the window after this without an ack */
+#define GATEWAY_HOLD_TIMEOUT_MS 1000                /* Node: the same once the gateway holds the window unforwarded */
+#define GATEWAY_MAX_ATTEMPTS 4                      /* Node: transmissions before the window goes to the journal */
+#define GATEWAY_TASK_STACK_SIZE 6144                /* Forwards upstream, so as large as the upload task */
+#define GATEWAY_TASK_PRIORITY 4                     /* Same as the upload task */
+#if GATEWAY_ENABLED && WIRE_MODE == WIRE_MODE_GATEWAY
+#error "A gateway uplinks over HTTPS itself; WIRE_MODE_GATEWAY is for nodes"
+#endif
+
+/* ===== TLS Session Configuration ===== */
+#ifndef TLS_SESSION_TICKETS
+#define TLS_SESSION_TICKETS 1                       /* Offer the previous connection's ticket on reconnect */
+#endif
+#define TLS_RESUME_MAX_MS 500                       /* Ticket connects longer than this count as full until one is timed */
+
+/* ===== Local Snapshot Server Configuration ===== */
+#define SNAPSHOT_SERVER_ENABLED 1                   /* Serve the slot snapshot to displays on the LAN */
+#define SNAPSHOT_SERVER_PORT 80                     /* Plain HTTP, LAN only */
+#define SNAPSHOT_PATH "/snapshot"                   /* GET, with ETag and ?wait=<ms> long-poll */
+#define SNAPSHOT_MAX_WAITERS 4                      /* Long-polls held at once */
+#define SNAPSHOT_WAIT_MAX_MS 30000                  /* Cap on the requested wait */
+#define SNAPSHOT_TASK_STACK_SIZE 4096               /* Answers parked long-polls */
+#define SNAPSHOT_TASK_PRIORITY 3                    /* Below upload and scan tasks */
 
 /* ===== WiFi Configuration ===== */
 #define WIFI_SSID "PRKiPhone"
 #define WIFI_PASS "prka1705"
-#define WIFI_MAXIMUM_RETRY 5
+#define WIFI_MAXIMUM_RETRY 5                        /* Failures before boot goes on offline; retries never stop */
+#define WIFI_BACKOFF_BASE_MS 250                    /* First reconnect delay, doubled per failure */
+#define WIFI_BACKOFF_MAX_MS 60000                   /* Reconnect delay cap (jittered down to half) */
+#define WIFI_CACHE_NAMESPACE "wifi"                 /* NVS namespace of the last good link */
+#define WIFI_CACHE_KEY "link"                       /* BSSID, channel and IP lease */
+#define WIFI_STATIC_IP_FROM_CACHE 0                 /* 1 = reuse the cached lease and skip DHCP */
 
 /* ===== WiFi Event Group Bits ===== */
 #define WIFI_CONNECTED_BIT BIT0
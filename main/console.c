@@ -0,0 +1,89 @@
+/**
+ * @file console.c
+ * @brief Implementation of the serial console command loop
+ *
+ * Modules register argument-less commands; a low-priority task polls stdin
+ * (non-blocking on the default UART console) and runs the command whose
+ * name matches a whole input line.
+ */
+#include "console.h"
+#include "config.h"
+
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <stdio.h>
+#include <string.h>
+
+typedef struct {
+    const char *name;
+    console_command_fn_t fn;
+} console_command_t;
+
+static console_command_t s_commands[CONSOLE_MAX_COMMANDS];
+static int s_command_count;
+
+bool console_register(const char *name, console_command_fn_t fn) {
+    if (s_command_count >= CONSOLE_MAX_COMMANDS) {
+        ESP_LOGW(TAG, "Console command table full, '%s' not registered", name);
+        return false;
+    }
+    s_commands[s_command_count].name = name;
+    s_commands[s_command_count].fn = fn;
+    s_command_count++;
+    return true;
+}
+
+static void console_run(const char *line) {
+    if (line[0] == '\0') return;
+
+    for (int i = 0; i < s_command_count; i++) {
+        if (strcmp(line, s_commands[i].name) == 0) {
+            s_commands[i].fn();
+            return;
+        }
+    }
+
+    printf("Commands:");
+    for (int i = 0; i < s_command_count; i++) {
+        printf(" %s", s_commands[i].name);
+    }
+    printf("\n");
+}
+
+static void console_task(void *arg) {
+    char line[32];
+    size_t len = 0;
+
+    while (1) {
+        int c = fgetc(stdin);
+        if (c == EOF) {
+            clearerr(stdin);
+            vTaskDelay(pdMS_TO_TICKS(CONSOLE_POLL_MS));
+            continue;
+        }
+        if (c == '\r' || c == '\n') {
+            line[len] = '\0';
+            console_run(line);
+            len = 0;
+        } else if (len < sizeof(line) - 1) {
+            line[len++] = (char)c;
+        }
+    }
+}
+
+void console_start(void) {
+#if CONSOLE_ENABLED
+    static bool started = false;
+    if (started) return;
+
+    static StaticTask_t task_buffer;
+    static StackType_t task_stack[CONSOLE_TASK_STACK_SIZE];
+    if (xTaskCreateStatic(console_task, "console", CONSOLE_TASK_STACK_SIZE, NULL,
+                          CONSOLE_TASK_PRIORITY, task_stack, &task_buffer) == NULL) {
+        ESP_LOGE(TAG, "Failed to create console task");
+        return;
+    }
+    started = true;
+#endif
+}
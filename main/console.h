@@ -0,0 +1,15 @@
+/**
+ * @file console.h
+ * @brief Line commands read from the serial console
+ */
+#ifndef CONSOLE_H
+#define CONSOLE_H
+
+#include <stdbool.h>
+
+typedef void (*console_command_fn_t)(void);
+
+bool console_register(const char *name, console_command_fn_t fn);
+void console_start(void);
+
+#endif /* CONSOLE_H */
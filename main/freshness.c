@@ -0,0 +1,410 @@
+/**
+ * @file freshness.c
+ * @brief Implementation of the freshness tracking
+ *
+ * Each slot keeps its latest sequence number, the highest one acked and
+ * the detection times of its last FRESHNESS_DETECT_RING transitions, in
+ * uptime ms. An ack covers every transition up to its sequence number:
+ * a transition superseded before it went out is acked by the later state
+ * that did. Transitions whose detection time was overwritten by newer
+ * ones still count as acked, but not in the histograms.
+ *
+ * Timestamps on the wire are unix ms once SNTP has synced; the offset to
+ * uptime is taken in the sync callback, so a resync never moves uptime.
+ */
+#include "freshness.h"
+#include "config.h"
+#include "console.h"
+#include "http_client.h"
+#include "parking_slot.h"
+
+#include "esp_log.h"
+#include "esp_netif_sntp.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+
+typedef struct {
+    uint32_t seq;                   /* Latest transition, 0 = none since boot */
+    uint32_t acked_seq;             /* Every transition up to here is acked */
+    uint32_t detected_ms[FRESHNESS_DETECT_RING];   /* Indexed by seq % FRESHNESS_DETECT_RING */
+} freshness_slot_t;
+
+typedef struct {
+    uint32_t count;
+    uint32_t within_slo;
+    uint32_t max_ms;
+    uint32_t buckets[FRESHNESS_BUCKETS];
+} freshness_histogram_t;
+
+static const uint32_t s_bounds_ms[FRESHNESS_BUCKETS - 1] = FRESHNESS_BUCKET_BOUNDS_MS;
+
+static freshness_slot_t s_slots[MAX_PARKING_SLOTS];
+static freshness_histogram_t s_total;       /* Since boot */
+static freshness_histogram_t s_window;      /* Since the last heartbeat */
+static freshness_stats_t s_stats;
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t s_window_start_ms;
+static int64_t s_wall_offset_us;            /* Unix time minus uptime, valid once synced */
+static bool s_sntp_started = false;
+
+static inline uint32_t freshness_now_ms(void) {
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+/* The ring still holds this transition's detection time */
+static inline bool freshness_in_ring(const freshness_slot_t *slot, uint32_t seq) {
+    return seq != 0 && seq <= slot->seq && slot->seq - seq < FRESHNESS_DETECT_RING;
+}
+
+static void freshness_histogram_add(freshness_histogram_t *h, uint32_t latency_ms) {
+    int bucket = 0;
+    while (bucket < FRESHNESS_BUCKETS - 1 && latency_ms > s_bounds_ms[bucket]) {
+        bucket++;
+    }
+    h->buckets[bucket]++;
+    h->count++;
+    if (latency_ms <= FRESHNESS_SLO_MS) {
+        h->within_slo++;
+    }
+    if (latency_ms > h->max_ms) {
+        h->max_ms = latency_ms;
+    }
+}
+
+static void freshness_histogram_merge(freshness_histogram_t *h, const freshness_histogram_t *from) {
+    h->count += from->count;
+    h->within_slo += from->within_slo;
+    if (from->max_ms > h->max_ms) {
+        h->max_ms = from->max_ms;
+    }
+    for (int bucket = 0; bucket < FRESHNESS_BUCKETS; bucket++) {
+        h->buckets[bucket] += from->buckets[bucket];
+    }
+}
+
+/* Interpolated within the bucket holding the given rank, capped at the largest latency seen */
+static uint32_t freshness_percentile(const freshness_histogram_t *h, uint32_t permille) {
+    if (h->count == 0) return 0;
+
+    uint32_t rank = (uint32_t)(((uint64_t)h->count * permille + 999) / 1000);
+    uint32_t seen = 0;
+    for (int bucket = 0; bucket < FRESHNESS_BUCKETS - 1; bucket++) {
+        uint32_t in_bucket = h->buckets[bucket];
+        if (seen + in_bucket >= rank) {
+            uint32_t lower = bucket ? s_bounds_ms[bucket - 1] : 0;
+            uint32_t value = lower + (uint32_t)((uint64_t)(s_bounds_ms[bucket] - lower) * (rank - seen) / in_bucket);
+            return value < h->max_ms ? value : h->max_ms;
+        }
+        seen += in_bucket;
+    }
+    return h->max_ms;
+}
+
+static void freshness_summarize(const freshness_histogram_t *h, freshness_summary_t *summary) {
+    summary->count = h->count;
+    summary->within_slo = h->within_slo;
+    summary->p50_ms = freshness_percentile(h, 500);
+    summary->p99_ms = freshness_percentile(h, 990);
+    summary->max_ms = h->max_ms;
+    memcpy(summary->buckets, h->buckets, sizeof(summary->buckets));
+}
+
+/* Age of the slot's oldest unacked transition; a lower bound once the ring has moved past it */
+static uint32_t freshness_unacked_age_ms(const freshness_slot_t *slot, uint32_t now_ms) {
+    uint32_t first = slot->acked_seq + 1;
+    if (!freshness_in_ring(slot, first)) {
+        first = slot->seq - (FRESHNESS_DETECT_RING - 1);
+    }
+    return now_ms - slot->detected_ms[first % FRESHNESS_DETECT_RING];
+}
+
+/* One slot's unacked transitions and the age of the oldest; false when it has none.
+ * Each slot takes the lock on its own, so walks over every slot never hold
+ * interrupts off for longer than one slot. */
+static bool freshness_slot_unacked(int slot_index, uint32_t now_ms, uint32_t *unacked, uint32_t *age_ms) {
+    portENTER_CRITICAL(&s_lock);
+    const freshness_slot_t *slot = &s_slots[slot_index];
+    *unacked = slot->seq - slot->acked_seq;
+    *age_ms = *unacked ? freshness_unacked_age_ms(slot, now_ms) : 0;
+    portEXIT_CRITICAL(&s_lock);
+    return *unacked != 0;
+}
+
+static void freshness_time_synced(struct timeval *tv) {
+    int64_t wall_us = (int64_t)tv->tv_sec * 1000000 + tv->tv_usec;
+    bool first;
+
+    portENTER_CRITICAL(&s_lock);
+    first = !s_stats.synced;
+    s_wall_offset_us = wall_us - esp_timer_get_time();
+    s_stats.synced = true;
+    portEXIT_CRITICAL(&s_lock);
+
+    if (first) {
+        ESP_LOGI(TAG, "Time synced, updates carry unix timestamps from now on");
+    }
+}
+
+void freshness_sync_time(void) {
+    if (s_sntp_started) return;
+
+    esp_sntp_config_t config = ESP_NETIF_SNTP_DEFAULT_CONFIG(FRESHNESS_SNTP_SERVER);
+    config.sync_cb = freshness_time_synced;
+    esp_err_t err = esp_netif_sntp_init(&config);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "SNTP start failed (%s), updates carry ages instead of timestamps", esp_err_to_name(err));
+        return;
+    }
+    s_sntp_started = true;
+}
+
+uint32_t freshness_commit(int slot_index, uint32_t detected_ms) {
+    if (slot_index < 0 || slot_index >= MAX_PARKING_SLOTS) return 0;
+
+    portENTER_CRITICAL(&s_lock);
+    freshness_slot_t *slot = &s_slots[slot_index];
+    uint32_t seq = ++slot->seq;
+    slot->detected_ms[seq % FRESHNESS_DETECT_RING] = detected_ms;
+    s_stats.committed++;
+    portEXIT_CRITICAL(&s_lock);
+    return seq;
+}
+
+int64_t freshness_detected_us(int slot_index, uint32_t seq) {
+    if (slot_index < 0 || slot_index >= MAX_PARKING_SLOTS) return 0;
+
+    int64_t now_us = esp_timer_get_time();
+    uint32_t now_ms = (uint32_t)(now_us / 1000);
+    int64_t detected_us = 0;
+
+    portENTER_CRITICAL(&s_lock);
+    const freshness_slot_t *slot = &s_slots[slot_index];
+    if (freshness_in_ring(slot, seq)) {
+        /* Through the age, so the 32-bit ms clock may wrap in between */
+        detected_us = now_us - (int64_t)(now_ms - slot->detected_ms[seq % FRESHNESS_DETECT_RING]) * 1000;
+    }
+    portEXIT_CRITICAL(&s_lock);
+    return detected_us;
+}
+
+void freshness_latest(int slot_index, uint32_t *seq, int64_t *detected_us) {
+    *seq = 0;
+    *detected_us = 0;
+    if (slot_index < 0 || slot_index >= MAX_PARKING_SLOTS) return;
+
+    portENTER_CRITICAL(&s_lock);
+    *seq = s_slots[slot_index].seq;
+    portEXIT_CRITICAL(&s_lock);
+    *detected_us = freshness_detected_us(slot_index, *seq);
+}
+
+void freshness_ack(int slot_index, uint32_t seq) {
+    if (slot_index < 0 || slot_index >= MAX_PARKING_SLOTS || seq == 0) return;
+
+    uint32_t now_ms = freshness_now_ms();
+
+    portENTER_CRITICAL(&s_lock);
+    freshness_slot_t *slot = &s_slots[slot_index];
+    if (seq > slot->seq) {
+        /* From before a reboot: sequences restart at 1 */
+        portEXIT_CRITICAL(&s_lock);
+        return;
+    }
+    if (seq <= slot->acked_seq) {
+        s_stats.stale_acks++;
+        portEXIT_CRITICAL(&s_lock);
+        return;
+    }
+
+    /* Transitions older than the ring are counted, not measured */
+    uint32_t first = slot->acked_seq + 1;
+    uint32_t oldest = slot->seq >= FRESHNESS_DETECT_RING ? slot->seq - (FRESHNESS_DETECT_RING - 1) : 1;
+    if (first < oldest) {
+        uint32_t skipped = (seq < oldest ? seq + 1 : oldest) - first;
+        s_stats.unmeasured += skipped;
+        first += skipped;
+    }
+    for (uint32_t k = first; k <= seq; k++) {
+        uint32_t latency_ms = now_ms - slot->detected_ms[k % FRESHNESS_DETECT_RING];
+        freshness_histogram_add(&s_total, latency_ms);
+        freshness_histogram_add(&s_window, latency_ms);
+    }
+    s_stats.acked += seq - slot->acked_seq;
+    slot->acked_seq = seq;
+    portEXIT_CRITICAL(&s_lock);
+}
+
+uint32_t freshness_unacked(int slot_index) {
+    if (slot_index < 0 || slot_index >= MAX_PARKING_SLOTS) return 0;
+
+    portENTER_CRITICAL(&s_lock);
+    uint32_t unacked = s_slots[slot_index].seq - s_slots[slot_index].acked_seq;
+    portEXIT_CRITICAL(&s_lock);
+    return unacked;
+}
+
+int64_t freshness_wall_ms(int64_t uptime_us) {
+    portENTER_CRITICAL(&s_lock);
+    bool synced = s_stats.synced;
+    int64_t offset_us = s_wall_offset_us;
+    portEXIT_CRITICAL(&s_lock);
+    return synced ? (offset_us + uptime_us) / 1000 : 0;
+}
+
+void freshness_get_summary(freshness_summary_t *summary) {
+    if (summary == NULL) return;
+
+    portENTER_CRITICAL(&s_lock);
+    freshness_histogram_t total = s_total;
+    portEXIT_CRITICAL(&s_lock);
+    freshness_summarize(&total, summary);
+}
+
+void freshness_get_stats(freshness_stats_t *stats) {
+    if (stats == NULL) return;
+
+    uint32_t now_ms = freshness_now_ms();
+    int slot_count = get_total_parking_slots();
+
+    portENTER_CRITICAL(&s_lock);
+    *stats = s_stats;
+    portEXIT_CRITICAL(&s_lock);
+
+    stats->unacked = 0;
+    stats->unacked_slots = 0;
+    stats->oldest_unacked_ms = 0;
+    for (int i = 0; i < slot_count; i++) {
+        uint32_t unacked, age_ms;
+        if (!freshness_slot_unacked(i, now_ms, &unacked, &age_ms)) continue;
+        stats->unacked += unacked;
+        stats->unacked_slots++;
+        if (age_ms > stats->oldest_unacked_ms) {
+            stats->oldest_unacked_ms = age_ms;
+        }
+    }
+}
+
+bool freshness_heartbeat(void) {
+    uint32_t now_ms = freshness_now_ms();
+    int slot_count = get_total_parking_slots();
+
+    /* The stalest slots with unacked transitions, oldest first */
+    int stale[FRESHNESS_HEARTBEAT_MAX_SLOTS];
+    uint32_t stale_unacked[FRESHNESS_HEARTBEAT_MAX_SLOTS];
+    uint32_t stale_age_ms[FRESHNESS_HEARTBEAT_MAX_SLOTS];
+    int stale_count = 0;
+
+    /* Acks from here on count towards the next heartbeat; a failed post hands these back */
+    portENTER_CRITICAL(&s_lock);
+    freshness_histogram_t window = s_window;
+    memset(&s_window, 0, sizeof(s_window));
+    portEXIT_CRITICAL(&s_lock);
+
+    for (int i = 0; i < slot_count; i++) {
+        uint32_t unacked, age_ms;
+        if (!freshness_slot_unacked(i, now_ms, &unacked, &age_ms)) continue;
+        int pos = stale_count < FRESHNESS_HEARTBEAT_MAX_SLOTS ? stale_count++ : FRESHNESS_HEARTBEAT_MAX_SLOTS;
+        while (pos > 0 && stale_age_ms[pos - 1] < age_ms) {
+            if (pos < FRESHNESS_HEARTBEAT_MAX_SLOTS) {
+                stale[pos] = stale[pos - 1];
+                stale_unacked[pos] = stale_unacked[pos - 1];
+                stale_age_ms[pos] = stale_age_ms[pos - 1];
+            }
+            pos--;
+        }
+        if (pos < FRESHNESS_HEARTBEAT_MAX_SLOTS) {
+            stale[pos] = i;
+            stale_unacked[pos] = unacked;
+            stale_age_ms[pos] = age_ms;
+        }
+    }
+
+    freshness_summary_t summary;
+    freshness_summarize(&window, &summary);
+    freshness_stats_t stats;
+    freshness_get_stats(&stats);
+
+    /* {"uptime_s":N,["time":unix_ms,]"window_s":N,"slo_ms":N,"acked":N,"within_slo":N,"p50_ms":N,
+     *  "p99_ms":N,"max_ms":N,"buckets":[...],"unacked":N,"unacked_slots":N,"oldest_unacked_ms":N,
+     *  "stale":{"spot":[unacked,age_ms],...}} */
+    static char body[512 + FRESHNESS_HEARTBEAT_MAX_SLOTS * (HTTP_JSON_ESCAPED_MAX(PARKING_SLOT_NAME_LEN - 1) + 32)];
+    int len = snprintf(body, sizeof(body), "{\"uptime_s\":%lu", (unsigned long)(now_ms / 1000));
+    int64_t wall_ms = freshness_wall_ms(esp_timer_get_time());
+    if (wall_ms > 0) {
+        len += snprintf(body + len, sizeof(body) - len, ",\"time\":%lld", (long long)wall_ms);
+    }
+    len += snprintf(body + len, sizeof(body) - len,
+        ",\"window_s\":%lu,\"slo_ms\":%lu,\"acked\":%lu,\"within_slo\":%lu,\"p50_ms\":%lu,\"p99_ms\":%lu,"
+        "\"max_ms\":%lu,\"buckets\":[",
+        (unsigned long)((now_ms - s_window_start_ms) / 1000), (unsigned long)FRESHNESS_SLO_MS,
+        (unsigned long)summary.count, (unsigned long)summary.within_slo, (unsigned long)summary.p50_ms,
+        (unsigned long)summary.p99_ms, (unsigned long)summary.max_ms);
+    for (int bucket = 0; bucket < FRESHNESS_BUCKETS; bucket++) {
+        len += snprintf(body + len, sizeof(body) - len, "%s%lu", bucket ? "," : "",
+            (unsigned long)summary.buckets[bucket]);
+    }
+    len += snprintf(body + len, sizeof(body) - len,
+        "],\"unacked\":%lu,\"unacked_slots\":%lu,\"oldest_unacked_ms\":%lu,\"stale\":{",
+        (unsigned long)stats.unacked, (unsigned long)stats.unacked_slots, (unsigned long)stats.oldest_unacked_ms);
+    for (int i = 0; i < stale_count; i++) {
+        len += snprintf(body + len, sizeof(body) - len, "%s\"", i ? "," : "");
+        len += (int)http_json_escape(body + len, sizeof(body) - len, parking_slot_name(stale[i]));
+        len += snprintf(body + len, sizeof(body) - len, "\":[%lu,%lu]",
+            (unsigned long)stale_unacked[i], (unsigned long)stale_age_ms[i]);
+    }
+    snprintf(body + len, sizeof(body) - len, "}}");
+
+    int status_code = http_client_post(FRESHNESS_HEARTBEAT_ENDPOINT, body);
+    bool ok = status_code >= 200 && status_code < 300;
+
+    portENTER_CRITICAL(&s_lock);
+    if (ok) {
+        s_stats.heartbeats++;
+    } else {
+        /* The next heartbeat reports them, its window_s running from the same start */
+        freshness_histogram_merge(&s_window, &window);
+        s_stats.heartbeat_failures++;
+    }
+    portEXIT_CRITICAL(&s_lock);
+
+    if (!ok) {
+        ESP_LOGW(TAG, "Freshness heartbeat failed (%d), its acks go into the next one", status_code);
+        return false;
+    }
+    s_window_start_ms = now_ms;
+    return true;
+}
+
+void freshness_heartbeat_if_due(void) {
+    if (freshness_now_ms() - s_window_start_ms >= FRESHNESS_HEARTBEAT_INTERVAL_MS) {
+        freshness_heartbeat();
+    }
+}
+
+void freshness_print_stats(void) {
+    freshness_stats_t stats;
+    freshness_summary_t summary;
+    freshness_get_stats(&stats);
+    freshness_get_summary(&summary);
+
+    ESP_LOGI(TAG, "===== FRESHNESS STATS =====");
+    ESP_LOGI(TAG, "Clock: %s", stats.synced ? "SNTP" : "uptime (not synced)");
+    ESP_LOGI(TAG, "Transitions: %lu committed, %lu acked (%lu unmeasured), %lu stale acks",
+        (unsigned long)stats.committed, (unsigned long)stats.acked,
+        (unsigned long)stats.unmeasured, (unsigned long)stats.stale_acks);
+    ESP_LOGI(TAG, "Detection to ack p50/p99/max: %lu/%lu/%lu ms, %lu of %lu within %lu ms",
+        (unsigned long)summary.p50_ms, (unsigned long)summary.p99_ms, (unsigned long)summary.max_ms,
+        (unsigned long)summary.within_slo, (unsigned long)summary.count, (unsigned long)FRESHNESS_SLO_MS);
+    ESP_LOGI(TAG, "Unacked: %lu transitions on %lu slots, oldest %lu ms",
+        (unsigned long)stats.unacked, (unsigned long)stats.unacked_slots, (unsigned long)stats.oldest_unacked_ms);
+    ESP_LOGI(TAG, "Heartbeats: %lu sent, %lu failed",
+        (unsigned long)stats.heartbeats, (unsigned long)stats.heartbeat_failures);
+}
+
+void freshness_init(void) {
+    s_window_start_ms = freshness_now_ms();
+    console_register(FRESHNESS_COMMAND, freshness_print_stats);
+}
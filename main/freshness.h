@@ -0,0 +1,58 @@
+/**
+ * @file freshness.h
+ * @brief End-to-end freshness: sequenced transitions matched to server acks
+ *
+ * Every committed slot transition gets the next sequence number of its
+ * slot and a detection time. Updates carry both to the server, and an
+ * acknowledged update acks its slot up to its sequence number, so the
+ * detection-to-ack latency of every transition lands in a histogram and
+ * a slot's unacknowledged transitions are its sequence minus the acked
+ * one. A heartbeat reports both against FRESHNESS_SLO_MS.
+ */
+#ifndef FRESHNESS_H
+#define FRESHNESS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Detection-to-ack histogram bounds in ms; the last bucket is open-ended */
+#define FRESHNESS_BUCKET_BOUNDS_MS { 100, 250, 500, 1000, 2500, 5000, 10000, 30000, 60000, 300000 }
+#define FRESHNESS_BUCKETS 11
+
+typedef struct {
+    uint32_t count;                 /* Transitions acked */
+    uint32_t within_slo;            /* Of those, acked within FRESHNESS_SLO_MS */
+    uint32_t p50_ms;                /* Percentiles read from bucket bounds */
+    uint32_t p99_ms;
+    uint32_t max_ms;
+    uint32_t buckets[FRESHNESS_BUCKETS];
+} freshness_summary_t;
+
+typedef struct {
+    bool synced;                    /* Wall time came from SNTP; else timestamps are uptime */
+    uint32_t committed;             /* Transitions sequenced */
+    uint32_t acked;                 /* Transitions acked */
+    uint32_t unmeasured;            /* Acked after their detection time left the ring */
+    uint32_t stale_acks;            /* Acks for sequences already acked */
+    uint32_t unacked;               /* Transitions not acked yet, all slots */
+    uint32_t unacked_slots;         /* Slots with at least one */
+    uint32_t oldest_unacked_ms;     /* Age of the oldest one */
+    uint32_t heartbeats;            /* Heartbeats the server acknowledged */
+    uint32_t heartbeat_failures;
+} freshness_stats_t;
+
+void freshness_init(void);
+void freshness_sync_time(void);
+uint32_t freshness_commit(int slot_index, uint32_t detected_ms);
+void freshness_latest(int slot_index, uint32_t *seq, int64_t *detected_us);
+int64_t freshness_detected_us(int slot_index, uint32_t seq);
+void freshness_ack(int slot_index, uint32_t seq);
+uint32_t freshness_unacked(int slot_index);
+int64_t freshness_wall_ms(int64_t uptime_us);
+void freshness_get_summary(freshness_summary_t *summary);
+void freshness_get_stats(freshness_stats_t *stats);
+bool freshness_heartbeat(void);
+void freshness_heartbeat_if_due(void);
+void freshness_print_stats(void);
+
+#endif /* FRESHNESS_H */
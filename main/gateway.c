@@ -0,0 +1,424 @@
+/**
+ * @file gateway.c
+ * @brief Implementation of the gateway role
+ *
+ * Per node the gateway keeps the boot id and the next sequence it expects.
+ * A record before that sequence was taken already and is only acked again;
+ * a record after it means an earlier frame was lost, so it and the rest of
+ * its frame are refused and the node's retransmission fills the gap. A
+ * node the gateway does not know, or one with a new boot id, is expected
+ * to number from 0; one that was mid-stream when the gateway rebooted gets
+ * its records refused until it gives up and restarts its numbering.
+ *
+ * Transports receive in their own context (the WiFi task for ESP-NOW), so
+ * gateway_handle_frame() only copies the frame into a queue; the gateway
+ * task takes it from there, stages its records and sends the ack.
+ *
+ * Taken records are staged in arrival order, one entry per node and spot
+ * with the latest state. The gateway task forwards the oldest
+ * BATCH_MAX_SIZE entries once the first has waited GATEWAY_BATCH_WINDOW_MS.
+ * A staged record is only held in RAM, so the ack names two sequences: the
+ * node's oldest record still buffered, before which everything reached the
+ * server, and the next one expected. The node keeps its records until the
+ * first passes them, and the task acks every node whose entries a batch
+ * forwarded. Unacknowledged entries are retried after GATEWAY_RETRY_MS;
+ * while the buffer is full, nodes get BUSY acks.
+ */
+#include "gateway.h"
+#include "gateway_transport.h"
+#include "http_client.h"
+#include "parking_slot.h"
+#include "rtos_ticks.h"
+#include "config.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include <string.h>
+
+typedef struct {
+    gateway_node_stats_t stats;
+    uint32_t next_seq;              /* Every record before this one was taken */
+    int64_t last_seen_us;           /* Table slot of the node heard from longest ago is reused */
+} gateway_node_t;
+
+typedef struct {
+    char name[PARKING_SLOT_NAME_LEN];
+    bool taken;                     /* Latest state */
+    int node;                       /* Node table index, -1 once the node was evicted or restarted */
+    uint32_t first_seq;             /* Oldest record merged in, on the node's numbering */
+    int64_t changed_us;             /* Oldest change not forwarded yet, on this controller's clock */
+    int64_t arrived_us;             /* When that change arrived */
+} gateway_entry_t;
+
+typedef struct {
+    gateway_addr_t from;
+    uint16_t len;
+    uint8_t data[GATEWAY_FRAME_MAX];
+} gateway_rx_frame_t;
+
+static gateway_node_t s_nodes[GATEWAY_MAX_NODES];
+static int s_node_count = 0;
+static gateway_entry_t s_entries[GATEWAY_BUFFER_SIZE];  /* Oldest first */
+static int s_entry_count = 0;
+static gateway_stats_t s_stats;
+static int64_t s_retry_us = 0;      /* No forwarding before this after a failed batch */
+
+/* Only the gateway task changes the tables above; s_lock keeps the stats readers out meanwhile */
+static SemaphoreHandle_t s_lock = NULL;
+static StaticSemaphore_t s_lock_buffer;
+static StaticTask_t s_task_buffer;
+static StackType_t s_task_stack[GATEWAY_TASK_STACK_SIZE];
+
+static QueueHandle_t s_rx_queue = NULL;
+static StaticQueue_t s_rx_queue_buffer;
+static uint8_t s_rx_queue_storage[GATEWAY_RX_QUEUE_LEN * sizeof(gateway_rx_frame_t)];
+static portMUX_TYPE s_rx_lock = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t s_rx_dropped = 0;
+
+/* Only touched by the gateway task: the frame being handled, the batch being forwarded */
+static gateway_rx_frame_t s_rx_frame;
+static char s_batch_names[BATCH_MAX_SIZE][PARKING_SLOT_NAME_LEN];
+static parking_update_t s_batch_updates[BATCH_MAX_SIZE];
+static bool s_batch_nodes[GATEWAY_MAX_NODES];
+
+/* Its buffered states are still forwarded, just no longer counted or acked for the node */
+static void gateway_detach_entries(int node) {
+    for (int i = 0; i < s_entry_count; i++) {
+        if (s_entries[i].node == node) s_entries[i].node = -1;
+    }
+}
+
+/* Find a node, or give it a table slot. The caller holds s_lock. */
+static int gateway_node_lookup(const gateway_addr_t *addr, uint16_t boot_id, int64_t now_us) {
+    int lru = 0;
+    for (int i = 0; i < s_node_count; i++) {
+        if (gateway_addr_equal(&s_nodes[i].stats.addr, addr)) {
+            if (s_nodes[i].stats.boot_id != boot_id) {
+                gateway_detach_entries(i);
+                s_nodes[i].stats.boot_id = boot_id;
+                s_nodes[i].stats.restarts++;
+                s_nodes[i].next_seq = 0;
+            }
+            s_nodes[i].last_seen_us = now_us;
+            return i;
+        }
+        if (s_nodes[i].last_seen_us < s_nodes[lru].last_seen_us) {
+            lru = i;
+        }
+    }
+
+    int index = s_node_count;
+    if (s_node_count == GATEWAY_MAX_NODES) {
+        index = lru;
+        gateway_detach_entries(index);
+        s_stats.evicted++;
+    } else {
+        s_node_count++;
+    }
+    memset(&s_nodes[index], 0, sizeof(s_nodes[index]));
+    s_nodes[index].stats.addr = *addr;
+    s_nodes[index].stats.boot_id = boot_id;
+    s_nodes[index].last_seen_us = now_us;
+    return index;
+}
+
+/* Every record of the node before this one reached the server */
+static uint32_t gateway_node_forwarded(int node) {
+    uint32_t seq = s_nodes[node].next_seq;
+    for (int i = 0; i < s_entry_count; i++) {
+        if (s_entries[i].node == node && gateway_seq_before(s_entries[i].first_seq, seq)) {
+            seq = s_entries[i].first_seq;
+        }
+    }
+    return seq;
+}
+
+static void gateway_send_ack(int node, uint8_t status) {
+    gateway_header_t ack = {
+        .kind = GATEWAY_FRAME_ACK,
+        .count = status,
+        .boot_id = s_nodes[node].stats.boot_id,
+        .seq = gateway_node_forwarded(node),
+    };
+    uint8_t frame[GATEWAY_ACK_SIZE];
+    gateway_put_ack(frame, &ack, s_nodes[node].next_seq);
+    gateway_transport_send(&s_nodes[node].stats.addr, frame, sizeof(frame));
+}
+
+/* Stage a record's state; false if the buffer is full. The caller holds s_lock. */
+static bool gateway_stage(int node, uint32_t seq, const gateway_record_t *record, int64_t now_us) {
+    for (int i = 0; i < s_entry_count; i++) {
+        gateway_entry_t *entry = &s_entries[i];
+        if (entry->node != node || strncmp(entry->name, record->name, record->name_len) != 0 ||
+            entry->name[record->name_len] != '\0') {
+            continue;
+        }
+        entry->taken = record->taken;
+        s_stats.coalesced++;
+        return true;
+    }
+
+    if (s_entry_count == GATEWAY_BUFFER_SIZE) return false;
+
+    gateway_entry_t *entry = &s_entries[s_entry_count++];
+    memset(entry, 0, sizeof(*entry));
+    memcpy(entry->name, record->name, record->name_len);
+    entry->taken = record->taken;
+    entry->node = node;
+    entry->first_seq = seq;
+    entry->changed_us = now_us - (int64_t)record->age_ms * 1000;
+    entry->arrived_us = now_us;
+    s_stats.depth = (uint32_t)s_entry_count;
+    if (s_stats.depth > s_stats.max_depth) {
+        s_stats.max_depth = s_stats.depth;
+    }
+    return true;
+}
+
+/* Called in the transport's receive context: copy the frame for the gateway task */
+void gateway_handle_frame(const gateway_addr_t *from, const uint8_t *data, size_t len) {
+    if (s_rx_queue == NULL || len > GATEWAY_FRAME_MAX) return;
+
+    gateway_rx_frame_t frame;
+    frame.from = *from;
+    frame.len = (uint16_t)len;
+    memcpy(frame.data, data, len);
+    if (xQueueSend(s_rx_queue, &frame, 0) != pdTRUE) {
+        /* The node sends it again */
+        portENTER_CRITICAL(&s_rx_lock);
+        s_rx_dropped++;
+        portEXIT_CRITICAL(&s_rx_lock);
+    }
+}
+
+static void gateway_take_frame(const gateway_rx_frame_t *frame) {
+    const uint8_t *data = frame->data;
+    size_t len = frame->len;
+
+    gateway_header_t header;
+    if (!gateway_get_header(data, len, &header) || header.kind != GATEWAY_FRAME_DATA) return;
+
+    int64_t now_us = esp_timer_get_time();
+    bool busy = false;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    s_stats.frames++;
+    int index = gateway_node_lookup(&frame->from, header.boot_id, now_us);
+    gateway_node_t *node = &s_nodes[index];
+    node->stats.frames++;
+
+    size_t pos = GATEWAY_HEADER_SIZE;
+    for (int i = 0; i < header.count; i++) {
+        gateway_record_t record;
+        if (!gateway_get_record(data, len, &pos, &record) || record.name_len >= PARKING_SLOT_NAME_LEN ||
+            !parking_slot_name_is_clean(record.name, record.name_len)) {
+            s_stats.malformed++;
+            break;
+        }
+
+        uint32_t seq = header.seq + (uint32_t)i;
+        if (gateway_seq_before(seq, node->next_seq)) {
+            node->stats.duplicates++;
+            s_stats.duplicates++;
+            continue;
+        }
+        if (seq != node->next_seq || !gateway_stage(index, seq, &record, now_us)) {
+            /* A gap, or no room: the node sends these again */
+            busy = seq == node->next_seq;
+            node->stats.refused += (uint32_t)(header.count - i);
+            s_stats.refused += (uint32_t)(header.count - i);
+            break;
+        }
+        node->next_seq++;
+        node->stats.records++;
+        s_stats.records++;
+    }
+    xSemaphoreGive(s_lock);
+
+    gateway_send_ack(index, busy ? GATEWAY_ACK_BUSY : GATEWAY_ACK_OK);
+}
+
+/* Take the frames received so far, then forward the oldest buffered states once they are due.
+ * Returns the ms until the next batch is due, UINT32_MAX if nothing is buffered. */
+uint32_t gateway_process(void) {
+    if (s_lock == NULL) return UINT32_MAX;
+
+    while (xQueueReceive(s_rx_queue, &s_rx_frame, 0) == pdTRUE) {
+        gateway_take_frame(&s_rx_frame);
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (s_entry_count == 0) {
+        xSemaphoreGive(s_lock);
+        return UINT32_MAX;
+    }
+
+    /* A full batch goes out without waiting for the window */
+    int64_t now_us = esp_timer_get_time();
+    int64_t due_us = s_entry_count >= BATCH_MAX_SIZE ? now_us
+                                                     : s_entries[0].arrived_us + (int64_t)GATEWAY_BATCH_WINDOW_MS * 1000;
+    if (due_us < s_retry_us) {
+        due_us = s_retry_us;
+    }
+    if (now_us < due_us) {
+        xSemaphoreGive(s_lock);
+        return (uint32_t)((due_us - now_us + 999) / 1000);
+    }
+
+    int count = s_entry_count < BATCH_MAX_SIZE ? s_entry_count : BATCH_MAX_SIZE;
+    for (int i = 0; i < count; i++) {
+        memcpy(s_batch_names[i], s_entries[i].name, sizeof(s_batch_names[i]));
+        s_batch_updates[i] = (parking_update_t){
+            .spot_id = s_batch_names[i],
+            .is_taken = s_entries[i].taken,
+            .detected_us = s_entries[i].changed_us,
+        };
+    }
+    xSemaphoreGive(s_lock);
+
+    int acked = http_client_send_batch(s_batch_updates, count);
+    now_us = esp_timer_get_time();
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    s_stats.requests++;
+    if (acked < count) {
+        s_stats.failed++;
+        s_retry_us = now_us + (int64_t)GATEWAY_RETRY_MS * 1000;
+    }
+
+    /* Entries 0..count-1 are still the batch: nothing but this task touches entries */
+    int kept = 0;
+    for (int i = 0; i < s_entry_count; i++) {
+        gateway_entry_t *entry = &s_entries[i];
+        bool done = false;
+        if (i < count) {
+            if (s_batch_updates[i].acked) {
+                uint32_t latency_ms = (uint32_t)((now_us - entry->changed_us) / 1000);
+                s_stats.forwarded++;
+                s_stats.total_latency_ms += latency_ms;
+                if (latency_ms > s_stats.max_latency_ms) {
+                    s_stats.max_latency_ms = latency_ms;
+                }
+                if (entry->node >= 0) {
+                    s_batch_nodes[entry->node] = true;
+                    gateway_node_stats_t *node = &s_nodes[entry->node].stats;
+                    node->forwarded++;
+                    node->last_latency_ms = latency_ms;
+                    node->total_latency_ms += latency_ms;
+                    if (latency_ms > node->max_latency_ms) {
+                        node->max_latency_ms = latency_ms;
+                    }
+                }
+                done = true;
+            }
+        }
+        if (!done) {
+            s_entries[kept++] = *entry;
+        }
+    }
+    s_entry_count = kept;
+    s_stats.depth = (uint32_t)kept;
+    xSemaphoreGive(s_lock);
+
+    /* The nodes can drop what this batch forwarded */
+    for (int i = 0; i < s_node_count; i++) {
+        if (!s_batch_nodes[i]) continue;
+        s_batch_nodes[i] = false;
+        gateway_send_ack(i, GATEWAY_ACK_OK);
+    }
+    return 0;
+}
+
+static void gateway_task(void *arg) {
+    while (1) {
+        /* Until a frame arrives or the next batch is due */
+        uint32_t wait_ms = gateway_process();
+        if (xQueueReceive(s_rx_queue, &s_rx_frame, wait_ms == UINT32_MAX ? portMAX_DELAY : rtos_ticks_at_least(wait_ms)) == pdTRUE) {
+            gateway_take_frame(&s_rx_frame);
+        }
+    }
+}
+
+bool gateway_init(void) {
+    if (s_lock != NULL) return true;
+
+    /* Frames may arrive as soon as the transport is up */
+    if (s_rx_queue == NULL) {
+        s_rx_queue = xQueueCreateStatic(GATEWAY_RX_QUEUE_LEN, sizeof(gateway_rx_frame_t), s_rx_queue_storage,
+                                        &s_rx_queue_buffer);
+    }
+    if (gateway_transport_init() != ESP_OK) return false;
+
+    s_lock = xSemaphoreCreateMutexStatic(&s_lock_buffer);
+
+    if (xTaskCreateStatic(gateway_task, "gateway_task", GATEWAY_TASK_STACK_SIZE, NULL,
+                          GATEWAY_TASK_PRIORITY, s_task_stack, &s_task_buffer) == NULL) {
+        ESP_LOGE(TAG, "Failed to create gateway task");
+        return false;
+    }
+    ESP_LOGI(TAG, "Gateway listening over %s", gateway_transport_name());
+    return true;
+}
+
+bool gateway_get_node_stats(int index, gateway_node_stats_t *stats) {
+    if (s_lock == NULL || stats == NULL) return false;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    bool found = index >= 0 && index < s_node_count;
+    if (found) {
+        *stats = s_nodes[index].stats;
+    }
+    xSemaphoreGive(s_lock);
+    return found;
+}
+
+void gateway_get_stats(gateway_stats_t *stats) {
+    if (stats == NULL) return;
+
+    if (s_lock != NULL) {
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+    }
+    *stats = s_stats;
+    stats->nodes = (uint32_t)s_node_count;
+    if (s_lock != NULL) {
+        xSemaphoreGive(s_lock);
+    }
+    portENTER_CRITICAL(&s_rx_lock);
+    stats->dropped = s_rx_dropped;
+    portEXIT_CRITICAL(&s_rx_lock);
+}
+
+void gateway_print_stats(void) {
+    gateway_stats_t stats;
+    gateway_get_stats(&stats);
+
+    uint32_t avg_latency_ms = stats.forwarded ? (uint32_t)(stats.total_latency_ms / stats.forwarded) : 0;
+
+    ESP_LOGI(TAG, "===== GATEWAY STATS (%s) =====", gateway_transport_name());
+    ESP_LOGI(TAG, "Nodes: %lu (evicted: %lu), frames: %lu (malformed: %lu, dropped: %lu)",
+        (unsigned long)stats.nodes, (unsigned long)stats.evicted, (unsigned long)stats.frames,
+        (unsigned long)stats.malformed, (unsigned long)stats.dropped);
+    ESP_LOGI(TAG, "Records: %lu, duplicates: %lu, coalesced: %lu, refused: %lu",
+        (unsigned long)stats.records, (unsigned long)stats.duplicates, (unsigned long)stats.coalesced,
+        (unsigned long)stats.refused);
+    ESP_LOGI(TAG, "Forwarded: %lu in %lu requests (failed: %lu), buffered: %lu (max %lu)",
+        (unsigned long)stats.forwarded, (unsigned long)stats.requests, (unsigned long)stats.failed,
+        (unsigned long)stats.depth, (unsigned long)stats.max_depth);
+    ESP_LOGI(TAG, "Change-to-server avg/max: %lu/%lu ms", (unsigned long)avg_latency_ms, (unsigned long)stats.max_latency_ms);
+
+    gateway_node_stats_t node;
+    for (int i = 0; gateway_get_node_stats(i, &node); i++) {
+        uint32_t node_avg_ms = node.forwarded ? (uint32_t)(node.total_latency_ms / node.forwarded) : 0;
+        ESP_LOGI(TAG, "  %02x:%02x:%02x:%02x:%02x:%02x boot %04x: records %lu, dup %lu, refused %lu, "
+            "restarts %lu, forwarded %lu, latency last/avg/max %lu/%lu/%lu ms",
+            node.addr.bytes[0], node.addr.bytes[1], node.addr.bytes[2],
+            node.addr.bytes[3], node.addr.bytes[4], node.addr.bytes[5], node.boot_id,
+            (unsigned long)node.records, (unsigned long)node.duplicates, (unsigned long)node.refused,
+            (unsigned long)node.restarts, (unsigned long)node.forwarded, (unsigned long)node.last_latency_ms,
+            (unsigned long)node_avg_ms, (unsigned long)node.max_latency_ms);
+    }
+}
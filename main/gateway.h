@@ -0,0 +1,61 @@
+/**
+ * @file gateway.h
+ * @brief Gateway role: one upstream session for many sensor nodes
+ *
+ * Nodes send their slot changes as gateway frames (gateway_proto.h). The
+ * gateway drops records it has already taken, keeps the latest state per
+ * node and spot in a bounded buffer and forwards it in arrival order as
+ * batched JSON updates over this controller's HTTPS session, so nodes need
+ * no association, DNS or TLS of their own. A node's records count as
+ * acknowledged once the server has them.
+ */
+#ifndef GATEWAY_H
+#define GATEWAY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "gateway_proto.h"
+
+/* Per-node counters; latency runs from the change on the node to the server's ack */
+typedef struct {
+    gateway_addr_t addr;
+    uint16_t boot_id;
+    uint32_t frames;                /* DATA frames received */
+    uint32_t records;               /* New records taken */
+    uint32_t duplicates;            /* Records taken before, acked again */
+    uint32_t refused;               /* Records past a gap or with the buffer full */
+    uint32_t restarts;              /* Boot id changes after the first frame */
+    uint32_t forwarded;             /* Records the server acknowledged */
+    uint32_t last_latency_ms;
+    uint32_t max_latency_ms;
+    uint64_t total_latency_ms;
+} gateway_node_stats_t;
+
+typedef struct {
+    uint32_t nodes;                 /* Nodes in the table */
+    uint32_t evicted;               /* Nodes dropped from a full table */
+    uint32_t frames;                /* DATA frames received */
+    uint32_t malformed;             /* DATA frames that did not parse */
+    uint32_t dropped;               /* Frames lost to a full receive queue */
+    uint32_t records;               /* New records taken */
+    uint32_t duplicates;            /* Retransmitted records acked again */
+    uint32_t coalesced;             /* Records that replaced a spot state still buffered */
+    uint32_t refused;               /* Records past a gap or with the buffer full */
+    uint32_t forwarded;             /* Spot states the server acknowledged */
+    uint32_t requests;              /* Upstream batches sent */
+    uint32_t failed;                /* Upstream batches not acknowledged */
+    uint32_t depth;                 /* Spot states buffered */
+    uint32_t max_depth;
+    uint32_t max_latency_ms;        /* Change on the node to the server's ack, any node */
+    uint64_t total_latency_ms;
+} gateway_stats_t;
+
+bool gateway_init(void);
+uint32_t gateway_process(void);
+void gateway_handle_frame(const gateway_addr_t *from, const uint8_t *data, size_t len);
+bool gateway_get_node_stats(int index, gateway_node_stats_t *stats);
+void gateway_get_stats(gateway_stats_t *stats);
+void gateway_print_stats(void);
+
+#endif /* GATEWAY_H */
@@ -0,0 +1,93 @@
+/**
+ * @file gateway_espnow.c
+ * @brief ESP-NOW gateway transport
+ *
+ * Nodes need no association: the radio only has to sit on the channel of
+ * the gateway's access point (GATEWAY_CHANNEL). A node sends to the
+ * broadcast address until the first ack gives it the gateway's MAC, and
+ * unicast from then on, which gets link-layer retries. The gateway answers
+ * each node by unicast; ESP-NOW holds at most 20 peers, so the peer slots
+ * are reused in the order they were registered.
+ */
+#include "gateway_transport.h"
+#include "config.h"
+
+#include "esp_log.h"
+#include "esp_now.h"
+#include "esp_wifi.h"
+#include <string.h>
+
+#define ESPNOW_PEER_SLOTS 16        /* Unicast peers kept registered, below the driver's limit of 20 */
+
+static const uint8_t s_broadcast_mac[ESP_NOW_ETH_ALEN] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+static uint8_t s_peers[ESPNOW_PEER_SLOTS][ESP_NOW_ETH_ALEN];
+static int s_peer_count = 0;
+static int s_peer_next = 0;         /* Slot reused when the table is full */
+
+static void espnow_recv_cb(const esp_now_recv_info_t *info, const uint8_t *data, int len) {
+    if (info == NULL || data == NULL || len <= 0) return;
+
+    gateway_addr_t from;
+    memcpy(from.bytes, info->src_addr, sizeof(from.bytes));
+    gateway_transport_receive(&from, data, (size_t)len);
+}
+
+static esp_err_t espnow_register(const uint8_t *mac) {
+    esp_now_peer_info_t peer = {
+        .channel = 0,               /* Whatever channel the radio is on */
+        .ifidx = WIFI_IF_STA,
+        .encrypt = false,
+    };
+    memcpy(peer.peer_addr, mac, ESP_NOW_ETH_ALEN);
+    return esp_now_add_peer(&peer);
+}
+
+static esp_err_t espnow_add_peer(const uint8_t *mac) {
+    if (esp_now_is_peer_exist(mac)) return ESP_OK;
+
+    if (s_peer_count == ESPNOW_PEER_SLOTS) {
+        esp_now_del_peer(s_peers[s_peer_next]);
+    } else {
+        s_peer_count++;
+    }
+    memcpy(s_peers[s_peer_next], mac, ESP_NOW_ETH_ALEN);
+    s_peer_next = (s_peer_next + 1) % ESPNOW_PEER_SLOTS;
+    return espnow_register(mac);
+}
+
+static esp_err_t espnow_init(void) {
+#if GATEWAY_ENABLED
+    /* Modem sleep would miss node frames between beacons */
+    esp_wifi_set_ps(WIFI_PS_NONE);
+#endif
+    esp_err_t err = esp_now_init();
+    if (err != ESP_OK) return err;
+
+    err = esp_now_register_recv_cb(espnow_recv_cb);
+    if (err != ESP_OK) return err;
+    return espnow_register(s_broadcast_mac);
+}
+
+static bool espnow_send(const gateway_addr_t *to, const uint8_t *data, size_t len) {
+    if (len > ESP_NOW_MAX_DATA_LEN) return false;
+
+    if (memcmp(to->bytes, s_broadcast_mac, ESP_NOW_ETH_ALEN) != 0) {
+        esp_err_t err = espnow_add_peer(to->bytes);
+        if (err != ESP_OK) {
+            ESP_LOGW(TAG, "ESP-NOW peer " MACSTR " not added: %s", MAC2STR(to->bytes), esp_err_to_name(err));
+            return false;
+        }
+    }
+    return esp_now_send(to->bytes, data, len) == ESP_OK;
+}
+
+static void espnow_broadcast(gateway_addr_t *addr) {
+    memcpy(addr->bytes, s_broadcast_mac, sizeof(addr->bytes));
+}
+
+const gateway_transport_t gateway_transport_espnow = {
+    .name = "espnow",
+    .init = espnow_init,
+    .send = espnow_send,
+    .broadcast = espnow_broadcast,
+};
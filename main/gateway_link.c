@@ -0,0 +1,294 @@
+/**
+ * @file gateway_link.c
+ * @brief Implementation of the node link
+ *
+ * A record is acknowledged once an ack from the gateway names a later
+ * forwarded sequence. Acks may arrive while a window is being transmitted, from the
+ * transport's receive context or, in the host simulation, from inside the
+ * send itself, so transmission walks the window by sequence number and
+ * skips whatever was acknowledged in between.
+ *
+ * With WIRE_MODE_GATEWAY this controller sends its own updates through one
+ * link: send_parking_batch() queues the batch, transmits it and waits for
+ * the acks, retransmitting up to GATEWAY_MAX_ATTEMPTS times. What is still
+ * unacknowledged then is reported as failed, so it goes to the journal,
+ * and the link restarts its numbering under a new boot id; the gateway
+ * would otherwise wait for the missing records forever.
+ */
+#include "gateway_link.h"
+#include "gateway_transport.h"
+#include "rtos_ticks.h"
+#include "config.h"
+
+#include "esp_log.h"
+#include "esp_random.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include <string.h>
+
+_Static_assert(PARKING_SLOT_NAME_LEN - 1 <= GATEWAY_NAME_MAX, "slot names do not fit a gateway record");
+
+void gateway_link_reset(gateway_link_t *link, const gateway_addr_t *broadcast, uint16_t boot_id) {
+    memset(link, 0, sizeof(*link));
+    link->gateway = *broadcast;
+    link->boot_id = boot_id;
+}
+
+bool gateway_link_queue(gateway_link_t *link, const char *name, bool taken, int64_t detected_us, uint32_t *seq) {
+    if (link->count == GATEWAY_LINK_WINDOW) return false;
+
+    /* A new window goes out at once */
+    if (link->count == 0) {
+        link->attempts = 0;
+        link->held = false;
+    }
+    gateway_link_record_t *record = &link->window[link->count++];
+    *record = (gateway_link_record_t){
+        .name = name,
+        .taken = taken,
+        .seq = link->next_seq++,
+        .detected_us = detected_us,
+    };
+    if (seq) *seq = record->seq;
+    link->stats.records++;
+    return true;
+}
+
+/* When the window goes out again if no ack takes it */
+int64_t gateway_link_retransmit_us(const gateway_link_t *link) {
+    return link->sent_us + (int64_t)(link->held ? GATEWAY_HOLD_TIMEOUT_MS : GATEWAY_ACK_TIMEOUT_MS) * 1000;
+}
+
+bool gateway_link_due(const gateway_link_t *link, int64_t now_us) {
+    return link->count > 0 && (link->attempts == 0 || now_us >= gateway_link_retransmit_us(link));
+}
+
+static uint16_t gateway_link_age_ms(int64_t detected_us, int64_t now_us) {
+    if (detected_us <= 0 || now_us <= detected_us) return 0;
+    int64_t age_ms = (now_us - detected_us) / 1000;
+    return age_ms > GATEWAY_AGE_MAX_MS ? GATEWAY_AGE_MAX_MS : (uint16_t)age_ms;
+}
+
+/* Send the window, as many records per frame as fit; returns frames sent */
+int gateway_link_transmit(gateway_link_t *link, int64_t now_us, gateway_link_send_fn_t send, void *ctx) {
+    if (link->count == 0) return 0;
+
+    bool retransmit = link->attempts > 0;
+    if (!retransmit) {
+        link->first_sent_us = now_us;
+    }
+    link->attempts++;
+    link->sent_us = now_us;
+    link->held = false;
+
+    uint8_t frame[GATEWAY_FRAME_MAX];
+    int frames = 0;
+    uint32_t seq = link->window[0].seq;
+    while (link->count > 0 && gateway_seq_before(seq, link->next_seq)) {
+        /* An ack taken during the previous send may have moved the window on */
+        if (gateway_seq_before(seq, link->window[0].seq)) {
+            seq = link->window[0].seq;
+        }
+        gateway_header_t header = {
+            .kind = GATEWAY_FRAME_DATA,
+            .count = 0,
+            .boot_id = link->boot_id,
+            .seq = seq,
+        };
+        size_t len = GATEWAY_HEADER_SIZE;
+        for (int i = (int)(seq - link->window[0].seq); i < link->count && header.count < UINT8_MAX; i++) {
+            const gateway_link_record_t *record = &link->window[i];
+            size_t name_len = strnlen(record->name, GATEWAY_NAME_MAX);
+            if (len + gateway_record_size(name_len) > sizeof(frame)) break;
+            len += gateway_put_record(frame + len, record->name, name_len, record->taken,
+                                      gateway_link_age_ms(record->detected_us, now_us));
+            header.count++;
+        }
+        if (header.count == 0) break;
+        gateway_put_header(frame, &header);
+        seq += header.count;
+
+        if (send(&link->gateway, frame, len, ctx)) {
+            frames++;
+        }
+    }
+
+    link->stats.frames += (uint32_t)frames;
+    if (retransmit) {
+        link->stats.retransmits += (uint32_t)frames;
+    }
+    return frames;
+}
+
+/* Take an ack; returns the records it acknowledged */
+int gateway_link_receive(gateway_link_t *link, const gateway_addr_t *from, const uint8_t *data, size_t len,
+                         int64_t now_us) {
+    gateway_header_t header;
+    uint32_t held_seq;
+    if (!gateway_get_ack(data, len, &header, &held_seq) || header.boot_id != link->boot_id ||
+        gateway_seq_before(link->next_seq, held_seq) || gateway_seq_before(held_seq, header.seq)) {
+        /* Not ours, from before a restart, or acking records never sent */
+        return 0;
+    }
+
+    link->gateway = *from;
+    link->gateway_known = true;
+    if (header.count == GATEWAY_ACK_BUSY) {
+        link->stats.busy++;
+    }
+
+    int acked = 0;
+    if (gateway_seq_before(link->acked_seq, header.seq)) {
+        link->acked_seq = header.seq;
+        while (acked < link->count && gateway_seq_before(link->window[acked].seq, header.seq)) {
+            acked++;
+        }
+        memmove(link->window, link->window + acked, (size_t)(link->count - acked) * sizeof(link->window[0]));
+        link->count -= acked;
+        link->stats.acked += (uint32_t)acked;
+
+        if (link->count == 0 && acked > 0) {
+            uint32_t ack_ms = (uint32_t)((now_us - link->first_sent_us) / 1000);
+            link->stats.last_ack_ms = ack_ms;
+            if (ack_ms > link->stats.max_ack_ms) {
+                link->stats.max_ack_ms = ack_ms;
+            }
+            link->attempts = 0;
+        }
+    }
+
+    /* The gateway has the rest and acks again once it is forwarded */
+    link->held = link->count > 0 && held_seq == link->next_seq;
+    return acked;
+}
+
+bool gateway_link_acked(const gateway_link_t *link, uint32_t seq) {
+    return gateway_seq_before(seq, link->acked_seq);
+}
+
+/* Drop the window and number from 0 again under a new boot id; the gateway address is kept */
+void gateway_link_restart(gateway_link_t *link, uint16_t boot_id) {
+    link->boot_id = boot_id;
+    link->next_seq = 0;
+    link->acked_seq = 0;
+    link->count = 0;
+    link->attempts = 0;
+    link->held = false;
+    link->stats.restarts++;
+}
+
+/* ----- This controller's own link ----- */
+
+static gateway_link_t s_link;
+static SemaphoreHandle_t s_lock = NULL;
+static StaticSemaphore_t s_lock_buffer;
+static SemaphoreHandle_t s_ack = NULL;  /* Given when an ack moved the window */
+static StaticSemaphore_t s_ack_buffer;
+
+static bool gateway_link_send_frame(const gateway_addr_t *to, const uint8_t *data, size_t len, void *ctx) {
+    return gateway_transport_send(to, data, len);
+}
+
+/* Random, and different from the current one so a restart is always visible */
+static uint16_t gateway_link_new_boot_id(void) {
+    uint16_t boot_id;
+    do {
+        boot_id = (uint16_t)esp_random();
+    } while (boot_id == s_link.boot_id);
+    return boot_id;
+}
+
+bool gateway_link_init(void) {
+    if (s_lock != NULL) return true;
+    if (gateway_transport_init() != ESP_OK) return false;
+
+    s_lock = xSemaphoreCreateMutexStatic(&s_lock_buffer);
+    s_ack = xSemaphoreCreateBinaryStatic(&s_ack_buffer);
+
+    gateway_addr_t broadcast;
+    gateway_transport_broadcast(&broadcast);
+    gateway_link_reset(&s_link, &broadcast, gateway_link_new_boot_id());
+    ESP_LOGI(TAG, "Gateway link over %s, boot id %04x", gateway_transport_name(), s_link.boot_id);
+    return true;
+}
+
+int gateway_link_send(parking_update_t *updates, int count) {
+    if (s_lock == NULL || count <= 0) return 0;
+    if (count > GATEWAY_LINK_WINDOW) count = GATEWAY_LINK_WINDOW;
+
+    uint32_t seqs[GATEWAY_LINK_WINDOW];
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    /* Every call leaves the window empty, so the whole batch fits */
+    for (int i = 0; i < count; i++) {
+        updates[i].acked = false;
+        gateway_link_queue(&s_link, updates[i].spot_id, updates[i].is_taken, updates[i].detected_us, &seqs[i]);
+    }
+
+    while (s_link.count > 0) {
+        int64_t now_us = esp_timer_get_time();
+        if (gateway_link_due(&s_link, now_us)) {
+            if (s_link.attempts >= GATEWAY_MAX_ATTEMPTS) break;
+            gateway_link_transmit(&s_link, now_us, gateway_link_send_frame, NULL);
+        }
+
+        /* Sleep until an ack arrives or the window is due again */
+        int64_t wait_us = gateway_link_retransmit_us(&s_link) - esp_timer_get_time();
+        xSemaphoreGive(s_lock);
+        xSemaphoreTake(s_ack, wait_us > 0 ? rtos_ticks_at_least((uint32_t)((wait_us + 999) / 1000)) : 0);
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+    }
+
+    int acked = 0;
+    for (int i = 0; i < count; i++) {
+        if (gateway_link_acked(&s_link, seqs[i])) {
+            updates[i].acked = true;
+            acked++;
+        }
+    }
+    if (s_link.count > 0) {
+        ESP_LOGW(TAG, "Gateway did not acknowledge %d of %d updates", s_link.count, count);
+        gateway_link_restart(&s_link, gateway_link_new_boot_id());
+    }
+    xSemaphoreGive(s_lock);
+    return acked;
+}
+
+void gateway_link_handle_frame(const gateway_addr_t *from, const uint8_t *data, size_t len) {
+    if (s_lock == NULL) return;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    int acked = gateway_link_receive(&s_link, from, data, len, esp_timer_get_time());
+    xSemaphoreGive(s_lock);
+    if (acked > 0) {
+        xSemaphoreGive(s_ack);
+    }
+}
+
+void gateway_link_get_stats(gateway_link_stats_t *stats) {
+    if (stats == NULL) return;
+
+    if (s_lock != NULL) {
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+    }
+    *stats = s_link.stats;
+    if (s_lock != NULL) {
+        xSemaphoreGive(s_lock);
+    }
+}
+
+void gateway_link_print_stats(void) {
+    gateway_link_stats_t stats;
+    gateway_link_get_stats(&stats);
+
+    ESP_LOGI(TAG, "===== GATEWAY LINK STATS (%s) =====", gateway_transport_name());
+    ESP_LOGI(TAG, "Gateway: %02x:%02x:%02x:%02x:%02x:%02x%s",
+        s_link.gateway.bytes[0], s_link.gateway.bytes[1], s_link.gateway.bytes[2],
+        s_link.gateway.bytes[3], s_link.gateway.bytes[4], s_link.gateway.bytes[5],
+        s_link.gateway_known ? "" : " (not heard from yet)");
+    ESP_LOGI(TAG, "Records: %lu (acked %lu), frames: %lu, retransmits: %lu, restarts: %lu, gateway busy: %lu",
+        (unsigned long)stats.records, (unsigned long)stats.acked, (unsigned long)stats.frames,
+        (unsigned long)stats.retransmits, (unsigned long)stats.restarts, (unsigned long)stats.busy);
+    ESP_LOGI(TAG, "Send-to-ack last/max: %lu/%lu ms", (unsigned long)stats.last_ack_ms, (unsigned long)stats.max_ack_ms);
+}
@@ -0,0 +1,76 @@
+/**
+ * @file gateway_link.h
+ * @brief Node side of the gateway protocol: sequenced records, acks, retransmission
+ *
+ * A link holds a window of records the gateway has not acknowledged yet
+ * and retransmits the whole window (go-back-N) when no ack covers it in
+ * time. Records the gateway holds but has not forwarded yet stay in the
+ * window; they are only sent again after GATEWAY_HOLD_TIMEOUT_MS. The link itself does no I/O and takes the time from its caller,
+ * so one controller runs a single link over the gateway transport while
+ * the host simulation runs many with their own radios.
+ */
+#ifndef GATEWAY_LINK_H
+#define GATEWAY_LINK_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "config.h"
+#include "gateway_proto.h"
+#include "http_client.h"
+
+#define GATEWAY_LINK_WINDOW BATCH_MAX_SIZE
+
+typedef struct {
+    const char *name;               /* Not copied: slot names outlive the link */
+    bool taken;
+    uint32_t seq;
+    int64_t detected_us;            /* When the change was detected on the node (0 = unknown) */
+} gateway_link_record_t;
+
+typedef struct {
+    uint32_t records;               /* Records queued */
+    uint32_t acked;                 /* Records the gateway acknowledged */
+    uint32_t frames;                /* DATA frames sent */
+    uint32_t retransmits;           /* Frames sent again after an ack timeout */
+    uint32_t restarts;              /* Windows given up on; numbering restarts under a new boot id */
+    uint32_t busy;                  /* Acks saying the gateway buffer was full */
+    uint32_t last_ack_ms;           /* First transmission to the ack emptying the window */
+    uint32_t max_ack_ms;
+} gateway_link_stats_t;
+
+typedef struct {
+    gateway_addr_t gateway;         /* Broadcast address until an ack names the gateway */
+    bool gateway_known;
+    uint16_t boot_id;
+    uint32_t next_seq;              /* Sequence of the next record queued */
+    uint32_t acked_seq;             /* Every record before this one is acknowledged */
+    gateway_link_record_t window[GATEWAY_LINK_WINDOW];   /* Unacknowledged records, oldest first */
+    int count;
+    int attempts;                   /* Transmissions of the current window */
+    bool held;                      /* The last ack said the gateway holds the rest of the window */
+    int64_t first_sent_us;          /* First transmission of the current window */
+    int64_t sent_us;                /* Latest transmission */
+    gateway_link_stats_t stats;
+} gateway_link_t;
+
+typedef bool (*gateway_link_send_fn_t)(const gateway_addr_t *to, const uint8_t *data, size_t len, void *ctx);
+
+void gateway_link_reset(gateway_link_t *link, const gateway_addr_t *broadcast, uint16_t boot_id);
+bool gateway_link_queue(gateway_link_t *link, const char *name, bool taken, int64_t detected_us, uint32_t *seq);
+bool gateway_link_due(const gateway_link_t *link, int64_t now_us);
+int64_t gateway_link_retransmit_us(const gateway_link_t *link);
+int gateway_link_transmit(gateway_link_t *link, int64_t now_us, gateway_link_send_fn_t send, void *ctx);
+int gateway_link_receive(gateway_link_t *link, const gateway_addr_t *from, const uint8_t *data, size_t len,
+                         int64_t now_us);
+bool gateway_link_acked(const gateway_link_t *link, uint32_t seq);
+void gateway_link_restart(gateway_link_t *link, uint16_t boot_id);
+
+/* This controller's own link, used by send_parking_batch() with WIRE_MODE_GATEWAY */
+bool gateway_link_init(void);
+int gateway_link_send(parking_update_t *updates, int count);
+void gateway_link_handle_frame(const gateway_addr_t *from, const uint8_t *data, size_t len);
+void gateway_link_get_stats(gateway_link_stats_t *stats);
+void gateway_link_print_stats(void);
+
+#endif /* GATEWAY_LINK_H */
@@ -0,0 +1,135 @@
+/**
+ * @file gateway_proto.h
+ * @brief Frames between sensor nodes and a gateway controller
+ *
+ * Wire format, little-endian, one frame per ESP-NOW packet or UDP datagram:
+ *   DATA  node -> gateway
+ *         [0] version << 4 | kind  [1] record count  [2..3] boot id
+ *         [4..7] sequence of the first record, then per record:
+ *         [0] taken << 7 | name length  [1..2] age in ms (saturating)  name
+ *   ACK   gateway -> node
+ *         [0] version << 4 | kind  [1] status  [2..3] boot id
+ *         [4..7] every record before this sequence is forwarded upstream
+ *         [8..11] next sequence expected; every record before it is held
+ * Records in a frame carry consecutive sequence numbers. A node draws a
+ * random boot id at start-up and numbers its records from 0, so the
+ * gateway can tell a retransmitted record from a new one per node and boot.
+ * The age lets the gateway date a change without synchronised clocks.
+ */
+#ifndef GATEWAY_PROTO_H
+#define GATEWAY_PROTO_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define GATEWAY_FRAME_DATA 1u
+#define GATEWAY_FRAME_ACK 2u
+#define GATEWAY_PROTOCOL_VERSION 2u
+#define GATEWAY_FRAME_MAX 250       /* ESP-NOW payload limit */
+#define GATEWAY_HEADER_SIZE 8
+#define GATEWAY_ACK_SIZE 12
+#define GATEWAY_RECORD_HEADER_SIZE 3
+#define GATEWAY_NAME_MAX 127        /* 7-bit name length */
+#define GATEWAY_AGE_MAX_MS 0xFFFFu
+
+#define GATEWAY_ACK_OK 0u
+#define GATEWAY_ACK_BUSY 1u         /* Buffer full: records from the sequence on were not taken */
+
+/* Transport address: a MAC for ESP-NOW, IPv4 address and port for UDP */
+typedef struct {
+    uint8_t bytes[6];
+} gateway_addr_t;
+
+typedef struct {
+    uint8_t kind;
+    uint8_t count;                  /* DATA: records; ACK: status */
+    uint16_t boot_id;
+    uint32_t seq;
+} gateway_header_t;
+
+typedef struct {
+    const char *name;               /* Not terminated */
+    uint8_t name_len;
+    bool taken;
+    uint16_t age_ms;
+} gateway_record_t;
+
+static inline bool gateway_addr_equal(const gateway_addr_t *a, const gateway_addr_t *b) {
+    return memcmp(a->bytes, b->bytes, sizeof(a->bytes)) == 0;
+}
+
+/* True if a comes before b in 32-bit serial number arithmetic */
+static inline bool gateway_seq_before(uint32_t a, uint32_t b) {
+    return (int32_t)(a - b) < 0;
+}
+
+static inline size_t gateway_put_header(uint8_t *p, const gateway_header_t *header) {
+    p[0] = (uint8_t)(GATEWAY_PROTOCOL_VERSION << 4 | (header->kind & 0x0F));
+    p[1] = header->count;
+    p[2] = (uint8_t)header->boot_id;
+    p[3] = (uint8_t)(header->boot_id >> 8);
+    p[4] = (uint8_t)header->seq;
+    p[5] = (uint8_t)(header->seq >> 8);
+    p[6] = (uint8_t)(header->seq >> 16);
+    p[7] = (uint8_t)(header->seq >> 24);
+    return GATEWAY_HEADER_SIZE;
+}
+
+/* False for short frames and other protocol versions */
+static inline bool gateway_get_header(const uint8_t *p, size_t len, gateway_header_t *header) {
+    if (len < GATEWAY_HEADER_SIZE || (p[0] >> 4) != GATEWAY_PROTOCOL_VERSION) return false;
+    header->kind = p[0] & 0x0F;
+    header->count = p[1];
+    header->boot_id = (uint16_t)(p[2] | p[3] << 8);
+    header->seq = (uint32_t)p[4] | ((uint32_t)p[5] << 8) | ((uint32_t)p[6] << 16) | ((uint32_t)p[7] << 24);
+    return true;
+}
+
+static inline size_t gateway_put_ack(uint8_t *p, const gateway_header_t *header, uint32_t held_seq) {
+    gateway_put_header(p, header);
+    p[8] = (uint8_t)held_seq;
+    p[9] = (uint8_t)(held_seq >> 8);
+    p[10] = (uint8_t)(held_seq >> 16);
+    p[11] = (uint8_t)(held_seq >> 24);
+    return GATEWAY_ACK_SIZE;
+}
+
+/* False for anything but a whole ACK frame; header->seq is the forwarded sequence */
+static inline bool gateway_get_ack(const uint8_t *p, size_t len, gateway_header_t *header, uint32_t *held_seq) {
+    if (len < GATEWAY_ACK_SIZE || !gateway_get_header(p, len, header) || header->kind != GATEWAY_FRAME_ACK) {
+        return false;
+    }
+    *held_seq = (uint32_t)p[8] | ((uint32_t)p[9] << 8) | ((uint32_t)p[10] << 16) | ((uint32_t)p[11] << 24);
+    return true;
+}
+
+static inline size_t gateway_record_size(size_t name_len) {
+    return GATEWAY_RECORD_HEADER_SIZE + name_len;
+}
+
+static inline size_t gateway_put_record(uint8_t *p, const char *name, size_t name_len, bool taken, uint16_t age_ms) {
+    p[0] = (uint8_t)((taken ? 0x80 : 0) | (name_len & GATEWAY_NAME_MAX));
+    p[1] = (uint8_t)age_ms;
+    p[2] = (uint8_t)(age_ms >> 8);
+    memcpy(p + GATEWAY_RECORD_HEADER_SIZE, name, name_len & GATEWAY_NAME_MAX);
+    return gateway_record_size(name_len & GATEWAY_NAME_MAX);
+}
+
+/* Record at *pos, advancing it; false once the frame runs out */
+static inline bool gateway_get_record(const uint8_t *p, size_t len, size_t *pos, gateway_record_t *record) {
+    if (*pos + GATEWAY_RECORD_HEADER_SIZE > len) return false;
+    const uint8_t *r = p + *pos;
+    size_t name_len = r[0] & GATEWAY_NAME_MAX;
+    if (name_len == 0 || *pos + gateway_record_size(name_len) > len) return false;
+
+    record->taken = (r[0] & 0x80) != 0;
+    record->name_len = (uint8_t)name_len;
+    record->age_ms = (uint16_t)(r[1] | r[2] << 8);
+    record->name = (const char *)r + GATEWAY_RECORD_HEADER_SIZE;
+    *pos += gateway_record_size(name_len);
+    return true;
+}
+
+#endif /* GATEWAY_PROTO_H */
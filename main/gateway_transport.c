@@ -0,0 +1,94 @@
+/**
+ * @file gateway_transport.c
+ * @brief Dispatch to the configured gateway transport and frame routing
+ *
+ * Receive callbacks run in the transport's own context (the WiFi task for
+ * ESP-NOW), so the handlers they reach do not send: data frames are queued
+ * for the gateway task, and acks only move this controller's link window.
+ */
+#include "gateway_transport.h"
+#include "gateway.h"
+#include "gateway_link.h"
+#include "config.h"
+
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+
+#if GATEWAY_TRANSPORT == GATEWAY_TRANSPORT_UDP
+static const gateway_transport_t *const s_transport = &gateway_transport_udp;
+#else
+static const gateway_transport_t *const s_transport = &gateway_transport_espnow;
+#endif
+
+static gateway_transport_stats_t s_stats;
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+static bool s_started = false;
+
+esp_err_t gateway_transport_init(void) {
+    if (s_started) return ESP_OK;
+
+    esp_err_t err = s_transport->init();
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Gateway transport %s failed to start: %s", s_transport->name, esp_err_to_name(err));
+        return err;
+    }
+    s_started = true;
+    return ESP_OK;
+}
+
+bool gateway_transport_send(const gateway_addr_t *to, const uint8_t *data, size_t len) {
+    bool sent = s_started && s_transport->send(to, data, len);
+
+    portENTER_CRITICAL(&s_lock);
+    if (sent) {
+        s_stats.frames_sent++;
+        s_stats.bytes_sent += len;
+    } else {
+        s_stats.send_failures++;
+    }
+    portEXIT_CRITICAL(&s_lock);
+    return sent;
+}
+
+void gateway_transport_broadcast(gateway_addr_t *addr) {
+    s_transport->broadcast(addr);
+}
+
+void gateway_transport_receive(const gateway_addr_t *from, const uint8_t *data, size_t len) {
+    gateway_header_t header;
+    bool valid = gateway_get_header(data, len, &header);
+
+    portENTER_CRITICAL(&s_lock);
+    s_stats.frames_received++;
+    s_stats.bytes_received += len;
+    portEXIT_CRITICAL(&s_lock);
+
+#if GATEWAY_ENABLED
+    if (valid && header.kind == GATEWAY_FRAME_DATA) {
+        gateway_handle_frame(from, data, len);
+        return;
+    }
+#endif
+#if WIRE_MODE == WIRE_MODE_GATEWAY
+    if (valid && header.kind == GATEWAY_FRAME_ACK) {
+        gateway_link_handle_frame(from, data, len);
+        return;
+    }
+#endif
+
+    portENTER_CRITICAL(&s_lock);
+    s_stats.malformed++;
+    portEXIT_CRITICAL(&s_lock);
+}
+
+const char *gateway_transport_name(void) {
+    return s_transport->name;
+}
+
+void gateway_transport_get_stats(gateway_transport_stats_t *stats) {
+    if (stats == NULL) return;
+
+    portENTER_CRITICAL(&s_lock);
+    *stats = s_stats;
+    portEXIT_CRITICAL(&s_lock);
+}
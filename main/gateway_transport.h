@@ -0,0 +1,47 @@
+/**
+ * @file gateway_transport.h
+ * @brief Pluggable datagram transports between nodes and the gateway
+ *
+ * A transport moves whole frames (gateway_proto.h) between addresses and
+ * hands every frame it receives to gateway_transport_receive(), which
+ * passes acks to this controller's node link and data frames to its
+ * gateway role. The transport is chosen with GATEWAY_TRANSPORT in config.h.
+ */
+#ifndef GATEWAY_TRANSPORT_H
+#define GATEWAY_TRANSPORT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "gateway_proto.h"
+
+/* One transport implementation */
+typedef struct {
+    const char *name;
+    esp_err_t (*init)(void);
+    bool (*send)(const gateway_addr_t *to, const uint8_t *data, size_t len);
+    /* Where a node sends until an ack names the gateway */
+    void (*broadcast)(gateway_addr_t *addr);
+} gateway_transport_t;
+
+extern const gateway_transport_t gateway_transport_espnow;
+extern const gateway_transport_t gateway_transport_udp;
+
+typedef struct {
+    uint32_t frames_sent;
+    uint32_t frames_received;
+    uint32_t send_failures;     /* Frames the transport would not take */
+    uint32_t malformed;         /* Received frames with a bad header, or of a kind this controller does not handle */
+    uint64_t bytes_sent;
+    uint64_t bytes_received;
+} gateway_transport_stats_t;
+
+esp_err_t gateway_transport_init(void);
+bool gateway_transport_send(const gateway_addr_t *to, const uint8_t *data, size_t len);
+void gateway_transport_broadcast(gateway_addr_t *addr);
+void gateway_transport_receive(const gateway_addr_t *from, const uint8_t *data, size_t len);
+const char *gateway_transport_name(void);
+void gateway_transport_get_stats(gateway_transport_stats_t *stats);
+
+#endif /* GATEWAY_TRANSPORT_H */
@@ -0,0 +1,106 @@
+/**
+ * @file gateway_udp.c
+ * @brief UDP gateway transport, for testing nodes and gateways on a LAN
+ *
+ * Needs WiFi association on both sides. The gateway listens on
+ * GATEWAY_UDP_PORT; a node binds any port, broadcasts until the first ack
+ * and then sends to the address it came from, so a gateway running on a
+ * host can stand in for a controller. Addresses hold the IPv4 address and
+ * the port, both in network byte order. A small task blocks in recvfrom()
+ * and hands each datagram on.
+ */
+#include "gateway_transport.h"
+#include "config.h"
+
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "lwip/sockets.h"
+#include <string.h>
+
+#define UDP_TASK_STACK_SIZE 3072
+#define UDP_TASK_PRIORITY 5         /* Like the WiFi task: receive handlers only copy */
+
+static int s_socket = -1;
+static StaticTask_t s_task_buffer;
+static StackType_t s_task_stack[UDP_TASK_STACK_SIZE];
+static uint8_t s_rx[GATEWAY_FRAME_MAX];
+
+static void udp_to_addr(const struct sockaddr_in *sin, gateway_addr_t *addr) {
+    memcpy(addr->bytes, &sin->sin_addr.s_addr, 4);
+    memcpy(addr->bytes + 4, &sin->sin_port, 2);
+}
+
+static void udp_from_addr(const gateway_addr_t *addr, struct sockaddr_in *sin) {
+    memset(sin, 0, sizeof(*sin));
+    sin->sin_family = AF_INET;
+    memcpy(&sin->sin_addr.s_addr, addr->bytes, 4);
+    memcpy(&sin->sin_port, addr->bytes + 4, 2);
+}
+
+static void udp_rx_task(void *arg) {
+    while (1) {
+        struct sockaddr_in sin;
+        socklen_t sin_len = sizeof(sin);
+        int len = recvfrom(s_socket, s_rx, sizeof(s_rx), 0, (struct sockaddr *)&sin, &sin_len);
+        if (len <= 0) {
+            ESP_LOGW(TAG, "Gateway UDP receive failed (errno %d)", errno);
+            vTaskDelay(pdMS_TO_TICKS(100));
+            continue;
+        }
+
+        gateway_addr_t from;
+        udp_to_addr(&sin, &from);
+        gateway_transport_receive(&from, s_rx, (size_t)len);
+    }
+}
+
+static esp_err_t udp_init(void) {
+    s_socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (s_socket < 0) return ESP_FAIL;
+
+    int broadcast = 1;
+    setsockopt(s_socket, SOL_SOCKET, SO_BROADCAST, &broadcast, sizeof(broadcast));
+
+    struct sockaddr_in local = {
+        .sin_family = AF_INET,
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+        .sin_port = htons(GATEWAY_ENABLED ? GATEWAY_UDP_PORT : 0),
+    };
+    if (bind(s_socket, (struct sockaddr *)&local, sizeof(local)) != 0) {
+        ESP_LOGE(TAG, "Gateway UDP bind failed (errno %d)", errno);
+        close(s_socket);
+        s_socket = -1;
+        return ESP_FAIL;
+    }
+
+    if (xTaskCreateStatic(udp_rx_task, "gateway_udp", UDP_TASK_STACK_SIZE, NULL,
+                          UDP_TASK_PRIORITY, s_task_stack, &s_task_buffer) == NULL) {
+        close(s_socket);
+        s_socket = -1;
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+static bool udp_send(const gateway_addr_t *to, const uint8_t *data, size_t len) {
+    struct sockaddr_in sin;
+    udp_from_addr(to, &sin);
+    return sendto(s_socket, data, len, 0, (struct sockaddr *)&sin, sizeof(sin)) == (int)len;
+}
+
+static void udp_broadcast(gateway_addr_t *addr) {
+    struct sockaddr_in sin = {
+        .sin_family = AF_INET,
+        .sin_addr.s_addr = htonl(INADDR_BROADCAST),
+        .sin_port = htons(GATEWAY_UDP_PORT),
+    };
+    udp_to_addr(&sin, addr);
+}
+
+const gateway_transport_t gateway_transport_udp = {
+    .name = "udp",
+    .init = udp_init,
+    .send = udp_send,
+    .broadcast = udp_broadcast,
+};
@@ -0,0 +1,211 @@
+/**
+ * @file heap_soak.c
+ * @brief Implementation of the heap soak run
+ *
+ * The soak sends a long series of updates for a dedicated spot through
+ * send_parking_update() with MEMLOG streaming on, so every before/after
+ * sample reaches the serial log. After a short warm-up (lazy client setup,
+ * TLS session) it takes a heap-walk checkpoint every
+ * HEAP_SOAK_CHECKPOINT_EVERY updates and, when heap tracing is built in,
+ * traces leaks for the rest of the run. Allocations still outstanding at
+ * the end are grouped by call site. A free-heap, min-free or largest-block
+ * series that never rises and falls by HEAP_SOAK_DRIFT_BYTES or more is
+ * reported as drift. The updates reach the production endpoint, so the
+ * soak only runs in builds that set HEAP_SOAK_ENABLED.
+ */
+#include "heap_soak.h"
+#include "config.h"
+#include "console.h"
+#include "http_client.h"
+#include "mem_telemetry.h"
+
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "sdkconfig.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(CONFIG_HEAP_TRACING_STANDALONE)
+#include "esp_heap_trace.h"
+#define HEAP_SOAK_TRACE 1
+#else
+#define HEAP_SOAK_TRACE 0
+#endif
+
+#if HEAP_SOAK_TRACE
+static heap_trace_record_t s_records[HEAP_SOAK_TRACE_RECORDS];
+#endif
+static volatile bool s_running;
+
+static void heap_soak_track(heap_soak_series_t *series, uint32_t value, bool first) {
+    if (first) {
+        series->first = value;
+    } else if (value > series->last) {
+        series->rises++;
+    }
+    series->last = value;
+}
+
+static void heap_soak_checkpoint(heap_soak_result_t *result) {
+    mem_sample_t sample;
+    mem_telemetry_sample_walked(MEM_EVENT_SOAK_CHECKPOINT, &sample);
+
+    bool first = result->checkpoints == 0;
+    heap_soak_track(&result->free_heap, sample.free_heap, first);
+    heap_soak_track(&result->min_free_heap, sample.min_free_heap, first);
+    heap_soak_track(&result->largest_block, sample.largest_block, first);
+    result->checkpoints++;
+}
+
+static void heap_soak_judge(heap_soak_series_t *series, uint32_t checkpoints) {
+    series->drifting = checkpoints >= 3 && series->rises == 0 &&
+                       series->first >= series->last + HEAP_SOAK_DRIFT_BYTES;
+}
+
+#if HEAP_SOAK_TRACE
+static int heap_soak_compare_sites(const void *a, const void *b) {
+    const heap_soak_site_t *x = a;
+    const heap_soak_site_t *y = b;
+    return (x->bytes < y->bytes) - (x->bytes > y->bytes);
+}
+
+/* Group the records still held by the leak tracer by their first caller */
+static void heap_soak_attribute(heap_soak_result_t *result) {
+    heap_soak_site_t sites[HEAP_SOAK_MAX_SITES];
+    size_t site_count = 0;
+
+    size_t count = heap_trace_get_count();
+    for (size_t i = 0; i < count; i++) {
+        heap_trace_record_t record;
+        if (heap_trace_get(i, &record) != ESP_OK || record.address == NULL) continue;
+        result->outstanding_blocks++;
+        result->outstanding_bytes += (uint32_t)record.size;
+
+        void *caller = record.alloced_by[0];
+        size_t s = 0;
+        while (s < site_count && sites[s].caller != caller) s++;
+        if (s == site_count) {
+            if (site_count == HEAP_SOAK_MAX_SITES) continue;
+            sites[site_count++] = (heap_soak_site_t){ .caller = caller };
+        }
+        sites[s].blocks++;
+        sites[s].bytes += (uint32_t)record.size;
+    }
+
+    qsort(sites, site_count, sizeof(sites[0]), heap_soak_compare_sites);
+    result->site_count = site_count < HEAP_SOAK_TOP_SITES ? (uint32_t)site_count : HEAP_SOAK_TOP_SITES;
+    memcpy(result->sites, sites, result->site_count * sizeof(sites[0]));
+
+    heap_trace_summary_t summary;
+    if (heap_trace_summary(&summary) == ESP_OK) {
+        result->trace_overflowed = summary.has_overflowed;
+    }
+}
+#endif
+
+static void heap_soak_print_series(const char *name, const heap_soak_series_t *series) {
+    ESP_LOGI(TAG, "%s: %lu -> %lu bytes (rose %lu times)%s", name,
+        (unsigned long)series->first, (unsigned long)series->last, (unsigned long)series->rises,
+        series->drifting ? " DRIFT" : "");
+}
+
+static void heap_soak_print(const heap_soak_result_t *result) {
+    ESP_LOGI(TAG, "===== HEAP SOAK =====");
+    ESP_LOGI(TAG, "Updates: %lu (failed %lu), checkpoints: %lu",
+        (unsigned long)result->updates, (unsigned long)result->failed, (unsigned long)result->checkpoints);
+    heap_soak_print_series("Free heap", &result->free_heap);
+    heap_soak_print_series("Min free heap", &result->min_free_heap);
+    heap_soak_print_series("Largest free block", &result->largest_block);
+
+    if (!result->traced) {
+        ESP_LOGI(TAG, "Heap tracing not built in (CONFIG_HEAP_TRACING_STANDALONE), no leak attribution");
+        return;
+    }
+    ESP_LOGI(TAG, "Outstanding after warm-up: %lu blocks, %lu bytes%s",
+        (unsigned long)result->outstanding_blocks, (unsigned long)result->outstanding_bytes,
+        result->trace_overflowed ? " (trace buffer overflowed, partial)" : "");
+    for (uint32_t i = 0; i < result->site_count; i++) {
+        ESP_LOGI(TAG, "  %p: %lu blocks, %lu bytes", result->sites[i].caller,
+            (unsigned long)result->sites[i].blocks, (unsigned long)result->sites[i].bytes);
+    }
+}
+
+bool heap_soak_run(uint32_t updates, heap_soak_result_t *result) {
+    heap_soak_result_t local;
+    if (result == NULL) result = &local;
+    memset(result, 0, sizeof(*result));
+    if (!HEAP_SOAK_ENABLED) {
+        /* The updates go to the production endpoint; only debug builds may send them */
+        ESP_LOGE(TAG, "Heap soak not built in (HEAP_SOAK_ENABLED=0)");
+        return false;
+    }
+
+    uint32_t warmup = updates < HEAP_SOAK_WARMUP ? updates : HEAP_SOAK_WARMUP;
+    ESP_LOGI(TAG, "Heap soak: %lu updates of '%s', warm-up %lu",
+        (unsigned long)updates, HEAP_SOAK_SPOT_ID, (unsigned long)warmup);
+    mem_telemetry_set_stream(true);
+
+    for (uint32_t i = 0; i <= updates; i++) {
+        if (i == warmup) {
+            heap_soak_checkpoint(result);
+#if HEAP_SOAK_TRACE
+            result->traced = heap_trace_start(HEAP_TRACE_LEAKS) == ESP_OK;
+#endif
+        } else if (i > warmup && ((i - warmup) % HEAP_SOAK_CHECKPOINT_EVERY == 0 || i == updates)) {
+            heap_soak_checkpoint(result);
+        }
+        if (i == updates) break;
+
+        if (!send_parking_update(HEAP_SOAK_SPOT_ID, (i & 1) != 0)) {
+            result->failed++;
+        }
+        result->updates++;
+    }
+
+#if HEAP_SOAK_TRACE
+    if (result->traced) {
+        heap_trace_stop();
+        heap_soak_attribute(result);
+    }
+#endif
+    mem_telemetry_set_stream(false);
+
+    heap_soak_judge(&result->free_heap, result->checkpoints);
+    heap_soak_judge(&result->min_free_heap, result->checkpoints);
+    heap_soak_judge(&result->largest_block, result->checkpoints);
+    heap_soak_print(result);
+
+    return !result->free_heap.drifting && !result->min_free_heap.drifting && !result->largest_block.drifting;
+}
+
+static void heap_soak_task(void *arg) {
+    heap_soak_run(HEAP_SOAK_UPDATES, NULL);
+    s_running = false;
+    vTaskDelete(NULL);
+}
+
+/* Console entry: the update path needs TLS stack headroom, so run in a task of its own */
+static void heap_soak_command(void) {
+    if (!HEAP_SOAK_ENABLED) {
+        ESP_LOGW(TAG, "Heap soak needs a debug build with HEAP_SOAK_ENABLED=1");
+        return;
+    }
+    if (s_running) {
+        ESP_LOGW(TAG, "Heap soak already running");
+        return;
+    }
+    s_running = true;
+    if (xTaskCreate(heap_soak_task, "heap_soak", HEAP_SOAK_TASK_STACK_SIZE, NULL,
+                    HEAP_SOAK_TASK_PRIORITY, NULL) != pdPASS) {
+        s_running = false;
+        ESP_LOGE(TAG, "Failed to create heap soak task");
+    }
+}
+
+void heap_soak_init(void) {
+#if HEAP_SOAK_TRACE
+    ESP_ERROR_CHECK(heap_trace_init_standalone(s_records, HEAP_SOAK_TRACE_RECORDS));
+#endif
+    console_register(HEAP_SOAK_COMMAND, heap_soak_command);
+}
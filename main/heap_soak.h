@@ -0,0 +1,48 @@
+/**
+ * @file heap_soak.h
+ * @brief Soak run of the update path with heap drift checks and leak attribution
+ */
+#ifndef HEAP_SOAK_H
+#define HEAP_SOAK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "config.h"
+
+/* A heap series followed across the checkpoints after warm-up */
+typedef struct {
+    uint32_t first;             /* At the first checkpoint */
+    uint32_t last;              /* At the latest checkpoint */
+    uint32_t rises;             /* Checkpoints where it went up */
+    bool drifting;              /* Never rose and fell by HEAP_SOAK_DRIFT_BYTES or more */
+} heap_soak_series_t;
+
+/* Outstanding allocations made from one call site during the traced window */
+typedef struct {
+    void *caller;               /* Return address into the allocating function */
+    uint32_t blocks;
+    uint32_t bytes;
+} heap_soak_site_t;
+
+typedef struct {
+    uint32_t updates;           /* Updates sent */
+    uint32_t failed;            /* Updates the server did not acknowledge */
+    uint32_t checkpoints;
+    heap_soak_series_t free_heap;
+    heap_soak_series_t min_free_heap;
+    heap_soak_series_t largest_block;
+    bool traced;                /* Heap tracing was available and ran */
+    bool trace_overflowed;      /* Record buffer filled, attribution is partial */
+    uint32_t outstanding_blocks;
+    uint32_t outstanding_bytes;
+    uint32_t site_count;
+    heap_soak_site_t sites[HEAP_SOAK_TOP_SITES];
+} heap_soak_result_t;
+
+void heap_soak_init(void);
+/* Send 'updates' changes of HEAP_SOAK_SPOT_ID through send_parking_update(),
+ * streaming MEMLOG samples; returns false when a heap series drifted, or at
+ * once without HEAP_SOAK_ENABLED */
+bool heap_soak_run(uint32_t updates, heap_soak_result_t *result);
+
+#endif /* HEAP_SOAK_H */
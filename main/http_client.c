@@ -4,13 +4,42 @@
  */
 #include "http_client.h"
 #include "config.h"
-#include "wifi_manager.h"
+#include "freshness.h"
+#include "gateway_link.h"
+#include "mem_telemetry.h"
+#include "span_trace.h"
+#include "state_stream.h"
+#include "tls_session.h"
 
 #include "esp_http_client.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "cJSON.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include <stdio.h>
 #include <string.h>
 
+/* Long-lived client session, reused across updates with HTTP/1.1 keep-alive */
+static esp_http_client_handle_t s_client = NULL;
+static SemaphoreHandle_t s_client_lock = NULL;
+static StaticSemaphore_t s_client_lock_buffer;
+static http_client_stats_t s_stats;
+static const char *s_endpoint = PARKING_ENDPOINT;  /* Path the session URL currently points at */
+
+/* Start of the current request stage, advanced by the event handler */
+static span_t s_span_mark;
+
+/* Set once the session handle has completed a handshake and holds its ticket */
+static bool s_have_ticket = false;
+static int64_t s_perform_start_us = 0;
+
+/* Connection state as far as the client knows; the server may still have dropped it */
+static bool s_connected = false;
+static bool s_prewarmed = false;        /* Opened ahead of an update that has not been sent yet */
+static bool s_prewarming = false;       /* The current perform is the pre-warm request */
+static int64_t s_last_request_us = 0;
+
 /* The HTTP Event Handler */
 static esp_err_t http_event_handler(esp_http_client_event_t *evt)
 {
@@ -23,21 +52,36 @@ static esp_err_t http_event_handler(esp_http_client_event_t *evt)
             break;
         case HTTP_EVENT_ON_CONNECTED:
             ESP_LOGI(TAG, "HTTP_EVENT_ON_CONNECTED");
+            /* TCP + TLS handshake, abbreviated when the ticket of the last connection is accepted */
+            s_stats.connects++;
+            tls_session_record(s_have_ticket, (uint32_t)((esp_timer_get_time() - s_perform_start_us) / 1000));
+            s_have_ticket = true;
+            s_connected = true;
+            SPAN_END(SPAN_STAGE_CONNECT, s_span_mark);
+            s_span_mark = SPAN_START();
             break;
         case HTTP_EVENT_HEADER_SENT:
             ESP_LOGI(TAG, "HTTP_EVENT_HEADER_SENT");
+            if (!s_prewarming) {
+                SPAN_END(SPAN_STAGE_POST, s_span_mark);
+            }
+            s_span_mark = SPAN_START();
             break;
         case HTTP_EVENT_ON_HEADER:
-            ESP_LOGI(TAG, "HTTP_EVENT_ON_HEADER, key=%s, value=%s", evt->header_key, evt->header_value);
+            ESP_LOGD(TAG, "HTTP_EVENT_ON_HEADER, key=%s, value=%s", evt->header_key, evt->header_value);
             break;
         case HTTP_EVENT_ON_DATA:
             ESP_LOGI(TAG, "HTTP_EVENT_ON_DATA, len=%d", evt->data_len);
             break;
         case HTTP_EVENT_ON_FINISH:
             ESP_LOGI(TAG, "HTTP_EVENT_ON_FINISH");
+            if (!s_prewarming) {
+                SPAN_END(SPAN_STAGE_RESPONSE, s_span_mark);
+            }
             break;
         case HTTP_EVENT_DISCONNECTED:
             ESP_LOGI(TAG, "HTTP_EVENT_DISCONNECTED");
+            s_connected = false;
             break;
         case HTTP_EVENT_REDIRECT:
             ESP_LOGI(TAG, "HTTP_EVENT_REDIRECT");
@@ -46,53 +90,531 @@ static esp_err_t http_event_handler(esp_http_client_event_t *evt)
     return ESP_OK;
 }
 
-bool send_parking_update(const char* spot_id, bool is_taken) {
-    print_memory_stats("Before HTTP request");
-
+/* Create the session handle; the connection itself is opened lazily on the first perform */
+static bool http_session_open(void) {
     char url[256];
-    bool success = false;
-
     snprintf(url, sizeof(url), "%s%s", SERVER_URL, PARKING_ENDPOINT);
 
-    cJSON *root = cJSON_CreateObject();
-    cJSON_AddStringToObject(root, "spot", spot_id);
-    cJSON_AddBoolToObject(root, "taken", is_taken);
-
-    char *post_data = cJSON_PrintUnformatted(root);
-    ESP_LOGI(TAG, "Sending update to %s: %s", url, post_data);
-
     esp_http_client_config_t config = {
         .url = url,
         .event_handler = http_event_handler,
-        .timeout_ms = 50000,
+        .timeout_ms = HTTP_TIMEOUT_MS,
+        .keep_alive_enable = true,
+#if TLS_SESSION_RESUME
+        .save_client_session = true,
+#endif
     };
 
-    esp_http_client_handle_t client = esp_http_client_init(&config);
+    s_client = esp_http_client_init(&config);
+    if (s_client == NULL) {
+        ESP_LOGE(TAG, "Failed to create HTTP client session");
+        return false;
+    }
+    s_have_ticket = false;
+
+    esp_http_client_set_method(s_client, HTTP_METHOD_POST);
+    esp_http_client_set_header(s_client, "Content-Type", "application/json");
+    esp_http_client_set_header(s_client, "Connection", "keep-alive");
+    return true;
+}
+
+/* Drop the current connection so the next perform starts a fresh handshake */
+static void http_session_reset(void) {
+    if (s_client != NULL) {
+        esp_http_client_close(s_client);
+    }
+    s_connected = false;
+    s_prewarmed = false;
+}
+
+bool http_client_init(void) {
+    if (s_client_lock == NULL) {
+        s_client_lock = xSemaphoreCreateMutexStatic(&s_client_lock_buffer);
+        if (s_client_lock == NULL) {
+            ESP_LOGE(TAG, "Failed to create HTTP client lock");
+            return false;
+        }
+    }
+
+    xSemaphoreTake(s_client_lock, portMAX_DELAY);
+    bool ok = (s_client != NULL) || http_session_open();
+    xSemaphoreGive(s_client_lock);
+    return ok;
+}
+
+void http_client_close(void) {
+    if (s_client_lock == NULL) return;
 
-    esp_http_client_set_method(client, HTTP_METHOD_POST);
-    esp_http_client_set_header(client, "Content-Type", "application/json");
+    xSemaphoreTake(s_client_lock, portMAX_DELAY);
+    if (s_client != NULL) {
+        esp_http_client_cleanup(s_client);
+        s_client = NULL;
+    }
+    s_connected = false;
+    s_prewarmed = false;
+    xSemaphoreGive(s_client_lock);
+}
 
-    esp_http_client_set_post_field(client, post_data, strlen(post_data));
+/* Batched bodies are only sent while the server accepts them */
+static bool s_batch_supported = true;
 
-    esp_err_t err = esp_http_client_perform(client);
+/* POST a body over the shared session, reconnecting if the connection was dropped.
+ * Returns the HTTP status code, or -1 if no response was received. */
+static int http_session_post(const char *post_data) {
+    esp_err_t err = ESP_FAIL;
+    int status_code = -1;
 
-    if (err == ESP_OK) {
-        int status_code = esp_http_client_get_status_code(client);
+    for (int attempt = 0; attempt <= HTTP_MAX_RECONNECTS; attempt++) {
+        if (attempt > 0) {
+            ESP_LOGW(TAG, "Reconnecting HTTP session (attempt %d)", attempt);
+            s_stats.reconnects++;
+            http_session_reset();
+        }
+
+        esp_http_client_set_post_field(s_client, post_data, strlen(post_data));
+        s_span_mark = SPAN_START();
+        s_perform_start_us = esp_timer_get_time();
+        err = esp_http_client_perform(s_client);
+        s_last_request_us = esp_timer_get_time();
+        if (err == ESP_OK) {
+            status_code = esp_http_client_get_status_code(s_client);
+            break;
+        }
+        ESP_LOGE(TAG, "HTTP POST request failed: %s", esp_err_to_name(err));
+    }
+
+    if (err != ESP_OK) {
+        /* Leave the session closed; the next update reconnects from scratch */
+        http_session_reset();
+    } else {
         ESP_LOGI(TAG, "HTTP POST Status = %d", status_code);
+    }
+    return status_code;
+}
 
-        if (status_code >= 200 && status_code < 300) {
-            success = true;
+/* Same host, so switching paths keeps the connection. The caller holds s_client_lock. */
+static void http_session_set_endpoint(const char *endpoint) {
+    if (strcmp(endpoint, s_endpoint) != 0) {
+        char url[256];
+        snprintf(url, sizeof(url), "%s%s", SERVER_URL, endpoint);
+        esp_http_client_set_url(s_client, url);
+        s_endpoint = endpoint;
+    }
+}
+
+/* Send one body to an endpoint on the server and account for it in the session stats.
+ * The caller holds s_client_lock. */
+static int http_post_body_locked(const char *endpoint, const char *post_data) {
+    ESP_LOGI(TAG, "Sending update to %s%s: %s", SERVER_URL, endpoint, post_data);
+    http_session_set_endpoint(endpoint);
+
+    /* Did the pre-warm predict this update? */
+    if (strcmp(endpoint, PARKING_ENDPOINT) == 0) {
+        if (s_prewarmed) {
+            s_stats.prewarm_hits++;
+        } else if (!s_connected) {
+            s_stats.prewarm_misses++;
+        }
+        s_prewarmed = false;
+    }
+
+    int64_t start_us = esp_timer_get_time();
+    int status_code = http_session_post(post_data);
+    uint32_t latency_ms = (uint32_t)((esp_timer_get_time() - start_us) / 1000);
+
+    s_stats.requests++;
+    if (status_code < 200 || status_code >= 300) {
+        s_stats.failures++;
+    }
+    s_stats.last_latency_ms = latency_ms;
+    s_stats.total_latency_ms += latency_ms;
+    if (latency_ms > s_stats.max_latency_ms) {
+        s_stats.max_latency_ms = latency_ms;
+    }
+
+    if (status_code > 0 && (status_code < 200 || status_code >= 300)) {
+        ESP_LOGE(TAG, "Server returned error code: %d", status_code);
+    }
+    ESP_LOGI(TAG, "HTTP request took %lu ms (connects: %lu, reconnects: %lu)",
+        (unsigned long)latency_ms, (unsigned long)s_stats.connects, (unsigned long)s_stats.reconnects);
+    return status_code;
+}
+
+static int http_post_body(const char *endpoint, const char *post_data) {
+    if (!http_client_init()) {
+        return -1;
+    }
+    xSemaphoreTake(s_client_lock, portMAX_DELAY);
+    int status_code = http_post_body_locked(endpoint, post_data);
+    xSemaphoreGive(s_client_lock);
+    return status_code;
+}
+
+int http_client_post(const char *endpoint, const char *body) {
+    return http_post_body(endpoint, body);
+}
+
+bool http_client_connected(void) {
+    return s_connected;
+}
+
+/* Open the connection ahead of an update with a HEAD on the update path; any
+ * answer leaves a warm keep-alive connection. Returns true if one is open. */
+bool http_client_prewarm(void) {
+#if PREWARM_ENABLED
+    if (!http_client_init()) {
+        return false;
+    }
+    xSemaphoreTake(s_client_lock, portMAX_DELAY);
+    if (!s_connected) {
+        http_session_set_endpoint(PARKING_ENDPOINT);
+        esp_http_client_set_method(s_client, HTTP_METHOD_HEAD);
+        esp_http_client_set_post_field(s_client, NULL, 0);
+
+        s_prewarming = true;
+        s_span_mark = SPAN_START();
+        s_perform_start_us = esp_timer_get_time();
+        esp_err_t err = esp_http_client_perform(s_client);
+        s_last_request_us = esp_timer_get_time();
+        s_prewarming = false;
+        esp_http_client_set_method(s_client, HTTP_METHOD_POST);
+
+        if (err == ESP_OK && s_connected) {
+            s_stats.prewarms++;
+            s_prewarmed = true;
         } else {
-            ESP_LOGE(TAG, "Server returned error code: %d", status_code);
+            ESP_LOGW(TAG, "Connection pre-warm failed: %s", esp_err_to_name(err));
+            http_session_reset();
         }
+    }
+    bool connected = s_connected;
+    xSemaphoreGive(s_client_lock);
+    return connected;
+#else
+    return false;
+#endif
+}
+
+/* Close a connection no request has used for PREWARM_IDLE_MS.
+ * Returns the ms until the open connection would go idle, UINT32_MAX if none. */
+uint32_t http_client_close_idle(void) {
+#if PREWARM_ENABLED
+    if (s_client_lock == NULL) return UINT32_MAX;
+
+    xSemaphoreTake(s_client_lock, portMAX_DELAY);
+    uint32_t left_ms = UINT32_MAX;
+    if (s_connected) {
+        int64_t idle_ms = (esp_timer_get_time() - s_last_request_us) / 1000;
+        if (idle_ms >= PREWARM_IDLE_MS) {
+            if (s_prewarmed) {
+                s_stats.prewarm_wasted++;
+            }
+            s_stats.idle_closes++;
+            http_session_reset();
+        } else {
+            left_ms = (uint32_t)(PREWARM_IDLE_MS - idle_ms);
+        }
+    }
+    xSemaphoreGive(s_client_lock);
+    return left_ms;
+#else
+    return UINT32_MAX;
+#endif
+}
+
+/* Detection time for the body: unix ms once SNTP has synced, else the age when sent */
+static bool http_update_time(const parking_update_t *update, const char **key, int64_t *value_ms) {
+    if (update->detected_us == 0) return false;
+
+    int64_t ts_ms = freshness_wall_ms(update->detected_us);
+    if (ts_ms > 0) {
+        *key = "ts";
+        *value_ms = ts_ms;
     } else {
-        ESP_LOGE(TAG, "HTTP POST request failed: %s", esp_err_to_name(err));
+        *key = "age";
+        *value_ms = (esp_timer_get_time() - update->detected_us) / 1000;
     }
+    return true;
+}
 
-    esp_http_client_cleanup(client);
-    cJSON_free(post_data);
+/* The inside of a JSON string, with the escapes cJSON_PrintUnformatted() uses.
+ * Writes what fits in size bytes, unterminated, and returns the whole length. */
+size_t http_json_escape(char *out, size_t size, const char *s) {
+    size_t len = 0;
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        const char *escape = NULL;
+        switch (c) {
+            case '"': escape = "\\\""; break;
+            case '\\': escape = "\\\\"; break;
+            case '\b': escape = "\\b"; break;
+            case '\f': escape = "\\f"; break;
+            case '\n': escape = "\\n"; break;
+            case '\r': escape = "\\r"; break;
+            case '\t': escape = "\\t"; break;
+            default: break;
+        }
+
+        char hex[7];
+        size_t n = 2;
+        if (escape == NULL && c < 0x20) {
+            snprintf(hex, sizeof(hex), "\\u%04x", c);
+            escape = hex;
+            n = 6;
+        } else if (escape == NULL) {
+            escape = s;
+            n = 1;
+        }
+        /* Once something did not fit, nothing after it is written either */
+        if (len + n <= size) {
+            memcpy(out + len, escape, n);
+        }
+        len += n;
+    }
+    return len;
+}
+
+#if STATIC_MEMORY_MODE
+
+/* Longest spot name once escaped, one update, and a full batch */
+#define HTTP_SPOT_JSON_MAX HTTP_JSON_ESCAPED_MAX(PARKING_SLOT_NAME_LEN - 1)
+#define HTTP_FRESHNESS_JSON_MAX (sizeof(",\"seq\":4294967295,\"age\":-9223372036854775808") - 1)
+#define HTTP_UPDATE_JSON_MAX \
+    (sizeof("{\"spot\":\"\",\"taken\":false}") - 1 + HTTP_SPOT_JSON_MAX + HTTP_FRESHNESS_JSON_MAX)
+#define HTTP_BODY_MAX (sizeof("{\"updates\":[]}") + BATCH_MAX_SIZE * (HTTP_UPDATE_JSON_MAX + 1))
+
+/* Request body, written and sent under s_client_lock */
+static char s_body[HTTP_BODY_MAX];
+
+typedef struct {
+    char *buf;
+    size_t size;
+    size_t len;
+} http_writer_t;
+
+static void http_put(http_writer_t *w, const char *s, size_t n) {
+    if (w->len + n < w->size) {
+        memcpy(w->buf + w->len, s, n);
+    }
+    w->len += n;
+}
+
+static void http_put_string(http_writer_t *w, const char *s) {
+    http_put(w, "\"", 1);
+    size_t room = w->len < w->size ? w->size - w->len : 0;
+    w->len += http_json_escape(room ? w->buf + w->len : NULL, room, s);
+    http_put(w, "\"", 1);
+}
+
+static void http_put_update(http_writer_t *w, const parking_update_t *update) {
+    http_put(w, "{\"spot\":", 8);
+    http_put_string(w, update->spot_id);
+    if (update->is_taken) {
+        http_put(w, ",\"taken\":true", 13);
+    } else {
+        http_put(w, ",\"taken\":false", 14);
+    }
+
+    char field[HTTP_FRESHNESS_JSON_MAX + 1];
+    if (update->seq != 0) {
+        http_put(w, field, snprintf(field, sizeof(field), ",\"seq\":%lu", (unsigned long)update->seq));
+    }
+    const char *key;
+    int64_t value_ms;
+    if (http_update_time(update, &key, &value_ms)) {
+        http_put(w, field, snprintf(field, sizeof(field), ",\"%s\":%lld", key, (long long)value_ms));
+    }
+    http_put(w, "}", 1);
+}
+
+/* Serialize straight into s_body, the same JSON the cJSON path produces, and send it */
+static int http_post_updates(const parking_update_t *updates, int count, span_t json_span) {
+    if (!http_client_init()) {
+        return -1;
+    }
+    xSemaphoreTake(s_client_lock, portMAX_DELAY);
+
+    http_writer_t w = { .buf = s_body, .size = sizeof(s_body) };
+    if (count == 1) {
+        http_put_update(&w, &updates[0]);
+    } else {
+        http_put(&w, "{\"updates\":[", 12);
+        for (int i = 0; i < count; i++) {
+            if (i > 0) http_put(&w, ",", 1);
+            http_put_update(&w, &updates[i]);
+        }
+        http_put(&w, "]}", 2);
+    }
+    SPAN_END(SPAN_STAGE_JSON, json_span);
+
+    int status_code = -1;
+    if (w.len < w.size) {
+        s_body[w.len] = '\0';
+        status_code = http_post_body_locked(PARKING_ENDPOINT, s_body);
+    } else {
+        ESP_LOGE(TAG, "Update body of %u bytes does not fit the %u byte buffer",
+            (unsigned)w.len, (unsigned)sizeof(s_body));
+    }
+
+    xSemaphoreGive(s_client_lock);
+    return status_code;
+}
+
+#else
+
+static void http_add_update(cJSON *item, const parking_update_t *update) {
+    cJSON_AddStringToObject(item, "spot", update->spot_id);
+    cJSON_AddBoolToObject(item, "taken", update->is_taken);
+    if (update->seq != 0) {
+        cJSON_AddNumberToObject(item, "seq", update->seq);
+    }
+    const char *key;
+    int64_t value_ms;
+    if (http_update_time(update, &key, &value_ms)) {
+        cJSON_AddNumberToObject(item, key, (double)value_ms);
+    }
+}
+
+/* Build the body with cJSON, print it to the heap and send it */
+static int http_post_updates(const parking_update_t *updates, int count, span_t json_span) {
+    cJSON *root = cJSON_CreateObject();
+    if (count == 1) {
+        http_add_update(root, &updates[0]);
+    } else {
+        cJSON *list = cJSON_AddArrayToObject(root, "updates");
+        for (int i = 0; i < count; i++) {
+            cJSON *item = cJSON_CreateObject();
+            http_add_update(item, &updates[i]);
+            cJSON_AddItemToArray(list, item);
+        }
+    }
+
+    char *post_data = cJSON_PrintUnformatted(root);
     cJSON_Delete(root);
+    SPAN_END(SPAN_STAGE_JSON, json_span);
+    if (post_data == NULL) {
+        ESP_LOGE(TAG, "Failed to serialize update");
+        return -1;
+    }
+
+    int status_code = http_post_body(PARKING_ENDPOINT, post_data);
+    cJSON_free(post_data);
+    return status_code;
+}
 
-    print_memory_stats("After HTTP request");
-    return success;
-}
\ No newline at end of file
+#endif /* STATIC_MEMORY_MODE */
+
+static bool http_send_update(const parking_update_t *update) {
+    mem_telemetry_sample(MEM_EVENT_HTTP_BEFORE);
+
+    span_t json_span = SPAN_START();
+    int status_code = http_post_updates(update, 1, json_span);
+
+    mem_telemetry_sample(MEM_EVENT_HTTP_AFTER);
+    return status_code >= 200 && status_code < 300;
+}
+
+bool send_parking_update(const char* spot_id, bool is_taken) {
+    parking_update_t update = { .spot_id = spot_id, .is_taken = is_taken };
+    return http_send_update(&update);
+}
+
+/* Status codes meaning the server does not understand the batched body */
+static bool http_batch_rejected(int status_code) {
+    return status_code == 400 || status_code == 404 || status_code == 405 ||
+           status_code == 415 || status_code == 422;
+}
+
+/* JSON over the HTTPS session, whatever the wire mode; the gateway forwards with this */
+int http_client_send_batch(parking_update_t *updates, int count) {
+    if (count <= 0) return 0;
+
+    for (int i = 0; i < count; i++) {
+        updates[i].acked = false;
+    }
+
+    if (BATCH_MODE_ENABLED && s_batch_supported && count > 1) {
+        mem_telemetry_sample(MEM_EVENT_HTTP_BEFORE);
+
+        span_t json_span = SPAN_START();
+        int status_code = http_post_updates(updates, count, json_span);
+
+        mem_telemetry_sample(MEM_EVENT_HTTP_AFTER);
+
+        if (status_code >= 200 && status_code < 300) {
+            s_stats.batches++;
+            for (int i = 0; i < count; i++) {
+                updates[i].acked = true;
+            }
+            return count;
+        }
+        if (!http_batch_rejected(status_code)) {
+            return 0;
+        }
+
+        /* Old server: remember that and fall back to one spot per request */
+        ESP_LOGW(TAG, "Server rejected batched update (%d), falling back to single-spot updates", status_code);
+        s_batch_supported = false;
+    }
+
+    int acked = 0;
+    for (int i = 0; i < count; i++) {
+        updates[i].acked = http_send_update(&updates[i]);
+        if (updates[i].acked) {
+            acked++;
+        }
+    }
+    return acked;
+}
+
+int send_parking_batch(parking_update_t *updates, int count) {
+    if (count <= 0) return 0;
+
+#if WIRE_MODE == WIRE_MODE_STREAM
+    int acked = state_stream_send(updates, count);
+#elif WIRE_MODE == WIRE_MODE_GATEWAY
+    int acked = gateway_link_send(updates, count);
+#else
+    int acked = http_client_send_batch(updates, count);
+#endif
+
+    /* An acknowledged update acks its slot's transitions up to the one it carries */
+    for (int i = 0; i < count; i++) {
+        if (updates[i].acked) {
+            freshness_ack(updates[i].slot_index, updates[i].seq);
+        }
+    }
+    return acked;
+}
+
+void http_client_get_stats(http_client_stats_t *stats) {
+    if (stats == NULL) return;
+
+    if (s_client_lock != NULL) {
+        xSemaphoreTake(s_client_lock, portMAX_DELAY);
+    }
+    *stats = s_stats;
+    if (s_client_lock != NULL) {
+        xSemaphoreGive(s_client_lock);
+    }
+}
+
+void http_client_print_stats(void) {
+    http_client_stats_t stats;
+    http_client_get_stats(&stats);
+
+    uint32_t avg_latency_ms = stats.requests ? (uint32_t)(stats.total_latency_ms / stats.requests) : 0;
+
+    ESP_LOGI(TAG, "===== HTTP SESSION STATS =====");
+    ESP_LOGI(TAG, "Requests: %lu (failed: %lu, batched: %lu)",
+        (unsigned long)stats.requests, (unsigned long)stats.failures, (unsigned long)stats.batches);
+    ESP_LOGI(TAG, "Connections opened: %lu", (unsigned long)stats.connects);
+    ESP_LOGI(TAG, "Reconnects: %lu", (unsigned long)stats.reconnects);
+#if PREWARM_ENABLED
+    ESP_LOGI(TAG, "Pre-warms: %lu, hits: %lu, misses: %lu, wasted: %lu, idle closes: %lu",
+        (unsigned long)stats.prewarms, (unsigned long)stats.prewarm_hits, (unsigned long)stats.prewarm_misses,
+        (unsigned long)stats.prewarm_wasted, (unsigned long)stats.idle_closes);
+#endif
+    ESP_LOGI(TAG, "Latency last/avg/max: %lu/%lu/%lu ms",
+        (unsigned long)stats.last_latency_ms, (unsigned long)avg_latency_ms, (unsigned long)stats.max_latency_ms);
+}
@@ -6,7 +6,51 @@
 #define HTTP_CLIENT_H
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
+/* Longest JSON escape of a string of len bytes without control characters (slot
+ * names, see parking_slot_name_is_clean()): every byte a quote or backslash */
+#define HTTP_JSON_ESCAPED_MAX(len) (2 * (len))
+
+/* Counters for the persistent HTTPS session */
+typedef struct {
+    uint32_t requests;          /* POST requests attempted */
+    uint32_t failures;          /* Requests that did not get a 2xx response */
+    uint32_t batches;           /* Multi-slot requests acknowledged by the server */
+    uint32_t connects;          /* TCP/TLS connections opened (handshake times in tls_session) */
+    uint32_t reconnects;        /* Retries after the server or WiFi dropped the connection */
+    uint32_t prewarms;          /* Connections opened ahead of an update */
+    uint32_t prewarm_hits;      /* Updates sent on a pre-warmed connection */
+    uint32_t prewarm_misses;    /* Updates that had to open the connection themselves */
+    uint32_t prewarm_wasted;    /* Pre-warmed connections closed idle without carrying an update */
+    uint32_t idle_closes;       /* Connections closed after PREWARM_IDLE_MS without a request */
+    uint32_t last_latency_ms;   /* Latency of the most recent request */
+    uint32_t max_latency_ms;    /* Worst request latency seen */
+    uint64_t total_latency_ms;  /* Sum of request latencies, for averaging */
+} http_client_stats_t;
+
+/* One slot change in a batched update */
+typedef struct {
+    const char *spot_id;        /* Parking slot name */
+    uint16_t slot_index;        /* Index into the slot table (binary stream frames carry this) */
+    bool is_taken;              /* New occupancy state */
+    bool acked;                 /* Set when the server acknowledged this change */
+    uint32_t seq;               /* Freshness sequence of the slot's transition, 0 = none */
+    int64_t detected_us;        /* When the change was detected, 0 = unknown (gateway records carry its age) */
+} parking_update_t;
+
+bool http_client_init(void);
+void http_client_close(void);
 bool send_parking_update(const char* spot_id, bool is_taken);
+int send_parking_batch(parking_update_t *updates, int count);
+int http_client_send_batch(parking_update_t *updates, int count);
+int http_client_post(const char *endpoint, const char *body);
+bool http_client_connected(void);
+bool http_client_prewarm(void);
+uint32_t http_client_close_idle(void);
+size_t http_json_escape(char *out, size_t size, const char *s);
+void http_client_get_stats(http_client_stats_t *stats);
+void http_client_print_stats(void);
 
-#endif /* HTTP_CLIENT_H */
\ No newline at end of file
+#endif /* HTTP_CLIENT_H */
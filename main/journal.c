@@ -0,0 +1,378 @@
+/**
+ * @file journal.c
+ * @brief Implementation of the store-and-forward flash journal
+ *
+ * Transitions the server did not acknowledge are appended to a ring of
+ * fixed-size records in the "journal" data partition. Records are staged in
+ * RAM and written in batches, and a sector is only erased right before the
+ * ring wraps into it. Each record carries a sequence number and a CRC, so
+ * the write position and the unreplayed tail are rebuilt on boot by
+ * scanning the partition. A replay sends the final state per slot (or the
+ * full history) as batches and then appends a commit record.
+ *
+ * STATE records keep the transition's freshness sequence. Sequences start
+ * over at boot, so records written before it replay without one.
+ */
+#include "journal.h"
+#include "parking_slot.h"
+#include "http_client.h"
+#include "freshness.h"
+#include "config.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_partition.h"
+#include "esp_rom_crc.h"
+#include <stddef.h>
+#include <string.h>
+
+#define JOURNAL_SECTOR_SIZE 4096
+#define JOURNAL_RECORD_ERASED 0xFFFFFFFFu
+
+#define JOURNAL_REC_STATE 0x01      /* Slot transition; arg = freshness sequence (0 = none) */
+#define JOURNAL_REC_COMMIT 0x02     /* Replay done; arg = highest sequence replayed */
+
+typedef struct __attribute__((packed)) {
+    uint32_t seq;           /* Monotonic record number, 0xFFFFFFFF when erased */
+    uint32_t arg;           /* Type-specific value */
+    uint16_t slot_index;    /* Slot for STATE records */
+    uint8_t type;           /* JOURNAL_REC_* */
+    uint8_t state;          /* New occupancy for STATE records */
+    uint16_t reserved;
+    uint16_t crc;           /* CRC-16 over the preceding fields */
+} journal_record_t;
+
+_Static_assert(sizeof(journal_record_t) == 16, "journal records must stay 16 bytes");
+_Static_assert(JOURNAL_SECTOR_SIZE % (JOURNAL_WRITE_BATCH * sizeof(journal_record_t)) == 0,
+               "write batches must not straddle sectors");
+
+#define JOURNAL_RECORDS_PER_SECTOR (JOURNAL_SECTOR_SIZE / sizeof(journal_record_t))
+
+static const esp_partition_t *s_partition = NULL;
+static uint32_t s_capacity = 0;         /* Records in the partition */
+static uint32_t s_write_pos = 0;        /* Next record index to write */
+static uint32_t s_next_seq = 1;
+static uint32_t s_committed_seq = 0;    /* Everything up to here has reached the server */
+static uint32_t s_boot_seq = 1;         /* First record written this boot */
+
+static journal_record_t s_staged[JOURNAL_WRITE_BATCH];
+static int s_staged_count = 0;
+
+static journal_stats_t s_stats;
+
+/* Replay compaction state: latest journaled state per slot */
+static uint32_t s_replay_seen[PARKING_SLOT_WORDS];
+static uint32_t s_replay_state[PARKING_SLOT_WORDS];
+static uint32_t s_replay_fresh_seq[MAX_PARKING_SLOTS];
+static parking_update_t s_replay_updates[BATCH_MAX_SIZE];
+
+static uint16_t journal_crc(const journal_record_t *rec) {
+    return esp_rom_crc16_le(0, (const uint8_t *)rec, offsetof(journal_record_t, crc));
+}
+
+static bool journal_record_erased(const journal_record_t *rec) {
+    const uint8_t *bytes = (const uint8_t *)rec;
+    for (size_t i = 0; i < sizeof(*rec); i++) {
+        if (bytes[i] != 0xFF) return false;
+    }
+    return true;
+}
+
+static bool journal_record_valid(const journal_record_t *rec) {
+    return rec->seq != JOURNAL_RECORD_ERASED && rec->crc == journal_crc(rec);
+}
+
+/* Erase the sector the ring is about to enter, counting unreplayed records it held */
+static esp_err_t journal_prepare_sector(uint32_t record_index) {
+    uint32_t offset = record_index * sizeof(journal_record_t);
+
+    journal_record_t last;
+    uint32_t last_offset = offset + JOURNAL_SECTOR_SIZE - sizeof(journal_record_t);
+    if (esp_partition_read(s_partition, last_offset, &last, sizeof(last)) == ESP_OK &&
+        journal_record_valid(&last) && last.seq > s_committed_seq) {
+        /* Sector is full and holds transitions that never reached the server */
+        uint32_t first_seq = last.seq - (JOURNAL_RECORDS_PER_SECTOR - 1);
+        uint32_t lost = last.seq - ((first_seq > s_committed_seq) ? first_seq - 1 : s_committed_seq);
+        s_stats.overwritten += lost;
+        s_stats.depth = (s_stats.depth > lost) ? s_stats.depth - lost : 0;
+        ESP_LOGW(TAG, "Journal full, overwriting %lu unreplayed records", (unsigned long)lost);
+    }
+
+    esp_err_t err = esp_partition_erase_range(s_partition, offset, JOURNAL_SECTOR_SIZE);
+    if (err == ESP_OK) {
+        s_stats.sector_erases++;
+    }
+    return err;
+}
+
+static esp_err_t journal_stage(journal_record_t *rec) {
+    rec->seq = s_next_seq++;
+    rec->reserved = 0;
+    rec->crc = journal_crc(rec);
+
+    s_staged[s_staged_count++] = *rec;
+    if (s_staged_count == JOURNAL_WRITE_BATCH) {
+        journal_flush();
+    }
+    return ESP_OK;
+}
+
+esp_err_t journal_init(void) {
+    s_partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY,
+                                           JOURNAL_PARTITION_LABEL);
+    if (s_partition == NULL) {
+        ESP_LOGW(TAG, "No \"%s\" partition, offline journal disabled", JOURNAL_PARTITION_LABEL);
+        return ESP_ERR_NOT_FOUND;
+    }
+    s_capacity = (s_partition->size / JOURNAL_SECTOR_SIZE) * JOURNAL_RECORDS_PER_SECTOR;
+
+    /* Recover the head and the commit point by scanning every record */
+    journal_record_t chunk[JOURNAL_WRITE_BATCH];
+    uint32_t head_seq = 0;
+    uint32_t head_index = 0;
+    bool have_head = false;
+
+    for (uint32_t index = 0; index < s_capacity; index += JOURNAL_WRITE_BATCH) {
+        esp_err_t err = esp_partition_read(s_partition, index * sizeof(journal_record_t), chunk, sizeof(chunk));
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Journal read failed: %s", esp_err_to_name(err));
+            return err;
+        }
+        for (int i = 0; i < JOURNAL_WRITE_BATCH; i++) {
+            if (journal_record_erased(&chunk[i])) continue;
+            if (!journal_record_valid(&chunk[i])) {
+                s_stats.corrupt++;
+                continue;
+            }
+            if (!have_head || chunk[i].seq > head_seq) {
+                head_seq = chunk[i].seq;
+                head_index = index + i;
+                have_head = true;
+            }
+            if (chunk[i].type == JOURNAL_REC_COMMIT && chunk[i].arg > s_committed_seq) {
+                s_committed_seq = chunk[i].arg;
+            }
+        }
+    }
+
+    /* Second pass only needs the count of unreplayed transitions */
+    for (uint32_t index = 0; have_head && index < s_capacity; index += JOURNAL_WRITE_BATCH) {
+        esp_partition_read(s_partition, index * sizeof(journal_record_t), chunk, sizeof(chunk));
+        for (int i = 0; i < JOURNAL_WRITE_BATCH; i++) {
+            if (journal_record_valid(&chunk[i]) && chunk[i].type == JOURNAL_REC_STATE &&
+                chunk[i].seq > s_committed_seq) {
+                s_stats.recovered++;
+            }
+        }
+    }
+
+    s_next_seq = head_seq + 1;
+    s_boot_seq = s_next_seq;
+    s_write_pos = have_head ? (head_index + 1) % s_capacity : 0;
+
+    /* A torn write after the head must not be written over: skip to the next sector */
+    journal_record_t next;
+    if (s_write_pos % JOURNAL_RECORDS_PER_SECTOR != 0 &&
+        esp_partition_read(s_partition, s_write_pos * sizeof(journal_record_t), &next, sizeof(next)) == ESP_OK &&
+        !journal_record_erased(&next)) {
+        s_write_pos = ((s_write_pos / JOURNAL_RECORDS_PER_SECTOR) + 1) * JOURNAL_RECORDS_PER_SECTOR % s_capacity;
+    }
+    s_stats.depth = s_stats.recovered;
+    s_stats.max_depth = s_stats.depth;
+
+    ESP_LOGI(TAG, "Journal ready: %lu records, head seq %lu, %lu unreplayed, %lu corrupt",
+        (unsigned long)s_capacity, (unsigned long)head_seq,
+        (unsigned long)s_stats.recovered, (unsigned long)s_stats.corrupt);
+    return ESP_OK;
+}
+
+bool journal_append(int slot_index, bool is_taken, uint32_t fresh_seq) {
+    if (s_partition == NULL) return false;
+
+    journal_record_t rec = {
+        .arg = fresh_seq,
+        .slot_index = (uint16_t)slot_index,
+        .type = JOURNAL_REC_STATE,
+        .state = is_taken ? 1 : 0,
+    };
+    journal_stage(&rec);
+
+    s_stats.appended++;
+    s_stats.depth++;
+    if (s_stats.depth > s_stats.max_depth) {
+        s_stats.max_depth = s_stats.depth;
+    }
+    return true;
+}
+
+void journal_flush(void) {
+    if (s_partition == NULL || s_staged_count == 0) return;
+
+    /* Staged records never cross a sector boundary unless the ring wraps mid-batch */
+    int written = 0;
+    while (written < s_staged_count) {
+        if (s_write_pos % JOURNAL_RECORDS_PER_SECTOR == 0 && journal_prepare_sector(s_write_pos) != ESP_OK) {
+            ESP_LOGE(TAG, "Journal sector erase failed, dropping %d records", s_staged_count - written);
+            break;
+        }
+
+        uint32_t room = JOURNAL_RECORDS_PER_SECTOR - (s_write_pos % JOURNAL_RECORDS_PER_SECTOR);
+        uint32_t n = s_staged_count - written;
+        if (n > room) n = room;
+
+        esp_err_t err = esp_partition_write(s_partition, s_write_pos * sizeof(journal_record_t),
+                                            &s_staged[written], n * sizeof(journal_record_t));
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Journal write failed: %s", esp_err_to_name(err));
+            break;
+        }
+        s_stats.flash_writes++;
+        written += n;
+        s_write_pos = (s_write_pos + n) % s_capacity;
+    }
+    s_staged_count = 0;
+}
+
+uint32_t journal_pending(void) {
+    return s_stats.depth;
+}
+
+/* Fill in one replayed update; the detection time is known while freshness still has it */
+static void journal_replay_update(parking_update_t *update, int slot_index, bool is_taken, uint32_t fresh_seq) {
+    update->spot_id = parking_slot_name(slot_index);
+    update->slot_index = (uint16_t)slot_index;
+    update->is_taken = is_taken;
+    update->seq = fresh_seq;
+    update->detected_us = freshness_detected_us(slot_index, fresh_seq);
+}
+
+/* Send the collected updates; returns false if the server did not take all of them */
+static bool journal_send_chunk(int *count) {
+    if (*count == 0) return true;
+
+    int acked = send_parking_batch(s_replay_updates, *count);
+    bool ok = (acked == *count);
+    if (ok) {
+        s_stats.replay_sent += *count;
+    }
+    *count = 0;
+    return ok;
+}
+
+int journal_replay(void) {
+    if (s_partition == NULL) return 0;
+
+    journal_flush();
+    if (s_stats.depth == 0) return 0;
+
+    int64_t start_us = esp_timer_get_time();
+    memset(s_replay_seen, 0, sizeof(s_replay_seen));
+    memset(s_replay_state, 0, sizeof(s_replay_state));
+
+    /* Walk the ring from its oldest sector: the one after the write position, or the
+     * write position's own when it sits on a boundary, as that sector is not erased
+     * until the next flush and still holds the previous lap */
+    journal_record_t chunk[JOURNAL_WRITE_BATCH];
+    uint32_t start = s_write_pos / JOURNAL_RECORDS_PER_SECTOR * JOURNAL_RECORDS_PER_SECTOR;
+    if (s_write_pos % JOURNAL_RECORDS_PER_SECTOR != 0) {
+        start = (start + JOURNAL_RECORDS_PER_SECTOR) % s_capacity;
+    }
+    uint32_t last_seq = s_committed_seq;
+    uint32_t transitions = 0;
+    int count = 0;
+    bool ok = true;
+
+    for (uint32_t n = 0; n < s_capacity && ok; n += JOURNAL_WRITE_BATCH) {
+        uint32_t index = (start + n) % s_capacity;
+        if (esp_partition_read(s_partition, index * sizeof(journal_record_t), chunk, sizeof(chunk)) != ESP_OK) {
+            return -1;
+        }
+        for (int i = 0; i < JOURNAL_WRITE_BATCH && ok; i++) {
+            journal_record_t *rec = &chunk[i];
+            if (!journal_record_valid(rec) || rec->type != JOURNAL_REC_STATE ||
+                rec->seq <= s_committed_seq || rec->slot_index >= get_total_parking_slots()) {
+                continue;
+            }
+            transitions++;
+            if (rec->seq > last_seq) {
+                last_seq = rec->seq;
+            }
+            uint32_t fresh_seq = rec->seq >= s_boot_seq ? rec->arg : 0;
+
+            if (JOURNAL_REPLAY_HISTORY) {
+                /* Every transition, in order */
+                journal_replay_update(&s_replay_updates[count], rec->slot_index, rec->state, fresh_seq);
+                if (++count == BATCH_MAX_SIZE) {
+                    ok = journal_send_chunk(&count);
+                }
+            } else {
+                /* Later records overwrite earlier ones: final state per slot */
+                uint32_t mask = 1u << (rec->slot_index & 31);
+                s_replay_seen[rec->slot_index >> 5] |= mask;
+                s_replay_fresh_seq[rec->slot_index] = fresh_seq;
+                if (rec->state) {
+                    s_replay_state[rec->slot_index >> 5] |= mask;
+                } else {
+                    s_replay_state[rec->slot_index >> 5] &= ~mask;
+                }
+            }
+        }
+    }
+
+    if (ok && !JOURNAL_REPLAY_HISTORY) {
+        for (int slot = 0; slot < get_total_parking_slots() && ok; slot++) {
+            uint32_t mask = 1u << (slot & 31);
+            if (!(s_replay_seen[slot >> 5] & mask)) continue;
+            journal_replay_update(&s_replay_updates[count], slot, (s_replay_state[slot >> 5] & mask) != 0,
+                s_replay_fresh_seq[slot]);
+            if (++count == BATCH_MAX_SIZE) {
+                ok = journal_send_chunk(&count);
+            }
+        }
+    }
+    if (ok) {
+        ok = journal_send_chunk(&count);
+    }
+    if (!ok) {
+        /* Nothing is committed; already-sent chunks are idempotent and get resent */
+        return -1;
+    }
+
+    journal_record_t commit = {
+        .arg = last_seq,
+        .type = JOURNAL_REC_COMMIT,
+    };
+    journal_stage(&commit);
+    journal_flush();
+    s_committed_seq = last_seq;
+
+    uint32_t elapsed_ms = (uint32_t)((esp_timer_get_time() - start_us) / 1000);
+    s_stats.depth = 0;
+    s_stats.replays++;
+    s_stats.replayed += transitions;
+    s_stats.replay_rate = elapsed_ms ? (uint32_t)((uint64_t)transitions * 1000 / elapsed_ms) : transitions;
+
+    ESP_LOGI(TAG, "Journal replayed %lu transitions in %lu ms", (unsigned long)transitions, (unsigned long)elapsed_ms);
+    return (int)transitions;
+}
+
+void journal_get_stats(journal_stats_t *stats) {
+    if (stats == NULL) return;
+    *stats = s_stats;
+}
+
+void journal_print_stats(void) {
+    journal_stats_t stats;
+    journal_get_stats(&stats);
+
+    ESP_LOGI(TAG, "===== OFFLINE JOURNAL STATS =====");
+    ESP_LOGI(TAG, "Depth: %lu (max %lu), appended: %lu, recovered at boot: %lu",
+        (unsigned long)stats.depth, (unsigned long)stats.max_depth,
+        (unsigned long)stats.appended, (unsigned long)stats.recovered);
+    ESP_LOGI(TAG, "Flash writes: %lu, sector erases: %lu, overwritten: %lu, corrupt: %lu",
+        (unsigned long)stats.flash_writes, (unsigned long)stats.sector_erases,
+        (unsigned long)stats.overwritten, (unsigned long)stats.corrupt);
+    ESP_LOGI(TAG, "Replays: %lu, transitions replayed: %lu, updates sent: %lu, last rate: %lu/s",
+        (unsigned long)stats.replays, (unsigned long)stats.replayed,
+        (unsigned long)stats.replay_sent, (unsigned long)stats.replay_rate);
+}
@@ -0,0 +1,36 @@
+/**
+ * @file journal.h
+ * @brief Store-and-forward flash journal for updates the server did not receive
+ */
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+/* Journal counters */
+typedef struct {
+    uint32_t depth;                 /* Journaled transitions not yet replayed */
+    uint32_t max_depth;             /* Highest depth seen */
+    uint32_t appended;              /* Transitions written since boot */
+    uint32_t recovered;             /* Unreplayed transitions found at boot */
+    uint32_t corrupt;               /* Records skipped at boot because of a bad CRC */
+    uint32_t overwritten;           /* Unreplayed transitions lost to ring wrap-around */
+    uint32_t flash_writes;          /* Batched partition writes */
+    uint32_t sector_erases;         /* Sectors erased */
+    uint32_t replays;               /* Successful replays */
+    uint32_t replayed;              /* Transitions covered by successful replays */
+    uint32_t replay_sent;           /* Slot updates actually sent after compaction */
+    uint32_t replay_rate;           /* Transitions per second of the last replay */
+} journal_stats_t;
+
+esp_err_t journal_init(void);
+bool journal_append(int slot_index, bool is_taken, uint32_t fresh_seq);
+void journal_flush(void);
+int journal_replay(void);
+uint32_t journal_pending(void);
+void journal_get_stats(journal_stats_t *stats);
+void journal_print_stats(void);
+
+#endif /* JOURNAL_H */
@@ -1,21 +1,274 @@
 /**
  * @file led_control.c
  * @brief Implementation of LED control functions
+ *
+ * Three backends share one framebuffer of two bits per slot (red, green):
+ *  - GPIO: one gpio_set_level() per LED pin that changed.
+ *  - Bundle: the discrete LEDs of the first slots sit in a dedicated-GPIO
+ *    bundle and change with a single register write; slots that do not
+ *    fit the bundle fall back to gpio_set_level().
+ *  - Strip: one WS2812 pixel per slot on a single data pin, clocked out by
+ *    RMT. The strip is a shift chain, so a flush sends the pixels up to the
+ *    last changed one and the ones behind it keep their latched colour.
  */
 #include "led_control.h"
 #include "parking_slot.h"
 #include "config.h"
+#include "span_trace.h"
 
 #include "driver/gpio.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+#if LED_BACKEND == LED_BACKEND_BUNDLE
+#include "driver/dedic_gpio.h"
+#elif LED_BACKEND == LED_BACKEND_STRIP
+#include "driver/rmt_tx.h"
+#endif
+#include <string.h>
+
+#define LED_RED 0x1
+#define LED_GREEN 0x2
+
+static uint8_t s_color[MAX_PARKING_SLOTS];              /* Wanted LED_RED | LED_GREEN bits */
+static uint8_t s_shown[MAX_PARKING_SLOTS];              /* Last pushed to the hardware */
+static uint32_t s_dirty[PARKING_SLOT_WORDS];
+static int s_dirty_count = 0;
+static led_control_stats_t s_stats;
+
+#if LED_BACKEND != LED_BACKEND_STRIP
+static void led_gpio_write(int slot_index, uint8_t changed, uint8_t color) {
+    /* For common cathode, a HIGH turns on the LED */
+    if (changed & LED_RED) {
+        gpio_set_level(parking_slots.led_red_pins[slot_index], (color & LED_RED) != 0);
+        s_stats.writes++;
+    }
+    if (changed & LED_GREEN) {
+        gpio_set_level(parking_slots.led_green_pins[slot_index], (color & LED_GREEN) != 0);
+        s_stats.writes++;
+    }
+}
+
+static void led_gpio_init(int slot_index) {
+    gpio_reset_pin(parking_slots.led_red_pins[slot_index]);
+    gpio_set_direction(parking_slots.led_red_pins[slot_index], GPIO_MODE_OUTPUT);
+
+    gpio_reset_pin(parking_slots.led_green_pins[slot_index]);
+    gpio_set_direction(parking_slots.led_green_pins[slot_index], GPIO_MODE_OUTPUT);
+}
+#endif
+
+#if LED_BACKEND == LED_BACKEND_BUNDLE
+
+#define LED_BUNDLE_SLOTS (LED_BUNDLE_MAX_PINS / 2)
+
+/* Slot i drives bundle bits 2i (red) and 2i+1 (green) */
+static dedic_gpio_bundle_handle_t s_bundle = NULL;
+static int s_bundle_slots = 0;
+
+static bool led_backend_start(void) {
+    if (s_bundle != NULL) return true;
+
+    s_bundle_slots = get_total_parking_slots() < LED_BUNDLE_SLOTS ? get_total_parking_slots() : LED_BUNDLE_SLOTS;
+    int pins[LED_BUNDLE_MAX_PINS];
+    for (int i = 0; i < s_bundle_slots; i++) {
+        pins[2 * i] = parking_slots.led_red_pins[i];
+        pins[2 * i + 1] = parking_slots.led_green_pins[i];
+    }
+
+    dedic_gpio_bundle_config_t config = {
+        .gpio_array = pins,
+        .array_size = (size_t)(2 * s_bundle_slots),
+        .flags = {
+            .out_en = 1,
+        },
+    };
+    if (dedic_gpio_new_bundle(&config, &s_bundle) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create LED GPIO bundle");
+        s_bundle = NULL;
+        return false;
+    }
+    ESP_LOGI(TAG, "LED bundle: %d slots on dedicated GPIO", s_bundle_slots);
+    return true;
+}
+
+static bool led_backend_push(void) {
+    uint32_t mask = 0;
+    uint32_t value = 0;
+
+    for (int w = 0; w < PARKING_SLOT_WORDS; w++) {
+        for (uint32_t bits = s_dirty[w]; bits != 0; bits &= bits - 1) {
+            int slot_index = (w << 5) + __builtin_ctz(bits);
+            uint8_t color = s_color[slot_index];
+            uint8_t changed = color ^ s_shown[slot_index];
+
+            if (slot_index < s_bundle_slots) {
+                mask |= (uint32_t)changed << (2 * slot_index);
+                value |= (uint32_t)color << (2 * slot_index);
+            } else {
+                led_gpio_write(slot_index, changed, color);
+            }
+            s_shown[slot_index] = color;
+        }
+    }
+    if (mask != 0) {
+        dedic_gpio_bundle_write(s_bundle, mask, value);
+        s_stats.writes++;
+    }
+    return true;
+}
+
+#elif LED_BACKEND == LED_BACKEND_STRIP
+
+/* WS2812 bit timings */
+#define LED_STRIP_T0H_NS 300
+#define LED_STRIP_T0L_NS 900
+#define LED_STRIP_T1H_NS 900
+#define LED_STRIP_T1L_NS 300
+#define LED_STRIP_TICKS(ns) ((uint32_t)((uint64_t)(ns) * LED_STRIP_RESOLUTION_HZ / 1000000000ULL))
+
+static rmt_channel_handle_t s_strip = NULL;
+static rmt_encoder_handle_t s_strip_encoder = NULL;
+static uint8_t s_pixels[MAX_PARKING_SLOTS * 3];         /* GRB, handed to RMT */
+static bool s_strip_busy = false;
+
+static bool led_backend_start(void) {
+    if (s_strip != NULL) return true;
+
+    /* The C6 RMT has no DMA: the driver refills the channel memory ping-pong from s_pixels */
+    rmt_tx_channel_config_t channel_config = {
+        .gpio_num = LED_STRIP_GPIO,
+        .clk_src = RMT_CLK_SRC_DEFAULT,
+        .resolution_hz = LED_STRIP_RESOLUTION_HZ,
+        .mem_block_symbols = 48,
+        .trans_queue_depth = 1,
+    };
+    rmt_bytes_encoder_config_t encoder_config = {
+        .bit0 = {
+            .level0 = 1,
+            .duration0 = LED_STRIP_TICKS(LED_STRIP_T0H_NS),
+            .level1 = 0,
+            .duration1 = LED_STRIP_TICKS(LED_STRIP_T0L_NS),
+        },
+        .bit1 = {
+            .level0 = 1,
+            .duration0 = LED_STRIP_TICKS(LED_STRIP_T1H_NS),
+            .level1 = 0,
+            .duration1 = LED_STRIP_TICKS(LED_STRIP_T1L_NS),
+        },
+        .flags.msb_first = 1,
+    };
+
+    if (rmt_new_tx_channel(&channel_config, &s_strip) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create LED strip channel");
+        s_strip = NULL;
+        return false;
+    }
+    if (rmt_new_bytes_encoder(&encoder_config, &s_strip_encoder) != ESP_OK || rmt_enable(s_strip) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to set up LED strip encoder");
+        rmt_del_channel(s_strip);
+        s_strip = NULL;
+        return false;
+    }
+    ESP_LOGI(TAG, "LED strip: %d pixels on GPIO %d", get_total_parking_slots(), LED_STRIP_GPIO);
+    return true;
+}
+
+static bool led_backend_push(void) {
+    /* s_pixels belongs to RMT until the previous frame is out */
+    if (s_strip_busy && rmt_tx_wait_all_done(s_strip, LED_STRIP_TIMEOUT_MS) != ESP_OK) {
+        return false;
+    }
+    s_strip_busy = false;
+
+    int last = -1;
+    for (int w = 0; w < PARKING_SLOT_WORDS; w++) {
+        for (uint32_t bits = s_dirty[w]; bits != 0; bits &= bits - 1) {
+            int slot_index = (w << 5) + __builtin_ctz(bits);
+            uint8_t color = s_color[slot_index];
+            uint8_t *pixel = &s_pixels[slot_index * 3];
+            pixel[0] = (color & LED_GREEN) ? LED_STRIP_BRIGHTNESS : 0;
+            pixel[1] = (color & LED_RED) ? LED_STRIP_BRIGHTNESS : 0;
+            pixel[2] = 0;
+            last = slot_index;
+        }
+    }
+
+    rmt_transmit_config_t transmit_config = {
+        .loop_count = 0,
+    };
+    if (rmt_transmit(s_strip, s_strip_encoder, s_pixels, (size_t)(last + 1) * 3, &transmit_config) != ESP_OK) {
+        return false;
+    }
+    s_strip_busy = true;
+    s_stats.writes++;
+
+    for (int w = 0; w < PARKING_SLOT_WORDS; w++) {
+        for (uint32_t bits = s_dirty[w]; bits != 0; bits &= bits - 1) {
+            int slot_index = (w << 5) + __builtin_ctz(bits);
+            s_shown[slot_index] = s_color[slot_index];
+        }
+    }
+    return true;
+}
+
+#else
+
+static bool led_backend_start(void) {
+    return true;
+}
+
+static bool led_backend_push(void) {
+    for (int w = 0; w < PARKING_SLOT_WORDS; w++) {
+        for (uint32_t bits = s_dirty[w]; bits != 0; bits &= bits - 1) {
+            int slot_index = (w << 5) + __builtin_ctz(bits);
+            led_gpio_write(slot_index, s_color[slot_index] ^ s_shown[slot_index], s_color[slot_index]);
+            s_shown[slot_index] = s_color[slot_index];
+        }
+    }
+    return true;
+}
+
+#endif
+
+void led_control_add(int slot_index) {
+    if (slot_index >= get_total_parking_slots()) return;
+
+#if LED_BACKEND == LED_BACKEND_BUNDLE
+    if (slot_index >= LED_BUNDLE_MAX_PINS / 2) {
+        led_gpio_init(slot_index);
+    }
+#elif LED_BACKEND == LED_BACKEND_GPIO
+    led_gpio_init(slot_index);
+#endif
+
+    /* Start dark; the first flush writes every slot */
+    s_color[slot_index] = 0;
+    s_shown[slot_index] = LED_RED | LED_GREEN;
+    if (!(s_dirty[slot_index >> 5] & (1u << (slot_index & 31)))) {
+        s_dirty[slot_index >> 5] |= 1u << (slot_index & 31);
+        s_dirty_count++;
+    }
+}
 
 void set_led_color(int slot_index, bool red, bool green) {
     if (slot_index >= get_total_parking_slots()) return;
-    
-    /* For common cathode, a HIGH turns on the LED */
-    gpio_set_level(parking_slots[slot_index].led_red_pin, red);
-    gpio_set_level(parking_slots[slot_index].led_green_pin, green);
-    
+
+    uint8_t color = (red ? LED_RED : 0) | (green ? LED_GREEN : 0);
+    if (color == s_color[slot_index]) return;
+    s_color[slot_index] = color;
+
+    uint32_t bit = 1u << (slot_index & 31);
+    if (color == s_shown[slot_index]) {
+        /* Changed back before a flush: nothing to push */
+        if (s_dirty[slot_index >> 5] & bit) {
+            s_dirty[slot_index >> 5] &= ~bit;
+            s_dirty_count--;
+        }
+    } else if (!(s_dirty[slot_index >> 5] & bit)) {
+        s_dirty[slot_index >> 5] |= bit;
+        s_dirty_count++;
+    }
+
     if (red && green) {
         ESP_LOGD(TAG, "Slot %d: LED set to INVALID", slot_index);
     } else if (red) {
@@ -25,4 +278,42 @@ void set_led_color(int slot_index, bool red, bool green) {
     } else {
         ESP_LOGD(TAG, "Slot %d: LED turned OFF", slot_index);
     }
-}
\ No newline at end of file
+}
+
+void led_flush(void) {
+    if (s_dirty_count == 0 || !led_backend_start()) return;
+
+    span_t span = SPAN_START();
+    int64_t start_us = esp_timer_get_time();
+
+    if (!led_backend_push()) {
+        /* Strip frame still going out or not sent; keep the changes for the next flush */
+        return;
+    }
+
+    s_stats.flushes++;
+    s_stats.pixels += (uint32_t)s_dirty_count;
+    memset(s_dirty, 0, sizeof(s_dirty));
+    s_dirty_count = 0;
+
+    s_stats.last_flush_us = (uint32_t)(esp_timer_get_time() - start_us);
+    if (s_stats.last_flush_us > s_stats.max_flush_us) {
+        s_stats.max_flush_us = s_stats.last_flush_us;
+    }
+    SPAN_END(SPAN_STAGE_LED, span);
+}
+
+void led_control_get_stats(led_control_stats_t *stats) {
+    if (stats == NULL) return;
+    *stats = s_stats;
+}
+
+void led_control_print_stats(void) {
+    led_control_stats_t stats;
+    led_control_get_stats(&stats);
+
+    ESP_LOGI(TAG, "===== LED STATS =====");
+    ESP_LOGI(TAG, "Flushes: %lu, pixels changed: %lu, backend writes: %lu",
+        (unsigned long)stats.flushes, (unsigned long)stats.pixels, (unsigned long)stats.writes);
+    ESP_LOGI(TAG, "Flush time last/max: %lu/%lu us", (unsigned long)stats.last_flush_us, (unsigned long)stats.max_flush_us);
+}
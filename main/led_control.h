@@ -1,12 +1,30 @@
 /**
  * @file led_control.h
  * @brief Functions for controlling LED indicators
+ *
+ * set_led_color() only updates a per-slot framebuffer; led_flush() pushes
+ * the slots that changed since the last flush to the configured backend
+ * (LED_BACKEND in config.h).
  */
 #ifndef LED_CONTROL_H
 #define LED_CONTROL_H
 
 #include <stdbool.h>
+#include <stdint.h>
 
+/* Output counters */
+typedef struct {
+    uint32_t flushes;           /* led_flush() calls that had changes to push */
+    uint32_t pixels;            /* Slot indicators changed */
+    uint32_t writes;            /* Backend writes: GPIO levels, bundle writes or strip frames */
+    uint32_t last_flush_us;     /* Time spent in the most recent flush */
+    uint32_t max_flush_us;
+} led_control_stats_t;
+
+void led_control_add(int slot_index);
 void set_led_color(int slot_index, bool red, bool green);
+void led_flush(void);
+void led_control_get_stats(led_control_stats_t *stats);
+void led_control_print_stats(void);
 
-#endif /* LED_CONTROL_H */
\ No newline at end of file
+#endif /* LED_CONTROL_H */
@@ -5,15 +5,67 @@
 #include "config.h"
 #include "parking_slot.h"
 #include "ultrasonic_sensor.h"
+#include "sensor_backend.h"
 #include "led_control.h"
 #include "wifi_manager.h"
 #include "http_client.h"
+#include "upload_queue.h"
+#include "scan_scheduler.h"
+#include "journal.h"
+#include "mem_telemetry.h"
+#include "heap_soak.h"
+#include "span_trace.h"
+#include "console.h"
+#include "state_stream.h"
+#include "tls_session.h"
+#include "snapshot.h"
+#include "snapshot_server.h"
+#include "occupancy_history.h"
+#include "freshness.h"
+#include "gateway.h"
+#include "gateway_link.h"
 
 #include "esp_log.h"
+#include "esp_pm.h"
 #include "nvs_flash.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 
+/* A node on ESP-NOW has no IP link; all it reports goes through the gateway */
+#define NODE_RADIO_ONLY (WIRE_MODE == WIRE_MODE_GATEWAY && GATEWAY_TRANSPORT == GATEWAY_TRANSPORT_ESPNOW)
+
+/* Per-slot status and every module's counters, on demand from the console */
+static void print_stats(void) {
+    for (int i = 0; i < get_total_parking_slots(); i++) {
+        print_slot_status(i);
+    }
+
+    wifi_manager_print_stats();
+    led_control_print_stats();
+    http_client_print_stats();
+    tls_session_print_stats();
+    snapshot_print_stats();
+    snapshot_server_print_stats();
+    upload_queue_print_stats();
+    journal_print_stats();
+    ultrasonic_sensor_print_stats();
+    sensor_backend_print_stats();
+    scan_scheduler_print_stats();
+    mem_telemetry_print_stats();
+    span_trace_print_stats();
+    occupancy_history_print_stats();
+    freshness_print_stats();
+#if WIRE_MODE == WIRE_MODE_STREAM
+    state_stream_print_stats();
+#endif
+#if WIRE_MODE == WIRE_MODE_GATEWAY
+    gateway_link_print_stats();
+#endif
+#if GATEWAY_ENABLED
+    gateway_print_stats();
+#endif
+}
+
 void app_main() {
     ESP_LOGI(TAG, "Initializing parking system...");
     esp_log_level_set("esp-tls", ESP_LOG_DEBUG);
@@ -28,37 +80,104 @@ void app_main() {
     }
     ESP_ERROR_CHECK(ret);
 
+#if CONFIG_PM_ENABLE
+    /* Scale the clock down and light-sleep whenever no PM lock is held;
+     * the scan timer holds one while it runs and drops it between scans */
+    esp_pm_config_t pm_config = {
+        .max_freq_mhz = PM_MAX_FREQ_MHZ,
+        .min_freq_mhz = PM_MIN_FREQ_MHZ,
+        .light_sleep_enable = PM_LIGHT_SLEEP_ENABLED,
+    };
+    ESP_ERROR_CHECK(esp_pm_configure(&pm_config));
+#endif
+
+    /* Heap samples and latency spans are kept in RAM and read out from the console */
+    mem_telemetry_init();
+    heap_soak_init();
+    span_trace_init();
+    freshness_init();
+    snapshot_init();
+    console_register(STATS_COMMAND, print_stats);
+    console_start();
+
+#if NODE_RADIO_ONLY
+    /* Only the radio: updates go to the gateway over ESP-NOW */
+    wifi_init_radio(GATEWAY_CHANNEL);
+#else
     /* Initialize WiFi connection */
     ESP_LOGI(TAG, "Connecting to WiFi...");
     wifi_init_sta();
+    /* Updates carry unix timestamps once this syncs */
+    freshness_sync_time();
+#endif
+
+#if WIRE_MODE == WIRE_MODE_GATEWAY
+    /* Updates go to the gateway, which holds the HTTPS session */
+    gateway_link_init();
+#else
+    /* Open the long-lived HTTPS session used for all updates */
+    http_client_init();
+#endif
+
+#if GATEWAY_ENABLED
+    /* Take node frames and forward them over this controller's session */
+    gateway_init();
+#endif
+
+    /* Recover the offline journal before the network task starts using it */
+    journal_init();
+
+    /* Start the network task that drains state changes to the server */
+    upload_queue_init();
+
+    /* Initialize the configured sensor backend */
+    sensor_backend_init();
+
+    /* Load slot definitions from NVS, falling back to the compiled-in table */
+    int total_slots = load_parking_slots();
+
+    /* Pick up the occupancy history kept in RTC memory, or start a new one */
+    occupancy_history_init();
 
     /* Initialize all parking slots */
-    int total_slots = get_total_parking_slots();
     for (int i = 0; i < total_slots; i++) {
         init_parking_slot(i);
     }
 
     ESP_LOGI(TAG, "Parking system initialized with %d slots", total_slots);
 
-    /* Take initial measurements for all slots */
+    /* Serve the slot snapshot to local displays */
+    snapshot_server_start();
+
+    /* Take initial measurements for all slots, one at a time */
     for (int i = 0; i < total_slots; i++) {
         measure_distance(i);
-        vTaskDelay(pdMS_TO_TICKS(500));
+        vTaskDelay(pdMS_TO_TICKS(SCAN_GROUP_PERIOD_MS));
     }
 
     /* Send one-time initial status to server */
     send_initial_status();
 
-    /* Main monitoring loop */
-    while (1) {
-        for (int i = 0; i < total_slots; i++) {
-            measure_distance(i);
-            print_slot_status(i);
-            /* Introduce small delay between sensors to avoid interference */
-            vTaskDelay(pdMS_TO_TICKS(500));
-        }
+    /* Hand sensing over to the timer-driven scan scheduler */
+    scan_scheduler_start();
 
+    /* Main monitoring loop: reporting only, sensing runs in the scan task */
+#if STATS_PRINT_INTERVAL_MS
+    TickType_t stats_printed = xTaskGetTickCount();
+#endif
+    while (1) {
         print_parking_summary();
+#if STATS_PRINT_INTERVAL_MS
+        if (xTaskGetTickCount() - stats_printed >= pdMS_TO_TICKS(STATS_PRINT_INTERVAL_MS)) {
+            stats_printed = xTaskGetTickCount();
+            print_stats();
+        }
+#endif
+#if !NODE_RADIO_ONLY
+        span_trace_upload_if_due();
+        occupancy_history_upload_if_due();
+        freshness_heartbeat_if_due();
+#endif
 
         vTaskDelay(pdMS_TO_TICKS(UPDATE_INTERVAL_SEC));
     }
@@ -0,0 +1,167 @@
+/**
+ * @file mem_telemetry.c
+ * @brief Implementation of the heap sample ring
+ *
+ * A sample costs two counter reads and a 24-byte copy. The heap walk that
+ * yields the allocated total and the largest free block runs at most once
+ * per MEM_TELEMETRY_WALK_PERIOD_MS; in between, the allocated total is
+ * carried forward from the free-heap delta and the largest block is
+ * reused from the last walk. While streaming is enabled every sample is
+ * also printed as it is recorded, for runs longer than the ring.
+ */
+#include "mem_telemetry.h"
+#include "config.h"
+#include "console.h"
+
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_system.h"
+#include "freertos/FreeRTOS.h"
+#include <stdio.h>
+
+static const char *const s_event_names[MEM_EVENT_COUNT] = {
+    [MEM_EVENT_WIFI_INIT_BEFORE] = "Before WiFi init",
+    [MEM_EVENT_WIFI_INIT_AFTER] = "After WiFi init",
+    [MEM_EVENT_HTTP_BEFORE] = "Before HTTP request",
+    [MEM_EVENT_HTTP_AFTER] = "After HTTP request",
+    [MEM_EVENT_SOAK_CHECKPOINT] = "Soak checkpoint",
+};
+
+static mem_sample_t s_ring[MEM_TELEMETRY_RING_SIZE];
+static uint32_t s_head;                 /* Next slot to write */
+static mem_telemetry_stats_t s_stats;
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/* Results of the last heap walk */
+static bool s_walked;
+static uint32_t s_walk_ms;
+static uint32_t s_walk_free;
+static uint32_t s_walk_allocated;
+static uint32_t s_walk_largest;
+
+static bool s_stream;
+
+/* Same schema as reports/memory_parking_system.csv */
+static void mem_telemetry_print_header(void) {
+    printf("tag,timestamp,event,free_heap,min_free_heap,total_allocated_bytes,total_free_bytes,largest_free_block\n");
+}
+
+static void mem_telemetry_print_sample(const mem_sample_t *sample) {
+    const char *name = sample->event < MEM_EVENT_COUNT ? s_event_names[sample->event] : "Unknown";
+    printf("MEMLOG,%lu,%s,%lu,%lu,%lu,%lu,%lu\n",
+        (unsigned long)sample->timestamp_ms,
+        name,
+        (unsigned long)sample->free_heap,
+        (unsigned long)sample->min_free_heap,
+        (unsigned long)sample->allocated,
+        (unsigned long)sample->free_heap,
+        (unsigned long)sample->largest_block);
+}
+
+static void mem_telemetry_record(mem_event_t event, bool force_walk, mem_sample_t *out) {
+    mem_sample_t sample = {
+        .timestamp_ms = esp_log_timestamp(),
+        .free_heap = esp_get_free_heap_size(),
+        .min_free_heap = esp_get_minimum_free_heap_size(),
+        .event = (uint8_t)event,
+    };
+
+    /* The walk itself runs outside the lock; a rare concurrent double walk is harmless */
+    bool walk = force_walk || !s_walked || sample.timestamp_ms - s_walk_ms >= MEM_TELEMETRY_WALK_PERIOD_MS;
+    multi_heap_info_t info;
+    if (walk) {
+        heap_caps_get_info(&info, MALLOC_CAP_DEFAULT);
+    }
+
+    portENTER_CRITICAL(&s_lock);
+    if (walk) {
+        s_walk_ms = sample.timestamp_ms;
+        s_walk_free = (uint32_t)info.total_free_bytes;
+        s_walk_allocated = (uint32_t)info.total_allocated_bytes;
+        s_walk_largest = (uint32_t)info.largest_free_block;
+        s_walked = true;
+        sample.flags |= MEM_SAMPLE_WALKED;
+        s_stats.walks++;
+    }
+
+    /* Heap size is fixed, so whatever left the free pool is now allocated */
+    int64_t allocated = (int64_t)s_walk_allocated + s_walk_free - sample.free_heap;
+    sample.allocated = allocated > 0 ? (uint32_t)allocated : 0;
+    sample.largest_block = s_walk_largest < sample.free_heap ? s_walk_largest : sample.free_heap;
+
+    s_ring[s_head] = sample;
+    s_head = (s_head + 1) % MEM_TELEMETRY_RING_SIZE;
+    if (s_stats.depth < MEM_TELEMETRY_RING_SIZE) {
+        s_stats.depth++;
+    } else {
+        s_stats.overwritten++;
+    }
+    s_stats.samples++;
+    portEXIT_CRITICAL(&s_lock);
+
+    if (s_stream) {
+        mem_telemetry_print_sample(&sample);
+    }
+    if (out) {
+        *out = sample;
+    }
+}
+
+void mem_telemetry_sample(mem_event_t event) {
+    mem_telemetry_record(event, false, NULL);
+}
+
+void mem_telemetry_sample_walked(mem_event_t event, mem_sample_t *sample) {
+    mem_telemetry_record(event, true, sample);
+}
+
+void mem_telemetry_set_stream(bool enabled) {
+    if (enabled && !s_stream) {
+        mem_telemetry_print_header();
+    }
+    s_stream = enabled;
+    if (!enabled) {
+        fflush(stdout);
+    }
+}
+
+void mem_telemetry_dump(void) {
+    portENTER_CRITICAL(&s_lock);
+    uint32_t depth = s_stats.depth;
+    uint32_t first = (s_head + MEM_TELEMETRY_RING_SIZE - depth) % MEM_TELEMETRY_RING_SIZE;
+    portEXIT_CRITICAL(&s_lock);
+
+    mem_telemetry_print_header();
+    for (uint32_t i = 0; i < depth; i++) {
+        mem_sample_t sample;
+        portENTER_CRITICAL(&s_lock);
+        sample = s_ring[(first + i) % MEM_TELEMETRY_RING_SIZE];
+        portEXIT_CRITICAL(&s_lock);
+        mem_telemetry_print_sample(&sample);
+    }
+    fflush(stdout);
+}
+
+void mem_telemetry_init(void) {
+    console_register(MEM_TELEMETRY_DUMP_COMMAND, mem_telemetry_dump);
+}
+
+void mem_telemetry_get_stats(mem_telemetry_stats_t *stats) {
+    if (stats == NULL) return;
+
+    portENTER_CRITICAL(&s_lock);
+    *stats = s_stats;
+    portEXIT_CRITICAL(&s_lock);
+}
+
+void mem_telemetry_print_stats(void) {
+    mem_telemetry_stats_t stats;
+    mem_telemetry_get_stats(&stats);
+
+    ESP_LOGI(TAG, "===== MEMORY TELEMETRY =====");
+    ESP_LOGI(TAG, "Samples: %lu (held %lu/%d, overwritten %lu), heap walks: %lu",
+        (unsigned long)stats.samples, (unsigned long)stats.depth, MEM_TELEMETRY_RING_SIZE,
+        (unsigned long)stats.overwritten, (unsigned long)stats.walks);
+    ESP_LOGI(TAG, "Free heap: %lu bytes (min %lu)",
+        (unsigned long)esp_get_free_heap_size(), (unsigned long)esp_get_minimum_free_heap_size());
+}
@@ -0,0 +1,53 @@
+/**
+ * @file mem_telemetry.h
+ * @brief Binary ring of heap samples, dumped as MEMLOG CSV on demand
+ */
+#ifndef MEM_TELEMETRY_H
+#define MEM_TELEMETRY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Sampling points; names match the event column of the MEMLOG CSV */
+typedef enum {
+    MEM_EVENT_WIFI_INIT_BEFORE = 0,     /* "Before WiFi init" */
+    MEM_EVENT_WIFI_INIT_AFTER,          /* "After WiFi init" */
+    MEM_EVENT_HTTP_BEFORE,              /* "Before HTTP request" */
+    MEM_EVENT_HTTP_AFTER,               /* "After HTTP request" */
+    MEM_EVENT_SOAK_CHECKPOINT,          /* "Soak checkpoint" */
+    MEM_EVENT_COUNT,
+} mem_event_t;
+
+/* One heap sample as stored in the ring (24 bytes) */
+typedef struct {
+    uint32_t timestamp_ms;      /* esp_log_timestamp() at sampling time */
+    uint32_t free_heap;         /* Free heap, also the total_free_bytes column */
+    uint32_t min_free_heap;     /* Low-water mark since boot */
+    uint32_t allocated;         /* Total allocated bytes */
+    uint32_t largest_block;     /* Largest free block as of the last heap walk */
+    uint8_t event;              /* mem_event_t */
+    uint8_t flags;              /* MEM_SAMPLE_* */
+    uint16_t reserved;
+} mem_sample_t;
+
+#define MEM_SAMPLE_WALKED 0x01  /* allocated/largest_block come from a fresh heap walk */
+
+/* Counters for the telemetry ring */
+typedef struct {
+    uint32_t samples;           /* Samples recorded since boot */
+    uint32_t walks;             /* heap_caps_get_info() walks performed */
+    uint32_t overwritten;       /* Samples lost to ring wrap-around before a dump */
+    uint32_t depth;             /* Samples currently held */
+} mem_telemetry_stats_t;
+
+void mem_telemetry_init(void);
+void mem_telemetry_sample(mem_event_t event);
+/* Sample with a fresh heap walk and return the recorded values */
+void mem_telemetry_sample_walked(mem_event_t event, mem_sample_t *sample);
+void mem_telemetry_dump(void);
+/* Also print every new sample as a MEMLOG line while enabled (header on enable) */
+void mem_telemetry_set_stream(bool enabled);
+void mem_telemetry_get_stats(mem_telemetry_stats_t *stats);
+void mem_telemetry_print_stats(void);
+
+#endif /* MEM_TELEMETRY_H */
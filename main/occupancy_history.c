@@ -0,0 +1,382 @@
+/**
+ * @file occupancy_history.c
+ * @brief Implementation of the occupancy history store
+ *
+ * A transition is two varints: the seconds since the previous transition
+ * (any slot) shifted left by one with the new state in bit 0, then the slot
+ * index. A few seconds to minutes apart that is 2-3 bytes. The ring evicts
+ * whole transitions from its head and keeps the time just before the oldest
+ * one, so it always decodes to absolute times.
+ *
+ * The window aggregates are integrals updated at each transition: occupied
+ * and known slot-seconds grow by the current counts times the time since the
+ * last update. A summary covers the window since the last acknowledged one;
+ * what it reported is subtracted on success, so transitions recorded during
+ * the POST land in the next window.
+ */
+#include "occupancy_history.h"
+#include "parking_slot.h"
+#include "config.h"
+#include "console.h"
+#include "http_client.h"
+
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include <stdio.h>
+#include <string.h>
+
+#define HISTORY_MAGIC 0x4F485354    /* "OHST" */
+#define HISTORY_RECORD_MAX 7        /* 5-byte time varint, 2-byte slot varint */
+
+typedef struct {
+    uint32_t magic;
+    uint32_t size;                              /* sizeof(history_store_t), catches layout changes */
+    uint16_t slot_count;                        /* Slot table the store was built for */
+    uint16_t known;                             /* Slots with a known state */
+    uint16_t occupied;                          /* Slots occupied now */
+    uint16_t peak;                              /* Window peak of occupied */
+    uint32_t clock_s;                           /* History clock at the last update */
+    uint32_t window_start_s;
+    uint32_t arrivals;
+    uint32_t departures;
+    uint32_t dwell_count;
+    uint64_t dwell_total_s;
+    uint64_t occupied_area;                     /* Occupied slot-seconds in the window */
+    uint64_t known_area;                        /* Known slot-seconds in the window */
+    uint32_t recorded;
+    uint32_t evicted;
+    uint32_t events;                            /* Transitions in the ring */
+    uint32_t base_s;                            /* Time just before the oldest transition */
+    uint32_t last_s;                            /* Time of the newest transition */
+    uint16_t head;                              /* Oldest byte */
+    uint16_t used;                              /* Bytes in use */
+    uint32_t since_s[MAX_PARKING_SLOTS];        /* Start of each slot's current state */
+    uint32_t known_bits[PARKING_SLOT_WORDS];
+    uint32_t occupied_bits[PARKING_SLOT_WORDS];
+    uint8_t ring[HISTORY_RING_BYTES];
+} history_store_t;
+
+/* Survives deep sleep and software resets; validated at boot, since it is not cleared at power-on */
+static RTC_NOINIT_ATTR history_store_t s_store;
+
+static SemaphoreHandle_t s_lock = NULL;
+static StaticSemaphore_t s_lock_buffer;
+static uint32_t s_clock_offset_s = 0;       /* History time at this boot's esp_timer zero */
+static occupancy_history_stats_t s_stats;
+
+static inline bool history_bit(const uint32_t *bits, int slot_index) {
+    return (bits[slot_index >> 5] >> (slot_index & 31)) & 1;
+}
+
+static inline void history_set_bit(uint32_t *bits, int slot_index, bool value) {
+    uint32_t mask = 1u << (slot_index & 31);
+    if (value) {
+        bits[slot_index >> 5] |= mask;
+    } else {
+        bits[slot_index >> 5] &= ~mask;
+    }
+}
+
+static uint32_t history_clock_s(void) {
+    return s_clock_offset_s + (uint32_t)(esp_timer_get_time() / 1000000);
+}
+
+static bool history_store_valid(int slot_count) {
+    return s_store.magic == HISTORY_MAGIC && s_store.size == sizeof(history_store_t) &&
+           s_store.slot_count == slot_count && s_store.head < HISTORY_RING_BYTES &&
+           s_store.used <= HISTORY_RING_BYTES && s_store.known <= slot_count &&
+           s_store.occupied <= s_store.known;
+}
+
+/* ----- Ring ----- */
+
+static int history_varint_len(uint32_t value) {
+    int len = 1;
+    while (value >= 0x80) {
+        value >>= 7;
+        len++;
+    }
+    return len;
+}
+
+static void history_put_varint(uint32_t value) {
+    uint16_t pos = (uint16_t)((s_store.head + s_store.used) % HISTORY_RING_BYTES);
+    do {
+        uint8_t byte = value & 0x7F;
+        value >>= 7;
+        s_store.ring[pos] = byte | (value ? 0x80 : 0);
+        pos = (pos + 1) % HISTORY_RING_BYTES;
+        s_store.used++;
+    } while (value);
+}
+
+/* Decode at *pos and advance it; *len counts the bytes read */
+static uint32_t history_get_varint(const uint8_t *ring, uint16_t *pos, uint16_t *len) {
+    uint32_t value = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        uint8_t byte = ring[*pos];
+        *pos = (*pos + 1) % HISTORY_RING_BYTES;
+        (*len)++;
+        value |= (uint32_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) break;
+    }
+    return value;
+}
+
+static void history_evict_oldest(void) {
+    uint16_t pos = s_store.head;
+    uint16_t len = 0;
+    uint32_t delta = history_get_varint(s_store.ring, &pos, &len);
+    history_get_varint(s_store.ring, &pos, &len);
+
+    s_store.head = pos;
+    s_store.used -= len;
+    s_store.base_s += delta >> 1;
+    s_store.events--;
+    s_store.evicted++;
+}
+
+static void history_append(int slot_index, bool occupied, uint32_t now_s) {
+    uint32_t delta = now_s - s_store.last_s;
+    if (delta > (UINT32_MAX >> 1)) delta = UINT32_MAX >> 1;
+
+    uint32_t word = (delta << 1) | (occupied ? 1 : 0);
+    int need = history_varint_len(word) + history_varint_len((uint32_t)slot_index);
+    while (s_store.used + need > HISTORY_RING_BYTES) {
+        history_evict_oldest();
+    }
+    history_put_varint(word);
+    history_put_varint((uint32_t)slot_index);
+    s_store.last_s += delta;
+    s_store.events++;
+    s_store.recorded++;
+}
+
+/* ----- Aggregates ----- */
+
+/* Integrate the counts up to now */
+static void history_advance(uint32_t now_s) {
+    if (now_s <= s_store.clock_s) return;
+    uint32_t elapsed_s = now_s - s_store.clock_s;
+    s_store.occupied_area += (uint64_t)s_store.occupied * elapsed_s;
+    s_store.known_area += (uint64_t)s_store.known * elapsed_s;
+    s_store.clock_s = now_s;
+}
+
+static void history_reset(int slot_count, uint32_t now_s) {
+    memset(&s_store, 0, sizeof(s_store));
+    s_store.magic = HISTORY_MAGIC;
+    s_store.size = sizeof(history_store_t);
+    s_store.slot_count = (uint16_t)slot_count;
+    s_store.clock_s = now_s;
+    s_store.window_start_s = now_s;
+    s_store.base_s = now_s;
+    s_store.last_s = now_s;
+}
+
+void occupancy_history_init(void) {
+    if (s_lock != NULL) return;
+    s_lock = xSemaphoreCreateMutexStatic(&s_lock_buffer);
+
+    int slot_count = get_total_parking_slots();
+    s_stats.restored = history_store_valid(slot_count);
+    if (s_stats.restored) {
+        /* Carry on from the last checkpoint; this boot's uptime counts from there */
+        s_clock_offset_s = s_store.clock_s - (uint32_t)(esp_timer_get_time() / 1000000);
+        ESP_LOGI(TAG, "Occupancy history restored: %lu transitions, window of %lu s",
+            (unsigned long)s_store.events, (unsigned long)(s_store.clock_s - s_store.window_start_s));
+    } else {
+        s_clock_offset_s = 0;
+        history_reset(slot_count, history_clock_s());
+    }
+    console_register(HISTORY_COMMAND, occupancy_history_print_stats);
+}
+
+void occupancy_history_record(int slot_index, bool occupied) {
+    if (s_lock == NULL || slot_index < 0 || slot_index >= s_store.slot_count) return;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    bool known = history_bit(s_store.known_bits, slot_index);
+    bool was_occupied = history_bit(s_store.occupied_bits, slot_index);
+    if (known && was_occupied == occupied) {
+        /* Same state as before a reset, or a repeat */
+        xSemaphoreGive(s_lock);
+        return;
+    }
+
+    uint32_t now_s = history_clock_s();
+    history_advance(now_s);
+
+    if (!known) {
+        history_set_bit(s_store.known_bits, slot_index, true);
+        s_store.known++;
+    } else if (was_occupied) {
+        s_store.departures++;
+        s_store.dwell_count++;
+        s_store.dwell_total_s += now_s - s_store.since_s[slot_index];
+        s_store.occupied--;
+    } else {
+        s_store.arrivals++;
+    }
+    if (occupied) {
+        s_store.occupied++;
+        if (s_store.occupied > s_store.peak) {
+            s_store.peak = s_store.occupied;
+        }
+    }
+    history_set_bit(s_store.occupied_bits, slot_index, occupied);
+    s_store.since_s[slot_index] = now_s;
+
+    history_append(slot_index, occupied, now_s);
+    xSemaphoreGive(s_lock);
+}
+
+uint32_t occupancy_history_now_s(void) {
+    return history_clock_s();
+}
+
+static void history_summary_locked(occupancy_summary_t *summary) {
+    history_advance(history_clock_s());
+
+    memset(summary, 0, sizeof(*summary));
+    summary->window_s = s_store.clock_s - s_store.window_start_s;
+    summary->slots = s_store.known;
+    summary->occupied = s_store.occupied;
+    summary->peak = s_store.peak;
+    summary->arrivals = s_store.arrivals;
+    summary->departures = s_store.departures;
+    summary->occupancy_permille = s_store.known_area
+        ? (uint32_t)(s_store.occupied_area * 1000 / s_store.known_area)
+        : (s_store.known ? (uint32_t)s_store.occupied * 1000 / s_store.known : 0);
+    summary->dwell_count = s_store.dwell_count;
+    summary->mean_dwell_s = s_store.dwell_count ? (uint32_t)(s_store.dwell_total_s / s_store.dwell_count) : 0;
+}
+
+void occupancy_history_get_summary(occupancy_summary_t *summary) {
+    if (summary == NULL) return;
+    if (s_lock == NULL) {
+        memset(summary, 0, sizeof(*summary));
+        return;
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    history_summary_locked(summary);
+    xSemaphoreGive(s_lock);
+}
+
+int occupancy_history_foreach(occupancy_history_visitor_t visitor, void *ctx) {
+    if (s_lock == NULL || visitor == NULL) return 0;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    uint16_t pos = s_store.head;
+    uint16_t read = 0;
+    uint32_t time_s = s_store.base_s;
+    int count = 0;
+    while (read < s_store.used) {
+        uint32_t word = history_get_varint(s_store.ring, &pos, &read);
+        int slot_index = (int)history_get_varint(s_store.ring, &pos, &read);
+        time_s += word >> 1;
+        visitor(slot_index, word & 1, time_s, ctx);
+        count++;
+    }
+    xSemaphoreGive(s_lock);
+    return count;
+}
+
+bool occupancy_history_upload(void) {
+    if (s_lock == NULL) return false;
+
+    /* Window counters and areas as reported, subtracted once the server has them */
+    occupancy_summary_t summary;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    history_summary_locked(&summary);
+    uint32_t end_s = s_store.clock_s;
+    uint64_t occupied_area = s_store.occupied_area;
+    uint64_t known_area = s_store.known_area;
+    uint64_t dwell_total_s = s_store.dwell_total_s;
+    uint32_t evicted = s_store.evicted;
+    uint32_t events = s_store.events;
+    xSemaphoreGive(s_lock);
+
+    static char body[256];
+    snprintf(body, sizeof(body),
+        "{\"window_s\":%lu,\"slots\":%u,\"occupied\":%u,\"peak\":%u,\"occupancy_permille\":%lu,"
+        "\"arrivals\":%lu,\"departures\":%lu,\"dwell_count\":%lu,\"mean_dwell_s\":%lu,"
+        "\"history\":%lu,\"evicted\":%lu}",
+        (unsigned long)summary.window_s, summary.slots, summary.occupied, summary.peak,
+        (unsigned long)summary.occupancy_permille, (unsigned long)summary.arrivals,
+        (unsigned long)summary.departures, (unsigned long)summary.dwell_count,
+        (unsigned long)summary.mean_dwell_s, (unsigned long)events, (unsigned long)evicted);
+
+    int status_code = http_client_post(HISTORY_ENDPOINT, body);
+    if (status_code < 200 || status_code >= 300) {
+        s_stats.upload_failures++;
+        ESP_LOGW(TAG, "Occupancy summary upload failed (%d), keeping the window open", status_code);
+        return false;
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    s_store.window_start_s = end_s;
+    s_store.arrivals -= summary.arrivals;
+    s_store.departures -= summary.departures;
+    s_store.dwell_count -= summary.dwell_count;
+    s_store.dwell_total_s -= dwell_total_s;
+    s_store.occupied_area -= occupied_area;
+    s_store.known_area -= known_area;
+    s_store.peak = s_store.occupied;
+    xSemaphoreGive(s_lock);
+    s_stats.uploads++;
+    return true;
+}
+
+void occupancy_history_upload_if_due(void) {
+    if (s_lock == NULL) return;
+
+    /* Also checkpoints the clock, so a reset continues from about here */
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    history_advance(history_clock_s());
+    bool due = s_store.clock_s - s_store.window_start_s >= HISTORY_SUMMARY_INTERVAL_MS / 1000;
+    xSemaphoreGive(s_lock);
+
+    if (due) {
+        occupancy_history_upload();
+    }
+}
+
+void occupancy_history_get_stats(occupancy_history_stats_t *stats) {
+    if (stats == NULL) return;
+    *stats = s_stats;
+    if (s_lock == NULL) return;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    stats->events = s_store.events;
+    stats->ring_bytes = s_store.used;
+    stats->recorded = s_store.recorded;
+    stats->evicted = s_store.evicted;
+    xSemaphoreGive(s_lock);
+}
+
+void occupancy_history_print_stats(void) {
+    occupancy_history_stats_t stats;
+    occupancy_summary_t summary;
+    occupancy_history_get_stats(&stats);
+    occupancy_history_get_summary(&summary);
+
+    uint32_t per_hour_x10 = summary.window_s ? (uint32_t)((uint64_t)summary.arrivals * 36000 / summary.window_s) : 0;
+
+    ESP_LOGI(TAG, "===== OCCUPANCY HISTORY =====");
+    ESP_LOGI(TAG, "Store: %s, %lu transitions in %lu of %u bytes, recorded %lu, evicted %lu",
+        stats.restored ? "restored" : "new", (unsigned long)stats.events, (unsigned long)stats.ring_bytes,
+        HISTORY_RING_BYTES, (unsigned long)stats.recorded, (unsigned long)stats.evicted);
+    ESP_LOGI(TAG, "Window %lu s: occupancy %lu.%lu%%, peak %u of %u, arrivals %lu (%lu.%lu/h), "
+        "mean dwell %lu s over %lu stays",
+        (unsigned long)summary.window_s, (unsigned long)(summary.occupancy_permille / 10),
+        (unsigned long)(summary.occupancy_permille % 10), summary.peak, summary.slots,
+        (unsigned long)summary.arrivals, (unsigned long)(per_hour_x10 / 10), (unsigned long)(per_hour_x10 % 10),
+        (unsigned long)summary.mean_dwell_s, (unsigned long)summary.dwell_count);
+    ESP_LOGI(TAG, "Summaries sent: %lu, failed: %lu", (unsigned long)stats.uploads,
+        (unsigned long)stats.upload_failures);
+}
@@ -0,0 +1,53 @@
+/**
+ * @file occupancy_history.h
+ * @brief Transition history and occupancy aggregates kept in RTC memory
+ *
+ * Every committed slot state goes into a delta-encoded ring of fixed size
+ * and updates the running aggregates of the current summary window, so a
+ * summary never replays the ring. Both live in RTC memory and carry over a
+ * deep sleep or a software reset; the history clock counts seconds and
+ * continues from its last checkpoint, so time spent asleep is not counted.
+ */
+#ifndef OCCUPANCY_HISTORY_H
+#define OCCUPANCY_HISTORY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Aggregates of one summary window */
+typedef struct {
+    uint32_t window_s;              /* Length of the window so far */
+    uint16_t slots;                 /* Slots with a known state */
+    uint16_t occupied;              /* Slots occupied now */
+    uint16_t peak;                  /* Most slots occupied at once in the window */
+    uint32_t arrivals;              /* Free -> occupied transitions */
+    uint32_t departures;            /* Occupied -> free transitions */
+    uint32_t occupancy_permille;    /* Occupied slot-seconds per known slot-second */
+    uint32_t dwell_count;           /* Stays that ended in the window */
+    uint32_t mean_dwell_s;          /* Mean length of those stays */
+} occupancy_summary_t;
+
+typedef struct {
+    bool restored;                  /* The store survived the last reset or deep sleep */
+    uint32_t events;                /* Transitions held in the ring */
+    uint32_t ring_bytes;            /* Ring bytes in use */
+    uint32_t recorded;              /* Transitions recorded since the store was created */
+    uint32_t evicted;               /* Oldest transitions dropped to make room */
+    uint32_t uploads;               /* Summaries the server acknowledged */
+    uint32_t upload_failures;       /* Summaries that will be retried with a longer window */
+} occupancy_history_stats_t;
+
+/* Called oldest first with each transition's absolute history time */
+typedef void (*occupancy_history_visitor_t)(int slot_index, bool occupied, uint32_t time_s, void *ctx);
+
+void occupancy_history_init(void);
+void occupancy_history_record(int slot_index, bool occupied);
+uint32_t occupancy_history_now_s(void);
+void occupancy_history_get_summary(occupancy_summary_t *summary);
+int occupancy_history_foreach(occupancy_history_visitor_t visitor, void *ctx);
+bool occupancy_history_upload(void);
+void occupancy_history_upload_if_due(void);
+void occupancy_history_get_stats(occupancy_history_stats_t *stats);
+void occupancy_history_print_stats(void);
+
+#endif /* OCCUPANCY_HISTORY_H */
@@ -4,162 +4,396 @@
  */
 #include "parking_slot.h"
 #include "config.h"
-#include "ultrasonic_sensor.h"
+#include "sensor_backend.h"
 #include "led_control.h"
-#include "http_client.h"
+#include "upload_queue.h"
+#include "snapshot.h"
+#include "occupancy_history.h"
+#include "freshness.h"
+#include "span_trace.h"
 
 #include "esp_log.h"
-#include "driver/gpio.h"
+#include "nvs.h"
 #include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include <stdlib.h>
+#include <string.h>
 
-/* Slot configuration array */
-const parking_slot_t parking_slots_config[] = {
-    {"Slot1", 5, 18, 8, 9, 0, false, false},   /* Slot 1 */
-    {"Slot2", 19, 21, 4, 6, 0, false, false},  /* Slot 2 */
+/* Compiled-in slot definitions, used when nothing is provisioned in NVS.
+ * Neighbouring sensors go in different scan groups. */
+static const parking_slot_def_t parking_slot_defaults[] = {
+    {"Slot1", 5, 18, 8, 9, 0},      /* Slot 1 */
+    {"Slot2", 19, 21, 4, 6, 1},     /* Slot 2 */
 };
 
-/* Runtime slot state array */
-parking_slot_t parking_slots[MAX_PARKING_SLOTS];
+/* Runtime slot table */
+parking_slot_table_t parking_slots;
+
+#define SLOT_FILTER_KNOWN   0x01    /* A state has been committed since boot */
+#define SLOT_FILTER_PENDING 0x02    /* A transition is waiting out the dwell time */
+
+/* Per-slot median ring and hysteresis state, in echo microseconds */
+typedef struct {
+    uint16_t samples[PARKING_MEDIAN_WINDOW];
+    uint8_t next;                   /* Ring write position */
+    uint8_t count;                  /* Samples in the ring */
+    uint8_t invalid_streak;         /* Consecutive out-of-range echoes */
+    uint8_t flags;                  /* SLOT_FILTER_* */
+    uint32_t pending_since_ms;      /* When the pending transition was first seen */
+} slot_filter_t;
+
+/* Settle margins in echo microseconds */
+#define SLOT_ACTIVE_LOW_US ULTRASONIC_CM_TO_ECHO_US(PARKING_THRESHOLD - SCAN_ACTIVE_BAND_CM)
+#define SLOT_ACTIVE_HIGH_US ULTRASONIC_CM_TO_ECHO_US(PARKING_THRESHOLD + PARKING_HYSTERESIS_CM + SCAN_ACTIVE_BAND_CM)
+#define SLOT_ACTIVE_CHANGE_US ULTRASONIC_CM_TO_ECHO_US(SCAN_ACTIVE_CHANGE_CM)
+#define SLOT_PREWARM_BAND_US ULTRASONIC_CM_TO_ECHO_US(PREWARM_BAND_CM)
+
+static slot_filter_t s_filters[MAX_PARKING_SLOTS];
+static parking_filter_stats_t s_filter_stats;
 
 int get_total_parking_slots(void) {
-    return sizeof(parking_slots_config) / sizeof(parking_slot_t);
+    return parking_slots.count;
+}
+
+/* Summary counter for a (valid, occupied) combination */
+static int *slot_state_counter(bool is_valid, bool is_occupied) {
+    if (!is_valid) return &parking_slots.invalid_count;
+    return is_occupied ? &parking_slots.occupied_count : &parking_slots.available_count;
+}
+
+/* Update the state bits and keep the summary counters in step, O(1) per transition */
+static void set_slot_state(int slot_index, bool is_valid, bool is_occupied) {
+    bool was_valid = parking_slot_is_valid(slot_index);
+    bool was_occupied = parking_slot_is_occupied(slot_index);
+    if (was_valid == is_valid && was_occupied == is_occupied) return;
+
+    (*slot_state_counter(was_valid, was_occupied))--;
+    (*slot_state_counter(is_valid, is_occupied))++;
+
+    uint32_t mask = 1u << (slot_index & 31);
+    int word = slot_index >> 5;
+    if (is_valid) {
+        parking_slots.valid_bits[word] |= mask;
+    } else {
+        parking_slots.valid_bits[word] &= ~mask;
+    }
+    if (is_occupied) {
+        parking_slots.occupied_bits[word] |= mask;
+    } else {
+        parking_slots.occupied_bits[word] &= ~mask;
+    }
+    snapshot_mark_changed();
+}
+
+bool parking_slot_name_is_clean(const char *name, size_t len) {
+    for (size_t i = 0; i < len && name[i] != '\0'; i++) {
+        if ((unsigned char)name[i] < 0x20) return false;
+    }
+    return true;
+}
+
+/* Replace control characters, which JSON would need six bytes for; returns how many */
+static int slot_name_clean(char *name) {
+    int replaced = 0;
+    for (char *p = name; *p; p++) {
+        if ((unsigned char)*p < 0x20) {
+            *p = '_';
+            replaced++;
+        }
+    }
+    return replaced;
+}
+
+int load_parking_slots(void) {
+    const parking_slot_def_t *defs = parking_slot_defaults;
+    int count = sizeof(parking_slot_defaults) / sizeof(parking_slot_def_t);
+    parking_slot_def_t *loaded = NULL;
+
+    /* Prefer the slot table provisioned in NVS */
+    nvs_handle_t handle;
+    if (nvs_open(SLOT_NVS_NAMESPACE, NVS_READONLY, &handle) == ESP_OK) {
+        size_t size = 0;
+        esp_err_t err = nvs_get_blob(handle, SLOT_NVS_KEY, NULL, &size);
+        if (err == ESP_OK && size > 0 && size % sizeof(parking_slot_def_t) == 0 &&
+            size / sizeof(parking_slot_def_t) <= MAX_PARKING_SLOTS) {
+            loaded = malloc(size);
+            if (loaded != NULL && nvs_get_blob(handle, SLOT_NVS_KEY, loaded, &size) == ESP_OK) {
+                defs = loaded;
+                count = size / sizeof(parking_slot_def_t);
+            }
+        } else if (err == ESP_OK) {
+            ESP_LOGE(TAG, "Ignoring malformed slot table in NVS (%u bytes)", (unsigned)size);
+        }
+        nvs_close(handle);
+    }
+
+    memset(&parking_slots, 0, sizeof(parking_slots));
+    memset(s_filters, 0, sizeof(s_filters));
+    for (int i = 0; i < count; i++) {
+        memcpy(parking_slots.slot_names[i], defs[i].slot_name, PARKING_SLOT_NAME_LEN);
+        parking_slots.slot_names[i][PARKING_SLOT_NAME_LEN - 1] = '\0';
+        if (slot_name_clean(parking_slots.slot_names[i]) > 0) {
+            ESP_LOGW(TAG, "Slot %d name had control characters, now \"%s\"", i, parking_slots.slot_names[i]);
+        }
+        parking_slots.trig_pins[i] = defs[i].trig_pin;
+        parking_slots.echo_pins[i] = defs[i].echo_pin;
+        parking_slots.led_red_pins[i] = defs[i].led_red_pin;
+        parking_slots.led_green_pins[i] = defs[i].led_green_pin;
+        parking_slots.scan_groups[i] = defs[i].scan_group;
+    }
+    parking_slots.count = count;
+    parking_slots.invalid_count = count; /* No reading yet */
+    snapshot_mark_changed();
+
+    ESP_LOGI(TAG, "Loaded %d parking slots from %s", count, (defs == loaded) ? "NVS" : "defaults");
+    free(loaded);
+    return count;
+}
+
+esp_err_t save_parking_slots(const parking_slot_def_t *defs, int count) {
+    if (defs == NULL || count <= 0 || count > MAX_PARKING_SLOTS) return ESP_ERR_INVALID_ARG;
+
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(SLOT_NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (err != ESP_OK) return err;
+
+    err = nvs_set_blob(handle, SLOT_NVS_KEY, defs, count * sizeof(parking_slot_def_t));
+    if (err == ESP_OK) {
+        err = nvs_commit(handle);
+    }
+    nvs_close(handle);
+    return err;
 }
 
 void init_parking_slot(int slot_index) {
     if (slot_index >= get_total_parking_slots()) return;
 
-    /* Copy the configuration into the runtime state */
-    parking_slots[slot_index] = parking_slots_config[slot_index];
+    /* Register the sensor with the configured backend */
+    sensor_backend_add(slot_index,
+        parking_slots.trig_pins[slot_index],
+        parking_slots.echo_pins[slot_index]);
+
+    /* Register the indicator; it starts dark and is written on the first flush */
+    led_control_add(slot_index);
+}
+
+void measure_distance(int slot_index) {
+    if (slot_index >= get_total_parking_slots()) return;
+
+    span_t span = SPAN_START();
 
-    /* Initialize the ultrasonic sensor pins */
-    gpio_reset_pin(parking_slots[slot_index].trig_pin);
-    gpio_set_direction(parking_slots[slot_index].trig_pin, GPIO_MODE_OUTPUT);
+    /* Get the echo time from the sensor backend; a timeout reads as 0 us (invalid) */
+    ultrasonic_reading_t reading;
+    uint32_t echo_us = 0;
+    if (sensor_backend_measure(slot_index, &reading)) {
+        echo_us = reading.echo_us;
+        SPAN_RECORD(SPAN_STAGE_ECHO, (uint32_t)(reading.done_us - reading.trigger_us));
+    }
+
+    process_echo(slot_index, echo_us);
+    led_flush();
+    SPAN_END(SPAN_STAGE_MEASURE, span);
+}
 
-    gpio_reset_pin(parking_slots[slot_index].echo_pin);
-    gpio_set_direction(parking_slots[slot_index].echo_pin, GPIO_MODE_INPUT);
+/* Median of the filter window; insertion sort on at most PARKING_MEDIAN_WINDOW samples */
+static uint16_t slot_filter_median(const slot_filter_t *filter) {
+    uint16_t sorted[PARKING_MEDIAN_WINDOW];
+    int n = filter->count;
 
-    /* Initialize the LED pins */
-    gpio_reset_pin(parking_slots[slot_index].led_red_pin);
-    gpio_set_direction(parking_slots[slot_index].led_red_pin, GPIO_MODE_OUTPUT);
-    
-    gpio_reset_pin(parking_slots[slot_index].led_green_pin);
-    gpio_set_direction(parking_slots[slot_index].led_green_pin, GPIO_MODE_OUTPUT);
-    
-    /* Turn off all LEDs initially */
-    set_led_color(slot_index, false, false);
+    for (int i = 0; i < n; i++) {
+        uint16_t value = filter->samples[i];
+        int j = i;
+        while (j > 0 && sorted[j - 1] > value) {
+            sorted[j] = sorted[j - 1];
+            j--;
+        }
+        sorted[j] = value;
+    }
+    return sorted[n / 2];
 }
 
-void measure_distance(int slot_index) {
+/* A car pulling in or backing out: the newest sample is already past the edge
+ * the median would cross, or within PREWARM_BAND_CM of it and a real step
+ * closer than the previous sample */
+static bool slot_filter_approaching(const slot_filter_t *filter, uint32_t echo_us, bool occupied) {
+    if (!(filter->flags & SLOT_FILTER_KNOWN) || filter->count == 0) return false;
+
+    uint32_t prev_us = filter->samples[(filter->next + PARKING_MEDIAN_WINDOW - 1) % PARKING_MEDIAN_WINDOW];
+    if (occupied) {
+        if (echo_us > PARKING_EXIT_ECHO_US) return true;
+        return echo_us + SLOT_PREWARM_BAND_US > PARKING_EXIT_ECHO_US && echo_us >= prev_us + SLOT_ACTIVE_CHANGE_US;
+    }
+    if (echo_us < PARKING_ENTER_ECHO_US) return true;
+    return echo_us < PARKING_ENTER_ECHO_US + SLOT_PREWARM_BAND_US && echo_us + SLOT_ACTIVE_CHANGE_US <= prev_us;
+}
+
+void process_echo(int slot_index, uint32_t echo_us) {
     if (slot_index >= get_total_parking_slots()) return;
 
-    int trig_pin = parking_slots[slot_index].trig_pin;
-    int echo_pin = parking_slots[slot_index].echo_pin;
-    
-    /* Get the distance measurement from the ultrasonic sensor */
-    float distance = measure_ultrasonic_distance(trig_pin, echo_pin);
-    parking_slots[slot_index].distance = distance;
-    
-    /* Store the previous state for change detection */
-    bool previous_state = parking_slots[slot_index].is_occupied;
-
-    /* Validate the reading */
-    if (distance > 400 || distance < 2) {
-        parking_slots[slot_index].is_valid = false;
-    } else {
-        parking_slots[slot_index].is_valid = true;
-        parking_slots[slot_index].is_occupied = (distance < PARKING_THRESHOLD);
+    span_t span = SPAN_START();
+    slot_filter_t *filter = &s_filters[slot_index];
+    bool previous_state = parking_slot_is_occupied(slot_index);
+    bool was_valid = parking_slot_is_valid(slot_index);
+
+    /* Validate the reading against precomputed echo-time bounds */
+    if (echo_us < PARKING_MIN_ECHO_US || echo_us > PARKING_MAX_ECHO_US) {
+        /* Only a run of bad echoes marks the sensor invalid; the last occupancy is kept */
+        if (filter->invalid_streak < UINT8_MAX) {
+            filter->invalid_streak++;
+        }
+        if (filter->invalid_streak >= PARKING_INVALID_READINGS) {
+            set_slot_state(slot_index, false, previous_state);
+        }
+        SPAN_END(SPAN_STAGE_FILTER, span);
+        return;
+    }
+    filter->invalid_streak = 0;
+
+    /* Open the upload connection while the filter is still confirming the change */
+    if (slot_filter_approaching(filter, echo_us, previous_state)) {
+        upload_queue_prewarm();
+    }
+
+    /* Push into the per-slot ring and take the median */
+    filter->samples[filter->next] = (uint16_t)echo_us;
+    filter->next = (filter->next + 1) % PARKING_MEDIAN_WINDOW;
+    if (filter->count < PARKING_MEDIAN_WINDOW) {
+        filter->count++;
+    }
+    uint16_t median_us = slot_filter_median(filter);
+    parking_slots.echo_us[slot_index] = median_us;
+
+    /* Enter/exit hysteresis around the threshold */
+    bool desired = previous_state
+        ? (median_us <= PARKING_EXIT_ECHO_US)
+        : (median_us < PARKING_ENTER_ECHO_US);
+
+    bool is_occupied = previous_state;
+    uint32_t now_ms = (uint32_t)(esp_timer_get_time() / 1000);
+    uint32_t detected_ms = now_ms;
+
+    if (!(filter->flags & SLOT_FILTER_KNOWN)) {
+        /* First good reading after boot is committed straight away */
+        filter->flags |= SLOT_FILTER_KNOWN;
+        is_occupied = desired;
+    } else if (desired == previous_state) {
+        if (filter->flags & SLOT_FILTER_PENDING) {
+            /* Candidate transition did not last the dwell time */
+            s_filter_stats.rejected++;
+            filter->flags &= ~SLOT_FILTER_PENDING;
+        }
+    } else if (!(filter->flags & SLOT_FILTER_PENDING)) {
+        filter->flags |= SLOT_FILTER_PENDING;
+        filter->pending_since_ms = now_ms;
+    } else if (now_ms - filter->pending_since_ms >= PARKING_DWELL_MS) {
+        filter->flags &= ~SLOT_FILTER_PENDING;
+        is_occupied = desired;
+        /* The car got there when the filter first saw it, not after the dwell */
+        detected_ms = filter->pending_since_ms;
     }
 
-    /* Update the LED state based on parking slot occupancy */
-    if (parking_slots[slot_index].is_valid) {
-        if (parking_slots[slot_index].is_occupied) {
+    SPAN_END(SPAN_STAGE_FILTER, span);
+    set_slot_state(slot_index, true, is_occupied);
+
+    /* Update the LED state and the history when the slot state changed */
+    if (!was_valid || previous_state != is_occupied) {
+        occupancy_history_record(slot_index, is_occupied);
+        if (is_occupied) {
             /* Occupied - glow RED */
             set_led_color(slot_index, true, false);
         } else {
             /* Available - glow GREEN */
             set_led_color(slot_index, false, true);
         }
+    }
 
-        /* If state changed, send update to server */
-        if (previous_state != parking_slots[slot_index].is_occupied) {
-            ESP_LOGI(TAG, "%s status changed: %s -> %s", 
-                parking_slots[slot_index].slot_name,
-                previous_state ? "OCCUPIED" : "AVAILABLE",
-                parking_slots[slot_index].is_occupied ? "OCCUPIED" : "AVAILABLE");
-
-            bool update_success = send_parking_update(
-                parking_slots[slot_index].slot_name, 
-                parking_slots[slot_index].is_occupied
-            );
-            
-            if (update_success) {
-                ESP_LOGI(TAG, "Server update successful for %s", parking_slots[slot_index].slot_name);
-            } else {
-                ESP_LOGE(TAG, "Failed to update server for %s", parking_slots[slot_index].slot_name);
-            }
-        }
+    /* If state changed, hand the update to the network task */
+    if (previous_state != is_occupied) {
+        s_filter_stats.committed++;
+        ESP_LOGI(TAG, "%s status changed: %s -> %s", 
+            parking_slot_name(slot_index),
+            previous_state ? "OCCUPIED" : "AVAILABLE",
+            is_occupied ? "OCCUPIED" : "AVAILABLE");
+
+        freshness_commit(slot_index, detected_ms);
+        upload_queue_enqueue(slot_index, is_occupied);
     }
 }
 
+/* A slot is settled when its filter is full, nothing is pending, the median is
+ * clear of the hysteresis band and the newest sample agrees with the median */
+bool parking_slot_is_settled(int slot_index) {
+    if (slot_index >= get_total_parking_slots()) return true;
+
+    const slot_filter_t *filter = &s_filters[slot_index];
+    if (!(filter->flags & SLOT_FILTER_KNOWN) || (filter->flags & SLOT_FILTER_PENDING) ||
+        filter->invalid_streak > 0 || filter->count < PARKING_MEDIAN_WINDOW) {
+        return false;
+    }
+
+    uint16_t median_us = parking_slots.echo_us[slot_index];
+    if (median_us >= SLOT_ACTIVE_LOW_US && median_us <= SLOT_ACTIVE_HIGH_US) {
+        return false;
+    }
+
+    uint16_t newest_us = filter->samples[(filter->next + PARKING_MEDIAN_WINDOW - 1) % PARKING_MEDIAN_WINDOW];
+    uint16_t delta_us = (newest_us > median_us) ? newest_us - median_us : median_us - newest_us;
+    return delta_us <= SLOT_ACTIVE_CHANGE_US;
+}
+
 void print_slot_status(int slot_index) {
     if (slot_index >= get_total_parking_slots()) return;
 
-    ESP_LOGI(TAG, "Parking status for %s: ", parking_slots[slot_index].slot_name);
+    ESP_LOGI(TAG, "Parking status for %s: ", parking_slot_name(slot_index));
 
-    if (!parking_slots[slot_index].is_valid) {
+    if (!parking_slot_is_valid(slot_index)) {
         ESP_LOGE(TAG, "ERROR! Invalid reading");
     } else {        
-        if (parking_slots[slot_index].is_occupied) {
+        if (parking_slot_is_occupied(slot_index)) {
             ESP_LOGI(TAG, "OCCUPIED");
         } else {
             ESP_LOGI(TAG, "AVAILABLE");
         }
-        ESP_LOGI(TAG, "Distance: %.2f cm", parking_slots[slot_index].distance);
+        uint32_t distance_mm = ultrasonic_echo_to_mm(parking_slots.echo_us[slot_index]);
+        ESP_LOGI(TAG, "Distance: %lu.%lu cm", (unsigned long)(distance_mm / 10), (unsigned long)(distance_mm % 10));
     }
     ESP_LOGI(TAG, "\n\n");
 }
 
 void print_parking_summary(void) {
-    int occupied = 0;
-    int available = 0;
-    int invalid = 0;
+    /* Totals are maintained on every transition, no rescan needed */
+    int occupied = parking_slots.occupied_count;
+    int available = parking_slots.available_count;
+    int invalid = parking_slots.invalid_count;
     int total = get_total_parking_slots();
 
-    for (int i = 0; i < total; i++) {
-        if (!parking_slots[i].is_valid) {
-            invalid++;
-        } else if (parking_slots[i].is_occupied) {
-            occupied++;
-        } else {
-            available++;
-        }
-    }
-
     ESP_LOGI(TAG, "\n\n===== PARKING SUMMARY =====");
     ESP_LOGI(TAG, "Total slots: %d", total);
     ESP_LOGI(TAG, "Occupied: %d", occupied);
     ESP_LOGI(TAG, "Available: %d", available);
     ESP_LOGI(TAG, "Sensors with errors: %d", invalid);
+    ESP_LOGI(TAG, "Transitions committed: %lu, rejected by filter: %lu",
+        (unsigned long)s_filter_stats.committed, (unsigned long)s_filter_stats.rejected);
     ESP_LOGI(TAG, "===========================\n\n");
 }
 
+void get_parking_filter_stats(parking_filter_stats_t *stats) {
+    if (stats == NULL) return;
+    *stats = s_filter_stats;
+}
+
 void send_initial_status(void) {
     ESP_LOGI(TAG, "Sending initial status for all parking slots");
 
     for (int i = 0; i < get_total_parking_slots(); i++) {
-        if (parking_slots[i].is_valid) {
-            bool update_success = send_parking_update(
-                parking_slots[i].slot_name, 
-                parking_slots[i].is_occupied
-            );
-
-            if (update_success) {
-                ESP_LOGI(TAG, "Initial update successful for %s", parking_slots[i].slot_name);
-            } else {
-                ESP_LOGE(TAG, "Failed to send initial update for %s", parking_slots[i].slot_name);
+        if (parking_slot_is_valid(i)) {
+            if (!upload_queue_enqueue(i, parking_slot_is_occupied(i))) {
+                ESP_LOGE(TAG, "Failed to queue initial update for %s", parking_slot_name(i));
             }
         }
     }
+
+    /* Send everything collected above as one request */
+    upload_queue_flush();
 }
\ No newline at end of file
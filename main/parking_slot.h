@@ -6,27 +6,73 @@
 #define PARKING_SLOT_H
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "config.h"
 
+#define PARKING_SLOT_WORDS ((MAX_PARKING_SLOTS + 31) / 32)
+
+/* Slot definition as provisioned in NVS (and in the compiled-in defaults) */
+typedef struct __attribute__((packed)) {
+    char slot_name[PARKING_SLOT_NAME_LEN];  /* Parking slot name, NUL-terminated */
+    uint8_t trig_pin;                       /* GPIO pin connected to TRIG (see SENSOR_BACKEND) */
+    uint8_t echo_pin;                       /* GPIO pin connected to ECHO (see SENSOR_BACKEND) */
+    uint8_t led_red_pin;                    /* GPIO pin for RED */
+    uint8_t led_green_pin;                  /* GPIO pin for GREEN */
+    uint8_t scan_group;                     /* Interference group: slots in one group fire together */
+} parking_slot_def_t;
+
+/* Runtime slot table: one array per field, hot state packed into bitsets */
+typedef struct {
+    int count;                                              /* Slots loaded */
+    char slot_names[MAX_PARKING_SLOTS][PARKING_SLOT_NAME_LEN];
+    uint8_t trig_pins[MAX_PARKING_SLOTS];
+    uint8_t echo_pins[MAX_PARKING_SLOTS];
+    uint8_t led_red_pins[MAX_PARKING_SLOTS];
+    uint8_t led_green_pins[MAX_PARKING_SLOTS];
+    uint8_t scan_groups[MAX_PARKING_SLOTS];
+    uint16_t echo_us[MAX_PARKING_SLOTS];                    /* Last filtered echo time */
+    uint32_t occupied_bits[PARKING_SLOT_WORDS];             /* Current slot status */
+    uint32_t valid_bits[PARKING_SLOT_WORDS];                /* Whether last reading was valid */
+    int occupied_count;                                     /* Valid and occupied */
+    int available_count;                                    /* Valid and free */
+    int invalid_count;                                      /* Last reading invalid */
+} parking_slot_table_t;
+
+/* Occupancy filter counters */
 typedef struct {
-    char* slot_name;    /* Parking slot name */
-    int trig_pin;       /* GPIO pin connected to TRIG */
-    int echo_pin;       /* GPIO pin connected to ECHO */
-    int led_red_pin;    /* GPIO pin for RED */
-    int led_green_pin;  /* GPIO pin for GREEN */
-    float distance;     /* Last measured distance */
-    bool is_occupied;   /* Current slot status */
-    bool is_valid;      /* Whether last reading was valid */
-} parking_slot_t;
+    uint32_t committed;     /* Transitions that survived the median, hysteresis and dwell */
+    uint32_t rejected;      /* Candidate transitions dropped before the dwell time passed */
+} parking_filter_stats_t;
+
+extern parking_slot_table_t parking_slots;
+
+static inline bool parking_slot_is_occupied(int slot_index) {
+    return (parking_slots.occupied_bits[slot_index >> 5] >> (slot_index & 31)) & 1;
+}
 
-extern parking_slot_t parking_slots[];
+static inline bool parking_slot_is_valid(int slot_index) {
+    return (parking_slots.valid_bits[slot_index >> 5] >> (slot_index & 31)) & 1;
+}
 
-extern const parking_slot_t parking_slots_config[];
+static inline const char *parking_slot_name(int slot_index) {
+    return parking_slots.slot_names[slot_index];
+}
 
+/* Slot names must hold no control characters: JSON bodies are sized for names whose only
+ * escapes are quotes and backslashes (HTTP_JSON_ESCAPED_MAX) */
+bool parking_slot_name_is_clean(const char *name, size_t len);
+int load_parking_slots(void);
+esp_err_t save_parking_slots(const parking_slot_def_t *defs, int count);
 void init_parking_slot(int slot_index);
 void measure_distance(int slot_index);
+void process_echo(int slot_index, uint32_t echo_us);
+bool parking_slot_is_settled(int slot_index);
 void print_slot_status(int slot_index);
 void print_parking_summary(void);
 void send_initial_status(void);
 int get_total_parking_slots(void);
+void get_parking_filter_stats(parking_filter_stats_t *stats);
 
-#endif /* PARKING_SLOT_H */
\ No newline at end of file
+#endif /* PARKING_SLOT_H */
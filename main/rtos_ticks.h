@@ -0,0 +1,18 @@
+/**
+ * @file rtos_ticks.h
+ * @brief Millisecond deadlines for blocking FreeRTOS calls
+ */
+#ifndef RTOS_TICKS_H
+#define RTOS_TICKS_H
+
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+
+/* Ticks to block so that at least ms pass: pdMS_TO_TICKS() rounds down and the
+ * current tick is already partly over, so round up and add one. 0 stays a poll. */
+static inline TickType_t rtos_ticks_at_least(uint32_t ms) {
+    if (ms == 0) return 0;
+    return (TickType_t)(((uint64_t)ms * CONFIG_FREERTOS_HZ + 999) / 1000) + 1;
+}
+
+#endif /* RTOS_TICKS_H */
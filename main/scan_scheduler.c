@@ -0,0 +1,354 @@
+/**
+ * @file scan_scheduler.c
+ * @brief Implementation of the timer-driven scan scheduler
+ *
+ * Slots are split into interference groups by their scan_group field. A
+ * hardware timer fires every SCAN_GROUP_PERIOD_MS; on each tick the scan
+ * task collects the echoes of the previous group and triggers all sensors
+ * of the next group at once. Sensors that are far apart share a group,
+ * neighbours sit in different groups and are therefore staggered.
+ *
+ * Sampling is adaptive: a slot that reads stable backs off exponentially
+ * (SCAN_BACKOFF_BASE_MS doubling up to SCAN_BACKOFF_MAX_MS), one near the
+ * threshold or changing is sampled on every pass. Groups with no slot due
+ * are skipped, so active slots get shorter passes. When nothing is due for
+ * SCAN_IDLE_MIN_MS the timer is disabled, which releases its PM lock and
+ * lets the chip light-sleep until the next slot is due.
+ */
+#include "scan_scheduler.h"
+#include "parking_slot.h"
+#include "led_control.h"
+#include "sensor_backend.h"
+#include "upload_queue.h"
+#include "rtos_ticks.h"
+#include "span_trace.h"
+#include "config.h"
+
+#include "esp_log.h"
+#include "esp_attr.h"
+#include "esp_timer.h"
+#include "driver/gptimer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#define SCAN_GROUP_PERIOD_US ((uint64_t)SCAN_GROUP_PERIOD_MS * 1000)
+
+/* Slot indices ordered by group; group g owns s_group_slots[s_group_start[g] .. s_group_start[g + 1]) */
+static int s_group_slots[MAX_PARKING_SLOTS];
+static int s_group_start[SCAN_MAX_GROUPS + 1];
+static int s_group_count = 0;
+static int s_scan_ids[MAX_PARKING_SLOTS];       /* Sensors started on one tick */
+
+static TaskHandle_t s_scan_task = NULL;
+static StaticTask_t s_scan_task_buffer;
+static StackType_t s_scan_task_stack[SCAN_TASK_STACK_SIZE];
+static gptimer_handle_t s_timer = NULL;
+static scan_scheduler_stats_t s_stats;
+static uint64_t s_jitter_total_us = 0;
+static uint32_t s_jitter_samples = 0;
+
+/* Per-slot adaptive schedule */
+static uint32_t s_next_due_ms[MAX_PARKING_SLOTS];
+static uint8_t s_backoff[MAX_PARKING_SLOTS];    /* 0 = every pass, n = BASE << (n - 1) */
+static uint8_t s_resume[MAX_PARKING_SLOTS];     /* Backoff to return to after an outlier, 0 = none */
+#if SCAN_ADAPTIVE_ENABLED
+static bool s_resume_occupied[MAX_PARKING_SLOTS];
+#endif
+
+static bool IRAM_ATTR scan_timer_on_alarm(gptimer_handle_t timer, const gptimer_alarm_event_data_t *edata, void *user_ctx) {
+    BaseType_t higher_priority_woken = pdFALSE;
+    vTaskNotifyGiveFromISR(s_scan_task, &higher_priority_woken);
+    return higher_priority_woken == pdTRUE;
+}
+
+/* Bucket slots by scan_group, clamping out-of-range groups into the last one */
+static void scan_build_groups(void) {
+    int total = get_total_parking_slots();
+    int max_group = 0;
+
+    for (int i = 0; i < total; i++) {
+        int group = parking_slots.scan_groups[i];
+        if (group >= SCAN_MAX_GROUPS) group = SCAN_MAX_GROUPS - 1;
+        if (group > max_group) max_group = group;
+    }
+    s_group_count = (total > 0) ? max_group + 1 : 0;
+
+    int pos = 0;
+    for (int g = 0; g < s_group_count; g++) {
+        s_group_start[g] = pos;
+        for (int i = 0; i < total; i++) {
+            int group = parking_slots.scan_groups[i];
+            if (group >= SCAN_MAX_GROUPS) group = SCAN_MAX_GROUPS - 1;
+            if (group == g) {
+                s_group_slots[pos++] = i;
+            }
+        }
+    }
+    s_group_start[s_group_count] = pos;
+}
+
+/* Push a slot's next sample out while it stays settled, pull it in as soon as it is not.
+ * A lone outlier that leaves the state unchanged returns the slot to its old gap;
+ * a slot that did change climbs back from the shortest gap. */
+static void scan_reschedule(int slot_index, uint32_t now_ms) {
+#if SCAN_ADAPTIVE_ENABLED
+    uint8_t backoff = s_backoff[slot_index];
+    bool occupied = parking_slot_is_occupied(slot_index);
+
+    if (!parking_slot_is_settled(slot_index)) {
+        if (backoff > 0) {
+            s_resume[slot_index] = backoff;
+            s_resume_occupied[slot_index] = occupied;
+        }
+        backoff = 0;
+    } else if (s_resume[slot_index] > 0) {
+        if (s_resume_occupied[slot_index] == occupied) {
+            backoff = s_resume[slot_index];
+        }
+        s_resume[slot_index] = 0;
+    } else if ((SCAN_BACKOFF_BASE_MS << backoff) <= SCAN_BACKOFF_MAX_MS) {
+        backoff++;
+    }
+    s_backoff[slot_index] = backoff;
+
+    if (backoff == 0) {
+        s_next_due_ms[slot_index] = now_ms;
+        return;
+    }
+    /* Align to multiples of the gap so settled slots come due together and
+     * the idle time between bursts is long enough to sleep through */
+    uint32_t gap_ms = SCAN_BACKOFF_BASE_MS << (backoff - 1);
+    if (gap_ms > SCAN_BACKOFF_MAX_MS) gap_ms = SCAN_BACKOFF_MAX_MS;
+    s_next_due_ms[slot_index] = (now_ms / gap_ms + 1) * gap_ms;
+#endif
+}
+
+static bool scan_slot_due(int slot_index, uint32_t now_ms) {
+    return (int32_t)(now_ms - s_next_due_ms[slot_index]) >= 0;
+}
+
+/* Feed the readings the backend has completed (echo or timeout) to the slot logic */
+static void scan_collect(void) {
+    ultrasonic_reading_t readings[SENSOR_COLLECT_CHUNK];
+    uint32_t now_ms = (uint32_t)(esp_timer_get_time() / 1000);
+    int count;
+
+    do {
+        count = sensor_backend_collect(readings, SENSOR_COLLECT_CHUNK, 0);
+        for (int i = 0; i < count; i++) {
+            const ultrasonic_reading_t *reading = &readings[i];
+            if (reading->valid) {
+                SPAN_RECORD(SPAN_STAGE_ECHO, (uint32_t)(reading->done_us - reading->trigger_us));
+            }
+            process_echo(reading->sensor_id, reading->valid ? reading->echo_us : 0);
+            scan_reschedule(reading->sensor_id, now_ms);
+        }
+    } while (count == SENSOR_COLLECT_CHUNK);
+
+    /* One LED push for everything collected on this tick */
+    led_flush();
+}
+
+/* Start a scan of the due sensors of a group; returns how many started */
+static int scan_fire_group(int group, uint32_t now_ms) {
+    int due = 0;
+    for (int k = s_group_start[group]; k < s_group_start[group + 1]; k++) {
+        int slot_index = s_group_slots[k];
+        if (scan_slot_due(slot_index, now_ms)) {
+            s_scan_ids[due++] = slot_index;
+        } else {
+            s_stats.skipped++;
+        }
+    }
+    int fired = sensor_backend_start_scan(s_scan_ids, due);
+    s_stats.triggers += (uint32_t)fired;
+    return fired;
+}
+
+/* Milliseconds until the earliest slot is due */
+static uint32_t scan_idle_ms(uint32_t now_ms) {
+    int32_t earliest = INT32_MAX;
+    for (int i = 0; i < get_total_parking_slots(); i++) {
+        int32_t wait = (int32_t)(s_next_due_ms[i] - now_ms);
+        if (wait < earliest) earliest = wait;
+    }
+    return earliest > 0 ? (uint32_t)earliest : 0;
+}
+
+/* Disable the scan timer for an idle gap; the PM lock it holds goes with it */
+static void scan_idle(uint32_t idle_ms) {
+    int64_t start_us = esp_timer_get_time();
+
+    ESP_ERROR_CHECK(gptimer_stop(s_timer));
+    ESP_ERROR_CHECK(gptimer_disable(s_timer));
+    ulTaskNotifyTake(pdTRUE, rtos_ticks_at_least(idle_ms));
+    ESP_ERROR_CHECK(gptimer_set_raw_count(s_timer, 0));
+    ESP_ERROR_CHECK(gptimer_enable(s_timer));
+    ESP_ERROR_CHECK(gptimer_start(s_timer));
+
+    s_stats.idle_periods++;
+    s_stats.idle_ms += (uint64_t)((esp_timer_get_time() - start_us) / 1000);
+}
+
+/* Scan task state between ticks */
+static int s_group = 0;
+static int s_previous = -1;         /* Group fired on the last tick, -1 if none */
+static int s_pass_fired = 0;        /* Sensors triggered in the current pass */
+static int64_t s_epoch_us = 0;
+static uint32_t s_epoch_ticks = 0;
+static int64_t s_cycle_start_us = 0;
+
+bool scan_scheduler_process(uint32_t wait_ms) {
+    uint32_t pending = ulTaskNotifyTake(pdTRUE, (wait_ms == SCAN_WAIT_FOREVER) ? portMAX_DELAY : rtos_ticks_at_least(wait_ms));
+    if (pending == 0) {
+        return false;
+    }
+
+    int64_t now_us = esp_timer_get_time();
+    if (s_epoch_us == 0) {
+        s_epoch_us = now_us;
+        s_epoch_ticks = s_stats.ticks;
+        s_cycle_start_us = now_us;
+    }
+
+    /* Collect whatever completed since the previous tick */
+    scan_collect();
+    s_previous = -1;
+
+    /* Fire the next group in order that has a slot due; empty groups cost no tick */
+    uint32_t now_ms = (uint32_t)(now_us / 1000);
+    int64_t trigger_us = 0;
+    for (int tries = 0; tries <= s_group_count && s_previous < 0; tries++) {
+        if (s_group == s_group_count) {
+            s_group = 0;
+            if (s_pass_fired > 0) {
+                /* A full pass is done: upload its changes together */
+                upload_queue_flush();
+                s_stats.cycles++;
+                uint32_t cycle_us = (uint32_t)(now_us - s_cycle_start_us);
+                s_stats.cycle_time_us = s_stats.cycle_time_us
+                    ? (s_stats.cycle_time_us * 7 + cycle_us) / 8
+                    : cycle_us;
+            }
+            s_cycle_start_us = now_us;
+            s_pass_fired = 0;
+        }
+        trigger_us = esp_timer_get_time();
+        int fired = scan_fire_group(s_group, now_ms);
+        if (fired > 0) {
+            s_previous = s_group;
+            s_pass_fired += fired;
+        }
+        s_group++;
+    }
+
+    s_stats.overruns += pending - 1;
+    s_stats.ticks += pending;
+
+    if (s_previous < 0) {
+        /* Nothing due anywhere: sleep through long gaps, tick through short ones,
+         * but keep ticking while the backend still has readings to hand over */
+        uint32_t idle_ms = scan_idle_ms(now_ms);
+        if (idle_ms >= SCAN_IDLE_MIN_MS && sensor_backend_in_flight() == 0) {
+            scan_idle(idle_ms);
+            s_epoch_us = 0;
+        }
+        return true;
+    }
+
+    /* Jitter against the ideal schedule epoch + n * period */
+    int64_t ideal_us = s_epoch_us + (int64_t)(s_stats.ticks - s_epoch_ticks - 1) * SCAN_GROUP_PERIOD_US;
+    uint32_t jitter_us = (uint32_t)((trigger_us > ideal_us) ? trigger_us - ideal_us : ideal_us - trigger_us);
+    s_jitter_total_us += jitter_us;
+    s_jitter_samples++;
+    s_stats.jitter_avg_us = (uint32_t)(s_jitter_total_us / s_jitter_samples);
+    if (jitter_us > s_stats.jitter_max_us) {
+        s_stats.jitter_max_us = jitter_us;
+    }
+    return true;
+}
+
+static void scan_task(void *arg) {
+    while (1) {
+        scan_scheduler_process(SCAN_WAIT_FOREVER);
+    }
+}
+
+bool scan_scheduler_start(void) {
+    if (s_scan_task != NULL) return true;
+
+    scan_build_groups();
+    if (s_group_count == 0) {
+        ESP_LOGE(TAG, "No parking slots to scan");
+        return false;
+    }
+    s_stats.groups = s_group_count;
+
+    uint32_t now_ms = (uint32_t)(esp_timer_get_time() / 1000);
+    for (int i = 0; i < get_total_parking_slots(); i++) {
+        s_next_due_ms[i] = now_ms;
+        s_backoff[i] = 0;
+        s_resume[i] = 0;
+    }
+
+    s_scan_task = xTaskCreateStatic(scan_task, "scan_task", SCAN_TASK_STACK_SIZE, NULL,
+                                    SCAN_TASK_PRIORITY, s_scan_task_stack, &s_scan_task_buffer);
+    if (s_scan_task == NULL) {
+        ESP_LOGE(TAG, "Failed to create scan task");
+        return false;
+    }
+
+    gptimer_config_t timer_config = {
+        .clk_src = GPTIMER_CLK_SRC_DEFAULT,
+        .direction = GPTIMER_COUNT_UP,
+        .resolution_hz = 1000000, /* 1 us per tick */
+    };
+    ESP_ERROR_CHECK(gptimer_new_timer(&timer_config, &s_timer));
+
+    gptimer_event_callbacks_t callbacks = {
+        .on_alarm = scan_timer_on_alarm,
+    };
+    ESP_ERROR_CHECK(gptimer_register_event_callbacks(s_timer, &callbacks, NULL));
+
+    gptimer_alarm_config_t alarm_config = {
+        .alarm_count = SCAN_GROUP_PERIOD_US,
+        .reload_count = 0,
+        .flags.auto_reload_on_alarm = true,
+    };
+    ESP_ERROR_CHECK(gptimer_set_alarm_action(s_timer, &alarm_config));
+    ESP_ERROR_CHECK(gptimer_enable(s_timer));
+    ESP_ERROR_CHECK(gptimer_start(s_timer));
+
+    ESP_LOGI(TAG, "Scan scheduler started: %d slots in %d groups, %d ms per group",
+        get_total_parking_slots(), s_group_count, SCAN_GROUP_PERIOD_MS);
+    return true;
+}
+
+void scan_scheduler_get_stats(scan_scheduler_stats_t *stats) {
+    if (stats == NULL) return;
+    *stats = s_stats;
+
+    stats->active_slots = 0;
+    for (int i = 0; i < get_total_parking_slots(); i++) {
+        if (s_backoff[i] == 0) stats->active_slots++;
+    }
+}
+
+void scan_scheduler_print_stats(void) {
+    scan_scheduler_stats_t stats;
+    scan_scheduler_get_stats(&stats);
+
+    /* Per-slot sampling rate in hundredths of a hertz, without floating point */
+    uint32_t rate_centihz = stats.cycle_time_us ? (uint32_t)(100000000ULL / stats.cycle_time_us) : 0;
+
+    ESP_LOGI(TAG, "===== SCAN SCHEDULER STATS =====");
+    ESP_LOGI(TAG, "Groups: %lu, cycles: %lu, overruns: %lu",
+        (unsigned long)stats.groups, (unsigned long)stats.cycles, (unsigned long)stats.overruns);
+    ESP_LOGI(TAG, "Cycle time: %lu us (%lu.%02lu Hz per slot)",
+        (unsigned long)stats.cycle_time_us, (unsigned long)(rate_centihz / 100), (unsigned long)(rate_centihz % 100));
+    ESP_LOGI(TAG, "Trigger jitter avg/max: %lu/%lu us",
+        (unsigned long)stats.jitter_avg_us, (unsigned long)stats.jitter_max_us);
+    ESP_LOGI(TAG, "Adaptive: %lu active slots, %lu triggers, %lu skipped, %lu idle periods (%lu ms timer off)",
+        (unsigned long)stats.active_slots, (unsigned long)stats.triggers, (unsigned long)stats.skipped,
+        (unsigned long)stats.idle_periods, (unsigned long)stats.idle_ms);
+}
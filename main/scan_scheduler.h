@@ -0,0 +1,34 @@
+/**
+ * @file scan_scheduler.h
+ * @brief Timer-driven, crosstalk-aware scheduler for the ultrasonic sensors
+ */
+#ifndef SCAN_SCHEDULER_H
+#define SCAN_SCHEDULER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Scheduler timing counters */
+typedef struct {
+    uint32_t groups;            /* Interference groups fired in sequence */
+    uint32_t cycles;            /* Completed passes over all groups */
+    uint32_t ticks;             /* Group slots fired */
+    uint32_t overruns;          /* Timer ticks missed because a tick took too long */
+    uint32_t cycle_time_us;     /* Average time for one full pass (per-slot sample period) */
+    uint32_t jitter_avg_us;     /* Mean trigger deviation from the ideal schedule */
+    uint32_t jitter_max_us;     /* Worst trigger deviation from the ideal schedule */
+    uint32_t triggers;          /* Sensors fired */
+    uint32_t skipped;           /* Sensors passed over because they were not due */
+    uint32_t active_slots;      /* Slots currently sampled on every pass */
+    uint32_t idle_periods;      /* Times the timer was stopped for an idle gap */
+    uint64_t idle_ms;           /* Total time the timer was stopped (chip free to light-sleep) */
+} scan_scheduler_stats_t;
+
+#define SCAN_WAIT_FOREVER UINT32_MAX
+
+bool scan_scheduler_start(void);
+bool scan_scheduler_process(uint32_t wait_ms);
+void scan_scheduler_get_stats(scan_scheduler_stats_t *stats);
+void scan_scheduler_print_stats(void);
+
+#endif /* SCAN_SCHEDULER_H */
@@ -0,0 +1,143 @@
+/**
+ * @file sensor_backend.c
+ * @brief Dispatch to the configured sensor backend and throughput accounting
+ *
+ * The backend only starts and reports measurements. This layer counts what
+ * is in flight, turns a collect with a timeout into repeated backend
+ * collects, and keeps the busy time: the span from the first start of a
+ * scan until its last reading completed. Readings per second of busy time
+ * is the backend's throughput, independent of how often it is polled.
+ */
+#include "sensor_backend.h"
+#include "config.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#if SENSOR_BACKEND == SENSOR_BACKEND_MUX
+static const sensor_backend_t *const s_backend = &sensor_backend_mux;
+#elif SENSOR_BACKEND == SENSOR_BACKEND_BUS
+static const sensor_backend_t *const s_backend = &sensor_backend_bus;
+#elif SENSOR_BACKEND == SENSOR_BACKEND_SIM
+static const sensor_backend_t *const s_backend = &sensor_backend_sim;
+#else
+static const sensor_backend_t *const s_backend = &sensor_backend_gpio;
+#endif
+
+static sensor_backend_stats_t s_stats;
+static int64_t s_busy_since_us = 0;     /* Start of the current busy span */
+static int64_t s_last_done_us = 0;      /* Latest completion in the current busy span */
+
+esp_err_t sensor_backend_init(void) {
+    esp_err_t err = s_backend->init();
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Sensor backend %s failed to start: %s", s_backend->name, esp_err_to_name(err));
+    }
+    return err;
+}
+
+esp_err_t sensor_backend_add(int sensor_id, int trig_pin, int echo_pin) {
+    if (sensor_id < 0 || sensor_id >= ULTRASONIC_MAX_SENSORS) return ESP_ERR_INVALID_ARG;
+    return s_backend->add(sensor_id, trig_pin, echo_pin);
+}
+
+int sensor_backend_start_scan(const int *sensor_ids, int count) {
+    if (sensor_ids == NULL || count <= 0) return 0;
+
+    int64_t now_us = esp_timer_get_time();
+    int started = s_backend->start_scan(sensor_ids, count);
+    if (started <= 0) return 0;
+
+    if (s_stats.in_flight == 0) {
+        s_busy_since_us = now_us;
+        s_last_done_us = now_us;
+    }
+    s_stats.scans++;
+    s_stats.started += (uint32_t)started;
+    s_stats.in_flight += (uint32_t)started;
+    return started;
+}
+
+static void sensor_backend_account(const ultrasonic_reading_t *readings, int count) {
+    for (int i = 0; i < count; i++) {
+        if (readings[i].valid) {
+            s_stats.readings++;
+        } else {
+            s_stats.timeouts++;
+        }
+        if (readings[i].done_us > s_last_done_us) {
+            s_last_done_us = readings[i].done_us;
+        }
+    }
+
+    s_stats.in_flight = (s_stats.in_flight > (uint32_t)count) ? s_stats.in_flight - (uint32_t)count : 0;
+    if (s_stats.in_flight == 0) {
+        s_stats.busy_us += (uint64_t)(s_last_done_us - s_busy_since_us);
+    }
+}
+
+int sensor_backend_collect(ultrasonic_reading_t *readings, int max_readings, uint32_t timeout_ms) {
+    if (readings == NULL || max_readings <= 0) return 0;
+
+    int64_t deadline_us = esp_timer_get_time() + (int64_t)timeout_ms * 1000;
+    int count = 0;
+
+    while (count < max_readings && s_stats.in_flight > 0) {
+        int64_t left_us = deadline_us - esp_timer_get_time();
+        uint32_t wait_ms = (left_us > 0) ? (uint32_t)((left_us + 999) / 1000) : 0;
+
+        int got = s_backend->collect(readings + count, max_readings - count, wait_ms);
+        sensor_backend_account(readings + count, got);
+        count += got;
+        if (got == 0 && wait_ms == 0) break;
+    }
+    return count;
+}
+
+bool sensor_backend_measure(int sensor_id, ultrasonic_reading_t *reading) {
+    if (reading == NULL || sensor_backend_start_scan(&sensor_id, 1) != 1) return false;
+
+    /* Readings of other sensors still in flight are dropped, as the blocking path always did */
+    int64_t deadline_us = esp_timer_get_time() + (int64_t)SENSOR_MEASURE_TIMEOUT_MS * 1000;
+    while (esp_timer_get_time() < deadline_us) {
+        uint32_t left_ms = (uint32_t)((deadline_us - esp_timer_get_time() + 999) / 1000);
+        if (sensor_backend_collect(reading, 1, left_ms) == 0) break;
+        if (reading->sensor_id == sensor_id) {
+            return reading->valid;
+        }
+    }
+    return false;
+}
+
+uint32_t sensor_backend_in_flight(void) {
+    return s_stats.in_flight;
+}
+
+const char *sensor_backend_name(void) {
+    return s_backend->name;
+}
+
+void sensor_backend_get_stats(sensor_backend_stats_t *stats) {
+    if (stats == NULL) return;
+    *stats = s_stats;
+
+    uint64_t busy_us = s_stats.busy_us;
+    if (s_stats.in_flight > 0) {
+        busy_us += (uint64_t)(s_last_done_us - s_busy_since_us);
+    }
+    uint64_t done = (uint64_t)s_stats.readings + s_stats.timeouts;
+    stats->busy_us = busy_us;
+    stats->readings_per_sec = busy_us ? (uint32_t)(done * 1000000ULL / busy_us) : 0;
+}
+
+void sensor_backend_print_stats(void) {
+    sensor_backend_stats_t stats;
+    sensor_backend_get_stats(&stats);
+
+    ESP_LOGI(TAG, "===== SENSOR BACKEND STATS (%s) =====", s_backend->name);
+    ESP_LOGI(TAG, "Scans: %lu, started: %lu, readings: %lu, timeouts: %lu, in flight: %lu",
+        (unsigned long)stats.scans, (unsigned long)stats.started, (unsigned long)stats.readings,
+        (unsigned long)stats.timeouts, (unsigned long)stats.in_flight);
+    ESP_LOGI(TAG, "Throughput: %lu readings/s over %lu ms busy",
+        (unsigned long)stats.readings_per_sec, (unsigned long)(stats.busy_us / 1000));
+}
@@ -0,0 +1,57 @@
+/**
+ * @file sensor_backend.h
+ * @brief Pluggable distance sensor backends with batch start/collect
+ *
+ * Callers start a scan over a set of sensors and collect the readings as
+ * they complete; every started sensor yields exactly one reading, valid or
+ * not. The backend is chosen with SENSOR_BACKEND in config.h.
+ */
+#ifndef SENSOR_BACKEND_H
+#define SENSOR_BACKEND_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "ultrasonic_sensor.h"
+
+/* One backend implementation */
+typedef struct {
+    const char *name;
+    esp_err_t (*init)(void);
+    esp_err_t (*add)(int sensor_id, int trig_pin, int echo_pin);
+    /* Begin a measurement on each sensor not already in flight; returns how many started */
+    int (*start_scan)(const int *sensor_ids, int count);
+    /* Completed and timed-out readings, blocking up to wait_ms for the first one */
+    int (*collect)(ultrasonic_reading_t *readings, int max_readings, uint32_t wait_ms);
+} sensor_backend_t;
+
+extern const sensor_backend_t sensor_backend_gpio;
+extern const sensor_backend_t sensor_backend_mux;
+extern const sensor_backend_t sensor_backend_bus;
+extern const sensor_backend_t sensor_backend_sim;
+
+/* Backend counters; throughput counts readings per second with a scan in flight */
+typedef struct {
+    uint32_t scans;             /* start_scan() calls that started something */
+    uint32_t started;           /* Measurements started */
+    uint32_t readings;          /* Readings with an echo */
+    uint32_t timeouts;          /* Readings without one */
+    uint32_t in_flight;         /* Started and not collected yet */
+    uint64_t busy_us;           /* Time with at least one measurement in flight */
+    uint32_t readings_per_sec;  /* (readings + timeouts) per second of busy time */
+} sensor_backend_stats_t;
+
+esp_err_t sensor_backend_init(void);
+esp_err_t sensor_backend_add(int sensor_id, int trig_pin, int echo_pin);
+int sensor_backend_start_scan(const int *sensor_ids, int count);
+int sensor_backend_collect(ultrasonic_reading_t *readings, int max_readings, uint32_t timeout_ms);
+bool sensor_backend_measure(int sensor_id, ultrasonic_reading_t *reading);
+uint32_t sensor_backend_in_flight(void);
+const char *sensor_backend_name(void);
+void sensor_backend_get_stats(sensor_backend_stats_t *stats);
+void sensor_backend_print_stats(void);
+
+/* Simulated backend: distance each sensor reports, 0 for no echo */
+void sensor_sim_set_distance(int sensor_id, uint32_t distance_mm);
+
+#endif /* SENSOR_BACKEND_H */
@@ -0,0 +1,191 @@
+/**
+ * @file sensor_bus.c
+ * @brief I2C sensor backend for SRF08-style ultrasonic modules
+ *
+ * Up to 120 modules share one I2C bus, each at its own 7-bit address, and
+ * range on their own: the host writes a command, the module times the echo
+ * and holds the result in a register. A scan covering every module starts
+ * them all with one general-call write; partial scans (interference groups)
+ * address each module. Results are read with one transaction per module,
+ * which returns the revision byte (0xFF or a NACK while still ranging)
+ * together with the first echo in microseconds.
+ *
+ * The range register is set to PARKING_MAX_DISTANCE_CM so a module stops
+ * listening after SENSOR_BUS_RANGING_US rather than the default 65 ms.
+ */
+#include "sensor_backend.h"
+#include "rtos_ticks.h"
+#include "config.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "driver/i2c_master.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#define SRF_REG_COMMAND 0           /* Write: command; read: software revision */
+#define SRF_REG_RANGE 2             /* Write: range window; read: first echo, high byte first */
+#define SRF_CMD_RANGE_US 0x52       /* Range with the result in microseconds */
+#define SRF_BUSY 0xFF               /* Revision byte while ranging */
+#define SRF_ADDR_MIN 0x08
+#define SRF_ADDR_MAX 0x7F
+#define SRF_GENERAL_CALL 0x00
+
+#define BUS_WORDS ((ULTRASONIC_MAX_SENSORS + 31) / 32)
+
+static i2c_master_bus_handle_t s_bus = NULL;
+static i2c_master_dev_handle_t s_broadcast = NULL;
+static i2c_master_dev_handle_t s_devices[ULTRASONIC_MAX_SENSORS];
+static int s_device_count = 0;
+static int64_t s_started_us[ULTRASONIC_MAX_SENSORS];
+static uint32_t s_in_flight[BUS_WORDS];
+static int s_in_flight_count = 0;
+
+static esp_err_t bus_add_device(uint16_t address, i2c_master_dev_handle_t *device) {
+    i2c_device_config_t config = {
+        .dev_addr_length = I2C_ADDR_BIT_LEN_7,
+        .device_address = address,
+        .scl_speed_hz = SENSOR_BUS_CLOCK_HZ,
+    };
+    return i2c_master_bus_add_device(s_bus, &config, device);
+}
+
+static esp_err_t bus_init(void) {
+    if (s_bus != NULL) return ESP_OK;
+
+    i2c_master_bus_config_t config = {
+        .i2c_port = I2C_NUM_0,
+        .sda_io_num = SENSOR_BUS_SDA_PIN,
+        .scl_io_num = SENSOR_BUS_SCL_PIN,
+        .clk_source = I2C_CLK_SRC_DEFAULT,
+        .glitch_ignore_cnt = 7,
+        .flags.enable_internal_pullup = true,
+    };
+    esp_err_t err = i2c_new_master_bus(&config, &s_bus);
+    if (err != ESP_OK) return err;
+    return bus_add_device(SRF_GENERAL_CALL, &s_broadcast);
+}
+
+/* trig_pin carries the module address; echo_pin is not used on the bus */
+static esp_err_t bus_add(int sensor_id, int trig_pin, int echo_pin) {
+    if (trig_pin < SRF_ADDR_MIN || trig_pin > SRF_ADDR_MAX) {
+        ESP_LOGE(TAG, "Sensor %d: I2C address 0x%02x out of range", sensor_id, trig_pin);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    esp_err_t err = bus_add_device((uint16_t)trig_pin, &s_devices[sensor_id]);
+    if (err != ESP_OK) return err;
+
+    /* Shorten the range window; it resets at power-up, so set it on every boot */
+    const uint8_t range[2] = { SRF_REG_RANGE, SENSOR_BUS_RANGE_REG };
+    err = i2c_master_transmit(s_devices[sensor_id], range, sizeof(range), SENSOR_BUS_XFER_TIMEOUT_MS);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Sensor %d: no module at I2C address 0x%02x", sensor_id, trig_pin);
+    }
+    s_device_count++;
+    return err;
+}
+
+static void bus_mark(int sensor_id, int64_t now_us) {
+    s_started_us[sensor_id] = now_us;
+    s_in_flight[sensor_id >> 5] |= 1u << (sensor_id & 31);
+    s_in_flight_count++;
+}
+
+static bool bus_is_idle(int sensor_id) {
+    return s_devices[sensor_id] != NULL && !(s_in_flight[sensor_id >> 5] & (1u << (sensor_id & 31)));
+}
+
+static int bus_start_scan(const int *sensor_ids, int count) {
+    int idle = 0;
+    for (int i = 0; i < count; i++) {
+        if (sensor_ids[i] >= 0 && sensor_ids[i] < ULTRASONIC_MAX_SENSORS && bus_is_idle(sensor_ids[i])) idle++;
+    }
+    if (idle == 0) return 0;
+
+    const uint8_t command[2] = { SRF_REG_COMMAND, SRF_CMD_RANGE_US };
+    int64_t now_us = esp_timer_get_time();
+    int started = 0;
+
+    /* The whole bus at once: one general-call write starts every module */
+    if (idle == s_device_count && s_in_flight_count == 0 &&
+        i2c_master_transmit(s_broadcast, command, sizeof(command), SENSOR_BUS_XFER_TIMEOUT_MS) == ESP_OK) {
+        for (int i = 0; i < count; i++) {
+            if (sensor_ids[i] >= 0 && sensor_ids[i] < ULTRASONIC_MAX_SENSORS && bus_is_idle(sensor_ids[i])) {
+                bus_mark(sensor_ids[i], now_us);
+                started++;
+            }
+        }
+        return started;
+    }
+
+    for (int i = 0; i < count; i++) {
+        int sensor_id = sensor_ids[i];
+        if (sensor_id < 0 || sensor_id >= ULTRASONIC_MAX_SENSORS || !bus_is_idle(sensor_id)) continue;
+        if (i2c_master_transmit(s_devices[sensor_id], command, sizeof(command), SENSOR_BUS_XFER_TIMEOUT_MS) == ESP_OK) {
+            bus_mark(sensor_id, esp_timer_get_time());
+            started++;
+        }
+    }
+    return started;
+}
+
+/* Read one module; false while it is still ranging */
+static bool bus_read(int sensor_id, int64_t now_us, ultrasonic_reading_t *reading) {
+    int64_t elapsed_us = now_us - s_started_us[sensor_id];
+    if (elapsed_us < SENSOR_BUS_RANGING_US) return false;
+
+    const uint8_t reg = SRF_REG_COMMAND;
+    uint8_t data[4];
+    bool done = i2c_master_transmit_receive(s_devices[sensor_id], &reg, 1, data, sizeof(data),
+                                            SENSOR_BUS_XFER_TIMEOUT_MS) == ESP_OK && data[0] != SRF_BUSY;
+    if (!done && elapsed_us < (int64_t)ULTRASONIC_ECHO_TIMEOUT_MS * 1000) return false;
+
+    uint32_t echo_us = done ? ((uint32_t)data[2] << 8 | data[3]) : 0;
+    *reading = (ultrasonic_reading_t){
+        .sensor_id = sensor_id,
+        .valid = echo_us > 0,
+        .echo_us = echo_us,
+        .trigger_us = s_started_us[sensor_id],
+        .done_us = esp_timer_get_time(),
+        .cpu_us = 0,
+    };
+    s_in_flight[sensor_id >> 5] &= ~(1u << (sensor_id & 31));
+    s_in_flight_count--;
+    return true;
+}
+
+static int bus_collect(ultrasonic_reading_t *readings, int max_readings, uint32_t wait_ms) {
+    int64_t deadline_us = esp_timer_get_time() + (int64_t)wait_ms * 1000;
+
+    while (1) {
+        int count = 0;
+        int64_t now_us = esp_timer_get_time();
+        int64_t next_ready_us = INT64_MAX;
+
+        for (int w = 0; w < BUS_WORDS && count < max_readings; w++) {
+            for (uint32_t bits = s_in_flight[w]; bits != 0 && count < max_readings; bits &= bits - 1) {
+                int sensor_id = (w << 5) + __builtin_ctz(bits);
+                if (bus_read(sensor_id, now_us, &readings[count])) {
+                    count++;
+                } else if (s_started_us[sensor_id] + SENSOR_BUS_RANGING_US < next_ready_us) {
+                    next_ready_us = s_started_us[sensor_id] + SENSOR_BUS_RANGING_US;
+                }
+            }
+        }
+        if (count > 0 || s_in_flight_count == 0 || now_us >= deadline_us) return count;
+
+        /* Nothing finished yet: sleep until the first module may be done, or poll again */
+        int64_t wake_us = (next_ready_us > now_us) ? next_ready_us : now_us + 1000;
+        if (wake_us > deadline_us) wake_us = deadline_us;
+        vTaskDelay(rtos_ticks_at_least((wake_us - now_us + 999) / 1000));
+    }
+}
+
+const sensor_backend_t sensor_backend_bus = {
+    .name = "bus",
+    .init = bus_init,
+    .add = bus_add,
+    .start_scan = bus_start_scan,
+    .collect = bus_collect,
+};
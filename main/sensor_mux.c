@@ -0,0 +1,353 @@
+/**
+ * @file sensor_mux.c
+ * @brief Multiplexed sensor backend: many sensors behind analog mux banks
+ *
+ * Each bank is a CD74HC4067-style analog mux that routes one trigger GPIO
+ * and one echo GPIO to one of SENSOR_MUX_CHANNELS sensors. The select lines
+ * are shared by every bank (driven directly, or from a 74HC595 when
+ * SENSOR_MUX_SELECT_SHIFT is set), so a round selects one channel and
+ * measures that channel on every bank that has it pending, in parallel.
+ *
+ * Rounds chain from interrupt context: the echo ISR that completes the last
+ * bank of a round starts the next one, and a one-shot gptimer ends rounds
+ * whose sensors never answer. Sensors per second therefore grow with the
+ * number of banks, not with the number of channels.
+ */
+#include "sensor_backend.h"
+#include "rtos_ticks.h"
+#include "config.h"
+
+#include "esp_log.h"
+#include "esp_attr.h"
+#include "esp_cpu.h"
+#include "esp_rom_sys.h"
+#include "esp_timer.h"
+#include "driver/gpio.h"
+#include "driver/gptimer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include <string.h>
+
+#define MUX_NONE 0xFF
+
+typedef struct {
+    int trig_pin;
+    int echo_pin;
+    int channels;                       /* Channels in use, assigned in add() order */
+    int sensors[SENSOR_MUX_CHANNELS];   /* Sensor id per channel */
+    uint32_t pending;                   /* Channels started and not yet measured */
+    volatile int armed;                 /* Sensor measured in the current round, -1 if none */
+    volatile bool echo_high;
+    volatile int64_t rise_us;
+    volatile uint32_t cpu_cycles;
+} mux_bank_t;
+
+static mux_bank_t s_banks[SENSOR_MUX_MAX_BANKS];
+static int s_bank_count = 0;
+static uint8_t s_sensor_bank[ULTRASONIC_MAX_SENSORS];
+static uint8_t s_sensor_channel[ULTRASONIC_MAX_SENSORS];
+
+static bool s_round_active = false;
+static int s_channel = SENSOR_MUX_CHANNELS - 1;     /* Channel of the current or last round */
+static int s_round_left = 0;                        /* Banks still waiting for their echo */
+static int64_t s_round_trigger_us = 0;
+
+static gptimer_handle_t s_timer = NULL;
+static QueueHandle_t s_result_queue = NULL;
+static StaticQueue_t s_result_queue_buffer;
+static uint8_t s_result_queue_storage[ULTRASONIC_MAX_SENSORS * sizeof(ultrasonic_reading_t)];
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+
+#if SENSOR_MUX_SELECT_SHIFT
+static const int s_shift_pins[3] = SENSOR_MUX_SHIFT_PINS;
+
+/* Clock the channel into the 74HC595, most significant bit first, then latch it */
+static void IRAM_ATTR mux_select(int channel) {
+    for (int bit = 7; bit >= 0; bit--) {
+        gpio_set_level(s_shift_pins[0], (channel >> bit) & 1);
+        gpio_set_level(s_shift_pins[1], 1);
+        gpio_set_level(s_shift_pins[1], 0);
+    }
+    gpio_set_level(s_shift_pins[2], 1);
+    gpio_set_level(s_shift_pins[2], 0);
+}
+#else
+static const int s_select_pins[SENSOR_MUX_SELECT_BITS] = SENSOR_MUX_SELECT_PINS;
+
+static void IRAM_ATTR mux_select(int channel) {
+    for (int bit = 0; bit < SENSOR_MUX_SELECT_BITS; bit++) {
+        gpio_set_level(s_select_pins[bit], (channel >> bit) & 1);
+    }
+}
+#endif
+
+static void mux_output_init(int pin) {
+    gpio_reset_pin(pin);
+    gpio_set_direction(pin, GPIO_MODE_OUTPUT);
+    gpio_set_level(pin, 0);
+}
+
+/* End the bank's measurement; returns its sensor. The caller holds s_lock and
+ * queues the reading with mux_post() once it has released it. */
+static int IRAM_ATTR mux_disarm_locked(mux_bank_t *bank, uint32_t *cpu_us) {
+    int sensor_id = bank->armed;
+    /* At the current CPU clock, which power management may have scaled down */
+    *cpu_us = bank->cpu_cycles / esp_rom_get_cpu_ticks_per_us();
+    bank->armed = -1;
+    s_round_left--;
+    return sensor_id;
+}
+
+static void IRAM_ATTR mux_post(int sensor_id, bool valid, uint32_t echo_us, int64_t trigger_us, int64_t done_us,
+                               uint32_t cpu_us, BaseType_t *higher_priority_woken) {
+    ultrasonic_reading_t reading = {
+        .sensor_id = sensor_id,
+        .valid = valid,
+        .echo_us = echo_us,
+        .trigger_us = trigger_us,
+        .done_us = done_us,
+        .cpu_us = cpu_us,
+    };
+    xQueueSendFromISR(s_result_queue, &reading, higher_priority_woken);
+}
+
+/* Select the next channel with work on any bank and fire it; caller holds s_lock */
+static void IRAM_ATTR mux_start_round_locked(void) {
+    uint32_t entry_cycles = esp_cpu_get_cycle_count();
+    s_round_active = false;
+
+    for (int step = 1; step <= SENSOR_MUX_CHANNELS && !s_round_active; step++) {
+        int channel = (s_channel + step) % SENSOR_MUX_CHANNELS;
+        for (int b = 0; b < s_bank_count; b++) {
+            if (s_banks[b].pending & (1u << channel)) {
+                s_channel = channel;
+                s_round_active = true;
+                break;
+            }
+        }
+    }
+    if (!s_round_active) return;
+
+    mux_select(s_channel);
+    esp_rom_delay_us(SENSOR_MUX_SETTLE_US);
+
+    /* One trigger pulse on every bank that has this channel pending */
+    s_round_left = 0;
+    for (int b = 0; b < s_bank_count; b++) {
+        mux_bank_t *bank = &s_banks[b];
+        if (!(bank->pending & (1u << s_channel))) continue;
+        bank->pending &= ~(1u << s_channel);
+        bank->armed = bank->sensors[s_channel];
+        bank->echo_high = false;
+        s_round_left++;
+        gpio_set_level(bank->trig_pin, 1);
+    }
+    s_round_trigger_us = esp_timer_get_time();
+    esp_rom_delay_us(ULTRASONIC_TRIGGER_PULSE_US);
+    for (int b = 0; b < s_bank_count; b++) {
+        if (s_banks[b].armed >= 0) {
+            gpio_set_level(s_banks[b].trig_pin, 0);
+        }
+    }
+
+    gptimer_set_raw_count(s_timer, 0);
+    gptimer_start(s_timer);
+
+    uint32_t share = (esp_cpu_get_cycle_count() - entry_cycles) / (uint32_t)s_round_left;
+    for (int b = 0; b < s_bank_count; b++) {
+        if (s_banks[b].armed >= 0) {
+            s_banks[b].cpu_cycles = share;
+        }
+    }
+}
+
+static void IRAM_ATTR mux_end_round_locked(void) {
+    gptimer_stop(s_timer);
+    mux_start_round_locked();
+}
+
+/* Echo edges on a bank's shared line; the last bank to finish starts the next round */
+static void IRAM_ATTR mux_echo_isr(void *arg) {
+    uint32_t entry_cycles = esp_cpu_get_cycle_count();
+    mux_bank_t *bank = (mux_bank_t *)arg;
+    int64_t now_us = esp_timer_get_time();
+    int level = gpio_get_level(bank->echo_pin);
+    BaseType_t higher_priority_woken = pdFALSE;
+    int sensor_id = -1;
+    uint32_t echo_us = 0;
+    uint32_t cpu_us = 0;
+    int64_t trigger_us = 0;
+
+    portENTER_CRITICAL_ISR(&s_lock);
+    if (bank->armed >= 0) {
+        if (level == 1 && !bank->echo_high) {
+            bank->rise_us = now_us;
+            bank->echo_high = true;
+            bank->cpu_cycles += esp_cpu_get_cycle_count() - entry_cycles;
+        } else if (level == 0 && bank->echo_high) {
+            bank->cpu_cycles += esp_cpu_get_cycle_count() - entry_cycles;
+            echo_us = (uint32_t)(now_us - bank->rise_us);
+            trigger_us = s_round_trigger_us;
+            sensor_id = mux_disarm_locked(bank, &cpu_us);
+            if (s_round_left == 0) {
+                mux_end_round_locked();
+            }
+        }
+    }
+    portEXIT_CRITICAL_ISR(&s_lock);
+
+    if (sensor_id >= 0) {
+        mux_post(sensor_id, true, echo_us, trigger_us, now_us, cpu_us, &higher_priority_woken);
+    }
+    if (higher_priority_woken) {
+        portYIELD_FROM_ISR();
+    }
+}
+
+/* Round timeout: banks without a complete echo report an invalid reading */
+static bool IRAM_ATTR mux_timer_on_alarm(gptimer_handle_t timer, const gptimer_alarm_event_data_t *edata, void *user_ctx) {
+    BaseType_t higher_priority_woken = pdFALSE;
+    int64_t now_us = esp_timer_get_time();
+    int16_t sensor_ids[SENSOR_MUX_MAX_BANKS];
+    uint32_t cpu_us[SENSOR_MUX_MAX_BANKS];
+    int timed_out = 0;
+
+    portENTER_CRITICAL_ISR(&s_lock);
+    int64_t trigger_us = s_round_trigger_us;
+    for (int b = 0; b < s_bank_count; b++) {
+        if (s_banks[b].armed >= 0) {
+            sensor_ids[timed_out] = (int16_t)mux_disarm_locked(&s_banks[b], &cpu_us[timed_out]);
+            timed_out++;
+        }
+    }
+    mux_end_round_locked();
+    portEXIT_CRITICAL_ISR(&s_lock);
+
+    for (int i = 0; i < timed_out; i++) {
+        mux_post(sensor_ids[i], false, 0, trigger_us, now_us, cpu_us[i], &higher_priority_woken);
+    }
+    return higher_priority_woken == pdTRUE;
+}
+
+static esp_err_t mux_init(void) {
+    if (s_result_queue != NULL) return ESP_OK;
+
+    memset(s_sensor_bank, MUX_NONE, sizeof(s_sensor_bank));
+    s_result_queue = xQueueCreateStatic(ULTRASONIC_MAX_SENSORS, sizeof(ultrasonic_reading_t),
+        s_result_queue_storage, &s_result_queue_buffer);
+    if (s_result_queue == NULL) return ESP_ERR_NO_MEM;
+
+#if SENSOR_MUX_SELECT_SHIFT
+    for (int i = 0; i < 3; i++) {
+        mux_output_init(s_shift_pins[i]);
+    }
+#else
+    for (int i = 0; i < SENSOR_MUX_SELECT_BITS; i++) {
+        mux_output_init(s_select_pins[i]);
+    }
+#endif
+
+    esp_err_t err = gpio_install_isr_service(0);
+    if (err != ESP_OK && err != ESP_ERR_INVALID_STATE) return err;
+
+    /* One-shot round timeout; started and stopped from the ISRs above, which
+     * also drive the select lines. CONFIG_GPTIMER_CTRL_FUNC_IN_IRAM and
+     * CONFIG_GPIO_CTRL_FUNC_IN_IRAM (sdkconfig.defaults) keep that safe with
+     * the cache off. */
+    gptimer_config_t timer_config = {
+        .clk_src = GPTIMER_CLK_SRC_DEFAULT,
+        .direction = GPTIMER_COUNT_UP,
+        .resolution_hz = 1000000,
+    };
+    err = gptimer_new_timer(&timer_config, &s_timer);
+    if (err != ESP_OK) return err;
+
+    gptimer_event_callbacks_t callbacks = {
+        .on_alarm = mux_timer_on_alarm,
+    };
+    gptimer_alarm_config_t alarm_config = {
+        .alarm_count = (uint64_t)ULTRASONIC_ECHO_TIMEOUT_MS * 1000,
+        .flags.auto_reload_on_alarm = false,
+    };
+    ESP_ERROR_CHECK(gptimer_register_event_callbacks(s_timer, &callbacks, NULL));
+    ESP_ERROR_CHECK(gptimer_set_alarm_action(s_timer, &alarm_config));
+    return gptimer_enable(s_timer);
+}
+
+/* The bank is the trigger/echo pin pair; the next free channel on it goes to this sensor */
+static esp_err_t mux_add(int sensor_id, int trig_pin, int echo_pin) {
+    int b = 0;
+    while (b < s_bank_count && (s_banks[b].trig_pin != trig_pin || s_banks[b].echo_pin != echo_pin)) {
+        b++;
+    }
+
+    if (b == s_bank_count) {
+        if (s_bank_count == SENSOR_MUX_MAX_BANKS) {
+            ESP_LOGE(TAG, "Sensor %d: no mux bank left for GPIO %d/%d", sensor_id, trig_pin, echo_pin);
+            return ESP_ERR_NO_MEM;
+        }
+        mux_bank_t *bank = &s_banks[s_bank_count];
+        memset(bank, 0, sizeof(*bank));
+        bank->trig_pin = trig_pin;
+        bank->echo_pin = echo_pin;
+        bank->armed = -1;
+
+        mux_output_init(trig_pin);
+        gpio_reset_pin(echo_pin);
+        gpio_set_direction(echo_pin, GPIO_MODE_INPUT);
+        gpio_set_intr_type(echo_pin, GPIO_INTR_ANYEDGE);
+        esp_err_t err = gpio_isr_handler_add(echo_pin, mux_echo_isr, bank);
+        if (err != ESP_OK) return err;
+        gpio_intr_enable(echo_pin);
+        s_bank_count++;
+    }
+
+    mux_bank_t *bank = &s_banks[b];
+    if (bank->channels == SENSOR_MUX_CHANNELS) {
+        ESP_LOGE(TAG, "Sensor %d: mux bank on GPIO %d/%d is full", sensor_id, trig_pin, echo_pin);
+        return ESP_ERR_NO_MEM;
+    }
+    bank->sensors[bank->channels] = sensor_id;
+    s_sensor_bank[sensor_id] = (uint8_t)b;
+    s_sensor_channel[sensor_id] = (uint8_t)bank->channels;
+    bank->channels++;
+    return ESP_OK;
+}
+
+static int mux_start_scan(const int *sensor_ids, int count) {
+    int started = 0;
+
+    portENTER_CRITICAL(&s_lock);
+    for (int i = 0; i < count; i++) {
+        int sensor_id = sensor_ids[i];
+        if (sensor_id < 0 || sensor_id >= ULTRASONIC_MAX_SENSORS || s_sensor_bank[sensor_id] == MUX_NONE) continue;
+
+        mux_bank_t *bank = &s_banks[s_sensor_bank[sensor_id]];
+        uint32_t bit = 1u << s_sensor_channel[sensor_id];
+        if ((bank->pending & bit) || bank->armed == sensor_id) continue;
+        bank->pending |= bit;
+        started++;
+    }
+    if (started > 0 && !s_round_active) {
+        mux_start_round_locked();
+    }
+    portEXIT_CRITICAL(&s_lock);
+    return started;
+}
+
+static int mux_collect(ultrasonic_reading_t *readings, int max_readings, uint32_t wait_ms) {
+    int count = 0;
+    while (count < max_readings &&
+           xQueueReceive(s_result_queue, &readings[count], count == 0 ? rtos_ticks_at_least(wait_ms) : 0) == pdTRUE) {
+        count++;
+    }
+    return count;
+}
+
+const sensor_backend_t sensor_backend_mux = {
+    .name = "mux",
+    .init = mux_init,
+    .add = mux_add,
+    .start_scan = mux_start_scan,
+    .collect = mux_collect,
+};
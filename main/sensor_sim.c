@@ -0,0 +1,107 @@
+/**
+ * @file sensor_sim.c
+ * @brief Deterministic simulated sensor backend
+ *
+ * No hardware: every sensor reports the distance last set with
+ * sensor_sim_set_distance(), without noise. A reading completes after the
+ * HC-SR04 trigger-to-echo delay plus the round trip of that distance, so
+ * scan timing matches the GPIO backend; a distance of 0 means no echo and
+ * completes as a timeout. Sensors run in parallel and never interfere, so
+ * the same inputs always give the same readings at the same times.
+ */
+#include "sensor_backend.h"
+#include "rtos_ticks.h"
+#include "config.h"
+
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#define SIM_ECHO_DELAY_US 450       /* Trigger to echo rising edge */
+#define SIM_WORDS ((ULTRASONIC_MAX_SENSORS + 31) / 32)
+
+static uint32_t s_distance_mm[ULTRASONIC_MAX_SENSORS];
+static int64_t s_trigger_us[ULTRASONIC_MAX_SENSORS];
+static int64_t s_done_us[ULTRASONIC_MAX_SENSORS];
+static uint32_t s_added[SIM_WORDS];
+static uint32_t s_in_flight[SIM_WORDS];
+
+void sensor_sim_set_distance(int sensor_id, uint32_t distance_mm) {
+    if (sensor_id < 0 || sensor_id >= ULTRASONIC_MAX_SENSORS) return;
+    s_distance_mm[sensor_id] = distance_mm;
+}
+
+static esp_err_t sim_init(void) {
+    return ESP_OK;
+}
+
+static esp_err_t sim_add(int sensor_id, int trig_pin, int echo_pin) {
+    s_added[sensor_id >> 5] |= 1u << (sensor_id & 31);
+    return ESP_OK;
+}
+
+/* The distance is sampled at the trigger, as the sound leaves */
+static int sim_start_scan(const int *sensor_ids, int count) {
+    int64_t now_us = esp_timer_get_time();
+    int started = 0;
+
+    for (int i = 0; i < count; i++) {
+        int sensor_id = sensor_ids[i];
+        if (sensor_id < 0 || sensor_id >= ULTRASONIC_MAX_SENSORS) continue;
+        uint32_t bit = 1u << (sensor_id & 31);
+        if (!(s_added[sensor_id >> 5] & bit) || (s_in_flight[sensor_id >> 5] & bit)) continue;
+
+        /* No echo, or one too late for the timeout, completes at the timeout */
+        int64_t timeout_us = now_us + (int64_t)ULTRASONIC_ECHO_TIMEOUT_MS * 1000;
+        int64_t echo_done_us = now_us + SIM_ECHO_DELAY_US + (int64_t)s_distance_mm[sensor_id] * 2000 / 343;
+        s_trigger_us[sensor_id] = now_us;
+        s_done_us[sensor_id] = (s_distance_mm[sensor_id] != 0 && echo_done_us < timeout_us) ? echo_done_us : timeout_us;
+        s_in_flight[sensor_id >> 5] |= bit;
+        started++;
+    }
+    return started;
+}
+
+static int sim_collect(ultrasonic_reading_t *readings, int max_readings, uint32_t wait_ms) {
+    int64_t deadline_us = esp_timer_get_time() + (int64_t)wait_ms * 1000;
+
+    while (1) {
+        int count = 0;
+        int64_t now_us = esp_timer_get_time();
+        int64_t next_us = INT64_MAX;
+
+        for (int w = 0; w < SIM_WORDS && count < max_readings; w++) {
+            for (uint32_t bits = s_in_flight[w]; bits != 0 && count < max_readings; bits &= bits - 1) {
+                int sensor_id = (w << 5) + __builtin_ctz(bits);
+                int64_t done_us = s_done_us[sensor_id];
+                if (done_us > now_us) {
+                    if (done_us < next_us) next_us = done_us;
+                    continue;
+                }
+
+                bool valid = done_us - s_trigger_us[sensor_id] < (int64_t)ULTRASONIC_ECHO_TIMEOUT_MS * 1000;
+                readings[count++] = (ultrasonic_reading_t){
+                    .sensor_id = sensor_id,
+                    .valid = valid,
+                    .echo_us = valid ? (uint32_t)(done_us - s_trigger_us[sensor_id] - SIM_ECHO_DELAY_US) : 0,
+                    .trigger_us = s_trigger_us[sensor_id],
+                    .done_us = done_us,
+                    .cpu_us = 0,
+                };
+                s_in_flight[w] &= ~(1u << (sensor_id & 31));
+            }
+        }
+        if (count > 0 || next_us == INT64_MAX || now_us >= deadline_us) return count;
+
+        int64_t wake_us = next_us < deadline_us ? next_us : deadline_us;
+        vTaskDelay(rtos_ticks_at_least((wake_us - now_us + 999) / 1000));
+    }
+}
+
+const sensor_backend_t sensor_backend_sim = {
+    .name = "sim",
+    .init = sim_init,
+    .add = sim_add,
+    .start_scan = sim_start_scan,
+    .collect = sim_collect,
+};
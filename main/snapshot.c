@@ -0,0 +1,109 @@
+/**
+ * @file snapshot.c
+ * @brief Implementation of the occupancy snapshot buffer
+ */
+#include "snapshot.h"
+#include "http_client.h"
+#include "parking_slot.h"
+#include "config.h"
+
+#include "esp_log.h"
+#include "esp_random.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include <stdio.h>
+#include <string.h>
+
+/* Per slot: {"spot":"<name>","taken":false,"valid":false}, */
+#define SNAPSHOT_SLOT_MAX (HTTP_JSON_ESCAPED_MAX(PARKING_SLOT_NAME_LEN - 1) + 44)
+#define SNAPSHOT_BUFFER_SIZE (MAX_PARKING_SLOTS * SNAPSHOT_SLOT_MAX + 96)
+
+static char s_body[SNAPSHOT_BUFFER_SIZE];
+static size_t s_len = 0;
+static uint32_t s_built_version = UINT32_MAX;
+static volatile uint32_t s_version = 0;
+static uint32_t s_boot_id = 0;
+static SemaphoreHandle_t s_lock = NULL;
+static StaticSemaphore_t s_lock_buffer;
+static snapshot_change_cb_t s_listener = NULL;
+static snapshot_stats_t s_stats;
+
+void snapshot_init(void) {
+    if (s_lock != NULL) return;
+    s_lock = xSemaphoreCreateMutexStatic(&s_lock_buffer);
+    /* Keeps ETags from one boot from matching the next */
+    s_boot_id = esp_random();
+}
+
+void snapshot_set_listener(snapshot_change_cb_t cb) {
+    s_listener = cb;
+}
+
+void snapshot_mark_changed(void) {
+    s_version++;
+    if (s_listener != NULL) {
+        s_listener();
+    }
+}
+
+uint32_t snapshot_version(void) {
+    return s_version;
+}
+
+void snapshot_etag(uint32_t version, char etag[SNAPSHOT_ETAG_LEN]) {
+    snprintf(etag, SNAPSHOT_ETAG_LEN, "\"%08lx-%lu\"", (unsigned long)s_boot_id, (unsigned long)version);
+}
+
+static void snapshot_build(uint32_t version) {
+    char *p = s_body;
+    int total = get_total_parking_slots();
+
+    p += sprintf(p, "{\"version\":%lu,\"occupied\":%d,\"available\":%d,\"invalid\":%d,\"slots\":[",
+        (unsigned long)version, parking_slots.occupied_count, parking_slots.available_count,
+        parking_slots.invalid_count);
+    for (int i = 0; i < total; i++) {
+        p += sprintf(p, "%s{\"spot\":\"", i ? "," : "");
+        p += http_json_escape(p, sizeof(s_body) - (size_t)(p - s_body), parking_slot_name(i));
+        p += sprintf(p, "\",\"taken\":%s,\"valid\":%s}",
+            parking_slot_is_occupied(i) ? "true" : "false",
+            parking_slot_is_valid(i) ? "true" : "false");
+    }
+    p += sprintf(p, "]}");
+
+    s_len = (size_t)(p - s_body);
+    s_built_version = version;
+    s_stats.rebuilds++;
+}
+
+void snapshot_acquire(const char **body, size_t *len, char etag[SNAPSHOT_ETAG_LEN]) {
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    uint32_t version = s_version;
+    if (version != s_built_version) {
+        snapshot_build(version);
+    }
+    s_stats.reads++;
+    *body = s_body;
+    *len = s_len;
+    snapshot_etag(s_built_version, etag);
+}
+
+void snapshot_release(void) {
+    xSemaphoreGive(s_lock);
+}
+
+void snapshot_get_stats(snapshot_stats_t *stats) {
+    if (stats == NULL) return;
+    *stats = s_stats;
+    stats->version = s_version;
+    stats->size = (uint32_t)s_len;
+}
+
+void snapshot_print_stats(void) {
+    snapshot_stats_t stats;
+    snapshot_get_stats(&stats);
+
+    ESP_LOGI(TAG, "===== SNAPSHOT STATS =====");
+    ESP_LOGI(TAG, "Version: %lu, rebuilds: %lu, reads: %lu, size: %lu bytes",
+        (unsigned long)stats.version, (unsigned long)stats.rebuilds, (unsigned long)stats.reads,
+        (unsigned long)stats.size);
+}
@@ -0,0 +1,41 @@
+/**
+ * @file snapshot.h
+ * @brief Pre-serialized occupancy snapshot for local consumers
+ *
+ * Slot state changes only bump a version number. The JSON body is rebuilt
+ * on the first read after a change and served as-is until the next one;
+ * its ETag is the boot id and the version.
+ */
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SNAPSHOT_ETAG_LEN 24        /* "\"xxxxxxxx-nnnnnnnnnn\"" plus the terminator */
+
+/* Called after the version changed, from the task that changed a slot */
+typedef void (*snapshot_change_cb_t)(void);
+
+typedef struct {
+    uint32_t version;           /* Slot state changes since boot */
+    uint32_t rebuilds;          /* Times the body was serialized */
+    uint32_t reads;             /* snapshot_acquire() calls */
+    uint32_t size;              /* Current body length */
+} snapshot_stats_t;
+
+void snapshot_init(void);
+void snapshot_mark_changed(void);
+void snapshot_set_listener(snapshot_change_cb_t cb);
+uint32_t snapshot_version(void);
+void snapshot_etag(uint32_t version, char etag[SNAPSHOT_ETAG_LEN]);
+
+/* Lock the current body, rebuilding it first if the state moved on. The
+ * pointers stay valid until snapshot_release(). */
+void snapshot_acquire(const char **body, size_t *len, char etag[SNAPSHOT_ETAG_LEN]);
+void snapshot_release(void);
+
+void snapshot_get_stats(snapshot_stats_t *stats);
+void snapshot_print_stats(void);
+
+#endif /* SNAPSHOT_H */
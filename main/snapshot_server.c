@@ -0,0 +1,236 @@
+/**
+ * @file snapshot_server.c
+ * @brief Implementation of the local snapshot endpoint
+ *
+ * esp_http_server runs every handler on its one server task, so a held
+ * long-poll must not block there. The handler detaches the request with
+ * httpd_req_async_handler_begin() and parks it; the snapshot task answers
+ * parked requests when the version moves or their wait runs out. It runs
+ * below the scan task, so the changes of one scan group are answered
+ * together.
+ */
+#include "snapshot_server.h"
+#include "snapshot.h"
+#include "rtos_ticks.h"
+#include "config.h"
+
+#include "esp_http_server.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    httpd_req_t *req;           /* Detached request, NULL when the entry is free */
+    uint32_t version;           /* Version the client already has */
+    int64_t deadline_us;
+} snapshot_waiter_t;
+
+static snapshot_server_stats_t s_stats;
+
+#if SNAPSHOT_SERVER_ENABLED
+
+static httpd_handle_t s_server = NULL;
+static TaskHandle_t s_task = NULL;
+static StaticTask_t s_task_buffer;
+static StackType_t s_task_stack[SNAPSHOT_TASK_STACK_SIZE];
+static SemaphoreHandle_t s_lock = NULL;
+static StaticSemaphore_t s_lock_buffer;
+static snapshot_waiter_t s_waiters[SNAPSHOT_MAX_WAITERS];
+static volatile int64_t s_changed_us = 0;
+
+/* Answer with the current body, or 304 if the client's ETag still matches */
+static esp_err_t snapshot_respond(httpd_req_t *req, const char *if_none_match) {
+    const char *body;
+    size_t len;
+    char etag[SNAPSHOT_ETAG_LEN];
+
+    snapshot_acquire(&body, &len, etag);
+    httpd_resp_set_hdr(req, "ETag", etag);
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+
+    esp_err_t err;
+    if (if_none_match != NULL && strcmp(if_none_match, etag) == 0) {
+        httpd_resp_set_status(req, "304 Not Modified");
+        err = httpd_resp_send(req, NULL, 0);
+        s_stats.not_modified++;
+    } else {
+        httpd_resp_set_type(req, "application/json");
+        err = httpd_resp_send(req, body, (ssize_t)len);
+        s_stats.full++;
+    }
+    snapshot_release();
+    return err;
+}
+
+/* Hold the request for the next change; false if no waiter slot is free */
+static bool snapshot_park(httpd_req_t *req, uint32_t version, uint32_t wait_ms) {
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    snapshot_waiter_t *waiter = NULL;
+    for (int i = 0; i < SNAPSHOT_MAX_WAITERS && waiter == NULL; i++) {
+        if (s_waiters[i].req == NULL) waiter = &s_waiters[i];
+    }
+    if (waiter == NULL || httpd_req_async_handler_begin(req, &waiter->req) != ESP_OK) {
+        if (waiter != NULL) waiter->req = NULL;
+        xSemaphoreGive(s_lock);
+        return false;
+    }
+    waiter->version = version;
+    waiter->deadline_us = esp_timer_get_time() + (int64_t)wait_ms * 1000;
+    s_stats.parked++;
+    xSemaphoreGive(s_lock);
+
+    /* Let the task pick up the new deadline */
+    xTaskNotifyGive(s_task);
+    return true;
+}
+
+static esp_err_t snapshot_get_handler(httpd_req_t *req) {
+    s_stats.requests++;
+
+    char if_none_match[SNAPSHOT_ETAG_LEN] = "";
+    bool conditional = httpd_req_get_hdr_value_str(req, "If-None-Match", if_none_match,
+                                                   sizeof(if_none_match)) == ESP_OK;
+
+    uint32_t wait_ms = 0;
+    char query[32];
+    char value[12];
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+        httpd_query_key_value(query, "wait", value, sizeof(value)) == ESP_OK) {
+        wait_ms = (uint32_t)strtoul(value, NULL, 10);
+        if (wait_ms > SNAPSHOT_WAIT_MAX_MS) wait_ms = SNAPSHOT_WAIT_MAX_MS;
+    }
+
+    /* Only a client that is already current waits */
+    uint32_t version = snapshot_version();
+    if (conditional && wait_ms > 0) {
+        char etag[SNAPSHOT_ETAG_LEN];
+        snapshot_etag(version, etag);
+        if (strcmp(if_none_match, etag) == 0) {
+            if (snapshot_park(req, version, wait_ms)) {
+                return ESP_OK;
+            }
+            s_stats.rejected++;
+        }
+    }
+    return snapshot_respond(req, conditional ? if_none_match : NULL);
+}
+
+/* Runs in the task that changed a slot */
+static void snapshot_changed(void) {
+    s_changed_us = esp_timer_get_time();
+    if (s_task != NULL) {
+        xTaskNotifyGive(s_task);
+    }
+}
+
+static void snapshot_task(void *arg) {
+    while (1) {
+        /* Sleep until a change or the earliest deadline */
+        int64_t now_us = esp_timer_get_time();
+        int64_t next_us = INT64_MAX;
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        for (int i = 0; i < SNAPSHOT_MAX_WAITERS; i++) {
+            if (s_waiters[i].req != NULL && s_waiters[i].deadline_us < next_us) {
+                next_us = s_waiters[i].deadline_us;
+            }
+        }
+        xSemaphoreGive(s_lock);
+
+        TickType_t ticks = portMAX_DELAY;
+        if (next_us != INT64_MAX) {
+            ticks = next_us > now_us ? rtos_ticks_at_least((uint32_t)((next_us - now_us + 999) / 1000)) : 0;
+        }
+        ulTaskNotifyTake(pdTRUE, ticks);
+
+        uint32_t version = snapshot_version();
+        now_us = esp_timer_get_time();
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        for (int i = 0; i < SNAPSHOT_MAX_WAITERS; i++) {
+            snapshot_waiter_t *waiter = &s_waiters[i];
+            if (waiter->req == NULL) continue;
+
+            bool changed = waiter->version != version;
+            if (!changed && now_us < waiter->deadline_us) continue;
+
+            /* On timeout the client's ETag is still current: 304 */
+            char etag[SNAPSHOT_ETAG_LEN];
+            snapshot_etag(waiter->version, etag);
+            snapshot_respond(waiter->req, etag);
+            httpd_req_async_handler_complete(waiter->req);
+            waiter->req = NULL;
+
+            if (changed) {
+                s_stats.woken++;
+                s_stats.last_wake_us = (uint32_t)(esp_timer_get_time() - s_changed_us);
+                if (s_stats.last_wake_us > s_stats.max_wake_us) {
+                    s_stats.max_wake_us = s_stats.last_wake_us;
+                }
+            }
+        }
+        xSemaphoreGive(s_lock);
+    }
+}
+
+#endif /* SNAPSHOT_SERVER_ENABLED */
+
+bool snapshot_server_start(void) {
+#if SNAPSHOT_SERVER_ENABLED
+    if (s_server != NULL) return true;
+
+    s_lock = xSemaphoreCreateMutexStatic(&s_lock_buffer);
+    if (s_lock == NULL) {
+        ESP_LOGE(TAG, "Failed to create snapshot server lock");
+        return false;
+    }
+    s_task = xTaskCreateStatic(snapshot_task, "snapshot", SNAPSHOT_TASK_STACK_SIZE, NULL,
+                               SNAPSHOT_TASK_PRIORITY, s_task_stack, &s_task_buffer);
+    if (s_task == NULL) {
+        ESP_LOGE(TAG, "Failed to start snapshot task");
+        return false;
+    }
+    snapshot_set_listener(snapshot_changed);
+
+    httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+    config.server_port = SNAPSHOT_SERVER_PORT;
+    /* Parked long-polls keep their sockets open */
+    config.max_open_sockets = SNAPSHOT_MAX_WAITERS + 2;
+    config.lru_purge_enable = true;
+    if (httpd_start(&s_server, &config) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start snapshot server on port %d", SNAPSHOT_SERVER_PORT);
+        s_server = NULL;
+        return false;
+    }
+
+    httpd_uri_t uri = {
+        .uri = SNAPSHOT_PATH,
+        .method = HTTP_GET,
+        .handler = snapshot_get_handler,
+    };
+    httpd_register_uri_handler(s_server, &uri);
+    ESP_LOGI(TAG, "Snapshot server on port %d%s", SNAPSHOT_SERVER_PORT, SNAPSHOT_PATH);
+    return true;
+#else
+    return false;
+#endif
+}
+
+void snapshot_server_get_stats(snapshot_server_stats_t *stats) {
+    if (stats == NULL) return;
+    *stats = s_stats;
+}
+
+void snapshot_server_print_stats(void) {
+    snapshot_server_stats_t stats;
+    snapshot_server_get_stats(&stats);
+
+    ESP_LOGI(TAG, "===== SNAPSHOT SERVER STATS =====");
+    ESP_LOGI(TAG, "Requests: %lu (200: %lu, 304: %lu), long-polls parked: %lu, woken: %lu, rejected: %lu",
+        (unsigned long)stats.requests, (unsigned long)stats.full, (unsigned long)stats.not_modified,
+        (unsigned long)stats.parked, (unsigned long)stats.woken, (unsigned long)stats.rejected);
+    ESP_LOGI(TAG, "Change to response last/max: %lu/%lu us",
+        (unsigned long)stats.last_wake_us, (unsigned long)stats.max_wake_us);
+}
@@ -0,0 +1,30 @@
+/**
+ * @file snapshot_server.h
+ * @brief Local HTTP endpoint serving the occupancy snapshot
+ *
+ * GET SNAPSHOT_PATH returns the snapshot with its ETag. A request whose
+ * If-None-Match still matches gets 304, or with ?wait=<ms> is held until
+ * the next slot change (200) or the wait runs out (304).
+ */
+#ifndef SNAPSHOT_SERVER_H
+#define SNAPSHOT_SERVER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct {
+    uint32_t requests;          /* GETs received */
+    uint32_t full;              /* 200 answers with a body */
+    uint32_t not_modified;      /* 304 answers */
+    uint32_t parked;            /* Long-polls held for the next change */
+    uint32_t woken;             /* Long-polls answered by a change */
+    uint32_t rejected;          /* Long-polls refused because every waiter slot was taken */
+    uint32_t last_wake_us;      /* Change to response sent, most recent wake */
+    uint32_t max_wake_us;
+} snapshot_server_stats_t;
+
+bool snapshot_server_start(void);
+void snapshot_server_get_stats(snapshot_server_stats_t *stats);
+void snapshot_server_print_stats(void);
+
+#endif /* SNAPSHOT_SERVER_H */
@@ -0,0 +1,224 @@
+/**
+ * @file span_trace.c
+ * @brief Implementation of the span histograms
+ *
+ * Buckets are log-linear: four per power of two, so a percentile read from
+ * a bucket bound is within 25% of the true value, from 1 us up to the full
+ * 32-bit range in 124 buckets per stage. With SPAN_TRACE_ENABLED set to 0
+ * none of it is built; the summaries read empty.
+ */
+#include "span_trace.h"
+#include "config.h"
+#include "console.h"
+#include "http_client.h"
+
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include <stdio.h>
+#include <string.h>
+
+#if SPAN_TRACE_ENABLED
+
+#define SPAN_SUB_BITS 2
+#define SPAN_BUCKETS ((32 - SPAN_SUB_BITS + 1) << SPAN_SUB_BITS)
+
+typedef struct {
+    uint32_t count;
+    uint32_t max_us;
+    uint64_t total_us;
+    uint32_t buckets[SPAN_BUCKETS];
+} span_histogram_t;
+
+static const char *const s_stage_names[SPAN_STAGE_COUNT] = {
+    [SPAN_STAGE_MEASURE] = "measure",
+    [SPAN_STAGE_ECHO] = "echo",
+    [SPAN_STAGE_FILTER] = "filter",
+    [SPAN_STAGE_LED] = "led",
+    [SPAN_STAGE_JSON] = "json",
+    [SPAN_STAGE_CONNECT] = "connect",
+    [SPAN_STAGE_POST] = "post",
+    [SPAN_STAGE_RESPONSE] = "response",
+    [SPAN_STAGE_UPLOAD] = "upload",
+};
+
+static span_histogram_t s_histograms[SPAN_STAGE_COUNT];
+static span_histogram_t s_uploading[SPAN_STAGE_COUNT];    /* Window being posted, merged back on failure */
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t s_window_start_ms;
+
+static inline int span_bucket(uint32_t us) {
+    if (us < (1u << SPAN_SUB_BITS)) return (int)us;
+
+    int msb = 31 - __builtin_clz(us);
+    int sub = (int)(us >> (msb - SPAN_SUB_BITS)) & ((1 << SPAN_SUB_BITS) - 1);
+    return ((msb - SPAN_SUB_BITS + 1) << SPAN_SUB_BITS) + sub;
+}
+
+/* Largest value that falls into a bucket */
+static uint32_t span_bucket_upper(int bucket) {
+    if (bucket < (1 << SPAN_SUB_BITS)) return (uint32_t)bucket;
+
+    int msb = (bucket >> SPAN_SUB_BITS) + SPAN_SUB_BITS - 1;
+    uint64_t sub = (uint64_t)(bucket & ((1 << SPAN_SUB_BITS) - 1)) + (1u << SPAN_SUB_BITS) + 1;
+    uint64_t upper = (sub << (msb - SPAN_SUB_BITS)) - 1;
+    return upper > UINT32_MAX ? UINT32_MAX : (uint32_t)upper;
+}
+
+void span_trace_record(span_stage_t stage, uint32_t duration_us) {
+    if (stage >= SPAN_STAGE_COUNT) return;
+
+    int bucket = span_bucket(duration_us);
+    span_histogram_t *hist = &s_histograms[stage];
+
+    portENTER_CRITICAL(&s_lock);
+    hist->count++;
+    hist->total_us += duration_us;
+    hist->buckets[bucket]++;
+    if (duration_us > hist->max_us) {
+        hist->max_us = duration_us;
+    }
+    portEXIT_CRITICAL(&s_lock);
+}
+
+static void span_histogram_merge(span_histogram_t *hist, const span_histogram_t *from) {
+    hist->count += from->count;
+    hist->total_us += from->total_us;
+    if (from->max_us > hist->max_us) {
+        hist->max_us = from->max_us;
+    }
+    for (int i = 0; i < SPAN_BUCKETS; i++) {
+        hist->buckets[i] += from->buckets[i];
+    }
+}
+
+static uint32_t span_percentile(const span_histogram_t *hist, uint32_t per_mille) {
+    /* Rank of the sample at this percentile, rounded up */
+    uint32_t rank = (uint32_t)(((uint64_t)hist->count * per_mille + 999) / 1000);
+    uint32_t seen = 0;
+
+    for (int i = 0; i < SPAN_BUCKETS; i++) {
+        seen += hist->buckets[i];
+        if (seen >= rank && seen > 0) {
+            uint32_t upper = span_bucket_upper(i);
+            return upper < hist->max_us ? upper : hist->max_us;
+        }
+    }
+    return hist->max_us;
+}
+
+static void span_summarize(const span_histogram_t *hist, span_summary_t *summary) {
+    memset(summary, 0, sizeof(*summary));
+    if (hist->count == 0) return;
+    summary->count = hist->count;
+    summary->p50_us = span_percentile(hist, 500);
+    summary->p95_us = span_percentile(hist, 950);
+    summary->p99_us = span_percentile(hist, 990);
+    summary->max_us = hist->max_us;
+    summary->avg_us = (uint32_t)(hist->total_us / hist->count);
+}
+
+void span_trace_get_summary(span_stage_t stage, span_summary_t *summary) {
+    memset(summary, 0, sizeof(*summary));
+    if (stage >= SPAN_STAGE_COUNT) return;
+
+    /* Percentiles walk the buckets, so work on a snapshot */
+    span_histogram_t snapshot;
+    portENTER_CRITICAL(&s_lock);
+    snapshot = s_histograms[stage];
+    portEXIT_CRITICAL(&s_lock);
+    span_summarize(&snapshot, summary);
+}
+
+void span_trace_reset(void) {
+    portENTER_CRITICAL(&s_lock);
+    memset(s_histograms, 0, sizeof(s_histograms));
+    portEXIT_CRITICAL(&s_lock);
+    s_window_start_ms = (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+void span_trace_print_stats(void) {
+    uint32_t window_ms = (uint32_t)(esp_timer_get_time() / 1000) - s_window_start_ms;
+
+    ESP_LOGI(TAG, "===== LATENCY SPANS (last %lu s) =====", (unsigned long)(window_ms / 1000));
+    ESP_LOGI(TAG, "%-8s %7s %9s %9s %9s %9s", "stage", "count", "p50_us", "p95_us", "p99_us", "max_us");
+    for (int stage = 0; stage < SPAN_STAGE_COUNT; stage++) {
+        span_summary_t summary;
+        span_trace_get_summary((span_stage_t)stage, &summary);
+        if (summary.count == 0) continue;
+        ESP_LOGI(TAG, "%-8s %7lu %9lu %9lu %9lu %9lu", s_stage_names[stage],
+            (unsigned long)summary.count, (unsigned long)summary.p50_us, (unsigned long)summary.p95_us,
+            (unsigned long)summary.p99_us, (unsigned long)summary.max_us);
+    }
+}
+
+void span_trace_upload_if_due(void) {
+    uint32_t now_ms = (uint32_t)(esp_timer_get_time() / 1000);
+    if (now_ms - s_window_start_ms < SPAN_TRACE_UPLOAD_INTERVAL_MS) return;
+
+    /* Spans recorded from here on, the POST's own included, go into the next window;
+     * one stage at a time, so the lock is only held for a single copy */
+    for (int stage = 0; stage < SPAN_STAGE_COUNT; stage++) {
+        portENTER_CRITICAL(&s_lock);
+        s_uploading[stage] = s_histograms[stage];
+        memset(&s_histograms[stage], 0, sizeof(s_histograms[stage]));
+        portEXIT_CRITICAL(&s_lock);
+    }
+
+    /* {"window_ms":N,"spans":{"stage":[count,p50,p95,p99,max],...}} */
+    static char body[64 + SPAN_STAGE_COUNT * 72];
+    int len = snprintf(body, sizeof(body), "{\"window_ms\":%lu,\"spans\":{",
+        (unsigned long)(now_ms - s_window_start_ms));
+    bool first = true;
+    for (int stage = 0; stage < SPAN_STAGE_COUNT; stage++) {
+        span_summary_t summary;
+        span_summarize(&s_uploading[stage], &summary);
+        if (summary.count == 0) continue;
+        len += snprintf(body + len, sizeof(body) - len, "%s\"%s\":[%lu,%lu,%lu,%lu,%lu]",
+            first ? "" : ",", s_stage_names[stage], (unsigned long)summary.count,
+            (unsigned long)summary.p50_us, (unsigned long)summary.p95_us,
+            (unsigned long)summary.p99_us, (unsigned long)summary.max_us);
+        first = false;
+    }
+    snprintf(body + len, sizeof(body) - len, "}}");
+
+    int status_code = http_client_post(SPAN_TRACE_ENDPOINT, body);
+    if (status_code >= 200 && status_code < 300) {
+        /* Each upload covers one window */
+        s_window_start_ms = now_ms;
+        return;
+    }
+    /* The next upload reports them, its window running from the same start */
+    for (int stage = 0; stage < SPAN_STAGE_COUNT; stage++) {
+        portENTER_CRITICAL(&s_lock);
+        span_histogram_merge(&s_histograms[stage], &s_uploading[stage]);
+        portEXIT_CRITICAL(&s_lock);
+    }
+    ESP_LOGW(TAG, "Latency summary upload failed (%d), keeping histograms", status_code);
+}
+
+void span_trace_init(void) {
+    s_window_start_ms = (uint32_t)(esp_timer_get_time() / 1000);
+    console_register(SPAN_TRACE_COMMAND, span_trace_print_stats);
+    console_register(SPAN_TRACE_RESET_COMMAND, span_trace_reset);
+}
+
+#else
+
+/* Nothing is recorded, so the summaries are empty and there is nothing to send */
+void span_trace_get_summary(span_stage_t stage, span_summary_t *summary) {
+    memset(summary, 0, sizeof(*summary));
+}
+
+void span_trace_reset(void) {
+}
+
+void span_trace_print_stats(void) {
+}
+
+void span_trace_upload_if_due(void) {
+}
+
+void span_trace_init(void) {
+}
+
+#endif
@@ -0,0 +1,61 @@
+/**
+ * @file span_trace.h
+ * @brief Per-stage latency spans aggregated into fixed-bucket histograms
+ *
+ * Spans are taken with SPAN_START()/SPAN_END(); with SPAN_TRACE_ENABLED set
+ * to 0 the macros compile to nothing.
+ */
+#ifndef SPAN_TRACE_H
+#define SPAN_TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "config.h"
+#include "esp_timer.h"
+
+/* Pipeline stages from a car arriving to the server knowing; spans may nest */
+typedef enum {
+    SPAN_STAGE_MEASURE = 0,     /* measure_distance(): trigger to filtered state */
+    SPAN_STAGE_ECHO,            /* Trigger pulse to echo falling edge */
+    SPAN_STAGE_FILTER,          /* Validation, median and hysteresis */
+    SPAN_STAGE_LED,             /* led_flush() */
+    SPAN_STAGE_JSON,            /* cJSON build and print */
+    SPAN_STAGE_CONNECT,         /* TCP + TLS handshake */
+    SPAN_STAGE_POST,            /* Request start to headers sent */
+    SPAN_STAGE_RESPONSE,        /* Headers sent to response complete */
+    SPAN_STAGE_UPLOAD,          /* State change enqueued to acknowledged */
+    SPAN_STAGE_COUNT,
+} span_stage_t;
+
+/* Summary of one stage's histogram, in microseconds */
+typedef struct {
+    uint32_t count;
+    uint32_t p50_us;
+    uint32_t p95_us;
+    uint32_t p99_us;
+    uint32_t max_us;
+    uint32_t avg_us;
+} span_summary_t;
+
+typedef uint32_t span_t;
+
+#if SPAN_TRACE_ENABLED
+#define SPAN_START() ((span_t)esp_timer_get_time())
+#define SPAN_END(stage, start) span_trace_record((stage), (span_t)esp_timer_get_time() - (start))
+#define SPAN_RECORD(stage, us) span_trace_record((stage), (us))
+#else
+#define SPAN_START() ((span_t)0)
+#define SPAN_END(stage, start) ((void)(start))
+#define SPAN_RECORD(stage, us) ((void)(us))
+#endif
+
+void span_trace_init(void);
+#if SPAN_TRACE_ENABLED
+void span_trace_record(span_stage_t stage, uint32_t duration_us);
+#endif
+void span_trace_get_summary(span_stage_t stage, span_summary_t *summary);
+void span_trace_reset(void);
+void span_trace_upload_if_due(void);
+void span_trace_print_stats(void);
+
+#endif /* SPAN_TRACE_H */
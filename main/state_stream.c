@@ -0,0 +1,267 @@
+/**
+ * @file state_stream.c
+ * @brief Implementation of the binary state-delta stream
+ *
+ * A batch is written as one run of UPDATE frames and the call waits for
+ * the cumulative ACK that covers its last sequence number, so callers see
+ * the same per-update acked flags as with the JSON POST. Sequence numbers
+ * restart per boot; the server resets its per-slot ordering on each HELLO.
+ */
+#include "state_stream.h"
+#include "parking_slot.h"
+#include "config.h"
+#include "tls_session.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_transport.h"
+#include "esp_transport_ssl.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include <string.h>
+
+#define STREAM_TX_BUFFER_SIZE 512
+#define STREAM_RX_BUFFER_SIZE 64
+
+_Static_assert(BATCH_MAX_SIZE * 4 <= STREAM_TX_BUFFER_SIZE, "batch does not fit the frame buffer");
+_Static_assert(MAX_PARKING_SLOTS <= STREAM_MAX_SLOTS, "slot index does not fit the UPDATE frame");
+
+static esp_transport_handle_t s_transport = NULL;
+static bool s_connected = false;
+static bool s_have_ticket = false;      /* Transport holds the ticket of its last connection */
+static SemaphoreHandle_t s_lock = NULL;
+static StaticSemaphore_t s_lock_buffer;
+static uint32_t s_next_seq = 0;
+static state_stream_stats_t s_stats;
+
+static uint8_t s_tx[STREAM_TX_BUFFER_SIZE];
+static uint8_t s_rx[STREAM_RX_BUFFER_SIZE];
+static size_t s_rx_len = 0;
+
+static void stream_put_word(uint8_t *p, uint32_t word) {
+    p[0] = (uint8_t)word;
+    p[1] = (uint8_t)(word >> 8);
+    p[2] = (uint8_t)(word >> 16);
+    p[3] = (uint8_t)(word >> 24);
+}
+
+static uint32_t stream_get_word(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static bool stream_write_all(const uint8_t *data, int len) {
+    while (len > 0) {
+        int written = esp_transport_write(s_transport, (const char *)data, len, STREAM_ACK_TIMEOUT_MS);
+        if (written <= 0) {
+            ESP_LOGE(TAG, "Stream write failed (%d)", written);
+            return false;
+        }
+        s_stats.bytes_sent += (uint64_t)written;
+        data += written;
+        len -= written;
+    }
+    return true;
+}
+
+static void stream_disconnect(void) {
+    if (s_connected) {
+        esp_transport_close(s_transport);
+        s_connected = false;
+    }
+    s_rx_len = 0;
+}
+
+/* Send HELLO with the slot names, packed into as few TLS records as the buffer allows */
+static bool stream_send_hello(void) {
+    int total = get_total_parking_slots();
+    uint32_t names_len = 0;
+    for (int i = 0; i < total; i++) {
+        names_len += strlen(parking_slot_name(i)) + 1;
+    }
+
+    size_t used = 4;
+    stream_put_word(s_tx, stream_frame_hello(total, names_len));
+    for (int i = 0; i < total; i++) {
+        const char *name = parking_slot_name(i);
+        size_t len = strlen(name) + 1;
+        if (used + len > sizeof(s_tx)) {
+            if (!stream_write_all(s_tx, (int)used)) return false;
+            used = 0;
+        }
+        memcpy(s_tx + used, name, len);
+        used += len;
+    }
+    return stream_write_all(s_tx, (int)used);
+}
+
+static bool stream_connect(void) {
+    if (s_connected) return true;
+
+    if (s_transport == NULL) {
+        s_transport = esp_transport_ssl_init();
+        if (s_transport == NULL) {
+            ESP_LOGE(TAG, "Failed to create stream transport");
+            return false;
+        }
+#if TLS_SESSION_RESUME
+        esp_transport_ssl_session_tickets_enable(s_transport);
+#endif
+    }
+
+    int64_t start_us = esp_timer_get_time();
+    if (esp_transport_connect(s_transport, STREAM_HOST, STREAM_PORT, STREAM_CONNECT_TIMEOUT_MS) < 0) {
+        ESP_LOGE(TAG, "Stream connect to %s:%d failed", STREAM_HOST, STREAM_PORT);
+        return false;
+    }
+    tls_session_record(s_have_ticket, (uint32_t)((esp_timer_get_time() - start_us) / 1000));
+    s_have_ticket = true;
+    s_connected = true;
+    s_rx_len = 0;
+    s_stats.connects++;
+    ESP_LOGI(TAG, "Stream connected to %s:%d", STREAM_HOST, STREAM_PORT);
+
+    if (!stream_send_hello()) {
+        stream_disconnect();
+        return false;
+    }
+    return true;
+}
+
+/* Read acks until one covers last_seq. Returns false on timeout or a broken stream. */
+static bool stream_wait_ack(uint32_t last_seq, uint32_t *ack_seq, bool *have_ack) {
+    int64_t deadline_us = esp_timer_get_time() + (int64_t)STREAM_ACK_TIMEOUT_MS * 1000;
+
+    while (1) {
+        size_t pos = 0;
+        for (; pos + 4 <= s_rx_len; pos += 4) {
+            uint32_t word = stream_get_word(s_rx + pos);
+            if (stream_frame_type(word) == STREAM_FRAME_ACK) {
+                *ack_seq = word & STREAM_SEQ_MASK;
+                *have_ack = true;
+            }
+        }
+        memmove(s_rx, s_rx + pos, s_rx_len - pos);
+        s_rx_len -= pos;
+
+        if (*have_ack && stream_seq_covered(last_seq, *ack_seq)) {
+            return true;
+        }
+
+        int remaining_ms = (int)((deadline_us - esp_timer_get_time()) / 1000);
+        if (remaining_ms <= 0) {
+            s_stats.timeouts++;
+            ESP_LOGW(TAG, "Stream ack for seq %lu timed out", (unsigned long)last_seq);
+            return false;
+        }
+
+        int len = esp_transport_read(s_transport, (char *)s_rx + s_rx_len, (int)(sizeof(s_rx) - s_rx_len), remaining_ms);
+        if (len > 0) {
+            s_rx_len += (size_t)len;
+            s_stats.bytes_received += (uint64_t)len;
+        } else if (len != ERR_TCP_TRANSPORT_CONNECTION_TIMEOUT) {
+            ESP_LOGE(TAG, "Stream read failed (%d)", len);
+            return false;
+        }
+    }
+}
+
+int state_stream_send(parking_update_t *updates, int count) {
+    if (count <= 0) return 0;
+    if (count > BATCH_MAX_SIZE) count = BATCH_MAX_SIZE;
+
+    if (s_lock == NULL) {
+        s_lock = xSemaphoreCreateMutexStatic(&s_lock_buffer);
+        if (s_lock == NULL) return 0;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+
+    /* Sequence numbers are fixed before sending, so a retry reuses them */
+    uint32_t first_seq = s_next_seq;
+    uint32_t last_seq = (first_seq + (uint32_t)count - 1) & STREAM_SEQ_MASK;
+    s_next_seq = (first_seq + (uint32_t)count) & STREAM_SEQ_MASK;
+    for (int i = 0; i < count; i++) {
+        updates[i].acked = false;
+    }
+
+    bool written = false;
+    for (int attempt = 0; attempt <= HTTP_MAX_RECONNECTS && !written; attempt++) {
+        if (attempt > 0) {
+            ESP_LOGW(TAG, "Reconnecting stream (attempt %d)", attempt);
+            s_stats.reconnects++;
+            stream_disconnect();
+        }
+        /* Connecting sends HELLO through s_tx, so frames are re-encoded after it */
+        if (stream_connect()) {
+            for (int i = 0; i < count; i++) {
+                stream_put_word(s_tx + 4 * i,
+                    stream_frame_update(updates[i].slot_index, updates[i].is_taken, first_seq + i));
+            }
+            written = stream_write_all(s_tx, count * 4);
+        }
+    }
+
+    int acked = 0;
+    if (written) {
+        int64_t start_us = esp_timer_get_time();
+        uint32_t ack_seq = 0;
+        bool have_ack = false;
+        if (!stream_wait_ack(last_seq, &ack_seq, &have_ack)) {
+            /* Unknown how much the server took; start over on a fresh connection */
+            stream_disconnect();
+        }
+        uint32_t ack_ms = (uint32_t)((esp_timer_get_time() - start_us) / 1000);
+        s_stats.last_ack_ms = ack_ms;
+        if (ack_ms > s_stats.max_ack_ms) {
+            s_stats.max_ack_ms = ack_ms;
+        }
+
+        for (int i = 0; have_ack && i < count; i++) {
+            if (stream_seq_covered((first_seq + i) & STREAM_SEQ_MASK, ack_seq)) {
+                updates[i].acked = true;
+                acked++;
+            }
+        }
+        s_stats.updates += (uint32_t)count;
+        s_stats.acked += (uint32_t)acked;
+    } else {
+        stream_disconnect();
+    }
+
+    xSemaphoreGive(s_lock);
+    return acked;
+}
+
+void state_stream_close(void) {
+    if (s_lock == NULL) return;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    stream_disconnect();
+    xSemaphoreGive(s_lock);
+}
+
+void state_stream_get_stats(state_stream_stats_t *stats) {
+    if (stats == NULL) return;
+
+    if (s_lock != NULL) {
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+    }
+    *stats = s_stats;
+    if (s_lock != NULL) {
+        xSemaphoreGive(s_lock);
+    }
+}
+
+void state_stream_print_stats(void) {
+    state_stream_stats_t stats;
+    state_stream_get_stats(&stats);
+
+    uint32_t bytes_per_update = stats.updates ? (uint32_t)((stats.bytes_sent + stats.bytes_received) / stats.updates) : 0;
+
+    ESP_LOGI(TAG, "===== STATE STREAM STATS =====");
+    ESP_LOGI(TAG, "Updates: %lu (acked: %lu), connects: %lu, reconnects: %lu, ack timeouts: %lu",
+        (unsigned long)stats.updates, (unsigned long)stats.acked, (unsigned long)stats.connects,
+        (unsigned long)stats.reconnects, (unsigned long)stats.timeouts);
+    ESP_LOGI(TAG, "Bytes sent/received: %lu/%lu (%lu per update)",
+        (unsigned long)stats.bytes_sent, (unsigned long)stats.bytes_received, (unsigned long)bytes_per_update);
+    ESP_LOGI(TAG, "Write-to-ack last/max: %lu/%lu ms", (unsigned long)stats.last_ack_ms, (unsigned long)stats.max_ack_ms);
+}
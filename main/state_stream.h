@@ -0,0 +1,69 @@
+/**
+ * @file state_stream.h
+ * @brief Bit-packed state deltas over one persistent TLS stream
+ *
+ * Wire format: little-endian 32-bit words.
+ *   UPDATE  [31:30]=1  [29]=taken  [28:20]=slot index  [19:0]=sequence
+ *   ACK     [31:30]=2  [19:0]=highest sequence received (cumulative)
+ *   HELLO   [31:30]=3  [29:26]=version  [25:17]=slot count  [16:0]=name block length,
+ *           followed by the slot names, each NUL-terminated, in slot order
+ * The device sends HELLO once per connection so the server can map slot
+ * indexes to spot names; every UPDATE after that is four bytes.
+ */
+#ifndef STATE_STREAM_H
+#define STATE_STREAM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "http_client.h"
+
+#define STREAM_FRAME_UPDATE 1u
+#define STREAM_FRAME_ACK 2u
+#define STREAM_FRAME_HELLO 3u
+#define STREAM_PROTOCOL_VERSION 1u
+#define STREAM_SEQ_BITS 20
+#define STREAM_SEQ_MASK ((1u << STREAM_SEQ_BITS) - 1)
+#define STREAM_MAX_SLOTS 512        /* 9-bit slot index */
+
+static inline uint32_t stream_frame_type(uint32_t word) {
+    return word >> 30;
+}
+
+static inline uint32_t stream_frame_update(int slot_index, bool is_taken, uint32_t seq) {
+    return (STREAM_FRAME_UPDATE << 30) | ((uint32_t)is_taken << 29) |
+           (((uint32_t)slot_index & 0x1FF) << 20) | (seq & STREAM_SEQ_MASK);
+}
+
+static inline uint32_t stream_frame_ack(uint32_t seq) {
+    return (STREAM_FRAME_ACK << 30) | (seq & STREAM_SEQ_MASK);
+}
+
+static inline uint32_t stream_frame_hello(int slot_count, uint32_t names_len) {
+    return (STREAM_FRAME_HELLO << 30) | (STREAM_PROTOCOL_VERSION << 26) |
+           (((uint32_t)slot_count & 0x1FF) << 17) | (names_len & 0x1FFFF);
+}
+
+/* True if seq is at or before ack in 20-bit serial number arithmetic */
+static inline bool stream_seq_covered(uint32_t seq, uint32_t ack) {
+    return ((ack - seq) & STREAM_SEQ_MASK) < (1u << (STREAM_SEQ_BITS - 1));
+}
+
+/* Counters for the frame stream */
+typedef struct {
+    uint32_t updates;           /* UPDATE frames written */
+    uint32_t acked;             /* Updates covered by an ACK */
+    uint32_t connects;          /* TLS connections opened (each followed by HELLO) */
+    uint32_t reconnects;        /* Writes retried on a fresh connection */
+    uint32_t timeouts;          /* Batches whose ack did not arrive in time */
+    uint64_t bytes_sent;        /* Frame bytes written, HELLO included */
+    uint64_t bytes_received;    /* Ack bytes read */
+    uint32_t last_ack_ms;       /* Write-to-ack time of the most recent batch */
+    uint32_t max_ack_ms;        /* Worst write-to-ack time seen */
+} state_stream_stats_t;
+
+int state_stream_send(parking_update_t *updates, int count);
+void state_stream_close(void);
+void state_stream_get_stats(state_stream_stats_t *stats);
+void state_stream_print_stats(void);
+
+#endif /* STATE_STREAM_H */
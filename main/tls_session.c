@@ -0,0 +1,59 @@
+/**
+ * @file tls_session.c
+ * @brief Handshake timing shared by the HTTPS session and the frame stream
+ *
+ * Neither esp_http_client nor esp_transport_ssl reports whether the server
+ * accepted the offered ticket; a server that declines it falls back to a
+ * full handshake inside the same connect. So a connect with a ticket
+ * counts as resumed only if it took at most half the mean full handshake,
+ * or TLS_RESUME_MAX_MS before any full handshake was timed.
+ */
+#include "tls_session.h"
+
+#include "esp_log.h"
+
+static tls_session_stats_t s_stats;
+
+static tls_handshake_kind_t tls_session_classify(bool have_ticket, uint32_t connect_ms) {
+    if (!TLS_SESSION_RESUME || !have_ticket) return TLS_HANDSHAKE_FULL;
+
+    s_stats.tickets_offered++;
+    const tls_handshake_stats_t *full = &s_stats.kind[TLS_HANDSHAKE_FULL];
+    uint32_t limit_ms = full->count ? (uint32_t)(full->total_ms / full->count / 2) : TLS_RESUME_MAX_MS;
+    if (connect_ms <= limit_ms) return TLS_HANDSHAKE_RESUMED;
+
+    s_stats.tickets_declined++;
+    return TLS_HANDSHAKE_FULL;
+}
+
+void tls_session_record(bool have_ticket, uint32_t connect_ms) {
+    tls_handshake_stats_t *hs = &s_stats.kind[tls_session_classify(have_ticket, connect_ms)];
+    hs->count++;
+    hs->last_ms = connect_ms;
+    hs->total_ms += connect_ms;
+    if (connect_ms > hs->max_ms) {
+        hs->max_ms = connect_ms;
+    }
+}
+
+void tls_session_get_stats(tls_session_stats_t *stats) {
+    if (stats == NULL) return;
+    *stats = s_stats;
+}
+
+void tls_session_print_stats(void) {
+    static const char *const names[TLS_HANDSHAKE_KIND_COUNT] = { "Full", "Resumed" };
+
+    tls_session_stats_t stats;
+    tls_session_get_stats(&stats);
+
+    ESP_LOGI(TAG, "===== TLS HANDSHAKE STATS =====");
+    for (int i = 0; i < TLS_HANDSHAKE_KIND_COUNT; i++) {
+        const tls_handshake_stats_t *hs = &stats.kind[i];
+        ESP_LOGI(TAG, "%s: %lu, connect avg/last/max: %lu/%lu/%lu ms", names[i], (unsigned long)hs->count,
+            hs->count ? (unsigned long)(hs->total_ms / hs->count) : 0UL,
+            (unsigned long)hs->last_ms, (unsigned long)hs->max_ms);
+    }
+    ESP_LOGI(TAG, "Tickets offered: %lu, declined: %lu",
+        (unsigned long)stats.tickets_offered, (unsigned long)stats.tickets_declined);
+}
@@ -0,0 +1,55 @@
+/**
+ * @file tls_session.h
+ * @brief TLS session resumption and handshake timing
+ *
+ * Both the HTTPS session and the frame stream keep the session ticket of
+ * their last connection and offer it on the next connect, so a dropped link
+ * costs an abbreviated handshake instead of a full one. Connect times are
+ * recorded separately for full and resumed handshakes.
+ *
+ * The ticket is held in RAM only and does not survive a reboot or deep
+ * sleep. esp_tls_get_client_session() and mbedtls_ssl_session_save() could
+ * serialize it, but neither esp_http_client nor esp_transport_ssl takes a
+ * session for the next connect; persisting it would mean driving esp_tls
+ * directly instead of through those clients.
+ */
+#ifndef TLS_SESSION_H
+#define TLS_SESSION_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "sdkconfig.h"
+#include "config.h"
+
+/* Ticket reuse needs the esp-tls client session support compiled in */
+#if TLS_SESSION_TICKETS && defined(CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS)
+#define TLS_SESSION_RESUME 1
+#else
+#define TLS_SESSION_RESUME 0
+#endif
+
+typedef enum {
+    TLS_HANDSHAKE_FULL = 0,     /* Certificate exchange and key agreement, with or without a ticket offered */
+    TLS_HANDSHAKE_RESUMED,      /* Ticket offered and the connect was short enough to be an abbreviated one */
+    TLS_HANDSHAKE_KIND_COUNT
+} tls_handshake_kind_t;
+
+/* Connect time (TCP + TLS) of one handshake kind */
+typedef struct {
+    uint32_t count;
+    uint32_t last_ms;
+    uint32_t max_ms;
+    uint64_t total_ms;
+} tls_handshake_stats_t;
+
+typedef struct {
+    tls_handshake_stats_t kind[TLS_HANDSHAKE_KIND_COUNT];
+    uint32_t tickets_offered;   /* Connects that offered a ticket */
+    uint32_t tickets_declined;  /* Of those, connects that took a full handshake's time */
+} tls_session_stats_t;
+
+void tls_session_record(bool have_ticket, uint32_t connect_ms);
+void tls_session_get_stats(tls_session_stats_t *stats);
+void tls_session_print_stats(void);
+
+#endif /* TLS_SESSION_H */
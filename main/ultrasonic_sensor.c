@@ -1,41 +1,295 @@
 /**
  * @file ultrasonic_sensor.c
  * @brief Implementation of ultrasonic sensor functions
+ *
+ * Echo edges are timestamped from a GPIO any-edge interrupt using the full
+ * 64-bit esp_timer clock. Completed readings are posted to a queue, so the
+ * CPU is free while a measurement is in flight and many sensors can be
+ * triggered at once. This is the GPIO sensor backend (sensor_backend_gpio).
  */
 #include "ultrasonic_sensor.h"
+#include "sensor_backend.h"
+#include "rtos_ticks.h"
 #include "config.h"
 
 #include "esp_log.h"
+#include "esp_attr.h"
+#include "esp_cpu.h"
+#include "esp_rom_sys.h"
 #include "driver/gpio.h"
 #include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/queue.h"
 
-float measure_ultrasonic_distance(int trig_pin, int echo_pin) {
-    /* Send trigger pulse */
-    gpio_set_level(trig_pin, 0);
-    vTaskDelay(pdMS_TO_TICKS(2));
-    gpio_set_level(trig_pin, 1);
-    vTaskDelay(pdMS_TO_TICKS(10));
+typedef enum {
+    SENSOR_IDLE = 0,        /* No measurement in flight */
+    SENSOR_ARMED,           /* Trigger sent, waiting for the echo rising edge */
+    SENSOR_ECHO,            /* Echo high, waiting for the falling edge */
+} sensor_state_t;
+
+typedef struct {
+    int sensor_id;
+    int trig_pin;
+    int echo_pin;
+    bool in_use;
+    volatile sensor_state_t state;
+    volatile int64_t trigger_us;
+    volatile int64_t rise_us;
+    volatile uint32_t cpu_cycles;   /* Cycles spent on the current reading */
+} ultrasonic_sensor_t;
+
+static ultrasonic_sensor_t s_sensors[ULTRASONIC_MAX_SENSORS];
+static QueueHandle_t s_result_queue = NULL;
+static StaticQueue_t s_result_queue_buffer;
+static uint8_t s_result_queue_storage[ULTRASONIC_MAX_SENSORS * sizeof(ultrasonic_reading_t)];
+static ultrasonic_stats_t s_stats;
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/* At the current CPU clock, which power management may have scaled down */
+static inline uint32_t cycles_to_us(uint32_t cycles) {
+    return cycles / esp_rom_get_cpu_ticks_per_us();
+}
+
+static void IRAM_ATTR ultrasonic_record_stats(uint32_t cpu_us, bool valid) {
+    if (valid) {
+        s_stats.readings++;
+    } else {
+        s_stats.timeouts++;
+    }
+    s_stats.last_cpu_us = cpu_us;
+    s_stats.total_cpu_us += cpu_us;
+    if (cpu_us > s_stats.max_cpu_us) {
+        s_stats.max_cpu_us = cpu_us;
+    }
+}
+
+/* Timestamp echo edges; the reading is complete on the falling edge */
+static void IRAM_ATTR echo_isr_handler(void *arg) {
+    uint32_t entry_cycles = esp_cpu_get_cycle_count();
+    ultrasonic_sensor_t *sensor = (ultrasonic_sensor_t *)arg;
+    int64_t now_us = esp_timer_get_time();
+    int level = gpio_get_level(sensor->echo_pin);
+    BaseType_t higher_priority_woken = pdFALSE;
+    ultrasonic_reading_t reading;
+    bool done = false;
+
+    portENTER_CRITICAL_ISR(&s_lock);
+    if (sensor->state == SENSOR_ARMED && level == 1) {
+        sensor->rise_us = now_us;
+        sensor->state = SENSOR_ECHO;
+        sensor->cpu_cycles += esp_cpu_get_cycle_count() - entry_cycles;
+    } else if (sensor->state == SENSOR_ECHO && level == 0) {
+        sensor->cpu_cycles += esp_cpu_get_cycle_count() - entry_cycles;
+        reading = (ultrasonic_reading_t){
+            .sensor_id = sensor->sensor_id,
+            .valid = true,
+            .echo_us = (uint32_t)(now_us - sensor->rise_us),
+            .trigger_us = sensor->trigger_us,
+            .done_us = now_us,
+            .cpu_us = cycles_to_us(sensor->cpu_cycles),
+        };
+        sensor->state = SENSOR_IDLE;
+        ultrasonic_record_stats(reading.cpu_us, true);
+        done = true;
+    }
+    portEXIT_CRITICAL_ISR(&s_lock);
+
+    /* No FreeRTOS calls inside the critical section */
+    if (done) {
+        xQueueSendFromISR(s_result_queue, &reading, &higher_priority_woken);
+    }
+    if (higher_priority_woken) {
+        portYIELD_FROM_ISR();
+    }
+}
+
+esp_err_t ultrasonic_sensor_init(void) {
+    if (s_result_queue != NULL) return ESP_OK;
+
+    s_result_queue = xQueueCreateStatic(ULTRASONIC_MAX_SENSORS, sizeof(ultrasonic_reading_t),
+        s_result_queue_storage, &s_result_queue_buffer);
+    if (s_result_queue == NULL) {
+        ESP_LOGE(TAG, "Failed to create ultrasonic result queue");
+        return ESP_ERR_NO_MEM;
+    }
+
+    /* The ISR service may already be installed by another driver */
+    esp_err_t err = gpio_install_isr_service(0);
+    if (err != ESP_OK && err != ESP_ERR_INVALID_STATE) {
+        ESP_LOGE(TAG, "Failed to install GPIO ISR service: %s", esp_err_to_name(err));
+        return err;
+    }
+    return ESP_OK;
+}
+
+esp_err_t ultrasonic_sensor_add(int sensor_id, int trig_pin, int echo_pin) {
+    if (sensor_id < 0 || sensor_id >= ULTRASONIC_MAX_SENSORS) return ESP_ERR_INVALID_ARG;
+
+    ultrasonic_sensor_t *sensor = &s_sensors[sensor_id];
+    sensor->sensor_id = sensor_id;
+    sensor->trig_pin = trig_pin;
+    sensor->echo_pin = echo_pin;
+    sensor->state = SENSOR_IDLE;
+
+    gpio_reset_pin(trig_pin);
+    gpio_set_direction(trig_pin, GPIO_MODE_OUTPUT);
     gpio_set_level(trig_pin, 0);
 
-    /* Wait for echo to start with timeout */
-    uint32_t startTime = esp_timer_get_time();
-    uint32_t timeout = startTime + 30000; /* 30ms timeout */
+    gpio_reset_pin(echo_pin);
+    gpio_set_direction(echo_pin, GPIO_MODE_INPUT);
+    gpio_set_intr_type(echo_pin, GPIO_INTR_ANYEDGE);
+
+    esp_err_t err = gpio_isr_handler_add(echo_pin, echo_isr_handler, sensor);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to attach echo ISR on GPIO %d: %s", echo_pin, esp_err_to_name(err));
+        return err;
+    }
+    gpio_intr_enable(echo_pin);
+
+    sensor->in_use = true;
+    return ESP_OK;
+}
+
+esp_err_t ultrasonic_sensor_trigger(int sensor_id) {
+    if (sensor_id < 0 || sensor_id >= ULTRASONIC_MAX_SENSORS) return ESP_ERR_INVALID_ARG;
 
-    while (gpio_get_level(echo_pin) == 0 && esp_timer_get_time() < timeout) { 
-        startTime = esp_timer_get_time(); 
+    ultrasonic_sensor_t *sensor = &s_sensors[sensor_id];
+    if (!sensor->in_use) return ESP_ERR_INVALID_STATE;
+
+    uint32_t entry_cycles = esp_cpu_get_cycle_count();
+
+    portENTER_CRITICAL(&s_lock);
+    sensor->state = SENSOR_ARMED;
+    sensor->cpu_cycles = 0;
+    sensor->trigger_us = esp_timer_get_time();
+    portEXIT_CRITICAL(&s_lock);
+
+    /* A real 10 us trigger pulse instead of a 10 ms task delay */
+    gpio_set_level(sensor->trig_pin, 1);
+    esp_rom_delay_us(ULTRASONIC_TRIGGER_PULSE_US);
+    gpio_set_level(sensor->trig_pin, 0);
+
+    portENTER_CRITICAL(&s_lock);
+    sensor->cpu_cycles += esp_cpu_get_cycle_count() - entry_cycles;
+    portEXIT_CRITICAL(&s_lock);
+    return ESP_OK;
+}
+
+bool ultrasonic_sensor_wait(ultrasonic_reading_t *reading, uint32_t timeout_ms) {
+    if (s_result_queue == NULL || reading == NULL) return false;
+    return xQueueReceive(s_result_queue, reading, rtos_ticks_at_least(timeout_ms)) == pdTRUE;
+}
+
+/* Abandon an in-flight measurement; caller holds s_lock */
+static bool ultrasonic_cancel_locked(ultrasonic_sensor_t *sensor, ultrasonic_reading_t *reading) {
+    if (sensor->state == SENSOR_IDLE) return false;
+
+    sensor->state = SENSOR_IDLE;
+    uint32_t cpu_us = cycles_to_us(sensor->cpu_cycles);
+    if (reading != NULL) {
+        reading->sensor_id = sensor->sensor_id;
+        reading->valid = false;
+        reading->echo_us = 0;
+        reading->trigger_us = sensor->trigger_us;
+        reading->done_us = esp_timer_get_time();
+        reading->cpu_us = cpu_us;
     }
+    ultrasonic_record_stats(cpu_us, false);
+    return true;
+}
+
+bool ultrasonic_sensor_expire(int sensor_id, ultrasonic_reading_t *reading) {
+    if (sensor_id < 0 || sensor_id >= ULTRASONIC_MAX_SENSORS) return false;
+
+    ultrasonic_sensor_t *sensor = &s_sensors[sensor_id];
+    bool expired = false;
+
+    portENTER_CRITICAL(&s_lock);
+    if (esp_timer_get_time() - sensor->trigger_us >= (int64_t)ULTRASONIC_ECHO_TIMEOUT_MS * 1000) {
+        expired = ultrasonic_cancel_locked(sensor, reading);
+    }
+    portEXIT_CRITICAL(&s_lock);
+
+    return expired;
+}
+
+uint32_t ultrasonic_echo_to_mm(uint32_t echo_us) {
+    return ULTRASONIC_ECHO_US_TO_MM(echo_us);
+}
 
-    /* Measure echo pulse width with timeout */
-    uint32_t endTime = startTime;
-    while (gpio_get_level(echo_pin) == 1 && esp_timer_get_time() < timeout + 30000) { 
-        endTime = esp_timer_get_time(); 
+void ultrasonic_sensor_get_stats(ultrasonic_stats_t *stats) {
+    if (stats == NULL) return;
+
+    portENTER_CRITICAL(&s_lock);
+    *stats = s_stats;
+    portEXIT_CRITICAL(&s_lock);
+}
+
+void ultrasonic_sensor_print_stats(void) {
+    ultrasonic_stats_t stats;
+    ultrasonic_sensor_get_stats(&stats);
+
+    uint32_t total = stats.readings + stats.timeouts;
+    uint32_t avg_cpu_us = total ? (uint32_t)(stats.total_cpu_us / total) : 0;
+
+    ESP_LOGI(TAG, "===== ULTRASONIC SENSOR STATS =====");
+    ESP_LOGI(TAG, "Readings: %lu, timeouts: %lu", (unsigned long)stats.readings, (unsigned long)stats.timeouts);
+    ESP_LOGI(TAG, "CPU per reading last/avg/max: %lu/%lu/%lu us",
+        (unsigned long)stats.last_cpu_us, (unsigned long)avg_cpu_us, (unsigned long)stats.max_cpu_us);
+}
+
+/* ----- GPIO sensor backend ----- */
+
+static int gpio_backend_start_scan(const int *sensor_ids, int count) {
+    int started = 0;
+    for (int i = 0; i < count; i++) {
+        int sensor_id = sensor_ids[i];
+        if (sensor_id < 0 || sensor_id >= ULTRASONIC_MAX_SENSORS || s_sensors[sensor_id].state != SENSOR_IDLE) continue;
+        if (ultrasonic_sensor_trigger(sensor_id) == ESP_OK) {
+            started++;
+        }
+    }
+    return started;
+}
+
+/* Milliseconds until the first in-flight sensor times out, rounded up */
+static uint32_t gpio_backend_next_expiry_ms(void) {
+    int64_t now_us = esp_timer_get_time();
+    int64_t earliest_us = INT64_MAX;
+    for (int i = 0; i < ULTRASONIC_MAX_SENSORS; i++) {
+        if (s_sensors[i].in_use && s_sensors[i].state != SENSOR_IDLE &&
+            s_sensors[i].trigger_us + (int64_t)ULTRASONIC_ECHO_TIMEOUT_MS * 1000 < earliest_us) {
+            earliest_us = s_sensors[i].trigger_us + (int64_t)ULTRASONIC_ECHO_TIMEOUT_MS * 1000;
+        }
+    }
+    if (earliest_us == INT64_MAX || earliest_us <= now_us) return 0;
+    return (uint32_t)((earliest_us - now_us + 999) / 1000);
+}
+
+static int gpio_backend_collect(ultrasonic_reading_t *readings, int max_readings, uint32_t wait_ms) {
+    /* Never sleep past the first timeout; it has to be reported too */
+    uint32_t expiry_ms = gpio_backend_next_expiry_ms();
+    if (expiry_ms < wait_ms) wait_ms = expiry_ms;
+
+    int count = 0;
+    while (count < max_readings &&
+           s_result_queue != NULL &&
+           xQueueReceive(s_result_queue, &readings[count], count == 0 ? rtos_ticks_at_least(wait_ms) : 0) == pdTRUE) {
+        count++;
+    }
+    for (int i = 0; i < ULTRASONIC_MAX_SENSORS && count < max_readings; i++) {
+        if (s_sensors[i].in_use && ultrasonic_sensor_expire(i, &readings[count])) {
+            count++;
+        }
     }
+    return count;
+}
 
-    /* Calculate distance */
-    uint32_t duration = endTime - startTime;
-    float distance = (duration * 0.0343) / 2; /* Speed of sound = 343 m/s */
-    
-    return distance;
-}
\ No newline at end of file
+const sensor_backend_t sensor_backend_gpio = {
+    .name = "gpio",
+    .init = ultrasonic_sensor_init,
+    .add = ultrasonic_sensor_add,
+    .start_scan = gpio_backend_start_scan,
+    .collect = gpio_backend_collect,
+};
@@ -5,6 +5,36 @@
 #ifndef ULTRASONIC_SENSOR_H
 #define ULTRASONIC_SENSOR_H
 
-float measure_ultrasonic_distance(int trig_pin, int echo_pin);
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
 
-#endif /* ULTRASONIC_SENSOR_H */
\ No newline at end of file
+/* One completed (or timed out) echo measurement */
+typedef struct {
+    int sensor_id;          /* Sensor that produced the reading */
+    bool valid;             /* Echo pulse completed before the timeout */
+    uint32_t echo_us;       /* Echo pulse width in microseconds */
+    int64_t trigger_us;     /* Time the trigger pulse was sent */
+    int64_t done_us;        /* Time the echo falling edge was seen */
+    uint32_t cpu_us;        /* CPU time spent on this reading (trigger + ISRs) */
+} ultrasonic_reading_t;
+
+/* Driver counters */
+typedef struct {
+    uint32_t readings;      /* Completed echo measurements */
+    uint32_t timeouts;      /* Measurements without a complete echo */
+    uint32_t last_cpu_us;   /* CPU time of the most recent reading */
+    uint32_t max_cpu_us;    /* Worst CPU time per reading */
+    uint64_t total_cpu_us;  /* Sum of CPU time, for averaging */
+} ultrasonic_stats_t;
+
+esp_err_t ultrasonic_sensor_init(void);
+esp_err_t ultrasonic_sensor_add(int sensor_id, int trig_pin, int echo_pin);
+esp_err_t ultrasonic_sensor_trigger(int sensor_id);
+bool ultrasonic_sensor_wait(ultrasonic_reading_t *reading, uint32_t timeout_ms);
+bool ultrasonic_sensor_expire(int sensor_id, ultrasonic_reading_t *reading);
+uint32_t ultrasonic_echo_to_mm(uint32_t echo_us);
+void ultrasonic_sensor_get_stats(ultrasonic_stats_t *stats);
+void ultrasonic_sensor_print_stats(void);
+
+#endif /* ULTRASONIC_SENSOR_H */
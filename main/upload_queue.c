@@ -0,0 +1,359 @@
+/**
+ * @file upload_queue.c
+ * @brief Implementation of the asynchronous upload queue
+ *
+ * The sensing loop only records the latest state per slot and pushes the
+ * slot index onto a bounded queue. A dedicated network task drains the queue
+ * and talks to the server, so a slow request never stalls sensing or LEDs.
+ * Changes arriving within BATCH_WINDOW_MS, or before the sensing loop calls
+ * upload_queue_flush() at the end of a scan cycle, share one POST.
+ * Changes the server did not acknowledge go to the offline journal, and
+ * while it holds a backlog new changes are queued behind it.
+ *
+ * When a slot looks about to change, upload_queue_prewarm() has the network
+ * task open the connection while the occupancy filter is still confirming
+ * the change; the task closes it again once it has been idle.
+ */
+#include "upload_queue.h"
+#include "parking_slot.h"
+#include "http_client.h"
+#include "journal.h"
+#include "freshness.h"
+#include "rtos_ticks.h"
+#include "span_trace.h"
+#include "wifi_manager.h"
+#include "config.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+
+typedef struct {
+    bool pending;           /* Slot index is sitting in the queue */
+    bool is_taken;          /* Latest state to upload */
+    bool acked;             /* Server has acknowledged acked_state */
+    bool acked_state;       /* Last state the server acknowledged */
+    int64_t enqueued_us;    /* When the oldest unsent change was enqueued */
+    uint32_t seq;           /* Freshness sequence of the latest state */
+    int64_t detected_us;    /* When the latest state was detected */
+} upload_entry_t;
+
+static upload_entry_t s_entries[MAX_PARKING_SLOTS];
+static upload_queue_stats_t s_stats;
+static QueueHandle_t s_queue = NULL;
+static StaticQueue_t s_queue_buffer;
+static uint8_t s_queue_storage[UPLOAD_QUEUE_LENGTH * sizeof(int)];
+static StaticTask_t s_task_buffer;
+static StackType_t s_task_stack[UPLOAD_TASK_STACK_SIZE];
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+static bool s_flush_needed = false;     /* Entries were queued since the last flush marker */
+static bool s_marker_queued = false;    /* A flush marker is in the queue; one is enough */
+static bool s_prewarm_queued = false;   /* A pre-warm marker is in the queue */
+
+/* Queue marker that ends the current collection window early */
+#define UPLOAD_FLUSH_MARKER (-1)
+/* Queue marker asking for the connection to be opened ahead of an update */
+#define UPLOAD_PREWARM_MARKER (-2)
+
+/* Changes collected for one request; only touched by the network task */
+static int s_batch_slots[BATCH_MAX_SIZE];
+static upload_entry_t s_batch_entries[BATCH_MAX_SIZE];
+static parking_update_t s_batch_updates[BATCH_MAX_SIZE];
+
+/* Move a queued slot's latest state into the current batch */
+static bool upload_take_entry(int slot_index, int *count) {
+    portENTER_CRITICAL(&s_lock);
+    upload_entry_t entry = s_entries[slot_index];
+    s_entries[slot_index].pending = false;
+    s_stats.depth--;
+    /* A slot that flapped back to what the server already has needs no upload */
+    bool skip = entry.acked && entry.acked_state == entry.is_taken;
+    if (skip) {
+        s_stats.coalesced++;
+    }
+    portEXIT_CRITICAL(&s_lock);
+
+    if (skip) {
+        /* The server already holds this state, so its transitions count as acked */
+        freshness_ack(slot_index, entry.seq);
+        return false;
+    }
+
+    s_batch_slots[*count] = slot_index;
+    s_batch_entries[*count] = entry;
+    s_batch_updates[*count].spot_id = parking_slot_name(slot_index);
+    s_batch_updates[*count].slot_index = (uint16_t)slot_index;
+    s_batch_updates[*count].is_taken = entry.is_taken;
+    s_batch_updates[*count].seq = entry.seq;
+    s_batch_updates[*count].detected_us = entry.detected_us;
+    (*count)++;
+    return true;
+}
+
+static void upload_marker_taken(void) {
+    portENTER_CRITICAL(&s_lock);
+    s_marker_queued = false;
+    portEXIT_CRITICAL(&s_lock);
+}
+
+static void upload_prewarm_taken(void) {
+    portENTER_CRITICAL(&s_lock);
+    s_prewarm_queued = false;
+    portEXIT_CRITICAL(&s_lock);
+}
+
+/* A gateway node has no association of its own: the gateway link is tried regardless */
+static bool upload_link_up(void) {
+#if WIRE_MODE == WIRE_MODE_GATEWAY
+    return true;
+#else
+    return (xEventGroupGetBits(wifi_event_group) & WIFI_CONNECTED_BIT) != 0;
+#endif
+}
+
+/* Only worth a connection attempt while updates would go straight out */
+static void upload_prewarm(void) {
+    if (upload_link_up() && journal_pending() == 0) {
+        http_client_prewarm();
+    }
+}
+
+/* Gather changes until the batch is full, the window closes or a flush marker arrives */
+static int upload_collect_batch(TickType_t idle_wait) {
+    int count = 0;
+    int slot_index;
+
+    if (xQueueReceive(s_queue, &slot_index, idle_wait) != pdTRUE) {
+        return 0;
+    }
+    if (slot_index == UPLOAD_PREWARM_MARKER) {
+        upload_prewarm_taken();
+        upload_prewarm();
+        return 0;
+    }
+    if (slot_index != UPLOAD_FLUSH_MARKER) {
+        upload_take_entry(slot_index, &count);
+    } else {
+        upload_marker_taken();
+    }
+
+    TickType_t window_end = xTaskGetTickCount() + pdMS_TO_TICKS(BATCH_WINDOW_MS);
+    while (BATCH_MODE_ENABLED && slot_index != UPLOAD_FLUSH_MARKER && count < BATCH_MAX_SIZE) {
+        TickType_t now = xTaskGetTickCount();
+        TickType_t wait = (window_end > now) ? (window_end - now) : 0;
+        if (xQueueReceive(s_queue, &slot_index, wait) != pdTRUE) {
+            break;
+        }
+        if (slot_index == UPLOAD_PREWARM_MARKER) {
+            /* The batch is about to open the connection anyway */
+            upload_prewarm_taken();
+        } else if (slot_index != UPLOAD_FLUSH_MARKER) {
+            upload_take_entry(slot_index, &count);
+        } else {
+            upload_marker_taken();
+        }
+    }
+    return count;
+}
+
+/* Store and forward: while the journal holds unsent changes, new changes go behind them */
+static void upload_via_journal(int count) {
+    for (int i = 0; i < count; i++) {
+        journal_append(s_batch_slots[i], s_batch_updates[i].is_taken, s_batch_updates[i].seq);
+    }
+
+    bool replayed = upload_link_up() && journal_replay() >= 0;
+    if (!replayed) {
+        journal_flush();
+    }
+
+    /* Replay sends the latest journaled state per slot, which is this batch */
+    for (int i = 0; i < count; i++) {
+        s_batch_updates[i].acked = replayed;
+    }
+}
+
+int upload_queue_process(uint32_t idle_wait_ms) {
+    /* With a backlog in the journal, wake up periodically to retry the replay */
+    uint32_t wait_ms = (journal_pending() && idle_wait_ms > JOURNAL_RETRY_MS) ? JOURNAL_RETRY_MS : idle_wait_ms;
+    TickType_t idle_wait = (wait_ms == UPLOAD_WAIT_FOREVER) ? portMAX_DELAY : rtos_ticks_at_least(wait_ms);
+    int count = upload_collect_batch(idle_wait);
+    if (count == 0 && journal_pending() == 0) {
+        return 0;
+    }
+
+    bool via_journal = journal_pending() > 0;
+    if (via_journal) {
+        upload_via_journal(count);
+    } else {
+        send_parking_batch(s_batch_updates, count);
+    }
+    int64_t now_us = esp_timer_get_time();
+
+    for (int i = 0; i < count; i++) {
+        int slot_index = s_batch_slots[i];
+        bool success = s_batch_updates[i].acked;
+        uint32_t latency_ms = (uint32_t)((now_us - s_batch_entries[i].enqueued_us) / 1000);
+
+        portENTER_CRITICAL(&s_lock);
+        if (success) {
+            s_entries[slot_index].acked = true;
+            s_entries[slot_index].acked_state = s_batch_updates[i].is_taken;
+            s_stats.sent++;
+            s_stats.last_latency_ms = latency_ms;
+            s_stats.total_latency_ms += latency_ms;
+            if (latency_ms > s_stats.max_latency_ms) {
+                s_stats.max_latency_ms = latency_ms;
+            }
+        } else {
+            /* The server state is unknown until this slot is acknowledged again */
+            s_entries[slot_index].acked = false;
+            s_stats.failed++;
+        }
+        portEXIT_CRITICAL(&s_lock);
+
+        if (success) {
+            SPAN_RECORD(SPAN_STAGE_UPLOAD, (uint32_t)(now_us - s_batch_entries[i].enqueued_us));
+            ESP_LOGI(TAG, "Server update successful for %s (%lu ms after detection)",
+                s_batch_updates[i].spot_id, (unsigned long)latency_ms);
+        } else {
+            ESP_LOGE(TAG, "Failed to update server for %s", s_batch_updates[i].spot_id);
+            if (!via_journal) {
+                /* Keep it for replay once the server is reachable again */
+                journal_append(slot_index, s_batch_updates[i].is_taken, s_batch_updates[i].seq);
+            }
+        }
+    }
+    journal_flush();
+    return count;
+}
+
+static void upload_task(void *arg) {
+    while (1) {
+        /* Also wake up to close the connection once it has gone idle */
+        upload_queue_process(http_client_close_idle());
+    }
+}
+
+bool upload_queue_init(void) {
+    if (s_queue != NULL) return true;
+
+    /* Each slot is queued at most once, plus room for a flush marker */
+    s_queue = xQueueCreateStatic(UPLOAD_QUEUE_LENGTH, sizeof(int), s_queue_storage, &s_queue_buffer);
+    if (s_queue == NULL) {
+        ESP_LOGE(TAG, "Failed to create upload queue");
+        return false;
+    }
+
+    if (xTaskCreateStatic(upload_task, "upload_task", UPLOAD_TASK_STACK_SIZE, NULL,
+                          UPLOAD_TASK_PRIORITY, s_task_stack, &s_task_buffer) == NULL) {
+        ESP_LOGE(TAG, "Failed to create upload task");
+        vQueueDelete(s_queue);
+        s_queue = NULL;
+        return false;
+    }
+    return true;
+}
+
+bool upload_queue_enqueue(int slot_index, bool is_taken) {
+    if (slot_index < 0 || slot_index >= get_total_parking_slots() || s_queue == NULL) return false;
+
+    bool needs_push = false;
+    uint32_t seq;
+    int64_t detected_us;
+    freshness_latest(slot_index, &seq, &detected_us);
+
+    portENTER_CRITICAL(&s_lock);
+    upload_entry_t *entry = &s_entries[slot_index];
+    entry->is_taken = is_taken;
+    entry->seq = seq;
+    entry->detected_us = detected_us;
+    s_stats.enqueued++;
+    if (entry->pending) {
+        /* Already waiting: the network task will pick up the newest state */
+        s_stats.coalesced++;
+    } else {
+        entry->pending = true;
+        entry->enqueued_us = esp_timer_get_time();
+        s_stats.depth++;
+        if (s_stats.depth > s_stats.max_depth) {
+            s_stats.max_depth = s_stats.depth;
+        }
+        needs_push = true;
+        s_flush_needed = true;
+    }
+    portEXIT_CRITICAL(&s_lock);
+
+    if (needs_push && xQueueSend(s_queue, &slot_index, 0) != pdTRUE) {
+        portENTER_CRITICAL(&s_lock);
+        entry->pending = false;
+        s_stats.depth--;
+        s_stats.dropped++;
+        portEXIT_CRITICAL(&s_lock);
+        ESP_LOGW(TAG, "Upload queue full, dropped update for slot %d", slot_index);
+        return false;
+    }
+    return true;
+}
+
+void upload_queue_prewarm(void) {
+#if PREWARM_ENABLED && WIRE_MODE == WIRE_MODE_HTTP_JSON
+    if (s_queue == NULL || http_client_connected()) return;
+
+    portENTER_CRITICAL(&s_lock);
+    bool push = !s_prewarm_queued;
+    s_prewarm_queued = true;
+    portEXIT_CRITICAL(&s_lock);
+    if (!push) return;
+
+    int marker = UPLOAD_PREWARM_MARKER;
+    if (xQueueSend(s_queue, &marker, 0) != pdTRUE) {
+        upload_prewarm_taken();
+    }
+#endif
+}
+
+void upload_queue_flush(void) {
+    if (s_queue == NULL) return;
+
+    /* Only one marker at a time, and only behind new entries, so the queue
+     * never holds more than one entry per slot plus a marker */
+    portENTER_CRITICAL(&s_lock);
+    bool push = s_flush_needed && !s_marker_queued;
+    if (push) {
+        s_flush_needed = false;
+        s_marker_queued = true;
+    }
+    portEXIT_CRITICAL(&s_lock);
+    if (!push) return;
+
+    int marker = UPLOAD_FLUSH_MARKER;
+    if (xQueueSend(s_queue, &marker, 0) != pdTRUE) {
+        upload_marker_taken();
+    }
+}
+
+void upload_queue_get_stats(upload_queue_stats_t *stats) {
+    if (stats == NULL) return;
+
+    portENTER_CRITICAL(&s_lock);
+    *stats = s_stats;
+    portEXIT_CRITICAL(&s_lock);
+}
+
+void upload_queue_print_stats(void) {
+    upload_queue_stats_t stats;
+    upload_queue_get_stats(&stats);
+
+    uint32_t avg_latency_ms = stats.sent ? (uint32_t)(stats.total_latency_ms / stats.sent) : 0;
+
+    ESP_LOGI(TAG, "===== UPLOAD QUEUE STATS =====");
+    ESP_LOGI(TAG, "Depth: %lu (max %lu)", (unsigned long)stats.depth, (unsigned long)stats.max_depth);
+    ESP_LOGI(TAG, "Enqueued: %lu, coalesced: %lu, dropped: %lu",
+        (unsigned long)stats.enqueued, (unsigned long)stats.coalesced, (unsigned long)stats.dropped);
+    ESP_LOGI(TAG, "Sent: %lu, failed: %lu", (unsigned long)stats.sent, (unsigned long)stats.failed);
+    ESP_LOGI(TAG, "Enqueue-to-ack last/avg/max: %lu/%lu/%lu ms",
+        (unsigned long)stats.last_latency_ms, (unsigned long)avg_latency_ms, (unsigned long)stats.max_latency_ms);
+}
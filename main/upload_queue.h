@@ -0,0 +1,35 @@
+/**
+ * @file upload_queue.h
+ * @brief Asynchronous, per-slot coalescing queue for server updates
+ */
+#ifndef UPLOAD_QUEUE_H
+#define UPLOAD_QUEUE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Counters for the upload queue and network task */
+typedef struct {
+    uint32_t depth;             /* Slots currently waiting to be uploaded */
+    uint32_t max_depth;         /* Highest depth seen */
+    uint32_t enqueued;          /* State changes accepted from the sensing loop */
+    uint32_t coalesced;         /* Changes merged into an entry that was already pending */
+    uint32_t dropped;           /* Changes rejected because the queue was full */
+    uint32_t sent;              /* Updates acknowledged by the server */
+    uint32_t failed;            /* Updates the server did not acknowledge */
+    uint32_t last_latency_ms;   /* Enqueue-to-ack latency of the most recent update */
+    uint32_t max_latency_ms;    /* Worst enqueue-to-ack latency seen */
+    uint64_t total_latency_ms;  /* Sum of enqueue-to-ack latencies, for averaging */
+} upload_queue_stats_t;
+
+#define UPLOAD_WAIT_FOREVER UINT32_MAX
+
+bool upload_queue_init(void);
+int upload_queue_process(uint32_t idle_wait_ms);
+bool upload_queue_enqueue(int slot_index, bool is_taken);
+void upload_queue_flush(void);
+void upload_queue_prewarm(void);
+void upload_queue_get_stats(upload_queue_stats_t *stats);
+void upload_queue_print_stats(void);
+
+#endif /* UPLOAD_QUEUE_H */
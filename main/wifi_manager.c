@@ -1,56 +1,258 @@
 /**
  * @file wifi_manager.c
  * @brief Implementation of WiFi connectivity functions
+ *
+ * The last good link (BSSID, channel and IP lease) is cached in NVS. On the
+ * next connect the station goes straight to that AP on that channel instead
+ * of scanning every channel, and can optionally reuse the lease as a static
+ * IP to skip DHCP. A failed fast attempt drops the cache hints and falls back
+ * to a full scan with DHCP.
+ *
+ * Disconnects are retried forever with jittered exponential backoff from an
+ * esp_timer, so the event loop and the sensing tasks never block on WiFi.
  */
 #include "wifi_manager.h"
 #include "config.h"
+#include "mem_telemetry.h"
 
 #include "esp_wifi.h"
 #include "esp_log.h"
 #include "esp_event.h"
+#include "esp_random.h"
 #include "esp_system.h"
+#include "esp_timer.h"
+#include "nvs.h"
 #include "nvs_flash.h"
 #include "esp_netif.h"
+#include <string.h>
+
+#define WIFI_CACHE_VERSION 1
+
+/* Last good link, as stored in NVS */
+typedef struct __attribute__((packed)) {
+    uint8_t version;
+    uint8_t channel;
+    uint8_t bssid[6];
+    uint32_t ip;
+    uint32_t netmask;
+    uint32_t gateway;
+    uint32_t dns;
+} wifi_link_cache_t;
 
 /* Shared WiFi event group */
 EventGroupHandle_t wifi_event_group;
+static StaticEventGroup_t s_wifi_event_group_buffer;
 static int s_retry_num = 0;
 
+static esp_netif_t *s_netif = NULL;
+static esp_timer_handle_t s_reconnect_timer = NULL;
+static wifi_manager_stats_t s_stats;
+
+static wifi_link_cache_t s_cache;
+static bool s_cache_valid = false;
+static bool s_using_cache = false;      /* Current attempt is pinned to the cached BSSID/channel */
+static bool s_static_ip = false;        /* DHCP client stopped, cached lease applied */
+
+static uint8_t s_link_bssid[6];         /* AP of the current association */
+static uint8_t s_link_channel;
+
+static int64_t s_attempt_start_us = 0;  /* First connect attempt of the current outage */
+static int64_t s_outage_start_us = 0;   /* 0 while connected or before the first connect */
+
+static void wifi_cache_load(void) {
+    nvs_handle_t handle;
+    if (nvs_open(WIFI_CACHE_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) return;
+
+    size_t size = sizeof(s_cache);
+    s_cache_valid = nvs_get_blob(handle, WIFI_CACHE_KEY, &s_cache, &size) == ESP_OK &&
+                    size == sizeof(s_cache) && s_cache.version == WIFI_CACHE_VERSION &&
+                    s_cache.channel != 0;
+    nvs_close(handle);
+}
+
+/* Rewrite the cache only when the link changed, to spare the flash */
+static void wifi_cache_store(const esp_netif_ip_info_t *ip_info) {
+    wifi_link_cache_t cache = {
+        .version = WIFI_CACHE_VERSION,
+        .channel = s_link_channel,
+        .ip = ip_info->ip.addr,
+        .netmask = ip_info->netmask.addr,
+        .gateway = ip_info->gw.addr,
+    };
+    memcpy(cache.bssid, s_link_bssid, sizeof(cache.bssid));
+
+    esp_netif_dns_info_t dns;
+    if (esp_netif_get_dns_info(s_netif, ESP_NETIF_DNS_MAIN, &dns) == ESP_OK) {
+        cache.dns = dns.ip.u_addr.ip4.addr;
+    }
+
+    if (s_cache_valid && memcmp(&cache, &s_cache, sizeof(cache)) == 0) return;
+
+    nvs_handle_t handle;
+    if (nvs_open(WIFI_CACHE_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK) return;
+    if (nvs_set_blob(handle, WIFI_CACHE_KEY, &cache, sizeof(cache)) == ESP_OK &&
+        nvs_commit(handle) == ESP_OK) {
+        s_cache = cache;
+        s_cache_valid = true;
+    }
+    nvs_close(handle);
+}
+
+/* Point the station at the cached AP, or back at a full scan */
+static void wifi_apply_config(bool use_cache) {
+    wifi_config_t wifi_config = {
+        .sta = {
+            .ssid = WIFI_SSID,
+            .password = WIFI_PASS,
+            .threshold.authmode = WIFI_AUTH_WPA_WPA2_PSK,
+        },
+    };
+
+    s_using_cache = use_cache && s_cache_valid;
+    if (s_using_cache) {
+        wifi_config.sta.bssid_set = true;
+        memcpy(wifi_config.sta.bssid, s_cache.bssid, sizeof(s_cache.bssid));
+        wifi_config.sta.channel = s_cache.channel;
+        wifi_config.sta.scan_method = WIFI_FAST_SCAN;
+    } else {
+        wifi_config.sta.scan_method = WIFI_ALL_CHANNEL_SCAN;
+        wifi_config.sta.sort_method = WIFI_CONNECT_AP_BY_SIGNAL;
+    }
+    ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config));
+
+#if WIFI_STATIC_IP_FROM_CACHE
+    if (s_using_cache && !s_static_ip) {
+        esp_netif_ip_info_t ip_info = {
+            .ip.addr = s_cache.ip,
+            .netmask.addr = s_cache.netmask,
+            .gw.addr = s_cache.gateway,
+        };
+        esp_netif_dns_info_t dns = {
+            .ip.type = ESP_IPADDR_TYPE_V4,
+            .ip.u_addr.ip4.addr = s_cache.dns,
+        };
+        if (esp_netif_dhcpc_stop(s_netif) == ESP_OK && esp_netif_set_ip_info(s_netif, &ip_info) == ESP_OK) {
+            esp_netif_set_dns_info(s_netif, ESP_NETIF_DNS_MAIN, &dns);
+            s_static_ip = true;
+        }
+    } else if (!s_using_cache && s_static_ip) {
+        esp_netif_dhcpc_start(s_netif);
+        s_static_ip = false;
+    }
+#endif
+}
+
+static void wifi_connect_attempt(void) {
+    if (s_attempt_start_us == 0) {
+        s_attempt_start_us = esp_timer_get_time();
+    }
+    s_stats.attempts++;
+    if (s_using_cache) {
+        s_stats.fast_attempts++;
+    }
+    esp_wifi_connect();
+}
+
+static void wifi_reconnect_timer_cb(void *arg) {
+    wifi_connect_attempt();
+}
+
+/* Equal jitter: half the exponential delay fixed, half random */
+static uint32_t wifi_backoff_ms(int retry) {
+    int shift = retry < 16 ? retry : 16;
+    uint32_t delay_ms = WIFI_BACKOFF_BASE_MS << shift;
+    if (delay_ms > WIFI_BACKOFF_MAX_MS) delay_ms = WIFI_BACKOFF_MAX_MS;
+    return delay_ms / 2 + esp_random() % (delay_ms / 2 + 1);
+}
+
 /* The WiFi event handler */
 static void wifi_event_handler(void* arg, esp_event_base_t event_base,
     int32_t event_id, void* event_data)
 {
     if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START) {
-        esp_wifi_connect();
+        wifi_connect_attempt();
+    } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_CONNECTED) {
+        wifi_event_sta_connected_t *event = (wifi_event_sta_connected_t *)event_data;
+        memcpy(s_link_bssid, event->bssid, sizeof(s_link_bssid));
+        s_link_channel = event->channel;
     } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED) {
-        if (s_retry_num < WIFI_MAXIMUM_RETRY) {
-            esp_wifi_connect();
-            s_retry_num++;
-            ESP_LOGI(TAG, "Retry to connect to the AP");
-        } else {
+        wifi_event_sta_disconnected_t *event = (wifi_event_sta_disconnected_t *)event_data;
+
+        /* Uploads check this bit before replaying the offline journal */
+        bool was_connected = (xEventGroupGetBits(wifi_event_group) & WIFI_CONNECTED_BIT) != 0;
+        if (was_connected) {
+            xEventGroupClearBits(wifi_event_group, WIFI_CONNECTED_BIT);
+            s_outage_start_us = esp_timer_get_time();
+            s_attempt_start_us = 0;
+            s_stats.disconnects++;
+        }
+
+        if (s_using_cache && !was_connected) {
+            /* The cached AP did not answer: scan all channels until the next connect */
+            s_stats.cache_misses++;
+            wifi_apply_config(false);
+        }
+
+        uint32_t delay_ms = wifi_backoff_ms(s_retry_num);
+        s_retry_num++;
+        if (s_retry_num == WIFI_MAXIMUM_RETRY) {
+            /* Lets boot go on without the network; the retries continue */
             xEventGroupSetBits(wifi_event_group, WIFI_FAIL_BIT);
         }
-        ESP_LOGI(TAG,"Connect to the AP failed");
+        ESP_LOGI(TAG, "Connect to the AP failed (reason %d), retry %d in %lu ms",
+            event->reason, s_retry_num, (unsigned long)delay_ms);
+        esp_timer_start_once(s_reconnect_timer, (uint64_t)delay_ms * 1000);
     } else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
         ip_event_got_ip_t* event = (ip_event_got_ip_t*) event_data;
         ESP_LOGI(TAG, "Got IP:" IPSTR, IP2STR(&event->ip_info.ip));
+
+        int64_t now_us = esp_timer_get_time();
+        s_stats.connects++;
+        s_stats.last_connect_ms = (uint32_t)((now_us - s_attempt_start_us) / 1000);
+        if (s_stats.last_connect_ms > s_stats.max_connect_ms) {
+            s_stats.max_connect_ms = s_stats.last_connect_ms;
+        }
+        if (s_outage_start_us != 0) {
+            s_stats.last_outage_ms = (uint32_t)((now_us - s_outage_start_us) / 1000);
+            s_stats.total_outage_ms += s_stats.last_outage_ms;
+            if (s_stats.last_outage_ms > s_stats.max_outage_ms) {
+                s_stats.max_outage_ms = s_stats.last_outage_ms;
+            }
+            s_outage_start_us = 0;
+        }
+        s_attempt_start_us = 0;
         s_retry_num = 0;
+
+        wifi_cache_store(&event->ip_info);
+        if (!s_using_cache) {
+            /* Pin the next reconnect to this AP; the config applies from the next connect */
+            wifi_apply_config(true);
+        }
+        xEventGroupClearBits(wifi_event_group, WIFI_FAIL_BIT);
         xEventGroupSetBits(wifi_event_group, WIFI_CONNECTED_BIT);
     }
 }
 
 void wifi_init_sta(void)
 {
-    print_memory_stats("Before WiFi init");
+    mem_telemetry_sample(MEM_EVENT_WIFI_INIT_BEFORE);
 
-    wifi_event_group = xEventGroupCreate();
+    wifi_event_group = xEventGroupCreateStatic(&s_wifi_event_group_buffer);
 
     ESP_ERROR_CHECK(esp_netif_init());
     ESP_ERROR_CHECK(esp_event_loop_create_default());
-    esp_netif_create_default_wifi_sta();
+    s_netif = esp_netif_create_default_wifi_sta();
 
     wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
     ESP_ERROR_CHECK(esp_wifi_init(&cfg));
+    /* The cache lives in our own NVS namespace; the driver's copy is not needed */
+    ESP_ERROR_CHECK(esp_wifi_set_storage(WIFI_STORAGE_RAM));
+
+    const esp_timer_create_args_t timer_args = {
+        .callback = wifi_reconnect_timer_cb,
+        .name = "wifi_reconnect",
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &s_reconnect_timer));
 
     esp_event_handler_instance_t instance_any_id;
     esp_event_handler_instance_t instance_got_ip;
@@ -65,20 +267,13 @@ void wifi_init_sta(void)
                                                         NULL,
                                                         &instance_got_ip));
 
-    wifi_config_t wifi_config = {
-        .sta = {
-            .ssid = WIFI_SSID,
-            .password = WIFI_PASS,
-            .threshold.authmode = WIFI_AUTH_WPA_WPA2_PSK,
-        },
-    };
-    
     ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
-    ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config));
+    wifi_cache_load();
+    wifi_apply_config(true);
     ESP_ERROR_CHECK(esp_wifi_set_protocol(WIFI_IF_STA, WIFI_PROTOCOL_11B | WIFI_PROTOCOL_11G | WIFI_PROTOCOL_11N));
     ESP_ERROR_CHECK(esp_wifi_start());
 
-    ESP_LOGI(TAG, "wifi_init_sta finished.");
+    ESP_LOGI(TAG, "wifi_init_sta finished (%s)", s_using_cache ? "cached AP" : "full scan");
 
     /* Wait until either the connection is established (WIFI_CONNECTED_BIT) or connection failed */
     EventBits_t bits = xEventGroupWaitBits(wifi_event_group,
@@ -88,36 +283,54 @@ void wifi_init_sta(void)
             portMAX_DELAY);
 
     if (bits & WIFI_CONNECTED_BIT) {
-        ESP_LOGI(TAG, "Connected to AP SSID:%s", WIFI_SSID);
+        ESP_LOGI(TAG, "Connected to AP SSID:%s in %lu ms", WIFI_SSID, (unsigned long)s_stats.last_connect_ms);
     } else if (bits & WIFI_FAIL_BIT) {
-        ESP_LOGI(TAG, "Failed to connect to SSID:%s, password:%s", WIFI_SSID, WIFI_PASS);
+        ESP_LOGW(TAG, "No connection to SSID:%s yet, continuing offline while retrying", WIFI_SSID);
     } else {
         ESP_LOGE(TAG, "UNEXPECTED EVENT");
     }
 
-    print_memory_stats("After WiFi init");
+    mem_telemetry_sample(MEM_EVENT_WIFI_INIT_AFTER);
 }
 
-void print_memory_stats(char *event) {
-    uint32_t free_heap = esp_get_free_heap_size();
-    uint32_t min_free_heap = esp_get_minimum_free_heap_size();
-    
-    multi_heap_info_t info;
-    heap_caps_get_info(&info, MALLOC_CAP_DEFAULT);
-
-    printf("MEMLOG,%lu,%s,%lu,%lu,%lu,%lu,%lu\n", 
-        (unsigned long)esp_log_timestamp(),
-        event,
-        (unsigned long)free_heap, 
-        (unsigned long)min_free_heap, 
-        (unsigned long)info.total_allocated_bytes,
-        (unsigned long)info.total_free_bytes,
-        (unsigned long)info.largest_free_block);
-
-    ESP_LOGI(TAG, "--- MEMORY STATS for event: %s ---", event);
-    ESP_LOGI(TAG, "Free heap: %lu bytes", (unsigned long)free_heap);
-    ESP_LOGI(TAG, "Minimum free heap ever: %lu bytes", (unsigned long)min_free_heap);
-    ESP_LOGI(TAG, "Total allocated: %lu bytes", (unsigned long)info.total_allocated_bytes);
-    ESP_LOGI(TAG, "Total free: %lu bytes", (unsigned long)info.total_free_bytes);
-    ESP_LOGI(TAG, "Largest free block: %lu bytes", (unsigned long)info.largest_free_block);
-}
\ No newline at end of file
+/* Radio only, for gateway nodes on ESP-NOW: no association, DHCP or reconnects,
+ * just the station interface parked on the gateway's channel */
+void wifi_init_radio(uint8_t channel)
+{
+    mem_telemetry_sample(MEM_EVENT_WIFI_INIT_BEFORE);
+
+    wifi_event_group = xEventGroupCreateStatic(&s_wifi_event_group_buffer);
+
+    ESP_ERROR_CHECK(esp_netif_init());
+    ESP_ERROR_CHECK(esp_event_loop_create_default());
+
+    wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
+    ESP_ERROR_CHECK(esp_wifi_init(&cfg));
+    ESP_ERROR_CHECK(esp_wifi_set_storage(WIFI_STORAGE_RAM));
+    ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
+    ESP_ERROR_CHECK(esp_wifi_start());
+    ESP_ERROR_CHECK(esp_wifi_set_channel(channel, WIFI_SECOND_CHAN_NONE));
+
+    ESP_LOGI(TAG, "wifi_init_radio finished (channel %u, not associated)", channel);
+
+    mem_telemetry_sample(MEM_EVENT_WIFI_INIT_AFTER);
+}
+
+void wifi_manager_get_stats(wifi_manager_stats_t *stats) {
+    if (stats == NULL) return;
+    *stats = s_stats;
+}
+
+void wifi_manager_print_stats(void) {
+    wifi_manager_stats_t stats;
+    wifi_manager_get_stats(&stats);
+
+    ESP_LOGI(TAG, "===== WIFI STATS =====");
+    ESP_LOGI(TAG, "Connects: %lu, disconnects: %lu, attempts: %lu (cached AP: %lu, cache misses: %lu)",
+        (unsigned long)stats.connects, (unsigned long)stats.disconnects, (unsigned long)stats.attempts,
+        (unsigned long)stats.fast_attempts, (unsigned long)stats.cache_misses);
+    ESP_LOGI(TAG, "Time to connect last/max: %lu/%lu ms",
+        (unsigned long)stats.last_connect_ms, (unsigned long)stats.max_connect_ms);
+    ESP_LOGI(TAG, "Outage last/max/total: %lu/%lu/%lu ms",
+        (unsigned long)stats.last_outage_ms, (unsigned long)stats.max_outage_ms, (unsigned long)stats.total_outage_ms);
+}
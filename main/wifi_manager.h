@@ -5,13 +5,30 @@
 #ifndef WIFI_MANAGER_H
 #define WIFI_MANAGER_H
 
+#include <stdint.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/event_groups.h"
 
+/* Connection timing counters */
+typedef struct {
+    uint32_t connects;          /* Times an IP was obtained */
+    uint32_t disconnects;       /* Established links that dropped */
+    uint32_t attempts;          /* esp_wifi_connect() calls */
+    uint32_t fast_attempts;     /* Attempts pinned to the cached BSSID and channel */
+    uint32_t cache_misses;      /* Fast attempts that failed and fell back to a full scan */
+    uint32_t last_connect_ms;   /* First attempt to IP, for the latest connect */
+    uint32_t max_connect_ms;
+    uint32_t last_outage_ms;    /* Link down to IP back, for the latest outage */
+    uint32_t max_outage_ms;
+    uint32_t total_outage_ms;
+} wifi_manager_stats_t;
+
 void wifi_init_sta(void);
-void print_memory_stats(char *event);
+void wifi_init_radio(uint8_t channel);
+void wifi_manager_get_stats(wifi_manager_stats_t *stats);
+void wifi_manager_print_stats(void);
 
 /* The WiFi event group that will be set when connected */
 extern EventGroupHandle_t wifi_event_group;
 
-#endif /* WIFI_MANAGER_H */
\ No newline at end of file
+#endif /* WIFI_MANAGER_H */
@@ -0,0 +1,982 @@
+/**
+ * @file bench.c
+ * @brief Cycle benchmarks for the parking firmware on the host simulation
+ *
+ * Each run provisions N slots, then repeats the sensing cycle the firmware
+ * performs: measure every slot, upload the resulting changes, print the
+ * summary. Host CPU time and heap activity are recorded per phase, while
+ * sensors, the network and the server run on the virtual clock. With -a the
+ * timer-driven scan scheduler runs instead for the same virtual time, and
+ * sampling rate, timer-off share and change-to-commit latency are reported;
+ * -e adds the network task between scan ticks and reports change-to-server
+ * latency, which is where connection pre-warming shows.
+ * With -k the heap soak (main/heap_soak.c) runs instead, streaming MEMLOG
+ * samples and attributing outstanding allocations to call sites.
+ * With -g the controller acts as a gateway for that many simulated nodes,
+ * which send their slot changes over the simulated radio (-r drops frames);
+ * forwarded throughput and per-node latency are reported.
+ * With -o the server is unreachable while slots churn until the (smaller)
+ * journal ring has wrapped, then comes back and the replay must bring it
+ * in sync.
+ *
+ * Usage: parking_bench [-n slots] [-c cycles] [-t trace.csv] [-s seed] [-f fail_per_mille] [-i idle_ms] [-k updates] [-g nodes] [-r loss_per_mille] [-o] [-a] [-e] [-l] [-m] [-v]
+ * Without -n the suite runs for 1, 16 and 256 slots.
+ */
+#include "sim_hal.h"
+#include "sim_server.h"
+#include "sim_support.h"
+
+#include "config.h"
+#include "freshness.h"
+#include "gateway.h"
+#include "gateway_link.h"
+#include "http_client.h"
+#include "led_control.h"
+#include "journal.h"
+#include "mem_telemetry.h"
+#include "heap_soak.h"
+#include "occupancy_history.h"
+#include "span_trace.h"
+#include "tls_session.h"
+#include "parking_slot.h"
+#include "scan_scheduler.h"
+#include "sensor_backend.h"
+#include "snapshot.h"
+#include "upload_queue.h"
+
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "nvs.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_DEFAULT_CYCLES 200
+#define BENCH_CYCLE_GAP_MS 500          /* Idle time between sensing cycles */
+#define BENCH_TURNOVER_PER_MILLE 30     /* Chance per cycle that a slot changes occupancy */
+#define BENCH_OCCUPIED_MM 60
+#define BENCH_FREE_MM 1500
+#define BENCH_JOURNAL_SIZE (256 * 1024)
+#define BENCH_OUTAGE_JOURNAL_SIZE (5 * 4096)    /* Five sectors, so -o wraps the ring quickly */
+#define BENCH_JOURNAL_SECTOR_RECORDS (4096 / 16)    /* Journal records per flash sector */
+#define BENCH_OUTAGE_TURNOVER_PER_MILLE 300     /* Chance per outage step that a slot changes occupancy */
+#define BENCH_OUTAGE_MAX_STEPS 100000
+#define BENCH_NODE_SLOTS 16             /* Slots per simulated gateway node */
+#define BENCH_NODE_TICK_MS 50           /* Node loop period */
+#define BENCH_NODE_DRAIN_MS 30000       /* Longest wait for nodes and gateway to go idle at the end */
+
+enum {
+    PHASE_MEASURE,
+    PHASE_UPLOAD,
+    PHASE_SUMMARY,
+    PHASE_COUNT,
+};
+
+static const char *const s_phase_names[PHASE_COUNT] = {
+    "measure_distance",
+    "upload",
+    "print_summary",
+};
+
+typedef struct {
+    double *host_us;            /* Host CPU time per cycle */
+    double *sim_ms;             /* Virtual time per cycle */
+    uint64_t allocs;
+    uint64_t bytes;
+} phase_samples_t;
+
+typedef struct {
+    int slots;
+    int cycles;
+    uint32_t seed;
+    uint32_t fail_per_mille;    /* Server answers 503 this often */
+    uint32_t idle_timeout_ms;   /* Server closes connections idle this long (0 = never) */
+    uint32_t soak_updates;      /* Run the heap soak with this many updates instead of cycles */
+    int gateway_nodes;          /* Act as gateway for this many simulated nodes instead of cycles */
+    uint32_t radio_loss_per_mille;  /* Radio frames lost this often */
+    bool outage;                /* Churn with the server unreachable until the journal ring wraps */
+    const char *trace_path;
+    bool dump_memlog;           /* Print the heap sample ring as MEMLOG CSV at the end */
+    bool print_spans;           /* Print the per-stage span histograms (simulated time) */
+    bool scheduler;             /* Run the scan scheduler instead of the measure/upload cycle */
+    bool end_to_end;            /* With the scheduler, run the network task between scan ticks */
+} bench_options_t;
+
+static double bench_host_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/* Sorts the samples in place */
+static void bench_percentiles(double *samples, int count, double *mean, double *p50, double *p99, double *max) {
+    double sum = 0;
+    for (int i = 0; i < count; i++) sum += samples[i];
+    qsort(samples, count, sizeof(double), compare_double);
+    *mean = sum / count;
+    *p50 = samples[count / 2];
+    *p99 = samples[(count * 99) / 100 < count ? (count * 99) / 100 : count - 1];
+    *max = samples[count - 1];
+}
+
+/* Wire slot i's sensor for the configured backend; returns its trigger and echo fields */
+static void bench_attach_sensor(int i, uint8_t *trig_pin, uint8_t *echo_pin) {
+#if SENSOR_BACKEND == SENSOR_BACKEND_MUX
+    /* Bank b on pins 255-2b and 254-2b, channels in slot order */
+    int bank = i / SENSOR_MUX_CHANNELS;
+    *trig_pin = (uint8_t)(255 - 2 * bank);
+    *echo_pin = (uint8_t)(254 - 2 * bank);
+    sim_sensor_attach_mux(i, *trig_pin, *echo_pin, i % SENSOR_MUX_CHANNELS);
+#elif SENSOR_BACKEND == SENSOR_BACKEND_BUS
+    /* One bus holds 120 modules; the rest get an address add() rejects */
+    *trig_pin = (uint8_t)(0x08 + i);
+    *echo_pin = 0;
+    if (*trig_pin <= 0x7F) {
+        sim_sensor_attach_i2c(i, *trig_pin);
+    }
+#elif SENSOR_BACKEND == SENSOR_BACKEND_SIM
+    *trig_pin = 0;
+    *echo_pin = 0;
+#else
+    *trig_pin = (uint8_t)i;
+    *echo_pin = (uint8_t)i;
+    sim_sensor_attach(i, i, i);
+#endif
+}
+
+/* Provision slot i with both LEDs on pin i and its sensor wired for the backend */
+static void bench_provision(int slots) {
+#if SENSOR_BACKEND == SENSOR_BACKEND_MUX && SENSOR_MUX_SELECT_SHIFT
+    const int shift_pins[3] = SENSOR_MUX_SHIFT_PINS;
+    sim_mux_configure_shift(shift_pins[0], shift_pins[1], shift_pins[2], SENSOR_MUX_SELECT_BITS);
+#elif SENSOR_BACKEND == SENSOR_BACKEND_MUX
+    const int select_pins[SENSOR_MUX_SELECT_BITS] = SENSOR_MUX_SELECT_PINS;
+    sim_mux_configure(select_pins, SENSOR_MUX_SELECT_BITS);
+#endif
+    parking_slot_def_t *defs = calloc(slots, sizeof(parking_slot_def_t));
+    for (int i = 0; i < slots; i++) {
+        snprintf(defs[i].slot_name, sizeof(defs[i].slot_name), "Slot%d", i + 1);
+        bench_attach_sensor(i, &defs[i].trig_pin, &defs[i].echo_pin);
+        defs[i].led_red_pin = (uint8_t)i;
+        defs[i].led_green_pin = (uint8_t)i;
+        defs[i].scan_group = (uint8_t)(i % SCAN_MAX_GROUPS);
+        sim_sensor_set_noise(i, 5, 10, 5);
+        sim_sensor_set_distance(i, BENCH_FREE_MM);
+    }
+    ESP_ERROR_CHECK(save_parking_slots(defs, slots));
+    free(defs);
+}
+
+/* Built-in churn when no trace is given: random arrivals and departures */
+static void bench_churn(int slots) {
+    for (int i = 0; i < slots; i++) {
+        if (sim_random() % 1000 < BENCH_TURNOVER_PER_MILLE) {
+            bool occupied = sim_sensor_get_distance(i) == BENCH_OCCUPIED_MM;
+            sim_sensor_set_distance(i, occupied ? BENCH_FREE_MM : BENCH_OCCUPIED_MM);
+        }
+    }
+}
+
+/* A batch whose slots all flapped back sends nothing, so go by the queue depth too */
+static void bench_drain_uploads(void) {
+    upload_queue_stats_t stats;
+    upload_queue_flush();
+    do {
+        while (upload_queue_process(0) > 0) {
+        }
+        upload_queue_get_stats(&stats);
+    } while (stats.depth > 0);
+}
+
+static void bench_phase_begin(double *host_start, int64_t *sim_start, sim_alloc_stats_t *alloc_start) {
+    sim_alloc_get_stats(alloc_start);
+    *sim_start = sim_now_us();
+    *host_start = bench_host_us();
+}
+
+static void bench_phase_end(phase_samples_t *phase, int cycle, double host_start, int64_t sim_start,
+                            const sim_alloc_stats_t *alloc_start) {
+    double host_end = bench_host_us();
+    sim_alloc_stats_t alloc_end;
+    sim_alloc_get_stats(&alloc_end);
+
+    phase->host_us[cycle] = host_end - host_start;
+    phase->sim_ms[cycle] = (sim_now_us() - sim_start) / 1000.0;
+    phase->allocs += alloc_end.allocs - alloc_start->allocs;
+    phase->bytes += alloc_end.bytes - alloc_start->bytes;
+}
+
+static void bench_print_spans(int slots) {
+    static const char *const names[SPAN_STAGE_COUNT] = {
+        "measure", "echo", "filter", "led", "json", "connect", "post", "response", "upload",
+    };
+    for (int stage = 0; stage < SPAN_STAGE_COUNT; stage++) {
+        span_summary_t summary;
+        span_trace_get_summary((span_stage_t)stage, &summary);
+        if (summary.count == 0) continue;
+        printf("%5d  span %-10s count %7lu  p50 %8lu  p95 %8lu  p99 %8lu  max %8lu us\n", slots, names[stage],
+            (unsigned long)summary.count, (unsigned long)summary.p50_us, (unsigned long)summary.p95_us,
+            (unsigned long)summary.p99_us, (unsigned long)summary.max_us);
+    }
+}
+
+/* The firmware's sensing cycle, timed phase by phase */
+static void bench_run_cycles(const bench_options_t *opts, int total_slots) {
+    phase_samples_t phases[PHASE_COUNT];
+    for (int p = 0; p < PHASE_COUNT; p++) {
+        phases[p].host_us = calloc(opts->cycles, sizeof(double));
+        phases[p].sim_ms = calloc(opts->cycles, sizeof(double));
+        phases[p].allocs = 0;
+        phases[p].bytes = 0;
+    }
+
+    for (int cycle = 0; cycle < opts->cycles; cycle++) {
+        double host_start;
+        int64_t sim_start;
+        sim_alloc_stats_t alloc_start;
+
+        if (opts->trace_path == NULL) {
+            bench_churn(total_slots);
+        }
+
+        bench_phase_begin(&host_start, &sim_start, &alloc_start);
+        for (int i = 0; i < total_slots; i++) {
+            measure_distance(i);
+        }
+        bench_phase_end(&phases[PHASE_MEASURE], cycle, host_start, sim_start, &alloc_start);
+
+        bench_phase_begin(&host_start, &sim_start, &alloc_start);
+        bench_drain_uploads();
+        bench_phase_end(&phases[PHASE_UPLOAD], cycle, host_start, sim_start, &alloc_start);
+
+        /* A local display polling once per cycle */
+        const char *body;
+        size_t len;
+        char etag[SNAPSHOT_ETAG_LEN];
+        snapshot_acquire(&body, &len, etag);
+        snapshot_release();
+
+        bench_phase_begin(&host_start, &sim_start, &alloc_start);
+        print_parking_summary();
+        bench_phase_end(&phases[PHASE_SUMMARY], cycle, host_start, sim_start, &alloc_start);
+
+        vTaskDelay(pdMS_TO_TICKS(BENCH_CYCLE_GAP_MS));
+    }
+
+    for (int p = 0; p < PHASE_COUNT; p++) {
+        double mean, p50, p99, max, sim_mean, sim_p50, sim_p99, sim_max;
+        bench_percentiles(phases[p].host_us, opts->cycles, &mean, &p50, &p99, &max);
+        bench_percentiles(phases[p].sim_ms, opts->cycles, &sim_mean, &sim_p50, &sim_p99, &sim_max);
+        printf("%5d  %-16s %9.1f %9.1f %9.1f %9.1f %10.1f %10.1f %12.2f %12.1f\n",
+            opts->slots, s_phase_names[p], mean, p50, p99, max, sim_mean, sim_max,
+            (double)phases[p].allocs / opts->cycles, (double)phases[p].bytes / opts->cycles);
+        free(phases[p].host_us);
+        free(phases[p].sim_ms);
+    }
+}
+
+typedef struct {
+    int64_t time_us;
+    int slot;
+    bool occupied;
+} bench_change_t;
+
+/* Run the scan task for cycles * BENCH_CYCLE_GAP_MS of virtual time. The churn is
+ * scripted up front as a trace, so changes land at their own times rather than
+ * whenever the scan task happens to be awake. */
+static void bench_run_scheduler(const bench_options_t *opts, int total_slots) {
+    int64_t start_us = sim_now_us();
+    int64_t end_us = start_us + (int64_t)opts->cycles * BENCH_CYCLE_GAP_MS * 1000;
+
+    bench_change_t *changes = calloc((size_t)opts->cycles * total_slots + 1, sizeof(bench_change_t));
+    int change_count = 0;
+    if (opts->trace_path == NULL) {
+        bool *occupied = calloc(total_slots, sizeof(bool));
+        for (int cycle = 0; cycle < opts->cycles; cycle++) {
+            /* Offset from the pass grid so changes do not line up with scan ticks */
+            int64_t time_ms = start_us / 1000 + (int64_t)cycle * BENCH_CYCLE_GAP_MS + 17;
+            for (int i = 0; i < total_slots; i++) {
+                if (sim_random() % 1000 < BENCH_TURNOVER_PER_MILLE) {
+                    occupied[i] = !occupied[i];
+                    sim_trace_add(time_ms, i, occupied[i] ? BENCH_OCCUPIED_MM : BENCH_FREE_MM);
+                    changes[change_count++] = (bench_change_t){ time_ms * 1000, i, occupied[i] };
+                }
+            }
+        }
+        free(occupied);
+    }
+
+    /* Change waiting for its commit, and for the server, per slot; time 0 = none */
+    bench_change_t *pending = calloc(total_slots, sizeof(bench_change_t));
+    bench_change_t *unsent = calloc(total_slots, sizeof(bench_change_t));
+    double *latency_ms = calloc(change_count + 1, sizeof(double));
+    double *server_ms = calloc(change_count + 1, sizeof(double));
+    int latencies = 0;
+    int server_latencies = 0;
+    int superseded = 0;
+    int next_change = 0;
+
+    double host_start = bench_host_us();
+    scan_scheduler_start();
+    while (sim_now_us() < end_us) {
+        /* Uploads run in their own task on the device and coalesce per slot, so they are drained afterwards */
+        scan_scheduler_process(BENCH_CYCLE_GAP_MS);
+
+        while (next_change < change_count && changes[next_change].time_us <= sim_now_us()) {
+            bench_change_t *change = &changes[next_change++];
+            if (pending[change->slot].time_us) {
+                /* Changed back before the first change was committed */
+                superseded++;
+                pending[change->slot].time_us = 0;
+                unsent[change->slot].time_us = 0;
+            } else {
+                pending[change->slot] = *change;
+                unsent[change->slot] = *change;
+            }
+        }
+        for (int i = 0; i < total_slots; i++) {
+            if (pending[i].time_us && parking_slot_is_occupied(i) == pending[i].occupied) {
+                latency_ms[latencies++] = (double)(sim_now_us() - pending[i].time_us) / 1000.0;
+                pending[i].time_us = 0;
+            }
+        }
+        if (!opts->end_to_end) continue;
+
+        /* The network task's turn: pre-warms, batches and idle closes */
+        upload_queue_process(0);
+        http_client_close_idle();
+        for (int i = 0; i < total_slots; i++) {
+            if (unsent[i].time_us && sim_server_spot_state(parking_slot_name(i)) == (int)unsent[i].occupied) {
+                server_ms[server_latencies++] = (double)(sim_now_us() - unsent[i].time_us) / 1000.0;
+                unsent[i].time_us = 0;
+            }
+        }
+    }
+    double host_ms = (bench_host_us() - host_start) / 1000.0;
+    bench_drain_uploads();
+
+    scan_scheduler_stats_t scan;
+    scan_scheduler_get_stats(&scan);
+    double seconds = (double)(sim_now_us() - start_us) / 1e6;
+    double mean = 0, p50 = 0, p99 = 0, max = 0;
+    if (latencies > 0) {
+        bench_percentiles(latency_ms, latencies, &mean, &p50, &p99, &max);
+    }
+    printf("%5d  scheduler: %.2f samples/slot/s, %lu of %lu sensors skipped, timer off %.1f%% of %.0f s, "
+           "host %.1f ms\n",
+        opts->slots, (double)scan.triggers / total_slots / seconds, (unsigned long)scan.skipped,
+        (unsigned long)(scan.triggers + scan.skipped), 100.0 * (double)scan.idle_ms / (seconds * 1000.0), seconds,
+        host_ms);
+    printf("%5d  change-to-commit latency: %d changes (%d superseded), mean %.0f, p50 %.0f, p99 %.0f, max %.0f ms\n",
+        opts->slots, latencies, superseded, mean, p50, p99, max);
+    if (opts->end_to_end && server_latencies > 0) {
+        bench_percentiles(server_ms, server_latencies, &mean, &p50, &p99, &max);
+        printf("%5d  change-to-server latency: %d changes, mean %.0f, p50 %.0f, p99 %.0f, max %.0f ms\n",
+            opts->slots, server_latencies, mean, p50, p99, max);
+    }
+    free(server_ms);
+    free(latency_ms);
+    free(unsent);
+    free(pending);
+    free(changes);
+}
+
+/* ----- Gateway nodes ----- */
+
+/* A sensor node as the gateway sees it: slots, and one link over the simulated radio */
+typedef struct {
+    uint8_t mac[6];
+    gateway_link_t link;
+    char names[BENCH_NODE_SLOTS][PARKING_SLOT_NAME_LEN];
+    bool taken[BENCH_NODE_SLOTS];
+    bool dirty[BENCH_NODE_SLOTS];           /* Changed since its state was last queued */
+    int64_t changed_us[BENCH_NODE_SLOTS];   /* Oldest change not queued yet */
+    int window_slots[GATEWAY_LINK_WINDOW];  /* Slot of each record queued in the current window */
+    int queued;                             /* Acks remove from the front: the last link.count are left */
+    uint32_t changes;
+} bench_node_t;
+
+static void bench_node_rx(const uint8_t *src, const uint8_t *data, size_t len, void *ctx) {
+    bench_node_t *node = ctx;
+    gateway_addr_t from;
+    memcpy(from.bytes, src, sizeof(from.bytes));
+    gateway_link_receive(&node->link, &from, data, len, sim_now_us());
+}
+
+/* The driver queues the frame; whether it arrives is for the acks to tell */
+static bool bench_node_send(const gateway_addr_t *to, const uint8_t *data, size_t len, void *ctx) {
+    bench_node_t *node = ctx;
+    sim_radio_transmit(node->mac, to->bytes, data, len);
+    return true;
+}
+
+static void bench_node_mark(bench_node_t *node, int slot, int64_t changed_us) {
+    if (!node->dirty[slot] || changed_us < node->changed_us[slot]) {
+        node->changed_us[slot] = changed_us;
+    }
+    node->dirty[slot] = true;
+}
+
+/* One pass of the node loop: queue a new window once the last one is acked, send it when due */
+static void bench_node_step(bench_node_t *node) {
+    gateway_link_t *link = &node->link;
+    if (link->count == 0) {
+        node->queued = 0;
+        for (int i = 0; i < BENCH_NODE_SLOTS && link->count < GATEWAY_LINK_WINDOW; i++) {
+            if (!node->dirty[i]) continue;
+            node->window_slots[node->queued++] = i;
+            gateway_link_queue(link, node->names[i], node->taken[i], node->changed_us[i], NULL);
+            node->dirty[i] = false;
+        }
+    }
+
+    int64_t now_us = sim_now_us();
+    if (!gateway_link_due(link, now_us)) return;
+    if (link->attempts >= GATEWAY_MAX_ATTEMPTS) {
+        /* Like gateway_link_send(): give up, keep the changes, number afresh */
+        for (int i = 0; i < link->count; i++) {
+            bench_node_mark(node, node->window_slots[node->queued - link->count + i], link->window[i].detected_us);
+        }
+        uint16_t boot_id;
+        do {
+            boot_id = (uint16_t)sim_random();
+        } while (boot_id == link->boot_id);
+        gateway_link_restart(link, boot_id);
+        return;
+    }
+    gateway_link_transmit(link, now_us, bench_node_send, node);
+}
+
+static bool bench_nodes_idle(const bench_node_t *nodes, int count) {
+    for (int n = 0; n < count; n++) {
+        if (nodes[n].link.count > 0) return false;
+        for (int i = 0; i < BENCH_NODE_SLOTS; i++) {
+            if (nodes[n].dirty[i]) return false;
+        }
+    }
+    gateway_stats_t stats;
+    gateway_get_stats(&stats);
+    return stats.depth == 0;
+}
+
+/* Nodes report every slot once, then churn; the gateway forwards between node passes.
+ * Returns the node slots whose state the server does not have. */
+static int bench_run_gateway(const bench_options_t *opts) {
+    int64_t start_us = sim_now_us();
+    int64_t end_us = start_us + (int64_t)opts->cycles * BENCH_CYCLE_GAP_MS * 1000;
+    uint32_t turnover = BENCH_TURNOVER_PER_MILLE * BENCH_NODE_TICK_MS / BENCH_CYCLE_GAP_MS;
+
+    gateway_init();
+    sim_radio_set_loss(opts->radio_loss_per_mille);
+    gateway_addr_t broadcast;
+    memset(broadcast.bytes, 0xFF, sizeof(broadcast.bytes));
+
+    bench_node_t *nodes = calloc(opts->gateway_nodes, sizeof(bench_node_t));
+    for (int n = 0; n < opts->gateway_nodes; n++) {
+        bench_node_t *node = &nodes[n];
+        const uint8_t mac[6] = { 0x02, 0x00, 0x00, 0x00, 0x01, (uint8_t)n };
+        memcpy(node->mac, mac, sizeof(mac));
+        sim_radio_add_station(node->mac, bench_node_rx, node);
+        gateway_link_reset(&node->link, &broadcast, (uint16_t)sim_random());
+        for (int i = 0; i < BENCH_NODE_SLOTS; i++) {
+            snprintf(node->names[i], sizeof(node->names[i]), "N%02d-S%02d", n, i);
+            bench_node_mark(node, i, sim_now_us());
+        }
+    }
+
+    http_client_stats_t http_start;
+    http_client_get_stats(&http_start);
+    double host_start = bench_host_us();
+    int64_t drain_end_us = end_us + (int64_t)BENCH_NODE_DRAIN_MS * 1000;
+    while (sim_now_us() < end_us || (sim_now_us() < drain_end_us && !bench_nodes_idle(nodes, opts->gateway_nodes))) {
+        int64_t tick_end_us = sim_now_us() + (int64_t)BENCH_NODE_TICK_MS * 1000;
+        for (int n = 0; n < opts->gateway_nodes; n++) {
+            bench_node_t *node = &nodes[n];
+            for (int i = 0; sim_now_us() < end_us && i < BENCH_NODE_SLOTS; i++) {
+                if (sim_random() % 1000 < turnover) {
+                    node->taken[i] = !node->taken[i];
+                    node->changes++;
+                    bench_node_mark(node, i, sim_now_us());
+                }
+            }
+            bench_node_step(node);
+        }
+
+        /* The gateway task's turn; it runs alongside the nodes on the device, after them here */
+        gateway_process();
+        http_client_close_idle();
+        if (sim_now_us() < tick_end_us) {
+            sim_advance_to(tick_end_us);
+        }
+    }
+    double host_ms = (bench_host_us() - host_start) / 1000.0;
+    double seconds = (double)(sim_now_us() - start_us) / 1e6;
+
+    int mismatched = 0;
+    for (int n = 0; n < opts->gateway_nodes; n++) {
+        for (int i = 0; i < BENCH_NODE_SLOTS; i++) {
+            if (sim_server_spot_state(nodes[n].names[i]) != (int)nodes[n].taken[i]) {
+                mismatched++;
+            }
+        }
+    }
+
+    gateway_stats_t gw;
+    http_client_stats_t http;
+    sim_hal_stats_t hal;
+    gateway_get_stats(&gw);
+    http_client_get_stats(&http);
+    sim_hal_get_stats(&hal);
+    printf("%5d  gateway: %d nodes, records %lu (duplicates %lu, coalesced %lu, refused %lu), forwarded %lu "
+           "(%.1f/s, %.1f per request), requests %lu (failed %lu), connects %lu, max buffered %lu, "
+           "latency avg %lu max %lu ms, radio frames %llu (dropped %llu), host %.1f ms, out of sync %d\n",
+        opts->slots, opts->gateway_nodes, (unsigned long)gw.records, (unsigned long)gw.duplicates,
+        (unsigned long)gw.coalesced, (unsigned long)gw.refused, (unsigned long)gw.forwarded,
+        (double)gw.forwarded / seconds, gw.requests ? (double)gw.forwarded / (double)gw.requests : 0.0,
+        (unsigned long)gw.requests, (unsigned long)gw.failed, (unsigned long)(http.connects - http_start.connects),
+        (unsigned long)gw.max_depth, gw.forwarded ? (unsigned long)(gw.total_latency_ms / gw.forwarded) : 0UL,
+        (unsigned long)gw.max_latency_ms, (unsigned long long)hal.radio_frames,
+        (unsigned long long)hal.radio_dropped, host_ms, mismatched);
+
+    for (int n = 0; n < opts->gateway_nodes; n++) {
+        const gateway_link_stats_t *link = &nodes[n].link.stats;
+        gateway_node_stats_t node = { 0 };
+        for (int i = 0; gateway_get_node_stats(i, &node); i++) {
+            if (memcmp(node.addr.bytes, nodes[n].mac, sizeof(node.addr.bytes)) == 0) break;
+        }
+        printf("%5d    node %02d: changes %lu, records %lu (acked %lu), frames %lu (retransmits %lu), "
+               "restarts %lu, busy %lu, ack max %lu ms, forwarded %lu, change-to-server avg %lu max %lu ms\n",
+            opts->slots, n, (unsigned long)nodes[n].changes, (unsigned long)link->records,
+            (unsigned long)link->acked, (unsigned long)link->frames, (unsigned long)link->retransmits,
+            (unsigned long)link->restarts, (unsigned long)link->busy, (unsigned long)link->max_ack_ms,
+            (unsigned long)node.forwarded, node.forwarded ? (unsigned long)(node.total_latency_ms / node.forwarded) : 0UL,
+            (unsigned long)node.max_latency_ms);
+    }
+    free(nodes);
+    return mismatched;
+}
+
+/* The strip must show every valid slot's state; the pin backends share pins with the sensors here */
+static int bench_check_strip(int total_slots) {
+#if LED_BACKEND == LED_BACKEND_STRIP
+    led_flush();
+    int mismatched = 0;
+    for (int i = 0; i < total_slots; i++) {
+        uint8_t grb[3];
+        if (!parking_slot_is_valid(i) || !sim_strip_pixel(i, grb)) continue;
+        bool occupied = parking_slot_is_occupied(i);
+        if ((grb[1] != 0) != occupied || (grb[0] != 0) == occupied) mismatched++;
+    }
+    return mismatched;
+#else
+    return 0;
+#endif
+}
+
+static void bench_print_soak_series(int slots, const char *name, const heap_soak_series_t *series) {
+    printf("%5d    %-18s %lu -> %lu bytes, rose %lu times%s\n", slots, name, (unsigned long)series->first,
+        (unsigned long)series->last, (unsigned long)series->rises, series->drifting ? ", DRIFT" : "");
+}
+
+/* Heap soak in place of the cycles; MEMLOG lines stream to stdout as it runs */
+static bool bench_run_soak(const bench_options_t *opts) {
+    heap_soak_result_t result;
+    bool ok = heap_soak_run(opts->soak_updates, &result);
+
+    printf("%5d  soak: updates %lu (failed %lu), checkpoints %lu, outstanding %lu blocks (%lu bytes)%s, %s\n",
+        opts->slots, (unsigned long)result.updates, (unsigned long)result.failed,
+        (unsigned long)result.checkpoints, (unsigned long)result.outstanding_blocks,
+        (unsigned long)result.outstanding_bytes, result.trace_overflowed ? " trace overflowed" : "",
+        ok ? "no drift" : result.checkpoints == 0 ? "refused" : "DRIFT");
+    bench_print_soak_series(opts->slots, "free heap", &result.free_heap);
+    bench_print_soak_series(opts->slots, "min free heap", &result.min_free_heap);
+    bench_print_soak_series(opts->slots, "largest free block", &result.largest_block);
+    for (uint32_t i = 0; i < result.site_count; i++) {
+        printf("%5d    site %p: %lu blocks, %lu bytes\n", opts->slots, result.sites[i].caller,
+            (unsigned long)result.sites[i].blocks, (unsigned long)result.sites[i].bytes);
+    }
+    return ok;
+}
+
+/* The local snapshot must report every valid slot as the device sees it */
+static int bench_check_snapshot(int total_slots) {
+    const char *body;
+    size_t len;
+    char etag[SNAPSHOT_ETAG_LEN];
+    int mismatched = 0;
+
+    snapshot_acquire(&body, &len, etag);
+    for (int i = 0; i < total_slots; i++) {
+        if (!parking_slot_is_valid(i)) continue;
+        char entry[64];
+        snprintf(entry, sizeof(entry), "{\"spot\":\"%s\",\"taken\":%s,\"valid\":true}",
+            parking_slot_name(i), parking_slot_is_occupied(i) ? "true" : "false");
+        if (strstr(body, entry) == NULL) mismatched++;
+    }
+    snapshot_release();
+    return mismatched;
+}
+
+/* Replay of the history ring: last state per slot, arrivals and finished stays */
+typedef struct {
+    int8_t state[MAX_PARKING_SLOTS];
+    uint32_t since_s[MAX_PARKING_SLOTS];
+    uint32_t arrivals;
+    uint32_t dwell_count;
+    uint64_t dwell_total_s;
+} bench_history_t;
+
+static void bench_history_visit(int slot_index, bool occupied, uint32_t time_s, void *ctx) {
+    bench_history_t *replay = ctx;
+    if (slot_index < 0 || slot_index >= MAX_PARKING_SLOTS) return;
+
+    if (replay->state[slot_index] == 1 && !occupied) {
+        replay->dwell_count++;
+        replay->dwell_total_s += time_s - replay->since_s[slot_index];
+    } else if (replay->state[slot_index] == 0 && occupied) {
+        replay->arrivals++;
+    }
+    replay->state[slot_index] = occupied;
+    replay->since_s[slot_index] = time_s;
+}
+
+/* Decoding the ring must give the device's state, and with nothing evicted the
+ * incrementally kept aggregates; returns the disagreements */
+static int bench_check_history(int total_slots, const occupancy_summary_t *summary,
+                               const occupancy_history_stats_t *stats) {
+    static bench_history_t replay;
+    memset(&replay, 0, sizeof(replay));
+    memset(replay.state, -1, sizeof(replay.state));
+    int mismatched = 0;
+
+    if (occupancy_history_foreach(bench_history_visit, &replay) != (int)stats->events) mismatched++;
+    for (int i = 0; i < total_slots; i++) {
+        if (parking_slot_is_valid(i) && replay.state[i] >= 0 && replay.state[i] != parking_slot_is_occupied(i)) {
+            mismatched++;
+        }
+    }
+    if (stats->evicted == 0) {
+        uint32_t mean_dwell_s = replay.dwell_count ? (uint32_t)(replay.dwell_total_s / replay.dwell_count) : 0;
+        if (replay.arrivals != summary->arrivals) mismatched++;
+        if (replay.dwell_count != summary->dwell_count || mean_dwell_s != summary->mean_dwell_s) mismatched++;
+    }
+    return mismatched;
+}
+
+/* Flip slots (all, or at the outage turnover rate) and measure until the filter commits them */
+static void bench_outage_step(int total_slots, bool all) {
+    for (int i = 0; i < total_slots; i++) {
+        if (all || sim_random() % 1000 < BENCH_OUTAGE_TURNOVER_PER_MILLE) {
+            bool occupied = sim_sensor_get_distance(i) == BENCH_OCCUPIED_MM;
+            sim_sensor_set_distance(i, occupied ? BENCH_FREE_MM : BENCH_OCCUPIED_MM);
+        }
+    }
+    /* Enough readings to move the median, then one more once the dwell time has passed */
+    for (int pass = 0; pass <= PARKING_MEDIAN_WINDOW / 2 + 1; pass++) {
+        if (pass > PARKING_MEDIAN_WINDOW / 2) {
+            vTaskDelay(pdMS_TO_TICKS(PARKING_DWELL_MS));
+        }
+        for (int i = 0; i < total_slots; i++) {
+            measure_distance(i);
+        }
+    }
+    bench_drain_uploads();
+}
+
+/* Server unreachable until the journal ring has wrapped over unreplayed records.
+ * Each attempt to end the outage flips every slot twice, so each slot's last
+ * transition is among the newest records and nothing the server needs was
+ * overwritten; the outage ends once that leaves the write position on a sector
+ * boundary, where the sector is not erased yet and holds the lap's oldest records.
+ * Returns 1 when the outage never got there. */
+static int bench_run_outage(const bench_options_t *opts, int total_slots) {
+    journal_stats_t stats;
+    sim_server_config()->online = false;
+
+    int steps = 0;
+    do {
+        bench_outage_step(total_slots, false);
+        journal_get_stats(&stats);
+        steps++;
+        if (stats.overwritten == 0) continue;
+
+        bench_outage_step(total_slots, true);
+        bench_outage_step(total_slots, true);
+        journal_get_stats(&stats);
+        steps += 2;
+    } while (steps < BENCH_OUTAGE_MAX_STEPS &&
+             (stats.overwritten == 0 || stats.appended % BENCH_JOURNAL_SECTOR_RECORDS != 0));
+
+    bool on_boundary = stats.overwritten > 0 && stats.appended % BENCH_JOURNAL_SECTOR_RECORDS == 0;
+    printf("%5d  outage: %d steps, journaled %lu, overwritten %lu, write position %s sector boundary\n",
+        opts->slots, steps, (unsigned long)stats.appended, (unsigned long)stats.overwritten,
+        on_boundary ? "on a" : "off the");
+    sim_server_config()->online = true;
+    return on_boundary ? 0 : 1;
+}
+
+static int bench_run(const bench_options_t *opts) {
+    sim_hal_reset(opts->seed);
+    sim_nvs_reset();
+    sim_server_reset(NULL);
+    sim_server_config()->fail_per_mille = opts->fail_per_mille;
+    sim_server_config()->idle_timeout_ms = opts->idle_timeout_ms;
+    sim_support_init();
+    snapshot_init();
+    heap_soak_init();
+    freshness_init();
+    if (sim_partition_create(JOURNAL_PARTITION_LABEL,
+                             opts->outage ? BENCH_OUTAGE_JOURNAL_SIZE : BENCH_JOURNAL_SIZE) != ESP_OK) {
+        return 1;
+    }
+
+    bench_provision(opts->slots);
+    if (opts->trace_path && sim_trace_load(opts->trace_path) < 0) {
+        fprintf(stderr, "Cannot read trace %s\n", opts->trace_path);
+        return 1;
+    }
+
+    /* Same bring-up order as app_main() */
+    freshness_sync_time();
+    http_client_init();
+    journal_init();
+    upload_queue_init();
+    sensor_backend_init();
+    int total_slots = load_parking_slots();
+    occupancy_history_init();
+    for (int i = 0; i < total_slots; i++) {
+        init_parking_slot(i);
+    }
+    for (int i = 0; i < total_slots; i++) {
+        measure_distance(i);
+    }
+    send_initial_status();
+    bench_drain_uploads();
+
+    bool soak_ok = true;
+    int gateway_mismatched = 0;
+    int outage_missed = 0;
+    if (opts->soak_updates > 0) {
+        soak_ok = bench_run_soak(opts);
+    } else if (opts->gateway_nodes > 0) {
+        gateway_mismatched = bench_run_gateway(opts);
+    } else if (opts->outage) {
+        outage_missed = bench_run_outage(opts, total_slots);
+    } else if (opts->scheduler) {
+        bench_run_scheduler(opts, total_slots);
+    } else {
+        bench_run_cycles(opts, total_slots);
+    }
+
+    /* The server must end up with exactly the state the device shows */
+    sim_server_config()->fail_per_mille = 0;
+    vTaskDelay(pdMS_TO_TICKS(JOURNAL_RETRY_MS));
+    upload_queue_process(0);
+
+    int mismatched = 0;
+    for (int i = 0; i < total_slots; i++) {
+        if (parking_slot_is_valid(i) &&
+            sim_server_spot_state(parking_slot_name(i)) != (int)parking_slot_is_occupied(i)) {
+            mismatched++;
+        }
+    }
+    int led_mismatched = bench_check_strip(total_slots);
+    int snapshot_mismatched = bench_check_snapshot(total_slots);
+
+    occupancy_summary_t history;
+    occupancy_history_stats_t history_stats;
+    occupancy_history_get_summary(&history);
+    occupancy_history_get_stats(&history_stats);
+    int history_mismatched = bench_check_history(total_slots, &history, &history_stats);
+    if (!occupancy_history_upload()) history_mismatched++;
+
+    /* Every transition must be acked once the server is in sync */
+    int freshness_mismatched = 0;
+    for (int i = 0; i < total_slots; i++) {
+        if (freshness_unacked(i) != 0) freshness_mismatched++;
+    }
+    if (!freshness_heartbeat()) freshness_mismatched++;
+
+    upload_queue_stats_t upload;
+    parking_filter_stats_t filter;
+    sim_server_stats_t server;
+    sim_hal_stats_t hal;
+    upload_queue_get_stats(&upload);
+    get_parking_filter_stats(&filter);
+    sim_server_get_stats(&server);
+    sim_hal_get_stats(&hal);
+
+    printf("%5d  transitions %lu (rejected %lu), uploads sent %lu failed %lu, requests %lu, connects %lu, "
+           "wire bytes/update %.1f, gpio writes %llu, server out of sync %d\n",
+        opts->slots, (unsigned long)filter.committed, (unsigned long)filter.rejected,
+        (unsigned long)upload.sent, (unsigned long)upload.failed, (unsigned long)server.requests,
+        (unsigned long)server.connects, server.updates ? (double)server.wire_bytes / (double)server.updates : 0.0,
+        (unsigned long long)hal.gpio_writes, mismatched);
+
+    tls_session_stats_t tls;
+    tls_session_get_stats(&tls);
+    const tls_handshake_stats_t *full = &tls.kind[TLS_HANDSHAKE_FULL];
+    const tls_handshake_stats_t *resumed = &tls.kind[TLS_HANDSHAKE_RESUMED];
+    http_client_stats_t http;
+    http_client_get_stats(&http);
+    printf("%5d  prewarm: opened %lu, hits %lu, misses %lu, wasted %lu, idle closes %lu, server idle closes %llu\n",
+        opts->slots, (unsigned long)http.prewarms, (unsigned long)http.prewarm_hits,
+        (unsigned long)http.prewarm_misses, (unsigned long)http.prewarm_wasted, (unsigned long)http.idle_closes,
+        (unsigned long long)server.idle_closes);
+
+    printf("%5d  handshakes: full %lu (avg %lu ms), resumed %lu (avg %lu ms), tickets declined %lu, "
+           "server resumed %lu\n",
+        opts->slots, (unsigned long)full->count, full->count ? (unsigned long)(full->total_ms / full->count) : 0UL,
+        (unsigned long)resumed->count, resumed->count ? (unsigned long)(resumed->total_ms / resumed->count) : 0UL,
+        (unsigned long)tls.tickets_declined, (unsigned long)server.resumed);
+
+    led_control_stats_t leds;
+    led_control_get_stats(&leds);
+    printf("%5d  leds: flushes %lu, pixels %lu, gpio writes %llu, bundle writes %llu, strip frames %llu (%llu bytes), "
+           "strip out of sync %d\n",
+        opts->slots, (unsigned long)leds.flushes, (unsigned long)leds.pixels, (unsigned long long)hal.gpio_writes,
+        (unsigned long long)hal.bundle_writes, (unsigned long long)hal.rmt_frames, (unsigned long long)hal.rmt_bytes,
+        led_mismatched);
+
+    printf("%5d  history: %lu transitions in %lu bytes (evicted %lu), window %lu s, occupancy %lu.%lu%%, "
+           "peak %u, arrivals %lu, mean dwell %lu s, summary %llu bytes, out of sync %d\n",
+        opts->slots, (unsigned long)history_stats.events, (unsigned long)history_stats.ring_bytes,
+        (unsigned long)history_stats.evicted, (unsigned long)history.window_s,
+        (unsigned long)(history.occupancy_permille / 10), (unsigned long)(history.occupancy_permille % 10),
+        history.peak, (unsigned long)history.arrivals, (unsigned long)history.mean_dwell_s,
+        (unsigned long long)server.analytics_bytes, history_mismatched);
+
+    sensor_backend_stats_t sensors;
+    sensor_backend_get_stats(&sensors);
+    printf("%5d  sensors: backend %s, started %lu, readings %lu, timeouts %lu, %lu readings/s over %lu ms busy, "
+           "i2c transactions %llu\n",
+        opts->slots, sensor_backend_name(), (unsigned long)sensors.started, (unsigned long)sensors.readings,
+        (unsigned long)sensors.timeouts, (unsigned long)sensors.readings_per_sec,
+        (unsigned long)(sensors.busy_us / 1000), (unsigned long long)hal.i2c_transactions);
+
+    snapshot_stats_t snapshot;
+    snapshot_get_stats(&snapshot);
+    printf("%5d  snapshot: version %lu, rebuilds %lu, reads %lu, size %lu bytes, out of sync %d\n",
+        opts->slots, (unsigned long)snapshot.version, (unsigned long)snapshot.rebuilds,
+        (unsigned long)snapshot.reads, (unsigned long)snapshot.size, snapshot_mismatched);
+
+    freshness_stats_t fresh;
+    freshness_summary_t fresh_summary;
+    freshness_get_stats(&fresh);
+    freshness_get_summary(&fresh_summary);
+    printf("%5d  freshness: acked %lu of %lu (unmeasured %lu), detection to ack p50 %lu p99 %lu max %lu ms, "
+           "%.1f%% within %d ms, server staleness avg %llu max %llu ms, seq regressions %llu, "
+           "heartbeats %llu, out of sync %d\n",
+        opts->slots, (unsigned long)fresh.acked, (unsigned long)fresh.committed, (unsigned long)fresh.unmeasured,
+        (unsigned long)fresh_summary.p50_ms, (unsigned long)fresh_summary.p99_ms,
+        (unsigned long)fresh_summary.max_ms,
+        fresh_summary.count ? 100.0 * fresh_summary.within_slo / fresh_summary.count : 100.0, FRESHNESS_SLO_MS,
+        server.stamped ? (unsigned long long)(server.stale_total_ms / server.stamped) : 0ULL,
+        (unsigned long long)server.stale_max_ms, (unsigned long long)server.seq_regressions,
+        (unsigned long long)server.heartbeats, freshness_mismatched);
+    if (opts->print_spans) {
+        bench_print_spans(opts->slots);
+    }
+    if (opts->dump_memlog) {
+        mem_telemetry_dump();
+    }
+    if (mismatched || led_mismatched || snapshot_mismatched || history_mismatched || gateway_mismatched ||
+        freshness_mismatched || outage_missed) {
+        return 2;
+    }
+    return soak_ok ? 0 : 3;
+}
+
+/* Every slot count runs in its own process so firmware statics start fresh */
+static int bench_fork(bench_options_t opts, int slots) {
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        opts.slots = slots;
+        int rc = bench_run(&opts);
+        fflush(stdout);
+        _exit(rc);
+    }
+    int status = 0;
+    if (pid < 0 || waitpid(pid, &status, 0) < 0) return 1;
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+}
+
+int main(int argc, char **argv) {
+    bench_options_t opts = {
+        .slots = 0,
+        .cycles = BENCH_DEFAULT_CYCLES,
+        .seed = 1,
+        .fail_per_mille = 0,
+        .idle_timeout_ms = 0,
+        .soak_updates = 0,
+        .gateway_nodes = 0,
+        .radio_loss_per_mille = 0,
+        .outage = false,
+        .trace_path = NULL,
+        .dump_memlog = false,
+        .print_spans = false,
+        .scheduler = false,
+    };
+    bool verbose = false;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:c:t:s:f:i:k:g:r:oaelmv")) != -1) {
+        switch (opt) {
+            case 'n': opts.slots = atoi(optarg); break;
+            case 'c': opts.cycles = atoi(optarg); break;
+            case 't': opts.trace_path = optarg; break;
+            case 's': opts.seed = (uint32_t)strtoul(optarg, NULL, 0); break;
+            case 'f': opts.fail_per_mille = (uint32_t)strtoul(optarg, NULL, 0); break;
+            case 'i': opts.idle_timeout_ms = (uint32_t)strtoul(optarg, NULL, 0); break;
+            case 'k': opts.soak_updates = (uint32_t)strtoul(optarg, NULL, 0); break;
+            case 'g': opts.gateway_nodes = atoi(optarg); break;
+            case 'r': opts.radio_loss_per_mille = (uint32_t)strtoul(optarg, NULL, 0); break;
+            case 'o': opts.outage = true; break;
+            case 'a': opts.scheduler = true; break;
+            case 'e': opts.scheduler = true; opts.end_to_end = true; break;
+            case 'l': opts.print_spans = true; break;
+            case 'm': opts.dump_memlog = true; break;
+            case 'v': verbose = true; break;
+            default:
+                fprintf(stderr, "usage: %s [-n slots] [-c cycles] [-t trace.csv] [-s seed] [-f fail_per_mille] [-i idle_ms] [-k updates] [-g nodes] [-r loss_per_mille] [-o] [-a] [-e] [-l] [-m] [-v]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (opts.slots < 0 || opts.slots > MAX_PARKING_SLOTS || opts.cycles <= 0) {
+        fprintf(stderr, "slots must be 1..%d and cycles positive\n", MAX_PARKING_SLOTS);
+        return 1;
+    }
+    if (opts.gateway_nodes < 0 || opts.gateway_nodes > GATEWAY_MAX_NODES) {
+        fprintf(stderr, "gateway nodes must be 0..%d\n", GATEWAY_MAX_NODES);
+        return 1;
+    }
+    sim_log_set_output(verbose ? stdout : NULL);
+
+    printf("%5s  %-16s %9s %9s %9s %9s %10s %10s %12s %12s\n", "slots", "phase", "mean_us", "p50_us", "p99_us",
+        "max_us", "sim_mean_ms", "sim_max_ms", "allocs/cycle", "bytes/cycle");
+
+    if (opts.slots > 0) {
+        return bench_run(&opts);
+    }
+
+    static const int suite[] = { 1, 16, 256 };
+    int rc = 0;
+    for (size_t i = 0; i < sizeof(suite) / sizeof(suite[0]); i++) {
+        int slot_rc = bench_fork(opts, suite[i]);
+        if (slot_rc != 0) rc = slot_rc;
+    }
+    return rc;
+}
@@ -0,0 +1,787 @@
+/**
+ * @file fleet.c
+ * @brief Fleet load generator for the parking endpoint
+ *
+ * Emulates many controllers against one server from a single epoll loop.
+ * Every device owns a few slots whose occupancy changes under a churn
+ * model; changes are coalesced per slot and uploaded the way the firmware
+ * does: POST PARKING_ENDPOINT with the same headers and JSON bodies as
+ * send_parking_update()/send_parking_batch(). The upload mode selects
+ * between the original connect-per-request client, a kept-alive
+ * connection with one spot per request, and kept-alive batches of up to
+ * BATCH_MAX_SIZE spots. Requests per second, connection and handshake
+ * counts, and latency percentiles are reported at the end.
+ *
+ * Usage: parking_fleet [options], see fleet_usage()
+ */
+#define _GNU_SOURCE /* memmem */
+#include "fleet_common.h"
+#include "config.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <math.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define FLEET_TX_SIZE 4096          /* BATCH_MAX_SIZE spots plus headers */
+#define FLEET_RX_SIZE 1024
+#define FLEET_MAX_EVENTS 512
+#define FLEET_RUSH_PEAK 0.2         /* Share of each rush period at peak rate */
+#define FLEET_RUSH_RATIO 10.0       /* Peak over off-peak change rate */
+
+typedef enum {
+    UPLOAD_CLOSE,                   /* Connect per request, like the original client */
+    UPLOAD_KEEPALIVE,               /* One spot per request on a kept-alive connection */
+    UPLOAD_BATCH,                   /* Up to BATCH_MAX_SIZE spots per kept-alive request */
+} upload_mode_t;
+
+typedef enum {
+    CHURN_POISSON,                  /* Every slot flips independently */
+    CHURN_RUSH,                     /* Poisson with a periodic rush hour */
+    CHURN_BURST,                    /* Half of a device's slots flip at once */
+} churn_model_t;
+
+typedef enum {
+    DEVICE_IDLE,
+    DEVICE_CONNECTING,
+    DEVICE_HANDSHAKE,
+    DEVICE_SENDING,
+    DEVICE_RECEIVING,
+} device_state_t;
+
+typedef struct {
+    int id;
+    int fd;                         /* -1 when no connection is open */
+    device_state_t state;
+    bool batch_supported;
+    bool connection_close;          /* Server answered Connection: close */
+    int cursor;                     /* Next slot to look at for pending changes */
+    int64_t request_start_us;
+    int64_t connect_start_us;
+    int64_t deadline_us;
+    int64_t retry_at_us;
+
+    int inflight_count;
+    uint16_t inflight_slot[BATCH_MAX_SIZE];
+    bool inflight_taken[BATCH_MAX_SIZE];
+    int64_t inflight_change_us[BATCH_MAX_SIZE];
+
+    char tx[FLEET_TX_SIZE];
+    size_t tx_len;
+    size_t tx_off;
+    char rx[FLEET_RX_SIZE];
+    size_t rx_len;
+#if FLEET_TLS
+    SSL *ssl;
+    SSL_SESSION *session;           /* Kept for resumption with -R */
+#endif
+} device_t;
+
+/* Timer heap entry: a slot change (slot >= 0), a device burst (-2) or a device wakeup (-1) */
+typedef struct {
+    int64_t at_us;
+    int32_t device;
+    int32_t slot;
+} fleet_timer_t;
+
+#define TIMER_WAKE -1
+#define TIMER_BURST -2
+
+typedef struct {
+    uint64_t requests;
+    uint64_t updates;               /* Spots acknowledged */
+    uint64_t changes;               /* Slot changes generated */
+    uint64_t connects;
+    uint64_t handshakes;
+    uint64_t resumed;
+    uint64_t errors;
+    uint64_t timeouts;
+    uint64_t rejected;              /* Non-2xx answers */
+    uint64_t fallbacks;             /* Devices that gave up batching */
+    uint64_t bytes_out;
+    uint64_t bytes_in;
+} fleet_stats_t;
+
+typedef struct {
+    int devices;
+    int slots;
+    double duration_s;
+    double dwell_s;
+    double rush_period_s;
+    double boot_spread_s;
+    upload_mode_t mode;
+    churn_model_t churn;
+    bool plain;
+    bool resume;
+    bool tls13;
+    bool source_per_device;
+    const char *host;
+    int port;
+    int timeout_ms;
+    int retry_ms;
+    uint64_t seed;
+} fleet_config_t;
+
+static fleet_config_t s_cfg = {
+    .devices = 100,
+    .slots = 8,
+    .duration_s = 30,
+    .dwell_s = 60,
+    .rush_period_s = 60,
+    .boot_spread_s = 1,
+    .mode = UPLOAD_CLOSE,
+    .churn = CHURN_POISSON,
+    .plain = !FLEET_TLS,
+    .host = "127.0.0.1",
+    .port = FLEET_DEFAULT_PORT,
+    .timeout_ms = 10000,
+    .retry_ms = 1000,
+    .seed = 1,
+};
+
+static device_t *s_devices;
+static bool *s_taken;               /* devices x slots, current occupancy */
+static bool *s_pending;             /* Change not yet sent */
+static int64_t *s_change_us;        /* First unsent change per slot */
+static fleet_timer_t *s_timers;
+static size_t s_timer_count;
+static size_t s_timer_capacity;
+static fleet_stats_t s_stats;
+static fleet_samples_t s_request_latency;
+static fleet_samples_t s_connect_latency;
+static fleet_samples_t s_ack_latency;
+static int s_epoll = -1;
+static int64_t s_start_us;
+static uint64_t s_rng;
+static struct sockaddr_in s_server;
+static volatile sig_atomic_t s_stop = 0;
+#if FLEET_TLS
+static SSL_CTX *s_tls = NULL;
+#endif
+
+static void fleet_on_signal(int sig) {
+    s_stop = 1;
+}
+
+/* ============================================================
+ * Random numbers and churn
+ * ============================================================ */
+
+static uint64_t fleet_rand(void) {
+    s_rng ^= s_rng << 13;
+    s_rng ^= s_rng >> 7;
+    s_rng ^= s_rng << 17;
+    return s_rng;
+}
+
+static double fleet_uniform(void) {
+    return ((fleet_rand() >> 11) + 0.5) / 9007199254740992.0;
+}
+
+static int64_t fleet_exponential_us(double mean_s) {
+    return (int64_t)(-log(fleet_uniform()) * mean_s * 1e6);
+}
+
+static double fleet_rush_factor(int64_t at_us) {
+    double phase = fmod((at_us - s_start_us) / 1e6, s_cfg.rush_period_s) / s_cfg.rush_period_s;
+    return phase < FLEET_RUSH_PEAK ? 1.0 : 1.0 / FLEET_RUSH_RATIO;
+}
+
+/* Next change of one slot after 'from_us' */
+static int64_t fleet_next_change_us(int64_t from_us) {
+    if (s_cfg.churn != CHURN_RUSH) {
+        return from_us + fleet_exponential_us(s_cfg.dwell_s);
+    }
+    /* Thinning: draw at the peak rate, keep with the rate ratio at that time.
+     * The peak rate is scaled so the mean over a period stays at 1 / dwell. */
+    double peak_mean_s = s_cfg.dwell_s * (FLEET_RUSH_PEAK + (1.0 - FLEET_RUSH_PEAK) / FLEET_RUSH_RATIO);
+    int64_t at_us = from_us;
+    do {
+        at_us += fleet_exponential_us(peak_mean_s);
+    } while (fleet_uniform() > fleet_rush_factor(at_us));
+    return at_us;
+}
+
+/* ============================================================
+ * Timer heap
+ * ============================================================ */
+
+static void fleet_timer_add(int64_t at_us, int device, int slot) {
+    if (s_timer_count == s_timer_capacity) {
+        s_timer_capacity = s_timer_capacity ? s_timer_capacity * 2 : 1024;
+        s_timers = realloc(s_timers, s_timer_capacity * sizeof(*s_timers));
+    }
+    size_t i = s_timer_count++;
+    while (i > 0 && s_timers[(i - 1) / 2].at_us > at_us) {
+        s_timers[i] = s_timers[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    s_timers[i] = (fleet_timer_t){ .at_us = at_us, .device = device, .slot = slot };
+}
+
+static fleet_timer_t fleet_timer_pop(void) {
+    fleet_timer_t top = s_timers[0];
+    fleet_timer_t last = s_timers[--s_timer_count];
+    size_t i = 0;
+    while (1) {
+        size_t child = 2 * i + 1;
+        if (child >= s_timer_count) break;
+        if (child + 1 < s_timer_count && s_timers[child + 1].at_us < s_timers[child].at_us) child++;
+        if (s_timers[child].at_us >= last.at_us) break;
+        s_timers[i] = s_timers[child];
+        i = child;
+    }
+    if (s_timer_count > 0) s_timers[i] = last;
+    return top;
+}
+
+/* ============================================================
+ * Connections
+ * ============================================================ */
+
+static void device_watch(device_t *dev, uint32_t events) {
+    struct epoll_event ev = { .events = events, .data.ptr = dev };
+    epoll_ctl(s_epoll, EPOLL_CTL_MOD, dev->fd, &ev);
+}
+
+static void device_disconnect(device_t *dev) {
+    if (dev->fd < 0) return;
+#if FLEET_TLS
+    if (dev->ssl) {
+        if (dev->state == DEVICE_IDLE) SSL_shutdown(dev->ssl);
+        SSL_free(dev->ssl);
+        dev->ssl = NULL;
+    }
+#endif
+    close(dev->fd);
+    dev->fd = -1;
+}
+
+static bool device_connect(device_t *dev) {
+    dev->fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (dev->fd < 0) return false;
+    fleet_set_nonblocking(dev->fd);
+    int one = 1;
+    setsockopt(dev->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    /* A source address per device keeps thousands of connects off one ephemeral port range */
+    if (s_cfg.source_per_device) {
+        struct sockaddr_in local = {
+            .sin_family = AF_INET,
+            .sin_addr.s_addr = htonl(0x7f010000u + (uint32_t)dev->id + 1),
+        };
+        bind(dev->fd, (struct sockaddr *)&local, sizeof(local));
+    }
+
+    s_stats.connects++;
+    dev->connect_start_us = fleet_now_us();
+    dev->state = DEVICE_CONNECTING;
+    struct epoll_event ev = { .events = EPOLLOUT, .data.ptr = dev };
+    epoll_ctl(s_epoll, EPOLL_CTL_ADD, dev->fd, &ev);
+
+    if (connect(dev->fd, (struct sockaddr *)&s_server, sizeof(s_server)) < 0 && errno != EINPROGRESS) {
+        return false;
+    }
+    return true;
+}
+
+/* >0 bytes, 0 closed or failed, -1 would block (interest set) */
+static ssize_t device_io(device_t *dev, void *buf, size_t len, bool write) {
+#if FLEET_TLS
+    if (dev->ssl) {
+        int n = write ? SSL_write(dev->ssl, buf, (int)len) : SSL_read(dev->ssl, buf, (int)len);
+        if (n > 0) return n;
+        int err = SSL_get_error(dev->ssl, n);
+        if (err == SSL_ERROR_WANT_READ) { device_watch(dev, EPOLLIN); return -1; }
+        if (err == SSL_ERROR_WANT_WRITE) { device_watch(dev, EPOLLOUT); return -1; }
+        return 0;
+    }
+#endif
+    ssize_t n = write ? send(dev->fd, buf, len, MSG_NOSIGNAL) : recv(dev->fd, buf, len, 0);
+    if (n > 0) return n;
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        device_watch(dev, write ? EPOLLOUT : EPOLLIN);
+        return -1;
+    }
+    return 0;
+}
+
+/* ============================================================
+ * Requests
+ * ============================================================ */
+
+static void device_spot_name(const device_t *dev, int slot, char *name, size_t size) {
+    snprintf(name, size, "D%04d-S%02d", dev->id, slot);
+}
+
+/* Take pending changes into the in-flight set and format the request */
+static void device_build_request(device_t *dev) {
+    int limit = (s_cfg.mode == UPLOAD_BATCH && dev->batch_supported) ? BATCH_MAX_SIZE : 1;
+    size_t base = (size_t)dev->id * (size_t)s_cfg.slots;
+
+    dev->inflight_count = 0;
+    for (int n = 0; n < s_cfg.slots && dev->inflight_count < limit; n++) {
+        int slot = (dev->cursor + n) % s_cfg.slots;
+        if (!s_pending[base + slot]) continue;
+        s_pending[base + slot] = false;
+        dev->inflight_slot[dev->inflight_count] = (uint16_t)slot;
+        dev->inflight_taken[dev->inflight_count] = s_taken[base + slot];
+        dev->inflight_change_us[dev->inflight_count] = s_change_us[base + slot];
+        dev->inflight_count++;
+    }
+    dev->cursor = (dev->cursor + 1) % s_cfg.slots;
+
+    /* Same bodies as cJSON_PrintUnformatted() in http_client.c */
+    char body[FLEET_TX_SIZE - 256];
+    size_t len = 0;
+    char name[16];
+    bool batch = dev->inflight_count > 1;
+    if (batch) len += (size_t)snprintf(body + len, sizeof(body) - len, "{\"updates\":[");
+    for (int i = 0; i < dev->inflight_count; i++) {
+        device_spot_name(dev, dev->inflight_slot[i], name, sizeof(name));
+        len += (size_t)snprintf(body + len, sizeof(body) - len, "%s{\"spot\":\"%s\",\"taken\":%s}",
+            (batch && i) ? "," : "", name, dev->inflight_taken[i] ? "true" : "false");
+    }
+    if (batch) len += (size_t)snprintf(body + len, sizeof(body) - len, "]}");
+
+    /* Headers as esp_http_client sends them; keep-alive only when the connection is reused */
+    dev->tx_len = (size_t)snprintf(dev->tx, sizeof(dev->tx),
+        "POST %s HTTP/1.1\r\nUser-Agent: ESP32 HTTP Client/1.0\r\nHost: %s\r\n"
+        "Content-Type: application/json\r\n%sContent-Length: %zu\r\n\r\n%.*s",
+        PARKING_ENDPOINT, s_cfg.host, s_cfg.mode == UPLOAD_CLOSE ? "" : "Connection: keep-alive\r\n",
+        len, (int)len, body);
+    dev->tx_off = 0;
+    dev->rx_len = 0;
+}
+
+/* Put unacknowledged spots back unless a newer change is already pending */
+static void device_requeue(device_t *dev) {
+    size_t base = (size_t)dev->id * (size_t)s_cfg.slots;
+    for (int i = 0; i < dev->inflight_count; i++) {
+        size_t index = base + dev->inflight_slot[i];
+        if (!s_pending[index]) {
+            s_pending[index] = true;
+            s_change_us[index] = dev->inflight_change_us[i];
+        } else if (dev->inflight_change_us[i] < s_change_us[index]) {
+            s_change_us[index] = dev->inflight_change_us[i];
+        }
+    }
+    dev->inflight_count = 0;
+}
+
+static bool device_has_pending(const device_t *dev) {
+    const bool *pending = s_pending + (size_t)dev->id * (size_t)s_cfg.slots;
+    for (int slot = 0; slot < s_cfg.slots; slot++) {
+        if (pending[slot]) return true;
+    }
+    return false;
+}
+
+static void device_step(device_t *dev);
+
+static void device_fail(device_t *dev, bool timeout) {
+    s_stats.errors++;
+    if (timeout) s_stats.timeouts++;
+    device_disconnect(dev);
+    device_requeue(dev);
+    dev->state = DEVICE_IDLE;
+    dev->retry_at_us = fleet_now_us() + (int64_t)s_cfg.retry_ms * 1000;
+    fleet_timer_add(dev->retry_at_us, dev->id, TIMER_WAKE);
+}
+
+/* Start the next request if the device is idle and has something to send */
+static void device_kick(device_t *dev) {
+    if (dev->state != DEVICE_IDLE || !device_has_pending(dev)) return;
+    int64_t now_us = fleet_now_us();
+    if (now_us < dev->retry_at_us) return;
+
+    device_build_request(dev);
+    dev->request_start_us = now_us;
+    dev->deadline_us = now_us + (int64_t)s_cfg.timeout_ms * 1000;
+    fleet_timer_add(dev->deadline_us, dev->id, TIMER_WAKE);
+
+    if (dev->fd >= 0) {
+        dev->state = DEVICE_SENDING;
+        device_step(dev);
+    } else if (!device_connect(dev)) {
+        device_fail(dev, false);
+    }
+}
+
+/* Status line, Content-Length and Connection of a complete response; false if more is needed */
+static bool device_parse_response(device_t *dev, int *status, bool *complete) {
+    char *end = memmem(dev->rx, dev->rx_len, "\r\n\r\n", 4);
+    *complete = false;
+    if (end == NULL) return dev->rx_len < sizeof(dev->rx);
+    if (sscanf(dev->rx, "HTTP/1.%*d %d", status) != 1) return false;
+
+    size_t header_len = (size_t)(end - dev->rx) + 4;
+    long content_length = 0;
+    for (char *line = memchr(dev->rx, '\n', header_len); line && line < end; line = memchr(line, '\n', (size_t)(end - line))) {
+        line++;
+        if (strncasecmp(line, "Content-Length:", 15) == 0) {
+            content_length = strtol(line + 15, NULL, 10);
+        } else if (strncasecmp(line, "Connection:", 11) == 0) {
+            const char *value = line + 11;
+            while (*value == ' ') value++;
+            dev->connection_close = strncasecmp(value, "close", 5) == 0;
+        }
+    }
+    /* The stand-in answers without a body; anything else only needs to be skipped */
+    if (content_length < 0 || header_len + (size_t)content_length > sizeof(dev->rx)) return false;
+    *complete = dev->rx_len >= header_len + (size_t)content_length;
+    return true;
+}
+
+static void device_complete(device_t *dev, int status) {
+    int64_t now_us = fleet_now_us();
+    s_stats.requests++;
+    fleet_samples_add(&s_request_latency, now_us - dev->request_start_us);
+
+    if (status >= 200 && status < 300) {
+        s_stats.updates += (uint64_t)dev->inflight_count;
+        for (int i = 0; i < dev->inflight_count; i++) {
+            fleet_samples_add(&s_ack_latency, now_us - dev->inflight_change_us[i]);
+        }
+        dev->inflight_count = 0;
+    } else {
+        s_stats.rejected++;
+        /* Old server: fall back to one spot per request, like send_parking_batch() */
+        if (dev->inflight_count > 1 && (status == 400 || status == 404 || status == 422) && dev->batch_supported) {
+            dev->batch_supported = false;
+            s_stats.fallbacks++;
+        } else {
+            dev->retry_at_us = now_us + (int64_t)s_cfg.retry_ms * 1000;
+            fleet_timer_add(dev->retry_at_us, dev->id, TIMER_WAKE);
+        }
+        device_requeue(dev);
+    }
+
+    dev->state = DEVICE_IDLE;
+    if (s_cfg.mode == UPLOAD_CLOSE || dev->connection_close) {
+        device_disconnect(dev);
+    } else {
+        device_watch(dev, EPOLLIN);
+    }
+    dev->connection_close = false;
+    device_kick(dev);
+}
+
+/* Drive one device as far as it can go without blocking */
+static void device_step(device_t *dev) {
+    switch (dev->state) {
+        case DEVICE_IDLE: {
+            /* Readable while idle: the server closed the kept-alive connection */
+            char scratch[64];
+            if (dev->fd >= 0 && device_io(dev, scratch, sizeof(scratch), false) != -1) {
+                device_disconnect(dev);
+            }
+            return;
+        }
+
+        case DEVICE_CONNECTING: {
+            int err = 0;
+            socklen_t len = sizeof(err);
+            if (getsockopt(dev->fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err != 0) {
+                device_fail(dev, false);
+                return;
+            }
+#if FLEET_TLS
+            if (s_tls) {
+                dev->ssl = SSL_new(s_tls);
+                SSL_set_fd(dev->ssl, dev->fd);
+                if (s_cfg.resume && dev->session) SSL_set_session(dev->ssl, dev->session);
+                dev->state = DEVICE_HANDSHAKE;
+                device_step(dev);
+                return;
+            }
+#endif
+            fleet_samples_add(&s_connect_latency, fleet_now_us() - dev->connect_start_us);
+            dev->state = DEVICE_SENDING;
+            device_step(dev);
+            return;
+        }
+
+        case DEVICE_HANDSHAKE: {
+#if FLEET_TLS
+            int r = SSL_connect(dev->ssl);
+            if (r != 1) {
+                int err = SSL_get_error(dev->ssl, r);
+                if (err == SSL_ERROR_WANT_READ) device_watch(dev, EPOLLIN);
+                else if (err == SSL_ERROR_WANT_WRITE) device_watch(dev, EPOLLOUT);
+                else device_fail(dev, false);
+                return;
+            }
+            s_stats.handshakes++;
+            if (SSL_session_reused(dev->ssl)) s_stats.resumed++;
+            if (s_cfg.resume) {
+                if (dev->session) SSL_SESSION_free(dev->session);
+                dev->session = SSL_get1_session(dev->ssl);
+            }
+            fleet_samples_add(&s_connect_latency, fleet_now_us() - dev->connect_start_us);
+            dev->state = DEVICE_SENDING;
+#endif
+        }
+        /* fall through */
+
+        case DEVICE_SENDING:
+            while (dev->tx_off < dev->tx_len) {
+                ssize_t n = device_io(dev, dev->tx + dev->tx_off, dev->tx_len - dev->tx_off, true);
+                if (n < 0) return;
+                if (n == 0) { device_fail(dev, false); return; }
+                dev->tx_off += (size_t)n;
+                s_stats.bytes_out += (uint64_t)n;
+            }
+            dev->state = DEVICE_RECEIVING;
+            device_watch(dev, EPOLLIN);
+            /* fall through */
+
+        case DEVICE_RECEIVING:
+            while (1) {
+                int status = 0;
+                bool complete = false;
+                if (!device_parse_response(dev, &status, &complete)) {
+                    device_fail(dev, false);
+                    return;
+                }
+                if (complete) {
+                    device_complete(dev, status);
+                    return;
+                }
+                ssize_t n = device_io(dev, dev->rx + dev->rx_len, sizeof(dev->rx) - dev->rx_len, false);
+                if (n < 0) return;
+                if (n == 0) { device_fail(dev, false); return; }
+                dev->rx_len += (size_t)n;
+                s_stats.bytes_in += (uint64_t)n;
+            }
+    }
+}
+
+/* ============================================================
+ * Timers
+ * ============================================================ */
+
+static void fleet_change_slot(device_t *dev, int slot, int64_t now_us) {
+    size_t index = (size_t)dev->id * (size_t)s_cfg.slots + (size_t)slot;
+    s_taken[index] = !s_taken[index];
+    if (!s_pending[index]) {
+        s_pending[index] = true;
+        s_change_us[index] = now_us;
+    }
+    s_stats.changes++;
+}
+
+static void fleet_on_timer(const fleet_timer_t *timer, int64_t now_us) {
+    device_t *dev = &s_devices[timer->device];
+
+    if (timer->slot == TIMER_WAKE) {
+        if (dev->state != DEVICE_IDLE && now_us >= dev->deadline_us) {
+            device_fail(dev, true);
+        }
+        device_kick(dev);
+        return;
+    }
+
+    if (timer->slot == TIMER_BURST) {
+        /* A group arrives or leaves together: flip about half the slots */
+        bool any = false;
+        for (int slot = 0; slot < s_cfg.slots; slot++) {
+            if (fleet_rand() & 1) {
+                fleet_change_slot(dev, slot, now_us);
+                any = true;
+            }
+        }
+        if (!any) fleet_change_slot(dev, (int)(fleet_rand() % (uint64_t)s_cfg.slots), now_us);
+        fleet_timer_add(now_us + fleet_exponential_us(s_cfg.dwell_s), dev->id, TIMER_BURST);
+    } else {
+        fleet_change_slot(dev, timer->slot, now_us);
+        fleet_timer_add(fleet_next_change_us(now_us), dev->id, timer->slot);
+    }
+    device_kick(dev);
+}
+
+/* ============================================================
+ * Setup and report
+ * ============================================================ */
+
+/* Devices boot spread over the boot window and send every slot, like send_initial_status() */
+static void fleet_boot(void) {
+    s_devices = calloc((size_t)s_cfg.devices, sizeof(*s_devices));
+    size_t total = (size_t)s_cfg.devices * (size_t)s_cfg.slots;
+    s_taken = calloc(total, sizeof(*s_taken));
+    s_pending = calloc(total, sizeof(*s_pending));
+    s_change_us = calloc(total, sizeof(*s_change_us));
+
+    for (int d = 0; d < s_cfg.devices; d++) {
+        device_t *dev = &s_devices[d];
+        dev->id = d;
+        dev->fd = -1;
+        dev->batch_supported = true;
+
+        int64_t boot_us = s_start_us + (int64_t)(fleet_uniform() * s_cfg.boot_spread_s * 1e6);
+        for (int slot = 0; slot < s_cfg.slots; slot++) {
+            size_t index = (size_t)d * (size_t)s_cfg.slots + (size_t)slot;
+            s_taken[index] = fleet_rand() & 1;
+            s_pending[index] = true;
+            s_change_us[index] = boot_us;
+            if (s_cfg.churn != CHURN_BURST) {
+                fleet_timer_add(fleet_next_change_us(boot_us), d, slot);
+            }
+        }
+        if (s_cfg.churn == CHURN_BURST) {
+            fleet_timer_add(boot_us + fleet_exponential_us(s_cfg.dwell_s), d, TIMER_BURST);
+        }
+        dev->retry_at_us = boot_us;
+        fleet_timer_add(boot_us, d, TIMER_WAKE);
+    }
+}
+
+static const char *const s_mode_names[] = { "close", "keepalive", "batch" };
+static const char *const s_churn_names[] = { "poisson", "rush", "burst" };
+
+static void fleet_report(double elapsed_s) {
+    double cpu_s = fleet_cpu_seconds();
+    printf("\nfleet: %d devices x %d slots, %s upload over %s%s, %s churn (dwell %.0f s), %.1f s\n",
+        s_cfg.devices, s_cfg.slots, s_mode_names[s_cfg.mode], s_cfg.plain ? "HTTP" : "TLS",
+        (!s_cfg.plain && s_cfg.resume) ? " with session resumption" : "",
+        s_churn_names[s_cfg.churn], s_cfg.dwell_s, elapsed_s);
+    printf("requests %llu (%.1f/s)  updates %llu (%.1f/s, %.2f per request)  changes %llu\n",
+        (unsigned long long)s_stats.requests, s_stats.requests / elapsed_s,
+        (unsigned long long)s_stats.updates, s_stats.updates / elapsed_s,
+        s_stats.requests ? (double)s_stats.updates / s_stats.requests : 0.0,
+        (unsigned long long)s_stats.changes);
+    printf("connects %llu (%.2f per request)  handshakes %llu (resumed %llu)\n",
+        (unsigned long long)s_stats.connects, s_stats.requests ? (double)s_stats.connects / s_stats.requests : 0.0,
+        (unsigned long long)s_stats.handshakes, (unsigned long long)s_stats.resumed);
+    printf("errors %llu (timeouts %llu)  rejected %llu  batch fallbacks %llu\n",
+        (unsigned long long)s_stats.errors, (unsigned long long)s_stats.timeouts,
+        (unsigned long long)s_stats.rejected, (unsigned long long)s_stats.fallbacks);
+    printf("bytes out %llu (%.0f per update)  in %llu\n",
+        (unsigned long long)s_stats.bytes_out, s_stats.updates ? (double)s_stats.bytes_out / s_stats.updates : 0.0,
+        (unsigned long long)s_stats.bytes_in);
+    fleet_samples_print("request latency", &s_request_latency, 1000, "ms");
+    fleet_samples_print("connect", &s_connect_latency, 1000, "ms");
+    fleet_samples_print("change to ack", &s_ack_latency, 1000, "ms");
+    printf("client cpu %.2f s (%.1f us/request)\n", cpu_s, s_stats.requests ? cpu_s * 1e6 / s_stats.requests : 0.0);
+}
+
+static void fleet_usage(const char *argv0) {
+    fprintf(stderr,
+        "usage: %s [options]\n"
+        "  -n devices       emulated controllers (default %d)\n"
+        "  -s slots         slots per controller (default %d)\n"
+        "  -t seconds       run time (default %.0f)\n"
+        "  -u mode          upload: close, keepalive or batch (default close)\n"
+        "  -M model         churn: poisson, rush or burst (default poisson)\n"
+        "  -D seconds       mean time between changes of one slot (default %.0f)\n"
+        "  -T seconds       rush period (default %.0f)\n"
+        "  -B seconds       boot window; 0 boots every device at once (default %.0f)\n"
+        "  -h host -p port  server (default %s:%d)\n"
+        "  -P               plain HTTP instead of TLS\n"
+        "  -R               resume TLS sessions on reconnect\n"
+        "  -3               allow TLS 1.3 (devices default to TLS 1.2)\n"
+        "  -L               one 127.1.x.y source address per device\n"
+        "  -w ms            request timeout (default %d)\n"
+        "  -r ms            retry delay after a failure (default %d)\n"
+        "  -S seed          random seed\n",
+        argv0, s_cfg.devices, s_cfg.slots, s_cfg.duration_s, s_cfg.dwell_s, s_cfg.rush_period_s,
+        s_cfg.boot_spread_s, s_cfg.host, s_cfg.port, s_cfg.timeout_ms, s_cfg.retry_ms);
+}
+
+static int fleet_lookup(const char *value, const char *const *names, int count) {
+    for (int i = 0; i < count; i++) {
+        if (strcmp(value, names[i]) == 0) return i;
+    }
+    return -1;
+}
+
+int main(int argc, char **argv) {
+    int opt;
+    while ((opt = getopt(argc, argv, "n:s:t:u:M:D:T:B:h:p:PR3Lw:r:S:")) != -1) {
+        switch (opt) {
+            case 'n': s_cfg.devices = atoi(optarg); break;
+            case 's': s_cfg.slots = atoi(optarg); break;
+            case 't': s_cfg.duration_s = atof(optarg); break;
+            case 'u': s_cfg.mode = (upload_mode_t)fleet_lookup(optarg, s_mode_names, 3); break;
+            case 'M': s_cfg.churn = (churn_model_t)fleet_lookup(optarg, s_churn_names, 3); break;
+            case 'D': s_cfg.dwell_s = atof(optarg); break;
+            case 'T': s_cfg.rush_period_s = atof(optarg); break;
+            case 'B': s_cfg.boot_spread_s = atof(optarg); break;
+            case 'h': s_cfg.host = optarg; break;
+            case 'p': s_cfg.port = atoi(optarg); break;
+            case 'P': s_cfg.plain = true; break;
+            case 'R': s_cfg.resume = true; break;
+            case '3': s_cfg.tls13 = true; break;
+            case 'L': s_cfg.source_per_device = true; break;
+            case 'w': s_cfg.timeout_ms = atoi(optarg); break;
+            case 'r': s_cfg.retry_ms = atoi(optarg); break;
+            case 'S': s_cfg.seed = strtoull(optarg, NULL, 10); break;
+            default: fleet_usage(argv[0]); return 1;
+        }
+    }
+    if (s_cfg.devices <= 0 || s_cfg.slots <= 0 || s_cfg.slots > 65535 || (int)s_cfg.mode < 0 ||
+        (int)s_cfg.churn < 0 || s_cfg.dwell_s <= 0 || s_cfg.rush_period_s <= 0 ||
+        (s_cfg.source_per_device && s_cfg.devices > 65534)) {
+        fleet_usage(argv[0]);
+        return 1;
+    }
+
+    s_server.sin_family = AF_INET;
+    s_server.sin_port = htons((uint16_t)s_cfg.port);
+    if (inet_pton(AF_INET, s_cfg.host, &s_server.sin_addr) != 1) {
+        fprintf(stderr, "Host must be an IPv4 address: %s\n", s_cfg.host);
+        return 1;
+    }
+#if FLEET_TLS
+    if (!s_cfg.plain && (s_tls = fleet_tls_client_ctx(s_cfg.tls13)) == NULL) {
+        fprintf(stderr, "Cannot set up TLS\n");
+        return 1;
+    }
+#else
+    if (!s_cfg.plain) {
+        fprintf(stderr, "Built without OpenSSL, only plain HTTP (-P) is available\n");
+        return 1;
+    }
+#endif
+
+    fleet_raise_fd_limit();
+    signal(SIGINT, fleet_on_signal);
+    signal(SIGTERM, fleet_on_signal);
+    signal(SIGPIPE, SIG_IGN);
+
+    s_rng = s_cfg.seed * 0x9E3779B97F4A7C15ull + 1;
+    s_epoll = epoll_create1(0);
+    s_start_us = fleet_now_us();
+    fleet_boot();
+
+    int64_t end_us = s_start_us + (int64_t)(s_cfg.duration_s * 1e6);
+    struct epoll_event events[FLEET_MAX_EVENTS];
+
+    while (!s_stop) {
+        int64_t now_us = fleet_now_us();
+        if (now_us >= end_us) break;
+        while (s_timer_count > 0 && s_timers[0].at_us <= now_us) {
+            fleet_timer_t timer = fleet_timer_pop();
+            fleet_on_timer(&timer, now_us);
+        }
+
+        int64_t wait_us = end_us - now_us;
+        if (s_timer_count > 0 && s_timers[0].at_us - now_us < wait_us) wait_us = s_timers[0].at_us - now_us;
+        int n = epoll_wait(s_epoll, events, FLEET_MAX_EVENTS, (int)((wait_us + 999) / 1000));
+        for (int i = 0; i < n; i++) {
+            device_step(events[i].data.ptr);
+        }
+    }
+
+    fleet_report((fleet_now_us() - s_start_us) / 1e6);
+    return 0;
+}
@@ -0,0 +1,129 @@
+/**
+ * @file fleet_common.c
+ * @brief Implementation of the shared fleet helpers
+ */
+#include "fleet_common.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+
+#if FLEET_TLS
+#include <openssl/evp.h>
+#include <openssl/x509.h>
+#endif
+
+int64_t fleet_now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void fleet_samples_add(fleet_samples_t *samples, int64_t value_us) {
+    if (samples->count == samples->capacity) {
+        size_t capacity = samples->capacity ? samples->capacity * 2 : 4096;
+        uint32_t *values = realloc(samples->values, capacity * sizeof(uint32_t));
+        if (values == NULL) return;
+        samples->values = values;
+        samples->capacity = capacity;
+    }
+    samples->values[samples->count++] = value_us < 0 ? 0 : value_us > UINT32_MAX ? UINT32_MAX : (uint32_t)value_us;
+    samples->sorted = false;
+}
+
+static int fleet_compare_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+uint32_t fleet_samples_percentile(fleet_samples_t *samples, double percentile) {
+    if (samples->count == 0) return 0;
+    if (!samples->sorted) {
+        qsort(samples->values, samples->count, sizeof(uint32_t), fleet_compare_u32);
+        samples->sorted = true;
+    }
+    size_t index = (size_t)(percentile / 100.0 * (double)samples->count);
+    return samples->values[index < samples->count ? index : samples->count - 1];
+}
+
+void fleet_samples_print(const char *label, fleet_samples_t *samples, double scale, const char *unit) {
+    printf("%-20s n %8zu  p50 %9.1f  p90 %9.1f  p99 %9.1f  max %9.1f %s\n", label, samples->count,
+        fleet_samples_percentile(samples, 50) / scale, fleet_samples_percentile(samples, 90) / scale,
+        fleet_samples_percentile(samples, 99) / scale, fleet_samples_percentile(samples, 100) / scale, unit);
+}
+
+void fleet_samples_free(fleet_samples_t *samples) {
+    free(samples->values);
+    memset(samples, 0, sizeof(*samples));
+}
+
+int fleet_set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags < 0 ? -1 : fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+/* Thousands of emulated devices need as many sockets */
+void fleet_raise_fd_limit(void) {
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+double fleet_cpu_seconds(void) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return (double)usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+           (double)usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+#if FLEET_TLS
+
+/* Devices skip certificate verification (CONFIG_ESP_TLS_SKIP_SERVER_CERT_VERIFY) and
+ * speak TLS 1.2 like the default mbedTLS build */
+SSL_CTX *fleet_tls_client_ctx(bool allow_tls13) {
+    SSL_CTX *ctx = SSL_CTX_new(TLS_client_method());
+    if (ctx == NULL) return NULL;
+    SSL_CTX_set_verify(ctx, SSL_VERIFY_NONE, NULL);
+    if (!allow_tls13) {
+        SSL_CTX_set_max_proto_version(ctx, TLS1_2_VERSION);
+    }
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT);
+    return ctx;
+}
+
+/* Ephemeral P-256 key and self-signed certificate, so the stand-in needs no files */
+SSL_CTX *fleet_tls_server_ctx(void) {
+    SSL_CTX *ctx = SSL_CTX_new(TLS_server_method());
+    EVP_PKEY *key = EVP_EC_gen("P-256");
+    X509 *cert = X509_new();
+    if (ctx == NULL || key == NULL || cert == NULL) goto fail;
+
+    X509_set_version(cert, 2);
+    ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+    X509_gmtime_adj(X509_getm_notBefore(cert), 0);
+    X509_gmtime_adj(X509_getm_notAfter(cert), 365L * 24 * 3600);
+    X509_set_pubkey(cert, key);
+    X509_NAME *name = X509_get_subject_name(cert);
+    X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, (const unsigned char *)"parking-standin", -1, -1, 0);
+    X509_set_issuer_name(cert, name);
+    if (X509_sign(cert, key, EVP_sha256()) == 0) goto fail;
+
+    if (SSL_CTX_use_certificate(ctx, cert) != 1 || SSL_CTX_use_PrivateKey(ctx, key) != 1) goto fail;
+    X509_free(cert);
+    EVP_PKEY_free(key);
+    return ctx;
+
+fail:
+    X509_free(cert);
+    EVP_PKEY_free(key);
+    SSL_CTX_free(ctx);
+    return NULL;
+}
+
+#endif
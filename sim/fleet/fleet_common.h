@@ -0,0 +1,48 @@
+/**
+ * @file fleet_common.h
+ * @brief Shared pieces of the fleet load generator and the stand-in server
+ *
+ * Monotonic time, latency sample sets, non-blocking sockets and the TLS
+ * contexts. TLS is compiled in when OpenSSL is found (FLEET_TLS).
+ */
+#ifndef FLEET_COMMON_H
+#define FLEET_COMMON_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef FLEET_TLS
+#define FLEET_TLS 0
+#endif
+
+#if FLEET_TLS
+#include <openssl/ssl.h>
+#endif
+
+#define FLEET_DEFAULT_PORT 8080
+
+/* Latency samples in microseconds, kept whole and sorted for percentiles */
+typedef struct {
+    uint32_t *values;
+    size_t count;
+    size_t capacity;
+    bool sorted;
+} fleet_samples_t;
+
+int64_t fleet_now_us(void);
+void fleet_samples_add(fleet_samples_t *samples, int64_t value_us);
+uint32_t fleet_samples_percentile(fleet_samples_t *samples, double percentile);
+void fleet_samples_print(const char *label, fleet_samples_t *samples, double scale, const char *unit);
+void fleet_samples_free(fleet_samples_t *samples);
+
+int fleet_set_nonblocking(int fd);
+void fleet_raise_fd_limit(void);
+double fleet_cpu_seconds(void);
+
+#if FLEET_TLS
+SSL_CTX *fleet_tls_client_ctx(bool allow_tls13);
+SSL_CTX *fleet_tls_server_ctx(void);
+#endif
+
+#endif /* FLEET_COMMON_H */
@@ -0,0 +1,322 @@
+/**
+ * @file standin.c
+ * @brief Stand-in parking server for fleet load tests
+ *
+ * Accepts POST PARKING_ENDPOINT bodies over HTTP/1.1, plain or TLS, with
+ * or without keep-alive, and answers 200 with an empty body. Single bodies
+ * and batched "updates" bodies are both accepted unless -l is given, which
+ * answers batches with 400 like the legacy endpoint. Request, update,
+ * connection and handshake counts and the server's own CPU time are
+ * reported every interval and on exit, so the cost per request of each
+ * upload mode can be compared.
+ *
+ * Usage: parking_standin [-p port] [-P] [-l] [-i report_s] [-t seconds]
+ *   -P  plain HTTP instead of TLS
+ */
+#define _GNU_SOURCE /* memmem */
+#include "fleet_common.h"
+#include "config.h"
+
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define STANDIN_RX_SIZE 8192        /* A full batch body plus headers */
+#define STANDIN_MAX_EVENTS 256
+
+typedef struct {
+    int fd;
+    bool handshake_done;
+    bool close_after;               /* Client asked for Connection: close */
+    char rx[STANDIN_RX_SIZE];
+    size_t rx_len;
+    char tx[160];
+    size_t tx_len;
+    size_t tx_off;
+#if FLEET_TLS
+    SSL *ssl;
+#endif
+} standin_conn_t;
+
+typedef struct {
+    uint64_t requests;
+    uint64_t updates;
+    uint64_t batches;
+    uint64_t rejected;
+    uint64_t accepted;              /* Connections accepted */
+    uint64_t handshakes;
+    uint64_t resumed;               /* Handshakes that resumed a session */
+    uint64_t active;
+} standin_stats_t;
+
+static volatile sig_atomic_t s_stop = 0;
+static standin_stats_t s_stats;
+static bool s_legacy = false;
+static int s_epoll = -1;
+#if FLEET_TLS
+static SSL_CTX *s_tls = NULL;
+#endif
+
+static void standin_on_signal(int sig) {
+    s_stop = 1;
+}
+
+static void standin_close(standin_conn_t *conn) {
+#if FLEET_TLS
+    if (conn->ssl) SSL_free(conn->ssl);
+#endif
+    close(conn->fd);
+    free(conn);
+    s_stats.active--;
+}
+
+static void standin_want(standin_conn_t *conn, uint32_t events) {
+    struct epoll_event ev = { .events = events, .data.ptr = conn };
+    epoll_ctl(s_epoll, EPOLL_CTL_MOD, conn->fd, &ev);
+}
+
+/* >0 bytes, 0 closed or failed, -1 would block (interest set) */
+static ssize_t standin_io(standin_conn_t *conn, void *buf, size_t len, bool write) {
+#if FLEET_TLS
+    if (conn->ssl) {
+        int n = write ? SSL_write(conn->ssl, buf, (int)len) : SSL_read(conn->ssl, buf, (int)len);
+        if (n > 0) return n;
+        int err = SSL_get_error(conn->ssl, n);
+        if (err == SSL_ERROR_WANT_READ) { standin_want(conn, EPOLLIN); return -1; }
+        if (err == SSL_ERROR_WANT_WRITE) { standin_want(conn, EPOLLOUT); return -1; }
+        return 0;
+    }
+#endif
+    ssize_t n = write ? send(conn->fd, buf, len, MSG_NOSIGNAL) : recv(conn->fd, buf, len, 0);
+    if (n > 0) return n;
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        standin_want(conn, write ? EPOLLOUT : EPOLLIN);
+        return -1;
+    }
+    return 0;
+}
+
+/* Length of a complete request at the start of rx, 0 if more is needed, -1 if malformed */
+static long standin_request_length(standin_conn_t *conn, size_t *header_len) {
+    char *end = memmem(conn->rx, conn->rx_len, "\r\n\r\n", 4);
+    if (end == NULL) return conn->rx_len == sizeof(conn->rx) ? -1 : 0;
+
+    *header_len = (size_t)(end - conn->rx) + 4;
+    long content_length = 0;
+    for (char *line = memchr(conn->rx, '\n', *header_len); line && line < end; line = memchr(line, '\n', (size_t)(end - line))) {
+        line++;
+        if (strncasecmp(line, "Content-Length:", 15) == 0) {
+            content_length = strtol(line + 15, NULL, 10);
+        } else if (strncasecmp(line, "Connection:", 11) == 0) {
+            const char *value = line + 11;
+            while (*value == ' ') value++;
+            conn->close_after = strncasecmp(value, "close", 5) == 0;
+        }
+    }
+    if (content_length < 0 || *header_len + (size_t)content_length > sizeof(conn->rx)) return -1;
+    return *header_len + (size_t)content_length <= conn->rx_len ? (long)(*header_len + content_length) : 0;
+}
+
+static int standin_handle(standin_conn_t *conn, size_t header_len, size_t total_len) {
+    s_stats.requests++;
+    if (strncmp(conn->rx, "POST ", 5) != 0) return 405;
+
+    size_t path_len = strlen(PARKING_ENDPOINT);
+    if (strncmp(conn->rx + 5, PARKING_ENDPOINT, path_len) != 0 || conn->rx[5 + path_len] != ' ') return 404;
+
+    const char *body = conn->rx + header_len;
+    const char *body_end = conn->rx + total_len;
+    bool batch = memmem(body, (size_t)(body_end - body), "\"updates\"", 9) != NULL;
+    if (batch && s_legacy) return 400;
+
+    int updates = 0;
+    for (const char *p = body; (p = memmem(p, (size_t)(body_end - p), "\"spot\":\"", 8)) != NULL; p += 8) {
+        updates++;
+    }
+    if (updates == 0) return 400;
+    s_stats.updates += (uint64_t)updates;
+    if (batch) s_stats.batches++;
+    return 200;
+}
+
+/* Drive one connection as far as it can go without blocking */
+static void standin_step(standin_conn_t *conn) {
+#if FLEET_TLS
+    if (conn->ssl && !conn->handshake_done) {
+        int r = SSL_accept(conn->ssl);
+        if (r != 1) {
+            int err = SSL_get_error(conn->ssl, r);
+            if (err == SSL_ERROR_WANT_READ) { standin_want(conn, EPOLLIN); return; }
+            if (err == SSL_ERROR_WANT_WRITE) { standin_want(conn, EPOLLOUT); return; }
+            standin_close(conn);
+            return;
+        }
+        conn->handshake_done = true;
+        s_stats.handshakes++;
+        if (SSL_session_reused(conn->ssl)) s_stats.resumed++;
+    }
+#endif
+
+    while (1) {
+        /* Finish a pending answer first */
+        while (conn->tx_off < conn->tx_len) {
+            ssize_t n = standin_io(conn, conn->tx + conn->tx_off, conn->tx_len - conn->tx_off, true);
+            if (n < 0) return;
+            if (n == 0) { standin_close(conn); return; }
+            conn->tx_off += (size_t)n;
+        }
+        if (conn->tx_len > 0) {
+            conn->tx_len = conn->tx_off = 0;
+            if (conn->close_after) { standin_close(conn); return; }
+            standin_want(conn, EPOLLIN);
+        }
+
+        size_t header_len = 0;
+        long total = standin_request_length(conn, &header_len);
+        if (total < 0) { standin_close(conn); return; }
+        if (total == 0) {
+            ssize_t n = standin_io(conn, conn->rx + conn->rx_len, sizeof(conn->rx) - conn->rx_len, false);
+            if (n < 0) return;
+            if (n == 0) { standin_close(conn); return; }
+            conn->rx_len += (size_t)n;
+            continue;
+        }
+
+        int status = standin_handle(conn, header_len, (size_t)total);
+        if (status != 200) s_stats.rejected++;
+        conn->tx_len = (size_t)snprintf(conn->tx, sizeof(conn->tx),
+            "HTTP/1.1 %d %s\r\nContent-Length: 0\r\nConnection: %s\r\n\r\n", status,
+            status == 200 ? "OK" : status == 400 ? "Bad Request" : status == 404 ? "Not Found" : "Method Not Allowed",
+            conn->close_after ? "close" : "keep-alive");
+        memmove(conn->rx, conn->rx + total, conn->rx_len - (size_t)total);
+        conn->rx_len -= (size_t)total;
+    }
+}
+
+static void standin_accept(int listen_fd) {
+    while (1) {
+        int fd = accept(listen_fd, NULL, NULL);
+        if (fd < 0) return;
+        fleet_set_nonblocking(fd);
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        standin_conn_t *conn = calloc(1, sizeof(*conn));
+        if (conn == NULL) { close(fd); continue; }
+        conn->fd = fd;
+#if FLEET_TLS
+        if (s_tls) {
+            conn->ssl = SSL_new(s_tls);
+            SSL_set_fd(conn->ssl, fd);
+        }
+#endif
+        s_stats.accepted++;
+        s_stats.active++;
+
+        struct epoll_event ev = { .events = EPOLLIN, .data.ptr = conn };
+        epoll_ctl(s_epoll, EPOLL_CTL_ADD, fd, &ev);
+    }
+}
+
+static void standin_report(const char *label, double elapsed_s, const standin_stats_t *since) {
+    double cpu_s = fleet_cpu_seconds();
+    uint64_t requests = s_stats.requests - since->requests;
+    printf("%s %7.1f s  requests %llu (%.1f/s)  updates %llu  batches %llu  rejected %llu  "
+           "connections %llu (active %llu)  handshakes %llu (resumed %llu)  cpu %.2f s (%.1f us/request)\n",
+        label, elapsed_s, (unsigned long long)s_stats.requests, elapsed_s > 0 ? requests / elapsed_s : 0.0,
+        (unsigned long long)s_stats.updates, (unsigned long long)s_stats.batches,
+        (unsigned long long)s_stats.rejected, (unsigned long long)s_stats.accepted,
+        (unsigned long long)s_stats.active, (unsigned long long)s_stats.handshakes,
+        (unsigned long long)s_stats.resumed, cpu_s, s_stats.requests ? cpu_s * 1e6 / s_stats.requests : 0.0);
+    fflush(stdout);
+}
+
+int main(int argc, char **argv) {
+    int port = FLEET_DEFAULT_PORT;
+    bool plain = !FLEET_TLS;
+    double report_s = 5;
+    double run_s = 0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "p:Pli:t:")) != -1) {
+        switch (opt) {
+            case 'p': port = atoi(optarg); break;
+            case 'P': plain = true; break;
+            case 'l': s_legacy = true; break;
+            case 'i': report_s = atof(optarg); break;
+            case 't': run_s = atof(optarg); break;
+            default:
+                fprintf(stderr, "usage: %s [-p port] [-P] [-l] [-i report_s] [-t seconds]\n", argv[0]);
+                return 1;
+        }
+    }
+
+#if FLEET_TLS
+    if (!plain && (s_tls = fleet_tls_server_ctx()) == NULL) {
+        fprintf(stderr, "Cannot set up TLS\n");
+        return 1;
+    }
+#endif
+    fleet_raise_fd_limit();
+    signal(SIGINT, standin_on_signal);
+    signal(SIGTERM, standin_on_signal);
+    signal(SIGPIPE, SIG_IGN);
+
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons((uint16_t)port),
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+    };
+    if (bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(listen_fd, 4096) < 0) {
+        perror("listen");
+        return 1;
+    }
+    fleet_set_nonblocking(listen_fd);
+
+    s_epoll = epoll_create1(0);
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = NULL };
+    epoll_ctl(s_epoll, EPOLL_CTL_ADD, listen_fd, &ev);
+    printf("standin: listening on %d (%s)%s\n", port, plain ? "plain" : "TLS", s_legacy ? ", legacy: batches rejected" : "");
+    fflush(stdout);
+
+    int64_t start_us = fleet_now_us();
+    int64_t next_report_us = start_us + (int64_t)(report_s * 1e6);
+    standin_stats_t last = s_stats;
+    int64_t last_us = start_us;
+    struct epoll_event events[STANDIN_MAX_EVENTS];
+
+    while (!s_stop) {
+        int n = epoll_wait(s_epoll, events, STANDIN_MAX_EVENTS, 100);
+        for (int i = 0; i < n; i++) {
+            if (events[i].data.ptr == NULL) {
+                standin_accept(listen_fd);
+            } else {
+                standin_step(events[i].data.ptr);
+            }
+        }
+
+        int64_t now_us = fleet_now_us();
+        if (run_s > 0 && now_us - start_us >= (int64_t)(run_s * 1e6)) break;
+        if (report_s > 0 && now_us >= next_report_us) {
+            standin_report("standin:", (now_us - last_us) / 1e6, &last);
+            last = s_stats;
+            last_us = now_us;
+            next_report_us += (int64_t)(report_s * 1e6);
+        }
+    }
+
+    standin_stats_t none = { 0 };
+    standin_report("standin total:", (fleet_now_us() - start_us) / 1e6, &none);
+    return 0;
+}
@@ -0,0 +1,42 @@
+/**
+ * @file cJSON.h
+ * @brief Host simulation stand-in for the subset of cJSON the firmware uses
+ *
+ * Allocates one node per item and one buffer per print, like the real
+ * library, so allocation counts in benchmarks stay representative.
+ */
+#ifndef SIM_CJSON_H
+#define SIM_CJSON_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct cJSON {
+    struct cJSON *next;
+    struct cJSON *child;
+    int type;
+    char *valuestring;
+    int valueint;
+    double valuedouble;
+    char *string;
+} cJSON;
+
+typedef struct cJSON_Hooks {
+    void *(*malloc_fn)(size_t sz);
+    void (*free_fn)(void *ptr);
+} cJSON_Hooks;
+
+void cJSON_InitHooks(cJSON_Hooks *hooks);
+cJSON *cJSON_CreateObject(void);
+cJSON *cJSON_CreateArray(void);
+cJSON *cJSON_AddStringToObject(cJSON *object, const char *name, const char *string);
+cJSON *cJSON_AddBoolToObject(cJSON *object, const char *name, bool boolean);
+cJSON *cJSON_AddNumberToObject(cJSON *object, const char *name, double number);
+cJSON *cJSON_AddArrayToObject(cJSON *object, const char *name);
+bool cJSON_AddItemToArray(cJSON *array, cJSON *item);
+bool cJSON_AddItemToObject(cJSON *object, const char *name, cJSON *item);
+char *cJSON_PrintUnformatted(const cJSON *item);
+void cJSON_Delete(cJSON *item);
+void cJSON_free(void *object);
+
+#endif /* SIM_CJSON_H */
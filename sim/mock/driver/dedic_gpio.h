@@ -0,0 +1,29 @@
+/**
+ * @file dedic_gpio.h
+ * @brief Host simulation stand-in for the dedicated GPIO bundle driver
+ */
+#ifndef SIM_DRIVER_DEDIC_GPIO_H
+#define SIM_DRIVER_DEDIC_GPIO_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+typedef struct dedic_gpio_bundle_t *dedic_gpio_bundle_handle_t;
+
+typedef struct {
+    const int *gpio_array;
+    size_t array_size;
+    struct {
+        unsigned int in_en: 1;
+        unsigned int in_invert: 1;
+        unsigned int out_en: 1;
+        unsigned int out_invert: 1;
+    } flags;
+} dedic_gpio_bundle_config_t;
+
+esp_err_t dedic_gpio_new_bundle(const dedic_gpio_bundle_config_t *config, dedic_gpio_bundle_handle_t *ret_bundle);
+esp_err_t dedic_gpio_del_bundle(dedic_gpio_bundle_handle_t bundle);
+void dedic_gpio_bundle_write(dedic_gpio_bundle_handle_t bundle, uint32_t mask, uint32_t value);
+
+#endif /* SIM_DRIVER_DEDIC_GPIO_H */
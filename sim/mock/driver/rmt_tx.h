@@ -0,0 +1,65 @@
+/**
+ * @file rmt_tx.h
+ * @brief Host simulation stand-in for the RMT transmit driver
+ *
+ * One channel drives an addressable LED strip: each transmission latches
+ * its bytes into the simulated strip after the WS2812 bit time on the
+ * virtual clock.
+ */
+#ifndef SIM_DRIVER_RMT_TX_H
+#define SIM_DRIVER_RMT_TX_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+typedef struct rmt_channel_t *rmt_channel_handle_t;
+typedef struct rmt_encoder_t *rmt_encoder_handle_t;
+
+typedef enum {
+    RMT_CLK_SRC_DEFAULT = 0,
+} rmt_clock_source_t;
+
+typedef union {
+    struct {
+        uint16_t duration0: 15;
+        uint16_t level0: 1;
+        uint16_t duration1: 15;
+        uint16_t level1: 1;
+    };
+    uint32_t val;
+} rmt_symbol_word_t;
+
+typedef struct {
+    int gpio_num;
+    rmt_clock_source_t clk_src;
+    uint32_t resolution_hz;
+    size_t mem_block_symbols;
+    size_t trans_queue_depth;
+    struct {
+        uint32_t invert_out: 1;
+        uint32_t with_dma: 1;
+    } flags;
+} rmt_tx_channel_config_t;
+
+typedef struct {
+    rmt_symbol_word_t bit0;
+    rmt_symbol_word_t bit1;
+    struct {
+        uint32_t msb_first: 1;
+    } flags;
+} rmt_bytes_encoder_config_t;
+
+typedef struct {
+    int loop_count;
+} rmt_transmit_config_t;
+
+esp_err_t rmt_new_tx_channel(const rmt_tx_channel_config_t *config, rmt_channel_handle_t *ret_chan);
+esp_err_t rmt_del_channel(rmt_channel_handle_t channel);
+esp_err_t rmt_enable(rmt_channel_handle_t channel);
+esp_err_t rmt_new_bytes_encoder(const rmt_bytes_encoder_config_t *config, rmt_encoder_handle_t *ret_encoder);
+esp_err_t rmt_transmit(rmt_channel_handle_t channel, rmt_encoder_handle_t encoder, const void *payload,
+                       size_t payload_bytes, const rmt_transmit_config_t *config);
+esp_err_t rmt_tx_wait_all_done(rmt_channel_handle_t channel, int timeout_ms);
+
+#endif /* SIM_DRIVER_RMT_TX_H */
@@ -0,0 +1,13 @@
+/**
+ * @file esp_attr.h
+ * @brief Host simulation stand-in for ESP-IDF section attributes
+ */
+#ifndef SIM_ESP_ATTR_H
+#define SIM_ESP_ATTR_H
+
+#define IRAM_ATTR
+#define DRAM_ATTR
+#define RTC_DATA_ATTR
+#define RTC_NOINIT_ATTR
+
+#endif /* SIM_ESP_ATTR_H */
@@ -0,0 +1,15 @@
+/**
+ * @file esp_cpu.h
+ * @brief Host simulation stand-in for the CPU cycle counter
+ */
+#ifndef SIM_ESP_CPU_H
+#define SIM_ESP_CPU_H
+
+#include <stdint.h>
+
+typedef uint32_t esp_cpu_cycle_count_t;
+
+/* Derived from the virtual clock at CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ */
+esp_cpu_cycle_count_t esp_cpu_get_cycle_count(void);
+
+#endif /* SIM_ESP_CPU_H */
@@ -0,0 +1,41 @@
+/**
+ * @file esp_netif_sntp.h
+ * @brief Host simulation stand-in for SNTP
+ *
+ * The first sync happens inside esp_netif_sntp_init(), at SIM_SNTP_EPOCH_S
+ * plus virtual time, so timestamps are the same on every run.
+ */
+#ifndef SIM_ESP_NETIF_SNTP_H
+#define SIM_ESP_NETIF_SNTP_H
+
+#include <stdbool.h>
+#include <sys/time.h>
+#include "esp_err.h"
+
+#define SIM_SNTP_EPOCH_S 1760000000LL   /* Wall time at virtual time 0 */
+
+typedef void (*esp_sntp_time_cb_t)(struct timeval *tv);
+
+typedef struct {
+    bool smooth_sync;
+    bool server_from_dhcp;
+    bool wait_for_sync;
+    bool start;
+    esp_sntp_time_cb_t sync_cb;
+    int num_of_servers;
+    const char *servers[1];
+} esp_sntp_config_t;
+
+#define ESP_NETIF_SNTP_DEFAULT_CONFIG(server) {     \
+    .smooth_sync = false,                           \
+    .server_from_dhcp = false,                      \
+    .wait_for_sync = true,                          \
+    .start = true,                                  \
+    .sync_cb = NULL,                                \
+    .num_of_servers = 1,                            \
+    .servers = { server },                          \
+}
+
+esp_err_t esp_netif_sntp_init(const esp_sntp_config_t *config);
+
+#endif /* SIM_ESP_NETIF_SNTP_H */
@@ -0,0 +1,13 @@
+/**
+ * @file esp_random.h
+ * @brief Host simulation stand-in for the hardware RNG
+ */
+#ifndef SIM_ESP_RANDOM_H
+#define SIM_ESP_RANDOM_H
+
+#include <stdint.h>
+
+/* Drawn from the seeded simulation generator, so runs stay reproducible */
+uint32_t esp_random(void);
+
+#endif /* SIM_ESP_RANDOM_H */
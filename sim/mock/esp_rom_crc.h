@@ -0,0 +1,12 @@
+/**
+ * @file esp_rom_crc.h
+ * @brief Host simulation stand-in for the ROM CRC routines
+ */
+#ifndef SIM_ESP_ROM_CRC_H
+#define SIM_ESP_ROM_CRC_H
+
+#include <stdint.h>
+
+uint16_t esp_rom_crc16_le(uint16_t crc, uint8_t const *buf, uint32_t len);
+
+#endif /* SIM_ESP_ROM_CRC_H */
@@ -0,0 +1,16 @@
+/**
+ * @file esp_rom_sys.h
+ * @brief Host simulation stand-in for ROM system helpers
+ */
+#ifndef SIM_ESP_ROM_SYS_H
+#define SIM_ESP_ROM_SYS_H
+
+#include <stdint.h>
+
+/* Advances the virtual clock instead of spinning */
+void esp_rom_delay_us(uint32_t us);
+
+/* CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ: the simulation does not scale the clock */
+uint32_t esp_rom_get_cpu_ticks_per_us(void);
+
+#endif /* SIM_ESP_ROM_SYS_H */
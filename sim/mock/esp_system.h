@@ -0,0 +1,16 @@
+/**
+ * @file esp_system.h
+ * @brief Host simulation stand-in for the heap size queries
+ *
+ * Backed by the allocation wrappers in sim_support.c against a nominal
+ * device heap.
+ */
+#ifndef SIM_ESP_SYSTEM_H
+#define SIM_ESP_SYSTEM_H
+
+#include <stdint.h>
+
+uint32_t esp_get_free_heap_size(void);
+uint32_t esp_get_minimum_free_heap_size(void);
+
+#endif /* SIM_ESP_SYSTEM_H */
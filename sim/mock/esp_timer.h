@@ -0,0 +1,13 @@
+/**
+ * @file esp_timer.h
+ * @brief Host simulation stand-in for esp_timer, backed by the virtual clock
+ */
+#ifndef SIM_ESP_TIMER_H
+#define SIM_ESP_TIMER_H
+
+#include <stdint.h>
+#include "esp_err.h"
+
+int64_t esp_timer_get_time(void);
+
+#endif /* SIM_ESP_TIMER_H */
@@ -0,0 +1,28 @@
+/**
+ * @file esp_transport.h
+ * @brief Host simulation stand-in for the ESP-IDF transport layer
+ *
+ * Connections are delivered in-process to the frame stream of the
+ * stand-in server in sim_server.c.
+ */
+#ifndef SIM_ESP_TRANSPORT_H
+#define SIM_ESP_TRANSPORT_H
+
+#include "esp_err.h"
+
+typedef struct esp_transport_item_t *esp_transport_handle_t;
+
+enum esp_tcp_transport_err_t {
+    ERR_TCP_TRANSPORT_NO_MEM = -3,
+    ERR_TCP_TRANSPORT_CONNECTION_FAILED = -2,
+    ERR_TCP_TRANSPORT_CONNECTION_CLOSED_BY_FIN = -1,
+    ERR_TCP_TRANSPORT_CONNECTION_TIMEOUT = 0,
+};
+
+int esp_transport_connect(esp_transport_handle_t t, const char *host, int port, int timeout_ms);
+int esp_transport_read(esp_transport_handle_t t, char *buffer, int len, int timeout_ms);
+int esp_transport_write(esp_transport_handle_t t, const char *buffer, int len, int timeout_ms);
+int esp_transport_close(esp_transport_handle_t t);
+esp_err_t esp_transport_destroy(esp_transport_handle_t t);
+
+#endif /* SIM_ESP_TRANSPORT_H */
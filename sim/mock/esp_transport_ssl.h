@@ -0,0 +1,13 @@
+/**
+ * @file esp_transport_ssl.h
+ * @brief Host simulation stand-in for the TLS transport
+ */
+#ifndef SIM_ESP_TRANSPORT_SSL_H
+#define SIM_ESP_TRANSPORT_SSL_H
+
+#include "esp_transport.h"
+
+esp_transport_handle_t esp_transport_ssl_init(void);
+void esp_transport_ssl_session_tickets_enable(esp_transport_handle_t t);
+
+#endif /* SIM_ESP_TRANSPORT_SSL_H */
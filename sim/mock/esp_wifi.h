@@ -0,0 +1,28 @@
+/**
+ * @file esp_wifi.h
+ * @brief Host simulation stand-in for the WiFi driver, as far as ESP-NOW needs it
+ */
+#ifndef SIM_ESP_WIFI_H
+#define SIM_ESP_WIFI_H
+
+#include "esp_err.h"
+
+typedef enum {
+    WIFI_IF_STA = 0,
+    WIFI_IF_AP,
+} wifi_interface_t;
+
+typedef enum {
+    WIFI_PS_NONE = 0,
+    WIFI_PS_MIN_MODEM,
+    WIFI_PS_MAX_MODEM,
+} wifi_ps_type_t;
+
+#define MACSTR "%02x:%02x:%02x:%02x:%02x:%02x"
+#define MAC2STR(a) (a)[0], (a)[1], (a)[2], (a)[3], (a)[4], (a)[5]
+
+static inline esp_err_t esp_wifi_set_ps(wifi_ps_type_t type) {
+    return ESP_OK;
+}
+
+#endif /* SIM_ESP_WIFI_H */
@@ -0,0 +1,10 @@
+/**
+ * @file queue.h
+ * @brief Host simulation stand-in for FreeRTOS queues (see FreeRTOS.h)
+ */
+#ifndef SIM_FREERTOS_QUEUE_H
+#define SIM_FREERTOS_QUEUE_H
+
+#include "freertos/FreeRTOS.h"
+
+#endif /* SIM_FREERTOS_QUEUE_H */
@@ -0,0 +1,10 @@
+/**
+ * @file task.h
+ * @brief Host simulation stand-in for FreeRTOS tasks (see FreeRTOS.h)
+ */
+#ifndef SIM_FREERTOS_TASK_H
+#define SIM_FREERTOS_TASK_H
+
+#include "freertos/FreeRTOS.h"
+
+#endif /* SIM_FREERTOS_TASK_H */
@@ -0,0 +1,13 @@
+/**
+ * @file nvs_flash.h
+ * @brief Host simulation stand-in for NVS flash initialisation
+ */
+#ifndef SIM_NVS_FLASH_H
+#define SIM_NVS_FLASH_H
+
+#include "esp_err.h"
+
+esp_err_t nvs_flash_init(void);
+esp_err_t nvs_flash_erase(void);
+
+#endif /* SIM_NVS_FLASH_H */
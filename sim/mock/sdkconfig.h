@@ -0,0 +1,15 @@
+/**
+ * @file sdkconfig.h
+ * @brief Host simulation stand-in for the generated ESP-IDF configuration
+ */
+#ifndef SIM_SDKCONFIG_H
+#define SIM_SDKCONFIG_H
+
+#define CONFIG_IDF_TARGET "linux-sim"
+#define CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ 160
+#define CONFIG_FREERTOS_HZ 100
+#define CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS 1
+#define CONFIG_HEAP_TRACING_STANDALONE 1
+#define CONFIG_HEAP_TRACING_STACK_DEPTH 2
+
+#endif /* SIM_SDKCONFIG_H */
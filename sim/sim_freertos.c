@@ -0,0 +1,272 @@
+/**
+ * @file sim_freertos.c
+ * @brief Cooperative, single-threaded stand-in for the FreeRTOS kernel
+ *
+ * Tasks are recorded but never run: the benchmark calls the firmware's
+ * *_process() entry points itself. A blocking call runs virtual-clock
+ * events (echo edges, timer alarms) until it can complete or its timeout
+ * passes, which is what a blocked task would observe on the device.
+ */
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/event_groups.h"
+#include "sim_hal.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define SIM_TICK_US (1000000 / CONFIG_FREERTOS_HZ)
+
+struct sim_queue {
+    uint8_t *storage;
+    UBaseType_t length;
+    UBaseType_t item_size;
+    UBaseType_t head;
+    UBaseType_t count;
+    bool owns_storage;
+    bool owns_self;
+};
+
+struct sim_task {
+    TaskFunction_t fn;
+    void *arg;
+    uint32_t notify;
+    bool owns_self;
+};
+
+struct sim_event_group {
+    EventBits_t bits;
+    bool owns_self;
+};
+
+/* The only "running" task: whoever calls ulTaskNotifyTake() */
+static uint32_t s_notify_pending;
+
+static int64_t sim_deadline(TickType_t ticks) {
+    if (ticks == portMAX_DELAY) return INT64_MAX;
+    return sim_now_us() + (int64_t)ticks * SIM_TICK_US;
+}
+
+/* Run events until cond is true or the deadline passes; false on timeout */
+#define SIM_WAIT_UNTIL(cond, ticks) ({                                      \
+        int64_t deadline_ = sim_deadline(ticks);                            \
+        while (!(cond)) {                                                   \
+            if (!sim_run_next_event(deadline_)) {                           \
+                if (deadline_ != INT64_MAX) sim_advance_to(deadline_);      \
+                break;                                                      \
+            }                                                               \
+        }                                                                   \
+        (cond);                                                             \
+    })
+
+/* ----- Tasks ----- */
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack_depth, void *arg,
+                       UBaseType_t priority, TaskHandle_t *handle) {
+    struct sim_task *task = calloc(1, sizeof(*task));
+    if (task == NULL) return pdFAIL;
+    task->fn = fn;
+    task->arg = arg;
+    task->owns_self = true;
+    if (handle) *handle = task;
+    return pdPASS;
+}
+
+TaskHandle_t xTaskCreateStatic(TaskFunction_t fn, const char *name, uint32_t stack_depth, void *arg,
+                               UBaseType_t priority, StackType_t *stack, StaticTask_t *tcb) {
+    _Static_assert(sizeof(StaticTask_t) >= sizeof(struct sim_task), "StaticTask_t too small");
+    struct sim_task *task = (struct sim_task *)tcb;
+    memset(task, 0, sizeof(*task));
+    task->fn = fn;
+    task->arg = arg;
+    return task;
+}
+
+void vTaskDelete(TaskHandle_t task) {
+    if (task && task->owns_self) free(task);
+}
+
+void vTaskDelay(TickType_t ticks) {
+    sim_advance_us((int64_t)ticks * SIM_TICK_US);
+}
+
+TickType_t xTaskGetTickCount(void) {
+    return (TickType_t)(sim_now_us() / SIM_TICK_US);
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *higher_priority_woken) {
+    s_notify_pending++;
+    if (higher_priority_woken) *higher_priority_woken = pdTRUE;
+}
+
+void xTaskNotifyGive(TaskHandle_t task) {
+    s_notify_pending++;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks) {
+    if (!SIM_WAIT_UNTIL(s_notify_pending > 0, ticks)) return 0;
+
+    uint32_t value = s_notify_pending;
+    s_notify_pending = clear_on_exit ? 0 : value - 1;
+    return value;
+}
+
+/* ----- Queues ----- */
+
+static QueueHandle_t sim_queue_setup(struct sim_queue *queue, UBaseType_t length, UBaseType_t item_size,
+                                     uint8_t *storage) {
+    queue->length = length;
+    queue->item_size = item_size;
+    queue->head = 0;
+    queue->count = 0;
+    queue->storage = storage;
+    return queue;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size) {
+    struct sim_queue *queue = calloc(1, sizeof(*queue));
+    uint8_t *storage = malloc(length * (item_size ? item_size : 1));
+    if (queue == NULL || storage == NULL) {
+        free(queue);
+        free(storage);
+        return NULL;
+    }
+    queue->owns_self = true;
+    queue->owns_storage = true;
+    return sim_queue_setup(queue, length, item_size, storage);
+}
+
+QueueHandle_t xQueueCreateStatic(UBaseType_t length, UBaseType_t item_size, uint8_t *storage, StaticQueue_t *buffer) {
+    _Static_assert(sizeof(StaticQueue_t) >= sizeof(struct sim_queue), "StaticQueue_t too small");
+    struct sim_queue *queue = (struct sim_queue *)buffer;
+    memset(queue, 0, sizeof(*queue));
+    return sim_queue_setup(queue, length, item_size, storage);
+}
+
+void vQueueDelete(QueueHandle_t queue) {
+    if (queue == NULL) return;
+    if (queue->owns_storage) free(queue->storage);
+    if (queue->owns_self) free(queue);
+}
+
+static BaseType_t sim_queue_put(QueueHandle_t queue, const void *item) {
+    if (queue->count == queue->length) return pdFALSE;
+    UBaseType_t tail = (queue->head + queue->count) % queue->length;
+    if (queue->item_size && item) {
+        memcpy(queue->storage + tail * queue->item_size, item, queue->item_size);
+    }
+    queue->count++;
+    return pdTRUE;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks) {
+    /* Nothing else runs to drain a full queue, so waiting cannot help */
+    BaseType_t sent = sim_queue_put(queue, item);
+    if (!sent && ticks) sim_advance_us((int64_t)(ticks == portMAX_DELAY ? 1 : ticks) * SIM_TICK_US);
+    return sent;
+}
+
+BaseType_t xQueueSendFromISR(QueueHandle_t queue, const void *item, BaseType_t *higher_priority_woken) {
+    BaseType_t sent = sim_queue_put(queue, item);
+    if (sent && higher_priority_woken) *higher_priority_woken = pdTRUE;
+    return sent;
+}
+
+BaseType_t xQueueOverwrite(QueueHandle_t queue, const void *item) {
+    queue->count = 0;
+    return sim_queue_put(queue, item);
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks) {
+    if (!SIM_WAIT_UNTIL(queue->count > 0, ticks)) return pdFALSE;
+
+    if (queue->item_size && item) {
+        memcpy(item, queue->storage + queue->head * queue->item_size, queue->item_size);
+    }
+    queue->head = (queue->head + 1) % queue->length;
+    queue->count--;
+    return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) {
+    return queue->count;
+}
+
+/* ----- Semaphores (queues of zero-sized items) ----- */
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void) {
+    SemaphoreHandle_t sem = xQueueCreate(1, 0);
+    if (sem) sem->count = 1;
+    return sem;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutexStatic(StaticSemaphore_t *buffer) {
+    SemaphoreHandle_t sem = xQueueCreateStatic(1, 0, NULL, buffer);
+    sem->count = 1;
+    return sem;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void) {
+    return xQueueCreate(1, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinaryStatic(StaticSemaphore_t *buffer) {
+    return xQueueCreateStatic(1, 0, NULL, buffer);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks) {
+    return xQueueReceive(sem, NULL, ticks);
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem) {
+    return sim_queue_put(sem, NULL);
+}
+
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t sem, BaseType_t *higher_priority_woken) {
+    return xQueueSendFromISR(sem, NULL, higher_priority_woken);
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t sem) {
+    vQueueDelete(sem);
+}
+
+/* ----- Event groups ----- */
+
+EventGroupHandle_t xEventGroupCreate(void) {
+    struct sim_event_group *group = calloc(1, sizeof(*group));
+    if (group) group->owns_self = true;
+    return group;
+}
+
+EventGroupHandle_t xEventGroupCreateStatic(StaticEventGroup_t *buffer) {
+    _Static_assert(sizeof(StaticEventGroup_t) >= sizeof(struct sim_event_group), "StaticEventGroup_t too small");
+    struct sim_event_group *group = (struct sim_event_group *)buffer;
+    memset(group, 0, sizeof(*group));
+    return group;
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits) {
+    group->bits |= bits;
+    return group->bits;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits) {
+    EventBits_t previous = group->bits;
+    group->bits &= ~bits;
+    return previous;
+}
+
+EventBits_t xEventGroupGetBits(EventGroupHandle_t group) {
+    return group->bits;
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits, BaseType_t clear_on_exit,
+                                BaseType_t wait_for_all, TickType_t ticks) {
+    SIM_WAIT_UNTIL(wait_for_all ? (group->bits & bits) == bits : (group->bits & bits) != 0, ticks);
+
+    EventBits_t value = group->bits;
+    if (clear_on_exit) group->bits &= ~bits;
+    return value;
+}
@@ -0,0 +1,958 @@
+/**
+ * @file sim_hal.c
+ * @brief Implementation of the host simulation HAL
+ *
+ * Everything runs on one virtual clock. Echo edges and timer alarms are
+ * events in a min-heap; advancing the clock delivers them in time order by
+ * calling the registered GPIO ISR or gptimer callback, exactly as the
+ * interrupt would on the device.
+ */
+#include "sim_hal.h"
+#include "sim_support.h"
+
+#include "driver/dedic_gpio.h"
+#include "driver/gpio.h"
+#include "driver/gptimer.h"
+#include "driver/i2c_master.h"
+#include "driver/rmt_tx.h"
+#include "esp_cpu.h"
+#include "esp_now.h"
+#include "esp_random.h"
+#include "esp_rom_sys.h"
+#include "esp_rom_crc.h"
+#include "esp_timer.h"
+#include "sdkconfig.h"
+#include "sensor_backend.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SIM_MAX_EVENTS 4096
+#define SIM_MAX_TIMERS 4
+#define SIM_MAX_TRACE 65536
+#define SIM_TRIGGER_MIN_US 5        /* Shorter pulses are ignored, like on the real sensor */
+#define SIM_TRIGGER_MAX_US 1000
+#define SIM_BUNDLE_MAX_PINS 8       /* Dedicated GPIO output channels on the C6 */
+#define SIM_STRIP_MAX_PIXELS 512
+#define SIM_STRIP_NS_PER_BIT 1200   /* WS2812 bit time */
+#define SIM_STRIP_RESET_US 50       /* Low time that latches the frame */
+#define SIM_MUX_MAX_BITS 8          /* Select lines of the analog muxes */
+#define SIM_I2C_ADDRESSES 128
+#define SIM_SRF_REVISION 11         /* Revision byte an idle module answers with */
+
+typedef struct {
+    int64_t time_us;
+    int pin;
+    int level;
+} sim_event_t;
+
+typedef struct {
+    bool configured;
+    int trig_pin;
+    int echo_pin;
+    int next_on_trig;               /* Next sensor sharing this trigger pin, -1 at the end */
+    int channel;                    /* Mux channel that must be selected to reach it, -1 if wired directly */
+    int i2c_address;                /* Address of the I2C module, 0 if not on the bus */
+    uint8_t range_reg;              /* I2C module: range window in 43 mm steps */
+    int64_t busy_until_us;          /* I2C module: ranging, ignores the bus until then */
+    uint16_t result_us;             /* I2C module: first echo of the last ranging, 0 = none */
+    uint32_t distance_mm;
+    uint32_t jitter_mm;
+    uint32_t spike_per_mille;
+    uint32_t dropout_per_mille;
+} sim_sensor_t;
+
+typedef struct {
+    int pin_level_in;
+    int pin_level_out;
+    int64_t rise_us;                /* Last output rising edge, for trigger pulse detection */
+    gpio_int_type_t intr_type;
+    bool intr_enabled;
+    gpio_isr_t isr;
+    void *isr_arg;
+    int first_sensor;               /* Sensors triggered by this pin, -1 if none */
+} sim_gpio_t;
+
+struct gptimer_t {
+    bool in_use;
+    bool running;
+    int64_t start_us;
+    int64_t next_alarm_us;
+    uint64_t alarm_count;
+    bool auto_reload;
+    gptimer_alarm_cb_t on_alarm;
+    void *user_data;
+};
+
+typedef struct {
+    int64_t time_us;
+    uint16_t sensor;
+    uint32_t distance_mm;
+} sim_trace_entry_t;
+
+struct dedic_gpio_bundle_t {
+    int pins[SIM_BUNDLE_MAX_PINS];
+    size_t count;
+};
+
+struct rmt_channel_t {
+    bool enabled;
+    int64_t done_us;                /* End of the frame in flight */
+};
+
+struct rmt_encoder_t {
+    int unused;
+};
+
+struct i2c_master_bus_t {
+    int unused;
+};
+
+struct i2c_master_dev_t {
+    uint16_t address;
+    uint32_t scl_speed_hz;
+};
+
+/* Analog mux select lines, driven directly or latched from a 74HC595 */
+typedef struct {
+    int bits;
+    int select_pins[SIM_MUX_MAX_BITS];
+    bool shift;
+    int data_pin;
+    int clock_pin;
+    int latch_pin;
+    uint8_t shift_reg;
+    uint8_t latched;
+} sim_mux_t;
+
+static int64_t s_now_us;
+static uint32_t s_rng;
+static sim_event_t s_events[SIM_MAX_EVENTS];
+static int s_event_count;
+static sim_gpio_t s_gpio[SIM_GPIO_COUNT];
+static sim_sensor_t s_sensors[SIM_MAX_SENSORS];
+static struct gptimer_t s_timers[SIM_MAX_TIMERS];
+static sim_trace_entry_t *s_trace;
+static int s_trace_count;
+static int s_trace_next;
+static sim_hal_stats_t s_stats;
+static uint8_t s_strip[SIM_STRIP_MAX_PIXELS * 3];
+static sim_mux_t s_mux;
+static int s_i2c_sensor[SIM_I2C_ADDRESSES];     /* Sensor id per I2C address, -1 if none */
+
+typedef struct {
+    uint8_t mac[6];
+    sim_radio_rx_t rx;
+    void *ctx;
+} sim_station_t;
+
+static sim_station_t s_stations[SIM_RADIO_MAX_STATIONS];
+static int s_station_count;
+static uint32_t s_radio_loss_per_mille;
+
+/* ESP-NOW on this device's station */
+static bool s_espnow_started;
+static esp_now_recv_cb_t s_espnow_recv_cb;
+static uint8_t s_espnow_peers[ESP_NOW_MAX_TOTAL_PEER_NUM][ESP_NOW_ETH_ALEN];
+static int s_espnow_peer_count;
+
+uint32_t sim_random(void) {
+    /* xorshift32: deterministic for a given seed */
+    s_rng ^= s_rng << 13;
+    s_rng ^= s_rng >> 17;
+    s_rng ^= s_rng << 5;
+    return s_rng;
+}
+
+uint32_t esp_random(void) {
+    return sim_random();
+}
+
+void sim_hal_reset(uint32_t seed) {
+    s_now_us = 0;
+    s_rng = seed ? seed : 0x12345678u;
+    s_event_count = 0;
+    memset(s_gpio, 0, sizeof(s_gpio));
+    memset(s_sensors, 0, sizeof(s_sensors));
+    memset(s_timers, 0, sizeof(s_timers));
+    memset(&s_stats, 0, sizeof(s_stats));
+    memset(s_strip, 0, sizeof(s_strip));
+    memset(&s_mux, 0, sizeof(s_mux));
+    for (int i = 0; i < SIM_GPIO_COUNT; i++) {
+        s_gpio[i].first_sensor = -1;
+    }
+    for (int i = 0; i < SIM_I2C_ADDRESSES; i++) {
+        s_i2c_sensor[i] = -1;
+    }
+    sim_host_free(s_trace);
+    s_trace = NULL;
+    s_trace_count = 0;
+    s_trace_next = 0;
+    s_station_count = 0;
+    s_radio_loss_per_mille = 0;
+    s_espnow_started = false;
+    s_espnow_recv_cb = NULL;
+    s_espnow_peer_count = 0;
+}
+
+int64_t sim_now_us(void) {
+    return s_now_us;
+}
+
+/* ----- Event heap ----- */
+
+static void sim_event_push(int64_t time_us, int pin, int level) {
+    if (s_event_count == SIM_MAX_EVENTS) return;
+
+    int i = s_event_count++;
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (s_events[parent].time_us <= time_us) break;
+        s_events[i] = s_events[parent];
+        i = parent;
+    }
+    s_events[i] = (sim_event_t){ .time_us = time_us, .pin = pin, .level = level };
+}
+
+static sim_event_t sim_event_pop(void) {
+    sim_event_t top = s_events[0];
+    sim_event_t last = s_events[--s_event_count];
+    int i = 0;
+    while (1) {
+        int child = 2 * i + 1;
+        if (child >= s_event_count) break;
+        if (child + 1 < s_event_count && s_events[child + 1].time_us < s_events[child].time_us) child++;
+        if (last.time_us <= s_events[child].time_us) break;
+        s_events[i] = s_events[child];
+        i = child;
+    }
+    if (s_event_count > 0) {
+        s_events[i] = last;
+    }
+    return top;
+}
+
+static struct gptimer_t *sim_next_timer(void) {
+    struct gptimer_t *next = NULL;
+    for (int i = 0; i < SIM_MAX_TIMERS; i++) {
+        if (s_timers[i].in_use && s_timers[i].running &&
+            (next == NULL || s_timers[i].next_alarm_us < next->next_alarm_us)) {
+            next = &s_timers[i];
+        }
+    }
+    return next;
+}
+
+static void sim_deliver_edge(const sim_event_t *ev) {
+    sim_gpio_t *gpio = &s_gpio[ev->pin];
+    int previous = gpio->pin_level_in;
+    gpio->pin_level_in = ev->level;
+    if (previous == ev->level || !gpio->intr_enabled || gpio->isr == NULL) return;
+
+    bool fire = gpio->intr_type == GPIO_INTR_ANYEDGE ||
+                (gpio->intr_type == GPIO_INTR_POSEDGE && ev->level) ||
+                (gpio->intr_type == GPIO_INTR_NEGEDGE && !ev->level);
+    if (fire) {
+        s_stats.isr_calls++;
+        gpio->isr(gpio->isr_arg);
+    }
+}
+
+static void sim_fire_timer(struct gptimer_t *timer) {
+    s_stats.timer_alarms++;
+    gptimer_alarm_event_data_t edata = {
+        .count_value = timer->alarm_count,
+        .alarm_value = timer->alarm_count,
+    };
+    if (timer->auto_reload) {
+        timer->next_alarm_us += (int64_t)timer->alarm_count;
+    } else {
+        timer->running = false;
+    }
+    if (timer->on_alarm) {
+        timer->on_alarm(timer, &edata, timer->user_data);
+    }
+}
+
+bool sim_run_next_event(int64_t deadline_us) {
+    struct gptimer_t *timer = sim_next_timer();
+    int64_t edge_time = s_event_count ? s_events[0].time_us : INT64_MAX;
+    int64_t timer_time = timer ? timer->next_alarm_us : INT64_MAX;
+    int64_t next = edge_time < timer_time ? edge_time : timer_time;
+
+    if (next == INT64_MAX || next > deadline_us) return false;
+
+    if (next > s_now_us) {
+        s_now_us = next;
+    }
+    sim_trace_apply();
+    if (edge_time <= timer_time) {
+        sim_event_t ev = sim_event_pop();
+        sim_deliver_edge(&ev);
+    } else {
+        sim_fire_timer(timer);
+    }
+    return true;
+}
+
+void sim_advance_to(int64_t time_us) {
+    while (sim_run_next_event(time_us)) {
+    }
+    if (time_us > s_now_us) {
+        s_now_us = time_us;
+    }
+    sim_trace_apply();
+}
+
+void sim_advance_us(int64_t delta_us) {
+    sim_advance_to(s_now_us + delta_us);
+}
+
+/* ----- Sensors and traces ----- */
+
+void sim_sensor_attach(int sensor_id, int trig_pin, int echo_pin) {
+    if (sensor_id < 0 || sensor_id >= SIM_MAX_SENSORS) return;
+    if (trig_pin < 0 || trig_pin >= SIM_GPIO_COUNT || echo_pin < 0 || echo_pin >= SIM_GPIO_COUNT) return;
+
+    sim_sensor_t *sensor = &s_sensors[sensor_id];
+    sensor->configured = true;
+    sensor->trig_pin = trig_pin;
+    sensor->echo_pin = echo_pin;
+    sensor->channel = -1;
+    sensor->next_on_trig = s_gpio[trig_pin].first_sensor;
+    s_gpio[trig_pin].first_sensor = sensor_id;
+}
+
+void sim_sensor_attach_mux(int sensor_id, int trig_pin, int echo_pin, int channel) {
+    sim_sensor_attach(sensor_id, trig_pin, echo_pin);
+    if (sensor_id >= 0 && sensor_id < SIM_MAX_SENSORS) {
+        s_sensors[sensor_id].channel = channel;
+    }
+}
+
+void sim_sensor_attach_i2c(int sensor_id, int address) {
+    if (sensor_id < 0 || sensor_id >= SIM_MAX_SENSORS || address <= 0 || address >= SIM_I2C_ADDRESSES) return;
+
+    sim_sensor_t *sensor = &s_sensors[sensor_id];
+    sensor->configured = true;
+    sensor->channel = -1;
+    sensor->i2c_address = address;
+    sensor->range_reg = 0xFF;
+    s_i2c_sensor[address] = sensor_id;
+}
+
+void sim_mux_configure(const int *select_pins, int bits) {
+    if (bits > SIM_MUX_MAX_BITS) bits = SIM_MUX_MAX_BITS;
+    s_mux.bits = bits;
+    s_mux.shift = false;
+    memcpy(s_mux.select_pins, select_pins, (size_t)bits * sizeof(int));
+}
+
+void sim_mux_configure_shift(int data_pin, int clock_pin, int latch_pin, int bits) {
+    s_mux.bits = bits;
+    s_mux.shift = true;
+    s_mux.data_pin = data_pin;
+    s_mux.clock_pin = clock_pin;
+    s_mux.latch_pin = latch_pin;
+}
+
+static int sim_mux_channel(void) {
+    int channel = 0;
+    if (s_mux.shift) {
+        channel = s_mux.latched;
+    } else {
+        for (int bit = 0; bit < s_mux.bits; bit++) {
+            channel |= s_gpio[s_mux.select_pins[bit]].pin_level_out << bit;
+        }
+    }
+    return channel & ((1 << s_mux.bits) - 1);
+}
+
+/* The simulated sensor backend reads the same distances, without the noise */
+void sim_sensor_set_distance(int sensor_id, uint32_t distance_mm) {
+    if (sensor_id < 0 || sensor_id >= SIM_MAX_SENSORS) return;
+    s_sensors[sensor_id].distance_mm = distance_mm;
+    sensor_sim_set_distance(sensor_id, distance_mm);
+}
+
+uint32_t sim_sensor_get_distance(int sensor_id) {
+    if (sensor_id < 0 || sensor_id >= SIM_MAX_SENSORS) return 0;
+    return s_sensors[sensor_id].distance_mm;
+}
+
+void sim_sensor_set_noise(int sensor_id, uint32_t jitter_mm, uint32_t spike_per_mille, uint32_t dropout_per_mille) {
+    if (sensor_id < 0 || sensor_id >= SIM_MAX_SENSORS) return;
+    s_sensors[sensor_id].jitter_mm = jitter_mm;
+    s_sensors[sensor_id].spike_per_mille = spike_per_mille;
+    s_sensors[sensor_id].dropout_per_mille = dropout_per_mille;
+}
+
+/* Distance one ping measures, with noise; false if it gets no echo */
+static bool sim_sensor_sample(const sim_sensor_t *sensor, uint32_t *distance_out) {
+    uint32_t distance_mm = sensor->distance_mm;
+
+    if (distance_mm == SIM_NO_ECHO || sim_random() % 1000 < sensor->dropout_per_mille) {
+        return false;
+    }
+    if (sim_random() % 1000 < sensor->spike_per_mille) {
+        distance_mm = 30 + sim_random() % 4000;
+    } else if (sensor->jitter_mm) {
+        distance_mm += sim_random() % (2 * sensor->jitter_mm + 1);
+        distance_mm = (distance_mm > sensor->jitter_mm) ? distance_mm - sensor->jitter_mm : 1;
+    }
+    *distance_out = distance_mm;
+    return true;
+}
+
+/* A trigger pulse: schedule the echo of every sensor wired to this pin
+ * (through a mux, only the one on the selected channel hears it) */
+static void sim_sensor_fire(int trig_pin) {
+    int channel = sim_mux_channel();
+    for (int id = s_gpio[trig_pin].first_sensor; id >= 0; id = s_sensors[id].next_on_trig) {
+        sim_sensor_t *sensor = &s_sensors[id];
+        uint32_t distance_mm;
+
+        if (sensor->channel >= 0 && sensor->channel != channel) continue;
+        if (!sim_sensor_sample(sensor, &distance_mm)) continue;
+
+        /* Round trip at 343 m/s */
+        int64_t echo_us = (int64_t)distance_mm * 2000 / 343;
+        int64_t rise_us = s_now_us + SIM_ECHO_DELAY_US;
+        sim_event_push(rise_us, sensor->echo_pin, 1);
+        sim_event_push(rise_us + echo_us, sensor->echo_pin, 0);
+    }
+}
+
+static int sim_trace_compare(const void *a, const void *b) {
+    const sim_trace_entry_t *x = a;
+    const sim_trace_entry_t *y = b;
+    return (x->time_us > y->time_us) - (x->time_us < y->time_us);
+}
+
+int sim_trace_load(const char *path) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) return -1;
+
+    sim_host_free(s_trace);
+    s_trace = sim_host_alloc(SIM_MAX_TRACE * sizeof(sim_trace_entry_t));
+    s_trace_count = 0;
+    s_trace_next = 0;
+    if (s_trace == NULL) {
+        fclose(file);
+        return -1;
+    }
+
+    char line[128];
+    while (fgets(line, sizeof(line), file) != NULL && s_trace_count < SIM_MAX_TRACE) {
+        unsigned long time_ms, sensor, distance_mm;
+        if (line[0] == '#' || sscanf(line, "%lu,%lu,%lu", &time_ms, &sensor, &distance_mm) != 3) {
+            continue;
+        }
+        if (sensor >= SIM_MAX_SENSORS) continue;
+        s_trace[s_trace_count++] = (sim_trace_entry_t){
+            .time_us = (int64_t)time_ms * 1000,
+            .sensor = (uint16_t)sensor,
+            .distance_mm = (uint32_t)distance_mm,
+        };
+    }
+    fclose(file);
+
+    qsort(s_trace, s_trace_count, sizeof(sim_trace_entry_t), sim_trace_compare);
+    sim_trace_apply();
+    return s_trace_count;
+}
+
+bool sim_trace_add(int64_t time_ms, int sensor_id, uint32_t distance_mm) {
+    if (s_trace == NULL) {
+        s_trace = sim_host_alloc(SIM_MAX_TRACE * sizeof(sim_trace_entry_t));
+        if (s_trace == NULL) return false;
+    }
+    if (s_trace_count == SIM_MAX_TRACE || sensor_id < 0 || sensor_id >= SIM_MAX_SENSORS) return false;
+
+    s_trace[s_trace_count++] = (sim_trace_entry_t){
+        .time_us = time_ms * 1000,
+        .sensor = (uint16_t)sensor_id,
+        .distance_mm = distance_mm,
+    };
+    return true;
+}
+
+void sim_trace_apply(void) {
+    while (s_trace_next < s_trace_count && s_trace[s_trace_next].time_us <= s_now_us) {
+        sim_sensor_set_distance(s_trace[s_trace_next].sensor, s_trace[s_trace_next].distance_mm);
+        s_trace_next++;
+    }
+}
+
+void sim_hal_get_stats(sim_hal_stats_t *stats) {
+    *stats = s_stats;
+}
+
+/* ----- esp_timer / esp_cpu / ROM ----- */
+
+int64_t esp_timer_get_time(void) {
+    return s_now_us;
+}
+
+esp_cpu_cycle_count_t esp_cpu_get_cycle_count(void) {
+    return (esp_cpu_cycle_count_t)(s_now_us * CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ);
+}
+
+void esp_rom_delay_us(uint32_t us) {
+    sim_advance_us(us);
+}
+
+uint32_t esp_rom_get_cpu_ticks_per_us(void) {
+    return CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ;
+}
+
+uint16_t esp_rom_crc16_le(uint16_t crc, uint8_t const *buf, uint32_t len) {
+    /* CRC-16/CCITT, reflected, with the ROM's inversion on entry and exit */
+    crc = ~crc;
+    for (uint32_t i = 0; i < len; i++) {
+        crc ^= buf[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 1) ? (crc >> 1) ^ 0x8408 : crc >> 1;
+        }
+    }
+    return ~crc;
+}
+
+/* ----- GPIO driver ----- */
+
+static bool sim_gpio_valid(gpio_num_t pin) {
+    return pin >= 0 && pin < SIM_GPIO_COUNT;
+}
+
+/* Interrupt routing survives a reset, so the benchmark can let a slot's
+ * trigger, echo and LEDs share one pin number (256 slots, 256 pins) */
+esp_err_t gpio_reset_pin(gpio_num_t gpio_num) {
+    if (!sim_gpio_valid(gpio_num)) return ESP_ERR_INVALID_ARG;
+    s_gpio[gpio_num].pin_level_out = 0;
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_direction(gpio_num_t gpio_num, gpio_mode_t mode) {
+    return sim_gpio_valid(gpio_num) ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+/* Drive an output; a high pulse of trigger width on a sensor pin fires the sensor */
+static void sim_gpio_drive(gpio_num_t gpio_num, uint32_t level) {
+    sim_gpio_t *gpio = &s_gpio[gpio_num];
+    int previous = gpio->pin_level_out;
+    gpio->pin_level_out = level ? 1 : 0;
+
+    if (!previous && level) {
+        gpio->rise_us = s_now_us;
+        if (s_mux.shift && gpio_num == s_mux.clock_pin) {
+            s_mux.shift_reg = (uint8_t)(s_mux.shift_reg << 1) | (uint8_t)s_gpio[s_mux.data_pin].pin_level_out;
+        } else if (s_mux.shift && gpio_num == s_mux.latch_pin) {
+            s_mux.latched = s_mux.shift_reg;
+        }
+    } else if (previous && !level && gpio->first_sensor >= 0) {
+        int64_t width_us = s_now_us - gpio->rise_us;
+        if (width_us >= SIM_TRIGGER_MIN_US && width_us <= SIM_TRIGGER_MAX_US) {
+            s_stats.trigger_pulses++;
+            sim_sensor_fire(gpio_num);
+        }
+    }
+}
+
+esp_err_t gpio_set_level(gpio_num_t gpio_num, uint32_t level) {
+    if (!sim_gpio_valid(gpio_num)) return ESP_ERR_INVALID_ARG;
+
+    s_stats.gpio_writes++;
+    sim_gpio_drive(gpio_num, level);
+    return ESP_OK;
+}
+
+int gpio_get_level(gpio_num_t gpio_num) {
+    if (!sim_gpio_valid(gpio_num)) return 0;
+    s_stats.gpio_reads++;
+    return s_gpio[gpio_num].pin_level_in;
+}
+
+esp_err_t gpio_set_intr_type(gpio_num_t gpio_num, gpio_int_type_t intr_type) {
+    if (!sim_gpio_valid(gpio_num)) return ESP_ERR_INVALID_ARG;
+    s_gpio[gpio_num].intr_type = intr_type;
+    return ESP_OK;
+}
+
+esp_err_t gpio_intr_enable(gpio_num_t gpio_num) {
+    if (!sim_gpio_valid(gpio_num)) return ESP_ERR_INVALID_ARG;
+    s_gpio[gpio_num].intr_enabled = true;
+    return ESP_OK;
+}
+
+esp_err_t gpio_intr_disable(gpio_num_t gpio_num) {
+    if (!sim_gpio_valid(gpio_num)) return ESP_ERR_INVALID_ARG;
+    s_gpio[gpio_num].intr_enabled = false;
+    return ESP_OK;
+}
+
+esp_err_t gpio_install_isr_service(int intr_alloc_flags) {
+    static bool installed = false;
+    if (installed) return ESP_ERR_INVALID_STATE;
+    installed = true;
+    return ESP_OK;
+}
+
+esp_err_t gpio_isr_handler_add(gpio_num_t gpio_num, gpio_isr_t isr_handler, void *args) {
+    if (!sim_gpio_valid(gpio_num)) return ESP_ERR_INVALID_ARG;
+    s_gpio[gpio_num].isr = isr_handler;
+    s_gpio[gpio_num].isr_arg = args;
+    return ESP_OK;
+}
+
+esp_err_t gpio_isr_handler_remove(gpio_num_t gpio_num) {
+    if (!sim_gpio_valid(gpio_num)) return ESP_ERR_INVALID_ARG;
+    s_gpio[gpio_num].isr = NULL;
+    s_gpio[gpio_num].isr_arg = NULL;
+    return ESP_OK;
+}
+
+/* ----- gptimer driver ----- */
+
+esp_err_t gptimer_new_timer(const gptimer_config_t *config, gptimer_handle_t *ret_timer) {
+    if (config == NULL || ret_timer == NULL || config->resolution_hz != 1000000) return ESP_ERR_INVALID_ARG;
+    for (int i = 0; i < SIM_MAX_TIMERS; i++) {
+        if (!s_timers[i].in_use) {
+            memset(&s_timers[i], 0, sizeof(s_timers[i]));
+            s_timers[i].in_use = true;
+            *ret_timer = &s_timers[i];
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t gptimer_del_timer(gptimer_handle_t timer) {
+    timer->in_use = false;
+    return ESP_OK;
+}
+
+esp_err_t gptimer_register_event_callbacks(gptimer_handle_t timer, const gptimer_event_callbacks_t *cbs, void *user_data) {
+    timer->on_alarm = cbs->on_alarm;
+    timer->user_data = user_data;
+    return ESP_OK;
+}
+
+esp_err_t gptimer_set_alarm_action(gptimer_handle_t timer, const gptimer_alarm_config_t *config) {
+    timer->alarm_count = config->alarm_count;
+    timer->auto_reload = config->flags.auto_reload_on_alarm;
+    return ESP_OK;
+}
+
+esp_err_t gptimer_enable(gptimer_handle_t timer) {
+    return ESP_OK;
+}
+
+esp_err_t gptimer_disable(gptimer_handle_t timer) {
+    return ESP_OK;
+}
+
+esp_err_t gptimer_start(gptimer_handle_t timer) {
+    timer->running = true;
+    timer->start_us = s_now_us;
+    timer->next_alarm_us = s_now_us + (int64_t)timer->alarm_count;
+    return ESP_OK;
+}
+
+esp_err_t gptimer_stop(gptimer_handle_t timer) {
+    timer->running = false;
+    return ESP_OK;
+}
+
+/* The count restarts from zero on every gptimer_start here, so only 0 is accepted */
+esp_err_t gptimer_set_raw_count(gptimer_handle_t timer, uint64_t value) {
+    return value == 0 ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+/* ----- Dedicated GPIO bundle ----- */
+
+esp_err_t dedic_gpio_new_bundle(const dedic_gpio_bundle_config_t *config, dedic_gpio_bundle_handle_t *ret_bundle) {
+    if (config->array_size == 0 || config->array_size > SIM_BUNDLE_MAX_PINS) return ESP_ERR_INVALID_ARG;
+    for (size_t i = 0; i < config->array_size; i++) {
+        if (!sim_gpio_valid(config->gpio_array[i])) return ESP_ERR_INVALID_ARG;
+    }
+
+    struct dedic_gpio_bundle_t *bundle = calloc(1, sizeof(*bundle));
+    if (bundle == NULL) return ESP_ERR_NO_MEM;
+    memcpy(bundle->pins, config->gpio_array, config->array_size * sizeof(int));
+    bundle->count = config->array_size;
+    *ret_bundle = bundle;
+    return ESP_OK;
+}
+
+esp_err_t dedic_gpio_del_bundle(dedic_gpio_bundle_handle_t bundle) {
+    free(bundle);
+    return ESP_OK;
+}
+
+void dedic_gpio_bundle_write(dedic_gpio_bundle_handle_t bundle, uint32_t mask, uint32_t value) {
+    s_stats.bundle_writes++;
+    for (size_t i = 0; i < bundle->count; i++) {
+        if (mask & (1u << i)) {
+            sim_gpio_drive(bundle->pins[i], (value >> i) & 1);
+        }
+    }
+}
+
+/* ----- RMT: one addressable strip ----- */
+
+esp_err_t rmt_new_tx_channel(const rmt_tx_channel_config_t *config, rmt_channel_handle_t *ret_chan) {
+    if (!sim_gpio_valid(config->gpio_num) || config->resolution_hz == 0) return ESP_ERR_INVALID_ARG;
+    /* The C6 RMT has no DMA */
+    if (config->flags.with_dma) return ESP_ERR_NOT_SUPPORTED;
+
+    struct rmt_channel_t *channel = calloc(1, sizeof(*channel));
+    if (channel == NULL) return ESP_ERR_NO_MEM;
+    *ret_chan = channel;
+    return ESP_OK;
+}
+
+esp_err_t rmt_del_channel(rmt_channel_handle_t channel) {
+    free(channel);
+    return ESP_OK;
+}
+
+esp_err_t rmt_enable(rmt_channel_handle_t channel) {
+    channel->enabled = true;
+    return ESP_OK;
+}
+
+esp_err_t rmt_new_bytes_encoder(const rmt_bytes_encoder_config_t *config, rmt_encoder_handle_t *ret_encoder) {
+    *ret_encoder = calloc(1, sizeof(struct rmt_encoder_t));
+    return *ret_encoder ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+esp_err_t rmt_transmit(rmt_channel_handle_t channel, rmt_encoder_handle_t encoder, const void *payload,
+                       size_t payload_bytes, const rmt_transmit_config_t *config) {
+    if (!channel->enabled) return ESP_ERR_INVALID_STATE;
+    if (payload_bytes > sizeof(s_strip)) return ESP_ERR_INVALID_ARG;
+
+    /* The frame starts when the previous one is out and shifts into the first pixels */
+    int64_t start_us = channel->done_us > s_now_us ? channel->done_us : s_now_us;
+    channel->done_us = start_us + (int64_t)payload_bytes * 8 * SIM_STRIP_NS_PER_BIT / 1000 + SIM_STRIP_RESET_US;
+    memcpy(s_strip, payload, payload_bytes);
+    s_stats.rmt_frames++;
+    s_stats.rmt_bytes += payload_bytes;
+    return ESP_OK;
+}
+
+esp_err_t rmt_tx_wait_all_done(rmt_channel_handle_t channel, int timeout_ms) {
+    if (channel->done_us > s_now_us) {
+        if (timeout_ms >= 0 && channel->done_us - s_now_us > (int64_t)timeout_ms * 1000) {
+            sim_advance_us((int64_t)timeout_ms * 1000);
+            return ESP_ERR_TIMEOUT;
+        }
+        sim_advance_to(channel->done_us);
+    }
+    return ESP_OK;
+}
+
+bool sim_strip_pixel(int index, uint8_t grb[3]) {
+    if (index < 0 || index >= SIM_STRIP_MAX_PIXELS) return false;
+    memcpy(grb, &s_strip[index * 3], 3);
+    return true;
+}
+
+/* ----- I2C: SRF08-style ranging modules ----- */
+
+/* Time on the wire: start, address and data bytes with their ACK bits, stop */
+static void sim_i2c_clock(const struct i2c_master_dev_t *dev, size_t write_size, size_t read_size) {
+    size_t bits = 2 + (1 + write_size) * 9 + (read_size ? (1 + read_size) * 9 + 1 : 0);
+    s_stats.i2c_transactions++;
+    sim_advance_us((int64_t)(bits * 1000000 / dev->scl_speed_hz) + 1);
+}
+
+static void sim_i2c_write(sim_sensor_t *sensor, const uint8_t *data, size_t size) {
+    if (size < 2) return;
+    if (data[0] == 2) {
+        sensor->range_reg = data[1];
+    } else if (data[0] == 0 && data[1] >= 0x50 && data[1] <= 0x52) {
+        /* The module listens for the whole range window, whatever it hears */
+        int64_t window_us = (int64_t)(sensor->range_reg + 1) * 43 * 2000 / 343;
+        uint32_t distance_mm;
+        sensor->result_us = 0;
+        if (sim_sensor_sample(sensor, &distance_mm) && (int64_t)distance_mm * 2000 / 343 <= window_us) {
+            sensor->result_us = (uint16_t)((int64_t)distance_mm * 2000 / 343);
+        }
+        sensor->busy_until_us = s_now_us + window_us;
+    }
+}
+
+esp_err_t i2c_new_master_bus(const i2c_master_bus_config_t *bus_config, i2c_master_bus_handle_t *ret_bus_handle) {
+    if (!sim_gpio_valid(bus_config->sda_io_num) || !sim_gpio_valid(bus_config->scl_io_num)) return ESP_ERR_INVALID_ARG;
+    *ret_bus_handle = calloc(1, sizeof(struct i2c_master_bus_t));
+    return *ret_bus_handle ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+esp_err_t i2c_master_bus_add_device(i2c_master_bus_handle_t bus_handle, const i2c_device_config_t *dev_config,
+                                    i2c_master_dev_handle_t *ret_handle) {
+    if (dev_config->device_address >= SIM_I2C_ADDRESSES || dev_config->scl_speed_hz == 0) return ESP_ERR_INVALID_ARG;
+    struct i2c_master_dev_t *dev = calloc(1, sizeof(*dev));
+    if (dev == NULL) return ESP_ERR_NO_MEM;
+    dev->address = dev_config->device_address;
+    dev->scl_speed_hz = dev_config->scl_speed_hz;
+    *ret_handle = dev;
+    return ESP_OK;
+}
+
+/* A module that is ranging, or absent, does not acknowledge its address */
+static sim_sensor_t *sim_i2c_device(const struct i2c_master_dev_t *dev) {
+    int id = s_i2c_sensor[dev->address];
+    if (id < 0 || s_now_us < s_sensors[id].busy_until_us) return NULL;
+    return &s_sensors[id];
+}
+
+esp_err_t i2c_master_transmit(i2c_master_dev_handle_t i2c_dev, const uint8_t *write_buffer, size_t write_size,
+                              int xfer_timeout_ms) {
+    sim_i2c_clock(i2c_dev, write_size, 0);
+
+    /* General call: every idle module takes the command */
+    if (i2c_dev->address == 0) {
+        for (int address = 1; address < SIM_I2C_ADDRESSES; address++) {
+            int id = s_i2c_sensor[address];
+            if (id >= 0 && s_now_us >= s_sensors[id].busy_until_us) {
+                sim_i2c_write(&s_sensors[id], write_buffer, write_size);
+            }
+        }
+        return ESP_OK;
+    }
+
+    sim_sensor_t *sensor = sim_i2c_device(i2c_dev);
+    if (sensor == NULL) return ESP_FAIL;
+    sim_i2c_write(sensor, write_buffer, write_size);
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_transmit_receive(i2c_master_dev_handle_t i2c_dev, const uint8_t *write_buffer,
+                                      size_t write_size, uint8_t *read_buffer, size_t read_size, int xfer_timeout_ms) {
+    sim_i2c_clock(i2c_dev, write_size, read_size);
+
+    sim_sensor_t *sensor = sim_i2c_device(i2c_dev);
+    if (sensor == NULL || write_size < 1) return ESP_FAIL;
+
+    /* Revision, light sensor, first echo high and low byte */
+    const uint8_t regs[4] = { SIM_SRF_REVISION, 0x80, (uint8_t)(sensor->result_us >> 8), (uint8_t)sensor->result_us };
+    for (size_t i = 0; i < read_size; i++) {
+        size_t reg = write_buffer[0] + i;
+        read_buffer[i] = reg < sizeof(regs) ? regs[reg] : 0;
+    }
+    return ESP_OK;
+}
+
+/* ----- Radio ----- */
+
+static const uint8_t s_radio_broadcast[6] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+
+bool sim_radio_add_station(const uint8_t mac[6], sim_radio_rx_t rx, void *ctx) {
+    if (s_station_count == SIM_RADIO_MAX_STATIONS) return false;
+    sim_station_t *station = &s_stations[s_station_count++];
+    memcpy(station->mac, mac, sizeof(station->mac));
+    station->rx = rx;
+    station->ctx = ctx;
+    return true;
+}
+
+void sim_radio_set_loss(uint32_t per_mille) {
+    s_radio_loss_per_mille = per_mille;
+}
+
+/* Returns false if the frame was lost; a unicast frame to no station is lost too */
+bool sim_radio_transmit(const uint8_t src[6], const uint8_t dst[6], const uint8_t *data, size_t len) {
+    s_stats.radio_frames++;
+    s_stats.radio_bytes += len;
+    sim_advance_us(SIM_RADIO_FRAME_US + (int64_t)len * SIM_RADIO_BYTE_US);
+
+    if (s_radio_loss_per_mille && sim_random() % 1000 < s_radio_loss_per_mille) {
+        s_stats.radio_dropped++;
+        return false;
+    }
+
+    /* The receiver may transmit from its handler, so copy the frame first */
+    uint8_t frame[ESP_NOW_MAX_DATA_LEN];
+    uint8_t from[6];
+    if (len > sizeof(frame)) return false;
+    memcpy(frame, data, len);
+    memcpy(from, src, sizeof(from));
+
+    bool broadcast = memcmp(dst, s_radio_broadcast, sizeof(s_radio_broadcast)) == 0;
+    bool delivered = false;
+    for (int i = 0; i < s_station_count; i++) {
+        sim_station_t *station = &s_stations[i];
+        if (memcmp(station->mac, from, sizeof(from)) == 0) continue;
+        if (broadcast || memcmp(station->mac, dst, 6) == 0) {
+            station->rx(from, frame, len, station->ctx);
+            delivered = true;
+        }
+    }
+    return delivered;
+}
+
+/* ----- ESP-NOW ----- */
+
+static const uint8_t s_device_mac[6] = SIM_DEVICE_MAC;
+
+static void sim_espnow_rx(const uint8_t *src, const uint8_t *data, size_t len, void *ctx) {
+    if (s_espnow_recv_cb == NULL) return;
+    uint8_t src_addr[ESP_NOW_ETH_ALEN];
+    uint8_t des_addr[ESP_NOW_ETH_ALEN];
+    memcpy(src_addr, src, sizeof(src_addr));
+    memcpy(des_addr, s_device_mac, sizeof(des_addr));
+    esp_now_recv_info_t info = { .src_addr = src_addr, .des_addr = des_addr };
+    s_espnow_recv_cb(&info, data, (int)len);
+}
+
+static int sim_espnow_peer(const uint8_t *peer_addr) {
+    for (int i = 0; i < s_espnow_peer_count; i++) {
+        if (memcmp(s_espnow_peers[i], peer_addr, ESP_NOW_ETH_ALEN) == 0) return i;
+    }
+    return -1;
+}
+
+esp_err_t esp_now_init(void) {
+    if (!s_espnow_started) {
+        if (!sim_radio_add_station(s_device_mac, sim_espnow_rx, NULL)) return ESP_ERR_NO_MEM;
+        s_espnow_started = true;
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_now_register_recv_cb(esp_now_recv_cb_t cb) {
+    if (!s_espnow_started) return ESP_ERR_ESPNOW_NOT_INIT;
+    s_espnow_recv_cb = cb;
+    return ESP_OK;
+}
+
+esp_err_t esp_now_add_peer(const esp_now_peer_info_t *peer) {
+    if (!s_espnow_started) return ESP_ERR_ESPNOW_NOT_INIT;
+    if (sim_espnow_peer(peer->peer_addr) >= 0) return ESP_ERR_ESPNOW_EXIST;
+    if (s_espnow_peer_count == ESP_NOW_MAX_TOTAL_PEER_NUM) return ESP_ERR_ESPNOW_FULL;
+    memcpy(s_espnow_peers[s_espnow_peer_count++], peer->peer_addr, ESP_NOW_ETH_ALEN);
+    return ESP_OK;
+}
+
+esp_err_t esp_now_del_peer(const uint8_t *peer_addr) {
+    int index = sim_espnow_peer(peer_addr);
+    if (index < 0) return ESP_ERR_ESPNOW_NOT_FOUND;
+    memmove(s_espnow_peers[index], s_espnow_peers[index + 1],
+            (size_t)(s_espnow_peer_count - index - 1) * ESP_NOW_ETH_ALEN);
+    s_espnow_peer_count--;
+    return ESP_OK;
+}
+
+bool esp_now_is_peer_exist(const uint8_t *peer_addr) {
+    return sim_espnow_peer(peer_addr) >= 0;
+}
+
+/* Like the driver, success means the frame was queued, not that it arrived */
+esp_err_t esp_now_send(const uint8_t *peer_addr, const uint8_t *data, size_t len) {
+    if (!s_espnow_started) return ESP_ERR_ESPNOW_NOT_INIT;
+    if (len == 0 || len > ESP_NOW_MAX_DATA_LEN) return ESP_ERR_ESPNOW_ARG;
+    if (sim_espnow_peer(peer_addr) < 0) return ESP_ERR_ESPNOW_NOT_FOUND;
+    sim_radio_transmit(s_device_mac, peer_addr, data, len);
+    return ESP_OK;
+}
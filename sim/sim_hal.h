@@ -0,0 +1,77 @@
+/**
+ * @file sim_hal.h
+ * @brief Host simulation HAL: virtual clock, GPIO, sensor traces and timers
+ */
+#ifndef SIM_HAL_H
+#define SIM_HAL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define SIM_GPIO_COUNT 256          /* Pins are uint8_t in the slot table */
+#define SIM_MAX_SENSORS 256
+#define SIM_ECHO_DELAY_US 450       /* HC-SR04: trigger to echo rising edge */
+#define SIM_NO_ECHO 0               /* Distance value meaning "no echo at all" */
+#define SIM_RADIO_MAX_STATIONS 48
+#define SIM_RADIO_FRAME_US 400      /* Per-frame airtime: preamble, MAC header, ack */
+#define SIM_RADIO_BYTE_US 8         /* Payload airtime at 1 Mbit/s */
+#define SIM_DEVICE_MAC { 0x02, 0x00, 0x00, 0x00, 0x00, 0x01 }  /* The simulated controller's own station */
+
+/* Counters for the simulated hardware */
+typedef struct {
+    uint64_t gpio_writes;           /* gpio_set_level() calls */
+    uint64_t bundle_writes;         /* dedic_gpio_bundle_write() calls */
+    uint64_t rmt_frames;            /* Strip frames transmitted */
+    uint64_t rmt_bytes;             /* Strip bytes transmitted (3 per pixel) */
+    uint64_t gpio_reads;            /* gpio_get_level() calls */
+    uint64_t isr_calls;             /* GPIO ISR invocations */
+    uint64_t trigger_pulses;        /* Valid trigger pulses seen on sensor pins */
+    uint64_t timer_alarms;          /* gptimer alarms fired */
+    uint64_t i2c_transactions;      /* I2C master transfers */
+    uint64_t radio_frames;          /* Frames put on the air */
+    uint64_t radio_bytes;           /* Payload bytes put on the air */
+    uint64_t radio_dropped;         /* Frames lost to the configured loss rate */
+} sim_hal_stats_t;
+
+/* Called with each frame a station receives */
+typedef void (*sim_radio_rx_t)(const uint8_t *src, const uint8_t *data, size_t len, void *ctx);
+
+/* Clock and event loop */
+void sim_hal_reset(uint32_t seed);
+int64_t sim_now_us(void);
+void sim_advance_to(int64_t time_us);
+void sim_advance_us(int64_t delta_us);
+bool sim_run_next_event(int64_t deadline_us);
+uint32_t sim_random(void);
+
+/* Sensors: a sensor answers trigger pulses on trig_pin with an echo on echo_pin */
+void sim_sensor_attach(int sensor_id, int trig_pin, int echo_pin);
+/* Behind an analog mux: the sensor only hears trig_pin while its channel is selected */
+void sim_sensor_attach_mux(int sensor_id, int trig_pin, int echo_pin, int channel);
+void sim_mux_configure(const int *select_pins, int bits);
+void sim_mux_configure_shift(int data_pin, int clock_pin, int latch_pin, int bits);
+/* SRF08-style module on the I2C bus at a 7-bit address */
+void sim_sensor_attach_i2c(int sensor_id, int address);
+void sim_sensor_set_distance(int sensor_id, uint32_t distance_mm);
+void sim_sensor_set_noise(int sensor_id, uint32_t jitter_mm, uint32_t spike_per_mille, uint32_t dropout_per_mille);
+uint32_t sim_sensor_get_distance(int sensor_id);
+
+/* Scripted traces: CSV lines "time_ms,sensor,distance_mm", applied as virtual time passes */
+int sim_trace_load(const char *path);
+bool sim_trace_add(int64_t time_ms, int sensor_id, uint32_t distance_mm);  /* Entries must come in time order */
+void sim_trace_apply(void);
+
+/* Addressable strip on the RMT channel: colour latched in a pixel, GRB */
+bool sim_strip_pixel(int index, uint8_t grb[3]);
+
+/* Radio: stations exchange frames by MAC; a frame is delivered once its
+ * airtime has passed, inside sim_radio_transmit(). ff:ff:ff:ff:ff:ff reaches
+ * every other station. */
+bool sim_radio_add_station(const uint8_t mac[6], sim_radio_rx_t rx, void *ctx);
+bool sim_radio_transmit(const uint8_t src[6], const uint8_t dst[6], const uint8_t *data, size_t len);
+void sim_radio_set_loss(uint32_t per_mille);
+
+void sim_hal_get_stats(sim_hal_stats_t *stats);
+
+#endif /* SIM_HAL_H */
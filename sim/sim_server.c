@@ -0,0 +1,500 @@
+/**
+ * @file sim_server.c
+ * @brief Mock esp_http_client and esp_transport wired to an in-process stand-in server
+ */
+#include "sim_server.h"
+#include "sim_hal.h"
+
+#include "esp_http_client.h"
+#include "esp_netif_sntp.h"
+#include "esp_transport.h"
+#include "esp_transport_ssl.h"
+#include "state_stream.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SIM_HTTP_BUFFER_SIZE 512    /* esp_http_client default rx/tx buffers */
+
+/* Wire cost estimates for comparing the two upload protocols */
+#define SIM_TLS_RECORD_OVERHEAD 29  /* Record header, explicit nonce and GCM tag */
+#define SIM_HTTP_REQUEST_HEADERS 170 /* Request line, Host, User-Agent, Content-Type/Length, Connection */
+#define SIM_HTTP_RESPONSE_BYTES 110 /* Status line and headers of an empty answer */
+#define SIM_TLS_HANDSHAKE_BYTES 4500 /* Full handshake including the certificate chain */
+#define SIM_TLS_RESUME_BYTES 600    /* Abbreviated handshake: hellos with the ticket, new ticket, Finished */
+
+struct esp_http_client {
+    http_event_handle_cb event_handler;
+    void *user_data;
+    bool keep_alive;
+    bool save_session;
+    bool have_ticket;
+    bool connected;
+    int64_t last_activity_us;
+    esp_http_client_method_t method;
+    char path[64];
+    const char *post_data;
+    int post_len;
+    int status_code;
+    char *rx_buffer;
+    char *tx_buffer;
+};
+
+typedef struct {
+    char spot_id[24];
+    int8_t taken;
+    uint32_t seq;                   /* Highest freshness sequence received */
+} sim_spot_t;
+
+static sim_server_config_t s_config = {
+    .handshake_ms = 350,
+    .resume_ms = 120,
+    .rtt_ms = 40,
+    .idle_timeout_ms = 0,
+    .online = true,
+    .accept_batch = true,
+};
+static sim_server_stats_t s_stats;
+static sim_spot_t s_spots[SIM_SERVER_MAX_SPOTS];
+static int s_spot_count;
+
+static void sim_stream_reset(void);
+
+/* Charge a new connection; a client holding a ticket gets the abbreviated handshake */
+static void sim_server_handshake(bool have_ticket) {
+    bool resume = have_ticket && s_config.resume_ms != 0;
+    sim_advance_us((int64_t)(resume ? s_config.resume_ms : s_config.handshake_ms) * 1000);
+    if (!s_config.online) return;
+
+    s_stats.connects++;
+    if (resume) s_stats.resumed++;
+    s_stats.wire_bytes += resume ? SIM_TLS_RESUME_BYTES : SIM_TLS_HANDSHAKE_BYTES;
+}
+
+void sim_server_reset(const sim_server_config_t *config) {
+    if (config) s_config = *config;
+    memset(&s_stats, 0, sizeof(s_stats));
+    s_spot_count = 0;
+    sim_stream_reset();
+}
+
+sim_server_config_t *sim_server_config(void) {
+    return &s_config;
+}
+
+void sim_server_get_stats(sim_server_stats_t *stats) {
+    *stats = s_stats;
+}
+
+static sim_spot_t *sim_server_find(const char *spot_id, size_t len, bool create) {
+    for (int i = 0; i < s_spot_count; i++) {
+        if (strlen(s_spots[i].spot_id) == len && memcmp(s_spots[i].spot_id, spot_id, len) == 0) {
+            return &s_spots[i];
+        }
+    }
+    if (!create || s_spot_count == SIM_SERVER_MAX_SPOTS || len >= sizeof(s_spots[0].spot_id)) return NULL;
+
+    sim_spot_t *spot = &s_spots[s_spot_count++];
+    memcpy(spot->spot_id, spot_id, len);
+    spot->spot_id[len] = '\0';
+    spot->taken = -1;
+    return spot;
+}
+
+int sim_server_spot_state(const char *spot_id) {
+    sim_spot_t *spot = sim_server_find(spot_id, strlen(spot_id), false);
+    return spot ? spot->taken : -1;
+}
+
+/* Numeric field of one update object, between its "spot" and the closing brace */
+static bool sim_server_field(const char *from, const char *key, long long *value) {
+    const char *close = strchr(from, '}');
+    const char *field = strstr(from, key);
+    if (field == NULL || (close != NULL && field > close)) return false;
+    *value = strtoll(field + strlen(key), NULL, 10);
+    return true;
+}
+
+/* Freshness fields: the sequence must not go backwards, and "ts" gives the staleness on arrival */
+static void sim_server_freshness(sim_spot_t *spot, const char *from) {
+    long long value;
+    if (sim_server_field(from, "\"seq\":", &value)) {
+        if ((uint32_t)value < spot->seq) {
+            s_stats.seq_regressions++;
+        } else {
+            spot->seq = (uint32_t)value;
+        }
+    }
+    if (sim_server_field(from, "\"ts\":", &value)) {
+        long long now_ms = SIM_SNTP_EPOCH_S * 1000 + sim_now_us() / 1000;
+        uint64_t stale_ms = now_ms > value ? (uint64_t)(now_ms - value) : 0;
+        s_stats.stamped++;
+        s_stats.stale_total_ms += stale_ms;
+        if (stale_ms > s_stats.stale_max_ms) {
+            s_stats.stale_max_ms = stale_ms;
+        }
+    }
+}
+
+/* Apply every {"spot":..,"taken":..} pair in the body; returns the HTTP status */
+static int sim_server_handle(const char *path, const char *body, int len) {
+    s_stats.requests++;
+    s_stats.bytes += (uint64_t)len;
+
+    if (s_config.fail_per_mille && sim_random() % 1000 < s_config.fail_per_mille) {
+        return 503;
+    }
+    if (strcmp(path, SIM_SERVER_TELEMETRY_PATH) == 0) {
+        s_stats.telemetry++;
+        return 200;
+    }
+    if (strcmp(path, SIM_SERVER_HEARTBEAT_PATH) == 0) {
+        s_stats.heartbeats++;
+        return 200;
+    }
+    if (strcmp(path, SIM_SERVER_ANALYTICS_PATH) == 0) {
+        s_stats.analytics++;
+        s_stats.analytics_bytes += (uint64_t)len;
+        return 200;
+    }
+    if (strcmp(path, SIM_SERVER_PARKING_PATH) != 0) {
+        return 404;
+    }
+    if (strstr(body, "\"updates\"") != NULL) {
+        if (!s_config.accept_batch) return 400;
+        s_stats.batch_requests++;
+    }
+
+    int applied = 0;
+    for (const char *p = strstr(body, "\"spot\":\""); p != NULL; p = strstr(p, "\"spot\":\"")) {
+        p += strlen("\"spot\":\"");
+        const char *end = strchr(p, '"');
+        const char *taken = end ? strstr(end, "\"taken\":") : NULL;
+        if (taken == NULL) return 400;
+
+        sim_spot_t *spot = sim_server_find(p, (size_t)(end - p), true);
+        if (spot) {
+            spot->taken = strncmp(taken + strlen("\"taken\":"), "true", 4) == 0;
+            sim_server_freshness(spot, end);
+        }
+        applied++;
+        p = end;
+    }
+    if (applied == 0) return 400;
+
+    s_stats.updates += (uint64_t)applied;
+    return 200;
+}
+
+/* ----- esp_http_client ----- */
+
+static void sim_http_event(esp_http_client_handle_t client, esp_http_client_event_id_t id) {
+    if (client->event_handler == NULL) return;
+    esp_http_client_event_t evt = {
+        .event_id = id,
+        .client = client,
+        .user_data = client->user_data,
+    };
+    client->event_handler(&evt);
+}
+
+/* Keep only the path: every request goes to the one stand-in server */
+static void sim_http_set_path(esp_http_client_handle_t client, const char *url) {
+    const char *scheme = strstr(url, "://");
+    const char *path = strchr(scheme ? scheme + 3 : url, '/');
+    snprintf(client->path, sizeof(client->path), "%s", path ? path : "/");
+}
+
+esp_http_client_handle_t esp_http_client_init(const esp_http_client_config_t *config) {
+    esp_http_client_handle_t client = calloc(1, sizeof(*client));
+    if (client == NULL) return NULL;
+
+    client->rx_buffer = malloc(config->buffer_size ? config->buffer_size : SIM_HTTP_BUFFER_SIZE);
+    client->tx_buffer = malloc(config->buffer_size_tx ? config->buffer_size_tx : SIM_HTTP_BUFFER_SIZE);
+    if (client->rx_buffer == NULL || client->tx_buffer == NULL) {
+        esp_http_client_cleanup(client);
+        return NULL;
+    }
+    client->event_handler = config->event_handler;
+    client->user_data = config->user_data;
+    client->keep_alive = config->keep_alive_enable;
+    client->save_session = config->save_client_session;
+    sim_http_set_path(client, config->url ? config->url : "/");
+    return client;
+}
+
+esp_err_t esp_http_client_set_url(esp_http_client_handle_t client, const char *url) {
+    if (url == NULL) return ESP_ERR_INVALID_ARG;
+    sim_http_set_path(client, url);
+    return ESP_OK;
+}
+
+esp_err_t esp_http_client_set_method(esp_http_client_handle_t client, esp_http_client_method_t method) {
+    client->method = method;
+    return ESP_OK;
+}
+
+esp_err_t esp_http_client_set_header(esp_http_client_handle_t client, const char *key, const char *value) {
+    return ESP_OK;
+}
+
+esp_err_t esp_http_client_set_post_field(esp_http_client_handle_t client, const char *data, int len) {
+    client->post_data = data;
+    client->post_len = len;
+    return ESP_OK;
+}
+
+esp_err_t esp_http_client_perform(esp_http_client_handle_t client) {
+    client->status_code = -1;
+
+    if (client->connected && !s_config.online) {
+        /* The network went down under the open connection; the write fails */
+        esp_http_client_close(client);
+        sim_http_event(client, HTTP_EVENT_ERROR);
+        return ESP_FAIL;
+    }
+    if (client->connected && s_config.idle_timeout_ms &&
+        sim_now_us() - client->last_activity_us > (int64_t)s_config.idle_timeout_ms * 1000) {
+        /* The server already closed this connection; the write fails */
+        s_stats.idle_closes++;
+        esp_http_client_close(client);
+        sim_http_event(client, HTTP_EVENT_ERROR);
+        return ESP_FAIL;
+    }
+
+    if (!client->connected) {
+        sim_server_handshake(client->have_ticket);
+        if (!s_config.online) {
+            sim_http_event(client, HTTP_EVENT_ERROR);
+            return ESP_ERR_HTTP_CONNECT;
+        }
+        client->connected = true;
+        client->have_ticket = client->save_session;
+        sim_http_event(client, HTTP_EVENT_ON_CONNECTED);
+    }
+
+    sim_http_event(client, HTTP_EVENT_HEADER_SENT);
+    sim_advance_us((int64_t)s_config.rtt_ms * 1000);
+    if (client->method == HTTP_METHOD_HEAD) {
+        /* Headers only: nothing is applied */
+        s_stats.heads++;
+        client->status_code = 200;
+    } else {
+        client->status_code = sim_server_handle(client->path, client->post_data ? client->post_data : "",
+                                                client->post_len);
+    }
+    s_stats.wire_bytes += (uint64_t)(SIM_HTTP_REQUEST_HEADERS + client->post_len + SIM_HTTP_RESPONSE_BYTES +
+                                     2 * SIM_TLS_RECORD_OVERHEAD);
+    client->last_activity_us = sim_now_us();
+    if (client->status_code != 200) s_stats.rejected++;
+
+    sim_http_event(client, HTTP_EVENT_ON_DATA);
+    sim_http_event(client, HTTP_EVENT_ON_FINISH);
+    if (!client->keep_alive) {
+        esp_http_client_close(client);
+    }
+    return ESP_OK;
+}
+
+int esp_http_client_get_status_code(esp_http_client_handle_t client) {
+    return client->status_code;
+}
+
+int64_t esp_http_client_get_content_length(esp_http_client_handle_t client) {
+    return 0;
+}
+
+esp_err_t esp_http_client_close(esp_http_client_handle_t client) {
+    if (client->connected) {
+        client->connected = false;
+        sim_http_event(client, HTTP_EVENT_DISCONNECTED);
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_http_client_cleanup(esp_http_client_handle_t client) {
+    if (client == NULL) return ESP_OK;
+    esp_http_client_close(client);
+    free(client->rx_buffer);
+    free(client->tx_buffer);
+    free(client);
+    return ESP_OK;
+}
+
+/* ----- esp_transport: binary frame stream ----- */
+
+#define SIM_STREAM_NAME_MAX 24
+
+struct esp_transport_item_t {
+    bool connected;
+    bool session_tickets;
+    bool have_ticket;
+    int64_t last_activity_us;
+    /* Server side of the connection */
+    uint8_t partial[4];
+    int partial_len;
+    bool hello_done;
+    uint32_t names_left;
+    int slot_count;
+    int name_slot;
+    char name[SIM_STREAM_NAME_MAX];
+    int name_len;
+    sim_spot_t *slots[STREAM_MAX_SLOTS];
+    uint32_t last_seq[STREAM_MAX_SLOTS];
+    bool seen[STREAM_MAX_SLOTS];
+    /* Pending ack, readable once the round trip has elapsed */
+    bool ack_pending;
+    uint32_t ack_seq;
+    int64_t ack_ready_us;
+    uint8_t ack_bytes[4];
+    int ack_offset;
+};
+
+static esp_transport_handle_t s_stream;
+
+static void sim_stream_reset(void) {
+    if (s_stream) s_stream->connected = false;
+}
+
+static void sim_stream_name_byte(esp_transport_handle_t t, uint8_t byte) {
+    t->names_left--;
+    if (byte != 0) {
+        if (t->name_len < SIM_STREAM_NAME_MAX - 1) t->name[t->name_len++] = (char)byte;
+        return;
+    }
+    if (t->name_slot < t->slot_count && t->name_slot < STREAM_MAX_SLOTS) {
+        t->slots[t->name_slot] = sim_server_find(t->name, (size_t)t->name_len, true);
+    }
+    t->name_slot++;
+    t->name_len = 0;
+}
+
+/* Returns true if the word was an UPDATE */
+static bool sim_stream_word(esp_transport_handle_t t, uint32_t word) {
+    uint32_t type = stream_frame_type(word);
+    if (type == STREAM_FRAME_HELLO) {
+        t->hello_done = true;
+        t->slot_count = (int)((word >> 17) & 0x1FF);
+        t->names_left = word & 0x1FFFF;
+        t->name_slot = 0;
+        t->name_len = 0;
+        memset(t->slots, 0, sizeof(t->slots));
+        memset(t->seen, 0, sizeof(t->seen));
+        return false;
+    }
+    if (type != STREAM_FRAME_UPDATE || !t->hello_done) return false;
+
+    int slot = (int)((word >> 20) & 0x1FF);
+    uint32_t seq = word & STREAM_SEQ_MASK;
+    /* Ignore a retransmitted frame older than what this slot already holds */
+    if (!t->seen[slot] || !stream_seq_covered(seq, t->last_seq[slot])) {
+        t->seen[slot] = true;
+        t->last_seq[slot] = seq;
+        if (t->slots[slot]) t->slots[slot]->taken = (word >> 29) & 1;
+    }
+    t->ack_seq = seq;
+    s_stats.updates++;
+    return true;
+}
+
+esp_transport_handle_t esp_transport_ssl_init(void) {
+    return calloc(1, sizeof(struct esp_transport_item_t));
+}
+
+void esp_transport_ssl_session_tickets_enable(esp_transport_handle_t t) {
+    t->session_tickets = true;
+}
+
+int esp_transport_connect(esp_transport_handle_t t, const char *host, int port, int timeout_ms) {
+    sim_server_handshake(t->have_ticket);
+    if (!s_config.online) return -1;
+
+    bool session_tickets = t->session_tickets;
+    memset(t, 0, sizeof(*t));
+    t->session_tickets = session_tickets;
+    t->have_ticket = session_tickets;
+    t->connected = true;
+    t->last_activity_us = sim_now_us();
+    s_stream = t;
+    return 0;
+}
+
+int esp_transport_write(esp_transport_handle_t t, const char *buffer, int len, int timeout_ms) {
+    if (!t->connected || s_stream != t) return ERR_TCP_TRANSPORT_CONNECTION_FAILED;
+    if (!s_config.online) {
+        t->connected = false;
+        return ERR_TCP_TRANSPORT_CONNECTION_FAILED;
+    }
+    if (s_config.idle_timeout_ms &&
+        sim_now_us() - t->last_activity_us > (int64_t)s_config.idle_timeout_ms * 1000) {
+        s_stats.idle_closes++;
+        t->connected = false;
+        return ERR_TCP_TRANSPORT_CONNECTION_FAILED;
+    }
+    t->last_activity_us = sim_now_us();
+    s_stats.bytes += (uint64_t)len;
+    s_stats.wire_bytes += (uint64_t)(len + SIM_TLS_RECORD_OVERHEAD);
+
+    /* A failed request loses the whole write: nothing applied, nothing acked */
+    if (s_config.fail_per_mille && sim_random() % 1000 < s_config.fail_per_mille) {
+        s_stats.rejected++;
+        return len;
+    }
+
+    bool updated = false;
+    for (int i = 0; i < len; i++) {
+        uint8_t byte = (uint8_t)buffer[i];
+        if (t->names_left > 0) {
+            sim_stream_name_byte(t, byte);
+            continue;
+        }
+        t->partial[t->partial_len++] = byte;
+        if (t->partial_len == 4) {
+            uint32_t word = (uint32_t)t->partial[0] | ((uint32_t)t->partial[1] << 8) |
+                            ((uint32_t)t->partial[2] << 16) | ((uint32_t)t->partial[3] << 24);
+            t->partial_len = 0;
+            updated |= sim_stream_word(t, word);
+        }
+    }
+
+    if (updated) {
+        s_stats.requests++;
+        uint32_t ack = stream_frame_ack(t->ack_seq);
+        for (int i = 0; i < 4; i++) t->ack_bytes[i] = (uint8_t)(ack >> (8 * i));
+        t->ack_pending = true;
+        t->ack_offset = 0;
+        t->ack_ready_us = sim_now_us() + (int64_t)s_config.rtt_ms * 1000;
+        s_stats.wire_bytes += 4 + SIM_TLS_RECORD_OVERHEAD;
+    }
+    return len;
+}
+
+int esp_transport_read(esp_transport_handle_t t, char *buffer, int len, int timeout_ms) {
+    if (!t->connected || s_stream != t) return ERR_TCP_TRANSPORT_CONNECTION_CLOSED_BY_FIN;
+
+    int64_t deadline_us = sim_now_us() + (int64_t)timeout_ms * 1000;
+    if (!t->ack_pending || t->ack_ready_us > deadline_us) {
+        sim_advance_to(deadline_us);
+        return ERR_TCP_TRANSPORT_CONNECTION_TIMEOUT;
+    }
+    if (t->ack_ready_us > sim_now_us()) sim_advance_to(t->ack_ready_us);
+
+    int n = 0;
+    while (n < len && t->ack_offset < 4) buffer[n++] = (char)t->ack_bytes[t->ack_offset++];
+    if (t->ack_offset == 4) t->ack_pending = false;
+    t->last_activity_us = sim_now_us();
+    return n;
+}
+
+int esp_transport_close(esp_transport_handle_t t) {
+    t->connected = false;
+    t->ack_pending = false;
+    return 0;
+}
+
+esp_err_t esp_transport_destroy(esp_transport_handle_t t) {
+    if (s_stream == t) s_stream = NULL;
+    free(t);
+    return ESP_OK;
+}
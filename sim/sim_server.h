@@ -0,0 +1,60 @@
+/**
+ * @file sim_server.h
+ * @brief In-process stand-in for the parking server
+ *
+ * Receives the bodies posted through the mock esp_http_client and the
+ * frames written to the mock esp_transport stream, keeps the last reported
+ * state of every spot and charges connection and request costs on the
+ * virtual clock.
+ */
+#ifndef SIM_SERVER_H
+#define SIM_SERVER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define SIM_SERVER_MAX_SPOTS 1024
+#define SIM_SERVER_PARKING_PATH "/pt/parking"
+#define SIM_SERVER_TELEMETRY_PATH "/pt/telemetry"
+#define SIM_SERVER_ANALYTICS_PATH "/pt/analytics"
+#define SIM_SERVER_HEARTBEAT_PATH "/pt/heartbeat"
+
+typedef struct {
+    uint32_t handshake_ms;          /* TCP + full TLS handshake charged on a new connection */
+    uint32_t resume_ms;             /* TCP + abbreviated handshake when the client offers a ticket (0 = no tickets) */
+    uint32_t rtt_ms;                /* Charged on every request */
+    uint32_t idle_timeout_ms;       /* Server closes keep-alive connections idle this long (0 = never) */
+    bool online;                    /* false: connects and requests fail, as with the network down */
+    bool accept_batch;              /* false: answer batched bodies with 400, like the legacy endpoint */
+    uint32_t fail_per_mille;        /* Random 503 answers */
+} sim_server_config_t;
+
+typedef struct {
+    uint64_t requests;              /* Bodies, or stream writes carrying updates, received */
+    uint64_t batch_requests;        /* Bodies carrying an "updates" array */
+    uint64_t updates;               /* Spot updates applied */
+    uint64_t telemetry;             /* Telemetry bodies received */
+    uint64_t analytics;             /* Occupancy summaries received */
+    uint64_t analytics_bytes;       /* Body bytes of those summaries */
+    uint64_t heartbeats;            /* Freshness heartbeats received */
+    uint64_t stamped;               /* Updates carrying a "ts" detection time */
+    uint64_t stale_total_ms;        /* Sum of arrival time minus "ts" */
+    uint64_t stale_max_ms;
+    uint64_t seq_regressions;       /* Updates whose "seq" was below one already received for the spot */
+    uint64_t heads;                 /* HEAD requests (connection pre-warms) */
+    uint64_t connects;              /* Connections accepted */
+    uint64_t resumed;               /* Connections that resumed a TLS session */
+    uint64_t idle_closes;           /* Connections dropped by the idle timeout */
+    uint64_t rejected;              /* Non-2xx answers */
+    uint64_t bytes;                 /* Body and frame bytes received */
+    uint64_t wire_bytes;            /* Estimated bytes on the wire both ways: headers, TLS records, answers */
+} sim_server_stats_t;
+
+void sim_server_reset(const sim_server_config_t *config);
+sim_server_config_t *sim_server_config(void);
+void sim_server_get_stats(sim_server_stats_t *stats);
+
+/* Last state the server holds for a spot: 1 taken, 0 free, -1 never reported */
+int sim_server_spot_state(const char *spot_id);
+
+#endif /* SIM_SERVER_H */
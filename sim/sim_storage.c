@@ -0,0 +1,221 @@
+/**
+ * @file sim_storage.c
+ * @brief RAM-backed NVS and flash partitions for the host simulation
+ *
+ * Storage lives in host memory so it does not count against the simulated heap.
+ */
+#include "nvs.h"
+#include "nvs_flash.h"
+#include "esp_partition.h"
+#include "sim_support.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SIM_NVS_MAX_ENTRIES 64
+#define SIM_NVS_MAX_BLOB 8192
+#define SIM_MAX_PARTITIONS 4
+
+typedef struct {
+    bool used;
+    char namespace_name[16];
+    char key[16];
+    size_t length;
+    uint8_t *value;
+} sim_nvs_entry_t;
+
+typedef struct {
+    esp_partition_t info;
+    uint8_t *data;
+} sim_partition_t;
+
+static sim_nvs_entry_t s_nvs[SIM_NVS_MAX_ENTRIES];
+static char s_namespaces[8][16];
+static int s_namespace_count;
+static sim_partition_t s_partitions[SIM_MAX_PARTITIONS];
+
+/* ----- NVS ----- */
+
+void sim_nvs_reset(void) {
+    for (int i = 0; i < SIM_NVS_MAX_ENTRIES; i++) {
+        sim_host_free(s_nvs[i].value);
+    }
+    memset(s_nvs, 0, sizeof(s_nvs));
+    s_namespace_count = 0;
+}
+
+esp_err_t nvs_flash_init(void) {
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_erase(void) {
+    sim_nvs_reset();
+    return ESP_OK;
+}
+
+esp_err_t nvs_open(const char *namespace_name, nvs_open_mode_t open_mode, nvs_handle_t *out_handle) {
+    if (strlen(namespace_name) >= sizeof(s_namespaces[0])) return ESP_ERR_INVALID_ARG;
+
+    for (int i = 0; i < s_namespace_count; i++) {
+        if (strcmp(s_namespaces[i], namespace_name) == 0) {
+            *out_handle = (nvs_handle_t)(i + 1);
+            return ESP_OK;
+        }
+    }
+    if (open_mode == NVS_READONLY) return ESP_ERR_NVS_NOT_FOUND;
+    if (s_namespace_count == 8) return ESP_ERR_NVS_NO_FREE_PAGES;
+
+    strcpy(s_namespaces[s_namespace_count], namespace_name);
+    *out_handle = (nvs_handle_t)++s_namespace_count;
+    return ESP_OK;
+}
+
+void nvs_close(nvs_handle_t handle) {
+}
+
+static sim_nvs_entry_t *sim_nvs_find(nvs_handle_t handle, const char *key, bool create) {
+    if (handle == 0 || handle > (nvs_handle_t)s_namespace_count || strlen(key) >= sizeof(s_nvs[0].key)) return NULL;
+
+    const char *ns = s_namespaces[handle - 1];
+    sim_nvs_entry_t *free_entry = NULL;
+    for (int i = 0; i < SIM_NVS_MAX_ENTRIES; i++) {
+        if (s_nvs[i].used) {
+            if (strcmp(s_nvs[i].namespace_name, ns) == 0 && strcmp(s_nvs[i].key, key) == 0) return &s_nvs[i];
+        } else if (free_entry == NULL) {
+            free_entry = &s_nvs[i];
+        }
+    }
+    if (!create || free_entry == NULL) return NULL;
+
+    free_entry->used = true;
+    strcpy(free_entry->namespace_name, ns);
+    strcpy(free_entry->key, key);
+    free_entry->length = 0;
+    free_entry->value = NULL;
+    return free_entry;
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out_value, size_t *length) {
+    sim_nvs_entry_t *entry = sim_nvs_find(handle, key, false);
+    if (entry == NULL) return ESP_ERR_NVS_NOT_FOUND;
+
+    if (out_value == NULL) {
+        *length = entry->length;
+        return ESP_OK;
+    }
+    if (*length < entry->length) {
+        *length = entry->length;
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memcpy(out_value, entry->value, entry->length);
+    *length = entry->length;
+    return ESP_OK;
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length) {
+    if (length > SIM_NVS_MAX_BLOB) return ESP_ERR_INVALID_SIZE;
+    sim_nvs_entry_t *entry = sim_nvs_find(handle, key, true);
+    if (entry == NULL) return ESP_ERR_NVS_NO_FREE_PAGES;
+
+    uint8_t *copy = sim_host_alloc(length ? length : 1);
+    if (copy == NULL) return ESP_ERR_NO_MEM;
+    memcpy(copy, value, length);
+    sim_host_free(entry->value);
+    entry->value = copy;
+    entry->length = length;
+    return ESP_OK;
+}
+
+esp_err_t nvs_get_u32(nvs_handle_t handle, const char *key, uint32_t *out_value) {
+    size_t length = sizeof(*out_value);
+    sim_nvs_entry_t *entry = sim_nvs_find(handle, key, false);
+    if (entry == NULL) return ESP_ERR_NVS_NOT_FOUND;
+    if (entry->length != length) return ESP_ERR_INVALID_SIZE;
+    return nvs_get_blob(handle, key, out_value, &length);
+}
+
+esp_err_t nvs_set_u32(nvs_handle_t handle, const char *key, uint32_t value) {
+    return nvs_set_blob(handle, key, &value, sizeof(value));
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key) {
+    sim_nvs_entry_t *entry = sim_nvs_find(handle, key, false);
+    if (entry == NULL) return ESP_ERR_NVS_NOT_FOUND;
+    sim_host_free(entry->value);
+    memset(entry, 0, sizeof(*entry));
+    return ESP_OK;
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle) {
+    return ESP_OK;
+}
+
+/* ----- Partitions ----- */
+
+esp_err_t sim_partition_create(const char *label, uint32_t size) {
+    for (int i = 0; i < SIM_MAX_PARTITIONS; i++) {
+        sim_partition_t *part = &s_partitions[i];
+        if (part->data != NULL && strcmp(part->info.label, label) != 0) continue;
+
+        uint8_t *data = sim_host_alloc(size);
+        if (data == NULL) return ESP_ERR_NO_MEM;
+        sim_host_free(part->data);
+        memset(data, 0xFF, size);
+        part->data = data;
+        part->info = (esp_partition_t){
+            .type = ESP_PARTITION_TYPE_DATA,
+            .subtype = 0x40,
+            .address = 0x190000 + 0x40000 * (uint32_t)i,
+            .size = size,
+            .erase_size = 4096,
+        };
+        strncpy(part->info.label, label, sizeof(part->info.label) - 1);
+        return ESP_OK;
+    }
+    return ESP_ERR_NO_MEM;
+}
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype,
+                                                const char *label) {
+    for (int i = 0; i < SIM_MAX_PARTITIONS; i++) {
+        sim_partition_t *part = &s_partitions[i];
+        if (part->data == NULL || part->info.type != type) continue;
+        if (subtype != ESP_PARTITION_SUBTYPE_ANY && part->info.subtype != (int)subtype) continue;
+        if (label != NULL && strcmp(part->info.label, label) != 0) continue;
+        return &part->info;
+    }
+    return NULL;
+}
+
+static sim_partition_t *sim_partition_of(const esp_partition_t *partition, size_t offset, size_t size) {
+    sim_partition_t *part = (sim_partition_t *)partition;
+    if (part == NULL || offset > part->info.size || size > part->info.size - offset) return NULL;
+    return part;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t src_offset, void *dst, size_t size) {
+    sim_partition_t *part = sim_partition_of(partition, src_offset, size);
+    if (part == NULL) return ESP_ERR_INVALID_SIZE;
+    memcpy(dst, part->data + src_offset, size);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t *partition, size_t dst_offset, const void *src, size_t size) {
+    sim_partition_t *part = sim_partition_of(partition, dst_offset, size);
+    if (part == NULL) return ESP_ERR_INVALID_SIZE;
+
+    /* NOR flash: programming can only clear bits */
+    const uint8_t *bytes = src;
+    for (size_t i = 0; i < size; i++) {
+        part->data[dst_offset + i] &= bytes[i];
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *partition, size_t offset, size_t size) {
+    sim_partition_t *part = sim_partition_of(partition, offset, size);
+    if (part == NULL || offset % part->info.erase_size || size % part->info.erase_size) return ESP_ERR_INVALID_ARG;
+    memset(part->data + offset, 0xFF, size);
+    return ESP_OK;
+}
@@ -0,0 +1,456 @@
+/**
+ * @file sim_support.c
+ * @brief Logging, error names, cJSON, heap queries, heap tracing, WiFi stubs and allocation wrappers
+ */
+#include "sim_support.h"
+#include "sim_hal.h"
+
+#include "config.h"
+#include "wifi_manager.h"
+
+#include "cJSON.h"
+#include "esp_heap_caps.h"
+#include "esp_heap_trace.h"
+#include "esp_system.h"
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_netif_sntp.h"
+#include "esp_timer.h"
+#include "freertos/event_groups.h"
+
+#include <limits.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SIM_ALLOC_MAGIC 0x51A110C5u
+#define SIM_HEAP_SIZE (320 * 1024)  /* Nominal ESP32-C6 heap */
+#define SIM_HEAP_WALK_US 150        /* Device cost of heap_caps_get_info() */
+
+/* ----- Allocation accounting (linked with -Wl,--wrap=malloc,...) ----- */
+
+typedef struct {
+    uint32_t magic;
+    uint32_t reserved;
+    uint64_t size;
+} sim_alloc_header_t;
+
+void *__real_malloc(size_t size);
+void __real_free(void *ptr);
+
+static sim_alloc_stats_t s_alloc;
+
+void sim_alloc_get_stats(sim_alloc_stats_t *stats) {
+    *stats = s_alloc;
+}
+
+void *sim_host_alloc(size_t size) {
+    return __real_malloc(size);
+}
+
+void sim_host_free(void *ptr) {
+    __real_free(ptr);
+}
+
+/* ----- Heap tracing (esp_heap_trace.h) on top of the wrappers ----- */
+
+static heap_trace_record_t *s_trace_records;
+static size_t s_trace_capacity;
+static heap_trace_summary_t s_trace;
+static bool s_tracing;
+
+esp_err_t heap_trace_init_standalone(heap_trace_record_t *record_buffer, size_t num_records) {
+    if (s_tracing) return ESP_ERR_INVALID_STATE;
+    s_trace_records = record_buffer;
+    s_trace_capacity = num_records;
+    return ESP_OK;
+}
+
+esp_err_t heap_trace_start(heap_trace_mode_t mode) {
+    if (s_trace_records == NULL) return ESP_ERR_INVALID_STATE;
+    memset(&s_trace, 0, sizeof(s_trace));
+    s_trace.mode = mode;
+    s_trace.capacity = s_trace_capacity;
+    s_tracing = true;
+    return ESP_OK;
+}
+
+esp_err_t heap_trace_stop(void) {
+    if (!s_tracing) return ESP_ERR_INVALID_STATE;
+    s_tracing = false;
+    return ESP_OK;
+}
+
+size_t heap_trace_get_count(void) {
+    return s_trace.count;
+}
+
+esp_err_t heap_trace_get(size_t index, heap_trace_record_t *record) {
+    if (record == NULL) return ESP_ERR_INVALID_ARG;
+    if (index >= s_trace.count) return ESP_ERR_NOT_FOUND;
+    *record = s_trace_records[index];
+    return ESP_OK;
+}
+
+esp_err_t heap_trace_summary(heap_trace_summary_t *summary) {
+    if (summary == NULL) return ESP_ERR_INVALID_ARG;
+    *summary = s_trace;
+    return ESP_OK;
+}
+
+static void sim_trace_alloc(void *ptr, size_t size, void *caller) {
+    s_trace.total_allocations++;
+    if (s_trace.count == s_trace_capacity) {
+        s_trace.has_overflowed = true;
+        return;
+    }
+    heap_trace_record_t *record = &s_trace_records[s_trace.count++];
+    memset(record, 0, sizeof(*record));
+    record->ccount = (uint32_t)sim_now_us();
+    record->address = ptr;
+    record->size = size;
+    record->alloced_by[0] = caller;
+    if (s_trace.count > s_trace.high_water_mark) s_trace.high_water_mark = s_trace.count;
+}
+
+/* Leak mode forgets freed blocks, keeping the rest in allocation order */
+static void sim_trace_free(void *ptr, void *caller) {
+    s_trace.total_frees++;
+    for (size_t i = 0; i < s_trace.count; i++) {
+        if (s_trace_records[i].address != ptr) continue;
+        if (s_trace.mode == HEAP_TRACE_LEAKS) {
+            memmove(&s_trace_records[i], &s_trace_records[i + 1], (s_trace.count - i - 1) * sizeof(s_trace_records[0]));
+            s_trace.count--;
+        } else {
+            s_trace_records[i].freed_by[0] = caller;
+        }
+        return;
+    }
+}
+
+static void *sim_alloc_track(sim_alloc_header_t *header, size_t size, void *caller) {
+    if (header == NULL) return NULL;
+    header->magic = SIM_ALLOC_MAGIC;
+    header->size = size;
+    s_alloc.allocs++;
+    s_alloc.bytes += size;
+    s_alloc.in_use += size;
+    if (s_alloc.in_use > s_alloc.peak) s_alloc.peak = s_alloc.in_use;
+    if (s_tracing) sim_trace_alloc(header + 1, size, caller);
+    return header + 1;
+}
+
+static void *sim_alloc(size_t size, void *caller) {
+    return sim_alloc_track(__real_malloc(sizeof(sim_alloc_header_t) + size), size, caller);
+}
+
+static void sim_free(void *ptr, void *caller) {
+    if (ptr == NULL) return;
+
+    sim_alloc_header_t *header = (sim_alloc_header_t *)ptr - 1;
+    if (header->magic != SIM_ALLOC_MAGIC) {
+        /* Allocated inside libc, outside the wrapper */
+        __real_free(ptr);
+        return;
+    }
+    header->magic = 0;
+    s_alloc.frees++;
+    s_alloc.in_use -= header->size;
+    if (s_tracing) sim_trace_free(ptr, caller);
+    __real_free(header);
+}
+
+void *__wrap_malloc(size_t size) {
+    return sim_alloc(size, __builtin_return_address(0));
+}
+
+void *__wrap_calloc(size_t count, size_t size) {
+    if (size && count > SIZE_MAX / size) return NULL;
+    void *ptr = sim_alloc(count * size, __builtin_return_address(0));
+    if (ptr) memset(ptr, 0, count * size);
+    return ptr;
+}
+
+void __wrap_free(void *ptr) {
+    sim_free(ptr, __builtin_return_address(0));
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+    void *caller = __builtin_return_address(0);
+    if (ptr == NULL) return sim_alloc(size, caller);
+    if (size == 0) {
+        sim_free(ptr, caller);
+        return NULL;
+    }
+
+    sim_alloc_header_t *header = (sim_alloc_header_t *)ptr - 1;
+    size_t old_size = header->magic == SIM_ALLOC_MAGIC ? header->size : 0;
+    void *copy = sim_alloc(size, caller);
+    if (copy == NULL) return NULL;
+    memcpy(copy, ptr, old_size < size ? old_size : size);
+    sim_free(ptr, caller);
+    return copy;
+}
+
+/* ----- Logging ----- */
+
+static FILE *s_log_out;
+
+void sim_log_set_output(FILE *out) {
+    s_log_out = out;
+}
+
+uint32_t esp_log_timestamp(void) {
+    return (uint32_t)(sim_now_us() / 1000);
+}
+
+void esp_log_level_set(const char *tag, esp_log_level_t level) {
+}
+
+void esp_log_write(esp_log_level_t level, const char *tag, const char *format, ...) {
+    /* Always format, so logging costs the same whether or not it is shown */
+    char line[512];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+
+    if (s_log_out) fputs(line, s_log_out);
+}
+
+const char *esp_err_to_name(esp_err_t code) {
+    switch (code) {
+        case ESP_OK: return "ESP_OK";
+        case ESP_FAIL: return "ESP_FAIL";
+        case ESP_ERR_NO_MEM: return "ESP_ERR_NO_MEM";
+        case ESP_ERR_INVALID_ARG: return "ESP_ERR_INVALID_ARG";
+        case ESP_ERR_INVALID_STATE: return "ESP_ERR_INVALID_STATE";
+        case ESP_ERR_INVALID_SIZE: return "ESP_ERR_INVALID_SIZE";
+        case ESP_ERR_NOT_FOUND: return "ESP_ERR_NOT_FOUND";
+        case ESP_ERR_NOT_SUPPORTED: return "ESP_ERR_NOT_SUPPORTED";
+        case ESP_ERR_TIMEOUT: return "ESP_ERR_TIMEOUT";
+        case ESP_ERR_NVS_NOT_FOUND: return "ESP_ERR_NVS_NOT_FOUND";
+        case ESP_ERR_NVS_NO_FREE_PAGES: return "ESP_ERR_NVS_NO_FREE_PAGES";
+        case ESP_ERR_NVS_NEW_VERSION_FOUND: return "ESP_ERR_NVS_NEW_VERSION_FOUND";
+        case ESP_ERR_HTTP_CONNECT: return "ESP_ERR_HTTP_CONNECT";
+        case ESP_ERR_HTTP_EAGAIN: return "ESP_ERR_HTTP_EAGAIN";
+        default: return "UNKNOWN ERROR";
+    }
+}
+
+/* ----- WiFi manager stand-ins ----- */
+
+EventGroupHandle_t wifi_event_group;
+
+void sim_support_init(void) {
+    if (wifi_event_group == NULL) {
+        wifi_event_group = xEventGroupCreate();
+    }
+    xEventGroupSetBits(wifi_event_group, WIFI_CONNECTED_BIT);
+}
+
+/* ----- SNTP ----- */
+
+esp_err_t esp_netif_sntp_init(const esp_sntp_config_t *config) {
+    if (config->sync_cb != NULL) {
+        int64_t now_us = esp_timer_get_time();
+        struct timeval tv = {
+            .tv_sec = (time_t)(SIM_SNTP_EPOCH_S + now_us / 1000000),
+            .tv_usec = (suseconds_t)(now_us % 1000000),
+        };
+        config->sync_cb(&tv);
+    }
+    return ESP_OK;
+}
+
+/* ----- Heap queries ----- */
+
+uint32_t esp_get_free_heap_size(void) {
+    return (uint32_t)(SIM_HEAP_SIZE - s_alloc.in_use);
+}
+
+uint32_t esp_get_minimum_free_heap_size(void) {
+    return (uint32_t)(SIM_HEAP_SIZE - s_alloc.peak);
+}
+
+void heap_caps_get_info(multi_heap_info_t *info, uint32_t caps) {
+    /* The device walks every block here; charge the walk to the clock too */
+    memset(info, 0, sizeof(*info));
+    info->total_free_bytes = SIM_HEAP_SIZE - s_alloc.in_use;
+    info->total_allocated_bytes = s_alloc.in_use;
+    info->largest_free_block = info->total_free_bytes;
+    info->minimum_free_bytes = SIM_HEAP_SIZE - s_alloc.peak;
+    info->allocated_blocks = s_alloc.allocs - s_alloc.frees;
+    sim_advance_us(SIM_HEAP_WALK_US);
+}
+
+/* ----- cJSON subset ----- */
+
+enum {
+    SIM_CJSON_FALSE,
+    SIM_CJSON_TRUE,
+    SIM_CJSON_NUMBER,
+    SIM_CJSON_STRING,
+    SIM_CJSON_ARRAY,
+    SIM_CJSON_OBJECT,
+};
+
+/* Like the real library: with custom hooks there is no realloc, prints grow by copy */
+static void *(*s_cjson_malloc)(size_t size) = malloc;
+static void (*s_cjson_free)(void *ptr) = free;
+
+void cJSON_InitHooks(cJSON_Hooks *hooks) {
+    s_cjson_malloc = (hooks && hooks->malloc_fn) ? hooks->malloc_fn : malloc;
+    s_cjson_free = (hooks && hooks->free_fn) ? hooks->free_fn : free;
+}
+
+static char *sim_strdup(const char *s) {
+    size_t len = strlen(s) + 1;
+    char *copy = s_cjson_malloc(len);
+    if (copy) memcpy(copy, s, len);
+    return copy;
+}
+
+static cJSON *sim_cjson_new(int type) {
+    cJSON *item = s_cjson_malloc(sizeof(cJSON));
+    if (item) {
+        memset(item, 0, sizeof(*item));
+        item->type = type;
+    }
+    return item;
+}
+
+cJSON *cJSON_CreateObject(void) {
+    return sim_cjson_new(SIM_CJSON_OBJECT);
+}
+
+cJSON *cJSON_CreateArray(void) {
+    return sim_cjson_new(SIM_CJSON_ARRAY);
+}
+
+bool cJSON_AddItemToArray(cJSON *array, cJSON *item) {
+    if (array == NULL || item == NULL) return false;
+    cJSON **tail = &array->child;
+    while (*tail) tail = &(*tail)->next;
+    *tail = item;
+    return true;
+}
+
+bool cJSON_AddItemToObject(cJSON *object, const char *name, cJSON *item) {
+    if (object == NULL || item == NULL) return false;
+    item->string = sim_strdup(name);
+    return item->string != NULL && cJSON_AddItemToArray(object, item);
+}
+
+static cJSON *sim_cjson_add(cJSON *object, const char *name, cJSON *item) {
+    if (!cJSON_AddItemToObject(object, name, item)) {
+        cJSON_Delete(item);
+        return NULL;
+    }
+    return item;
+}
+
+cJSON *cJSON_AddStringToObject(cJSON *object, const char *name, const char *string) {
+    cJSON *item = sim_cjson_new(SIM_CJSON_STRING);
+    if (item) item->valuestring = sim_strdup(string);
+    return sim_cjson_add(object, name, item);
+}
+
+cJSON *cJSON_AddBoolToObject(cJSON *object, const char *name, bool boolean) {
+    return sim_cjson_add(object, name, sim_cjson_new(boolean ? SIM_CJSON_TRUE : SIM_CJSON_FALSE));
+}
+
+cJSON *cJSON_AddNumberToObject(cJSON *object, const char *name, double number) {
+    cJSON *item = sim_cjson_new(SIM_CJSON_NUMBER);
+    if (item) {
+        /* valueint saturates, as in the real library */
+        item->valuedouble = number;
+        item->valueint = number >= INT_MAX ? INT_MAX : number <= (double)INT_MIN ? INT_MIN : (int)number;
+    }
+    return sim_cjson_add(object, name, item);
+}
+
+cJSON *cJSON_AddArrayToObject(cJSON *object, const char *name) {
+    return sim_cjson_add(object, name, cJSON_CreateArray());
+}
+
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+} sim_buf_t;
+
+static bool sim_buf_put(sim_buf_t *buf, const char *s) {
+    size_t n = strlen(s);
+    if (buf->len + n + 1 > buf->cap) {
+        size_t cap = buf->cap ? buf->cap : 256;
+        while (buf->len + n + 1 > cap) cap *= 2;
+        char *data = s_cjson_malloc(cap);
+        if (data == NULL) return false;
+        if (buf->data) {
+            memcpy(data, buf->data, buf->len + 1);
+            s_cjson_free(buf->data);
+        }
+        buf->data = data;
+        buf->cap = cap;
+    }
+    memcpy(buf->data + buf->len, s, n + 1);
+    buf->len += n;
+    return true;
+}
+
+static bool sim_cjson_print(const cJSON *item, sim_buf_t *buf) {
+    char number[32];
+    switch (item->type) {
+        case SIM_CJSON_FALSE: return sim_buf_put(buf, "false");
+        case SIM_CJSON_TRUE: return sim_buf_put(buf, "true");
+        case SIM_CJSON_NUMBER:
+            /* Integers that do not fit an int print like any other double */
+            if (item->valuedouble == (double)item->valueint) {
+                snprintf(number, sizeof(number), "%d", item->valueint);
+            } else {
+                snprintf(number, sizeof(number), "%1.15g", item->valuedouble);
+            }
+            return sim_buf_put(buf, number);
+        case SIM_CJSON_STRING:
+            return sim_buf_put(buf, "\"") && sim_buf_put(buf, item->valuestring) && sim_buf_put(buf, "\"");
+        default:
+            break;
+    }
+
+    bool object = item->type == SIM_CJSON_OBJECT;
+    if (!sim_buf_put(buf, object ? "{" : "[")) return false;
+    for (const cJSON *child = item->child; child; child = child->next) {
+        if (child != item->child && !sim_buf_put(buf, ",")) return false;
+        if (object && !(sim_buf_put(buf, "\"") && sim_buf_put(buf, child->string) && sim_buf_put(buf, "\":"))) {
+            return false;
+        }
+        if (!sim_cjson_print(child, buf)) return false;
+    }
+    return sim_buf_put(buf, object ? "}" : "]");
+}
+
+char *cJSON_PrintUnformatted(const cJSON *item) {
+    sim_buf_t buf = { 0 };
+    if (item == NULL || !sim_cjson_print(item, &buf)) {
+        s_cjson_free(buf.data);
+        return NULL;
+    }
+    return buf.data;
+}
+
+void cJSON_Delete(cJSON *item) {
+    while (item) {
+        cJSON *next = item->next;
+        cJSON_Delete(item->child);
+        s_cjson_free(item->valuestring);
+        s_cjson_free(item->string);
+        s_cjson_free(item);
+        item = next;
+    }
+}
+
+void cJSON_free(void *object) {
+    s_cjson_free(object);
+}
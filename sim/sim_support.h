@@ -0,0 +1,29 @@
+/**
+ * @file sim_support.h
+ * @brief Host simulation support: allocation accounting and firmware stubs
+ */
+#ifndef SIM_SUPPORT_H
+#define SIM_SUPPORT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Heap activity seen through the linker-wrapped malloc family */
+typedef struct {
+    uint64_t allocs;                /* malloc/calloc/realloc calls that returned memory */
+    uint64_t frees;                 /* free() calls on tracked blocks */
+    uint64_t bytes;                 /* Total bytes requested */
+    uint64_t in_use;                /* Bytes currently allocated */
+    uint64_t peak;                  /* Highest in_use seen */
+} sim_alloc_stats_t;
+
+void sim_alloc_get_stats(sim_alloc_stats_t *stats);
+
+/* Host memory for simulated flash and traces, not charged to the device heap */
+void *sim_host_alloc(size_t size);
+void sim_host_free(void *ptr);
+
+/* Bring up the pieces main.c and wifi_manager.c normally provide */
+void sim_support_init(void);
+
+#endif /* SIM_SUPPORT_H */